@@ -15,6 +15,7 @@ Feature: switch_manager help
         -s, --switch=PATH           the command path of switch
         -n, --name=SERVICE_NAME     service name
         -p, --port=PORT             server listen port (default 6653)
+        -m, --multi-switch=NUM      serve all switches from NUM switch processes
         -d, --daemonize             run in the background
         -l, --logging_level=LEVEL   set logging level
         -h, --help                  display this help and exit
@@ -30,6 +31,7 @@ Feature: switch_manager help
         -s, --switch=PATH           the command path of switch
         -n, --name=SERVICE_NAME     service name
         -p, --port=PORT             server listen port (default 6653)
+        -m, --multi-switch=NUM      serve all switches from NUM switch processes
         -d, --daemonize             run in the background
         -l, --logging_level=LEVEL   set logging level
         -h, --help                  display this help and exit
@@ -23,16 +23,23 @@
 #include "conversion-util.h"
 
 
+static packet_info *
+get_packet_in_info( const buffer *frame ) {
+  parse_deferred_packet( frame );
+  return ( packet_info * ) ( frame->user_data );
+}
+
+
 #define PACKET_INFO_MAC_ADDR( packet_member )                                          \
   {                                                                                    \
-    VALUE ret = ULL2NUM( mac_to_uint64( ( ( packet_info * ) ( frame->user_data ) )->packet_member ) ); \
+    VALUE ret = ULL2NUM( mac_to_uint64( get_packet_in_info( frame )->packet_member ) ); \
     return rb_funcall( rb_eval_string( "Trema::Mac" ), rb_intern( "new" ), 1, ret );  \
   }
 
 
 #define PACKET_INFO_IPv4_ADDR( packet_member )                                          \
   {                                                                                   \
-    VALUE ret = UINT2NUM( ( ( packet_info * ) ( frame->user_data ) )->packet_member ); \
+    VALUE ret = UINT2NUM( get_packet_in_info( frame )->packet_member ); \
     return rb_funcall( rb_eval_string( "IPAddr" ), rb_intern( "new" ), 2, ret, rb_eval_string( "Socket::AF_INET" )  );   \
   }
 
@@ -41,17 +48,13 @@
   { \
       char ipv6_str[ INET6_ADDRSTRLEN ]; \
       memset( ipv6_str, '\0', sizeof( ipv6_str ) ); \
-      if ( inet_ntop( AF_INET6, &( ( packet_info * ) ( frame->user_data ) )->packet_member, ipv6_str, sizeof( ipv6_str ) ) != NULL ) { \
+      if ( inet_ntop( AF_INET6, &get_packet_in_info( frame )->packet_member, ipv6_str, sizeof( ipv6_str ) ) != NULL ) { \
         return rb_funcall( rb_eval_string( "IPAddr" ), rb_intern( "new" ), 1, rb_str_new2( ipv6_str ) ); \
       } \
       return Qnil; \
   }
 
 
-static packet_info *
-get_packet_in_info( const buffer *frame ) {
-  return ( packet_info * ) ( frame->user_data );
-}
 
 
 
@@ -26,6 +26,9 @@
 #include <unistd.h>
 #include "array_util.h"
 #include "async.h"
+#include "buffer.h"
+#include "doubly_linked_list.h"
+#include "linked_list.h"
 #include "log.h"
 
 
@@ -57,6 +60,9 @@ run_thread( void *data ) {
   struct async *async = data;
 
   pthread_setspecific( async_key, data );
+  enable_buffer_cache();
+  enable_list_element_cache();
+  enable_dlist_element_cache();
   intptr_t ret = async->proc( async->data );
 
   return ( void * ) ret;
@@ -16,8 +16,14 @@
  */
 
 
+#include <assert.h>
 #include <pthread.h>
+#include <stdint.h>
 #include <sys/eventfd.h>
+#include <unistd.h>
+#include "async_util.h"
+#include "checks.h"
+#include "wrapper.h"
 
 
 pthread_t
@@ -32,6 +38,63 @@ create_event_fd( void ) {
 }
 
 
+event_notifier *
+create_event_notifier( void ) {
+  int fd = create_event_fd();
+  if ( fd < 0 ) {
+    return NULL;
+  }
+  event_notifier *notifier = xmalloc( sizeof( event_notifier ) );
+  notifier->fd = fd;
+  notifier->pending = 0;
+
+  return notifier;
+}
+
+
+void
+delete_event_notifier( event_notifier *notifier ) {
+  assert( notifier != NULL );
+
+  close( notifier->fd );
+  xfree( notifier );
+}
+
+
+bool
+notify_event( event_notifier *notifier ) {
+  assert( notifier != NULL );
+
+  if ( __sync_lock_test_and_set( &notifier->pending, 1 ) != 0 ) {
+    return true; // the reader has been notified already
+  }
+  uint64_t count = 1;
+  ssize_t ret = write( notifier->fd, &count, sizeof( count ) );
+  if ( ret != sizeof( count ) ) {
+    __sync_lock_release( &notifier->pending );
+    return false;
+  }
+
+  return true;
+}
+
+
+/*
+ * Must be called by the reader before it consumes what the notifications
+ * are for, so that anything produced afterwards notifies it again.
+ */
+void
+clear_event( event_notifier *notifier ) {
+  assert( notifier != NULL );
+
+  uint64_t count = 0;
+  ssize_t ret = read( notifier->fd, &count, sizeof( count ) );
+  UNUSED( ret );
+  __sync_lock_release( &notifier->pending );
+  __sync_synchronize();
+}
+
+
 /*
  * Local variables:
  * c-basic-offset: 2
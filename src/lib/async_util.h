@@ -21,6 +21,7 @@
 
 
 #include <pthread.h>
+#include "bool.h"
 
 
 #ifdef __cplusplus
@@ -83,8 +84,23 @@ delete_##name##_info( struct name##_info *obj ) { \
 }
 
 
+/*
+ * An event descriptor which is written only if the reader has not been
+ * notified since it last called clear_event(). A burst of notifications
+ * thus costs a single write() and a single wakeup.
+ */
+typedef struct {
+  int fd;
+  volatile unsigned int pending;
+} event_notifier;
+
+
 pthread_t current_thread( void );        
 int create_event_fd( void );
+event_notifier *create_event_notifier( void );
+void delete_event_notifier( event_notifier *notifier );
+bool notify_event( event_notifier *notifier );
+void clear_event( event_notifier *notifier );
 
 
 #ifdef __cplusplus
@@ -23,20 +23,191 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "bool.h"
 #include "buffer.h"
 #include "checks.h"
 #include "utility.h"
 #include "wrapper.h"
 
 
-typedef struct {
+#define BUFFER_SIZE_CLASSES 6
+#define BUFFER_CACHE_DEPTH 64
+
+
+/*
+ * A buffer is a single block: the header below followed by inline
+ * space for the data, whose size is given by its size class. The data
+ * moves to a separate allocation only when it outgrows the block.
+ */
+typedef struct private_buffer {
   buffer public;
   size_t real_length;
   void *top;
   pthread_mutex_t *mutex;
+  pthread_mutex_t embedded_mutex;
+  unsigned int size_class;
+  struct private_buffer *next; // in a buffer cache
+  void ( *release_data )( void *data, void *arg ); // for data not owned
+  void *release_arg;
 } private_buffer;
 
 
+// Rounded up so that the inline data is aligned as malloc() would.
+#define BUFFER_HEADER_SIZE ( ( sizeof( private_buffer ) + 15 ) & ~( size_t ) 15 )
+
+// Each class at most doubles the previous one above 512 bytes, so that a
+// block wastes less than half of its inline space.
+static const size_t size_classes[ BUFFER_SIZE_CLASSES ] = { 128, 512, 2048, 4096, 8192, 16384 };
+static const pthread_mutex_t initial_mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+
+/*
+ * Freed blocks are kept per thread and by size class when the thread
+ * has enabled its buffer cache.
+ */
+typedef struct {
+  bool enabled;
+  private_buffer *free_blocks[ BUFFER_SIZE_CLASSES ];
+  unsigned int n_free_blocks[ BUFFER_SIZE_CLASSES ];
+} buffer_cache;
+
+static __thread buffer_cache cache;
+static pthread_key_t cache_key;
+static pthread_once_t cache_key_once = PTHREAD_ONCE_INIT;
+
+
+static void *
+inline_data_of( private_buffer *pbuf ) {
+  return ( char * ) pbuf + BUFFER_HEADER_SIZE;
+}
+
+
+static bool
+data_is_inline( private_buffer *pbuf ) {
+  return pbuf->top == inline_data_of( pbuf );
+}
+
+
+static void
+free_data( private_buffer *pbuf ) {
+  if ( pbuf->release_data != NULL ) {
+    ( *pbuf->release_data )( pbuf->top, pbuf->release_arg );
+    pbuf->release_data = NULL;
+    pbuf->release_arg = NULL;
+    return;
+  }
+  if ( pbuf->top != NULL && !data_is_inline( pbuf ) ) {
+    xfree( pbuf->top );
+  }
+}
+
+
+static unsigned int
+size_class_for( size_t length ) {
+  for ( unsigned int i = 0; i < BUFFER_SIZE_CLASSES - 1; i++ ) {
+    if ( length <= size_classes[ i ] ) {
+      return i;
+    }
+  }
+  return BUFFER_SIZE_CLASSES - 1;
+}
+
+
+/*
+ * Returns a buffer without data whose inline space holds at least
+ * length bytes if the size classes allow.
+ */
+static private_buffer *
+alloc_block( size_t length ) {
+  unsigned int size_class = size_class_for( length );
+  if ( length > size_classes[ size_class ] ) {
+    // Large data goes to a separate allocation anyway.
+    size_class = 0;
+  }
+
+  private_buffer *pbuf = cache.free_blocks[ size_class ];
+  if ( pbuf != NULL ) {
+    cache.free_blocks[ size_class ] = pbuf->next;
+    cache.n_free_blocks[ size_class ]--;
+  }
+  else {
+    pbuf = xmalloc( BUFFER_HEADER_SIZE + size_classes[ size_class ] );
+  }
+
+  pbuf->public.data = NULL;
+  pbuf->public.length = 0;
+  pbuf->public.user_data = NULL;
+  pbuf->public.user_data_free_function = NULL;
+  pbuf->top = NULL;
+  pbuf->real_length = 0;
+  pbuf->embedded_mutex = initial_mutex;
+  pbuf->mutex = &pbuf->embedded_mutex;
+  pbuf->size_class = size_class;
+  pbuf->next = NULL;
+  pbuf->release_data = NULL;
+  pbuf->release_arg = NULL;
+
+  return pbuf;
+}
+
+
+static void
+free_block( private_buffer *pbuf ) {
+  free_data( pbuf );
+
+  unsigned int size_class = pbuf->size_class;
+  if ( cache.enabled && cache.n_free_blocks[ size_class ] < BUFFER_CACHE_DEPTH ) {
+    pbuf->next = cache.free_blocks[ size_class ];
+    cache.free_blocks[ size_class ] = pbuf;
+    cache.n_free_blocks[ size_class ]++;
+    return;
+  }
+  xfree( pbuf );
+}
+
+
+static void
+release_buffer_cache( void *value ) {
+  UNUSED( value );
+
+  cache.enabled = false;
+  for ( unsigned int i = 0; i < BUFFER_SIZE_CLASSES; i++ ) {
+    while ( cache.free_blocks[ i ] != NULL ) {
+      private_buffer *next = cache.free_blocks[ i ]->next;
+      xfree( cache.free_blocks[ i ] );
+      cache.free_blocks[ i ] = next;
+    }
+    cache.n_free_blocks[ i ] = 0;
+  }
+}
+
+
+static void
+create_cache_key() {
+  pthread_key_create( &cache_key, release_buffer_cache );
+}
+
+
+/**
+ * Makes the calling thread keep freed buffers for reuse, so that
+ * allocating and freeing a buffer on hot paths is a list operation.
+ * A buffer may still be freed by any thread. The cache is released
+ * when the thread exits or calls disable_buffer_cache().
+ */
+void
+enable_buffer_cache() {
+  pthread_once( &cache_key_once, create_cache_key );
+  pthread_setspecific( cache_key, &cache );
+  cache.enabled = true;
+}
+
+
+void
+disable_buffer_cache() {
+  release_buffer_cache( NULL );
+}
+
+
 static size_t
 front_length_of( const private_buffer *pbuf ) {
   assert( pbuf != NULL );
@@ -59,36 +230,22 @@ static private_buffer *
 alloc_new_data( private_buffer *pbuf, size_t length ) {
   assert( pbuf != NULL );
 
-  pbuf->public.data = xmalloc( length );
+  free_data( pbuf );
+  if ( length <= size_classes[ pbuf->size_class ] ) {
+    pbuf->top = inline_data_of( pbuf );
+    pbuf->real_length = size_classes[ pbuf->size_class ];
+  }
+  else {
+    pbuf->top = xmalloc( length );
+    pbuf->real_length = length;
+  }
+  pbuf->public.data = pbuf->top;
   pbuf->public.length = length;
-  pbuf->top = pbuf->public.data;
-  pbuf->real_length = length;
 
   return pbuf;
 }
 
 
-static private_buffer *
-alloc_private_buffer() {
-  private_buffer *new_buf = xcalloc( 1, sizeof( private_buffer ) );
-
-  new_buf->public.data = NULL;
-  new_buf->public.length = 0;
-  new_buf->public.user_data = NULL;
-  new_buf->public.user_data_free_function = NULL;
-  new_buf->top = NULL;
-  new_buf->real_length = 0;
-
-  pthread_mutexattr_t attr;
-  pthread_mutexattr_init( &attr );
-  pthread_mutexattr_settype( &attr, PTHREAD_MUTEX_RECURSIVE_NP );
-  new_buf->mutex = xmalloc( sizeof( pthread_mutex_t ) );
-  pthread_mutex_init( new_buf->mutex, &attr );
-
-  return new_buf;
-}
-
-
 static private_buffer *
 append_front( private_buffer *pbuf, size_t length ) {
   assert( pbuf != NULL );
@@ -96,7 +253,7 @@ append_front( private_buffer *pbuf, size_t length ) {
   size_t new_length = front_length_of( pbuf ) + pbuf->public.length + length;
   void *new_data = xmalloc( new_length );
   memcpy( ( char * ) new_data + front_length_of( pbuf ) + length, pbuf->public.data, pbuf->public.length );
-  xfree( pbuf->top );
+  free_data( pbuf );
 
   pbuf->public.data = ( char * ) new_data + front_length_of( pbuf );
   pbuf->real_length = new_length;
@@ -113,7 +270,7 @@ append_back( private_buffer *pbuf, size_t length ) {
   size_t new_length = front_length_of( pbuf ) + pbuf->public.length + length;
   void *new_data = xmalloc( new_length );
   memcpy( ( char * ) new_data + front_length_of( pbuf ), pbuf->public.data, pbuf->public.length );
-  xfree( pbuf->top );
+  free_data( pbuf );
 
   pbuf->public.data = ( char * ) new_data + front_length_of( pbuf );
   pbuf->real_length = new_length;
@@ -125,7 +282,7 @@ append_back( private_buffer *pbuf, size_t length ) {
 
 buffer *
 alloc_buffer() {
-  return ( buffer * ) alloc_private_buffer();
+  return ( buffer * ) alloc_block( 0 );
 }
 
 
@@ -133,19 +290,33 @@ buffer *
 alloc_buffer_with_length( size_t length ) {
   assert( length != 0 );
 
-  private_buffer *new_buf = xcalloc( 1, sizeof( private_buffer ) );
-  new_buf->public.data = xmalloc( length );
+  private_buffer *new_buf = alloc_block( length );
+  alloc_new_data( new_buf, length );
   new_buf->public.length = 0;
-  new_buf->public.user_data = NULL;
-  new_buf->public.user_data_free_function = NULL;
-  new_buf->top = new_buf->public.data;
-  new_buf->real_length = length;
 
-  pthread_mutexattr_t attr;
-  pthread_mutexattr_init( &attr );
-  pthread_mutexattr_settype( &attr, PTHREAD_MUTEX_RECURSIVE_NP );
-  new_buf->mutex = xmalloc( sizeof( pthread_mutex_t ) );
-  pthread_mutex_init( new_buf->mutex, &attr );
+  return ( buffer * ) new_buf;
+}
+
+
+/**
+ * Allocates a buffer whose data is the given memory instead of a copy
+ * of it. The buffer has no free space around the data, so growing it
+ * moves the data to memory of its own. release_function is called with
+ * data and arg once the buffer no longer refers to the memory.
+ */
+buffer *
+alloc_buffer_with_data( void *data, size_t length, void ( *release_function )( void *data, void *arg ), void *arg ) {
+  assert( data != NULL );
+  assert( length != 0 );
+  assert( release_function != NULL );
+
+  private_buffer *new_buf = alloc_block( 0 );
+  new_buf->top = data;
+  new_buf->real_length = length;
+  new_buf->public.data = data;
+  new_buf->public.length = length;
+  new_buf->release_data = release_function;
+  new_buf->release_arg = arg;
 
   return ( buffer * ) new_buf;
 }
@@ -162,13 +333,9 @@ free_buffer( buffer *buf ) {
   }
   pthread_mutex_lock( ( ( private_buffer * ) buf )->mutex );
   private_buffer *delete_me = ( private_buffer * ) buf;
-  if ( delete_me->top != NULL ) {
-    xfree( delete_me->top );
-  }
   pthread_mutex_unlock( delete_me->mutex );
   pthread_mutex_destroy( delete_me->mutex );
-  xfree( delete_me->mutex );
-  xfree( delete_me );
+  free_block( delete_me );
 }
 
 
@@ -188,7 +355,10 @@ append_front_buffer( buffer *buf, size_t length ) {
   }
 
   buffer *b = &( pbuf->public );
-  if ( already_allocated( pbuf, length ) ) {
+  if ( front_length_of( pbuf ) >= length ) {
+    b->data = ( char * ) b->data - length;
+    memset( b->data, 0, length );
+  } else if ( already_allocated( pbuf, length ) ) {
     memmove( ( char * ) b->data + length, b->data, b->length );
     memset( b->data, 0, length );
   } else {
@@ -255,8 +425,8 @@ duplicate_buffer( const buffer *buf ) {
 
   pthread_mutex_lock( ( ( const private_buffer * ) buf )->mutex );
 
-  private_buffer *new_buffer = alloc_private_buffer();
   const private_buffer *old_buffer = ( const private_buffer * ) buf;
+  private_buffer *new_buffer = alloc_block( old_buffer->real_length );
 
   if ( old_buffer->real_length == 0 ) {
     pthread_mutex_unlock( old_buffer->mutex );
@@ -319,6 +489,42 @@ reset_buffer( buffer *buf ) {
 }
 
 
+/*
+ * Reserves the given length of free space in front of the data so that
+ * append_front_buffer() can grow the data without moving it. The buffer
+ * must be empty.
+ */
+void
+reserve_buffer_headroom( buffer *buf, size_t length ) {
+  assert( buf != NULL );
+  assert( buf->length == 0 );
+
+  pthread_mutex_lock( ( ( private_buffer * ) buf )->mutex );
+
+  private_buffer *pbuf = ( private_buffer * ) buf;
+
+  if ( pbuf->real_length < length ) {
+    alloc_new_data( pbuf, length );
+  }
+  pbuf->public.data = ( char * ) pbuf->top + length;
+  pbuf->public.length = 0;
+
+  pthread_mutex_unlock( pbuf->mutex );
+}
+
+
+size_t
+get_buffer_headroom( const buffer *buf ) {
+  assert( buf != NULL );
+
+  pthread_mutex_lock( ( ( const private_buffer * ) buf )->mutex );
+  size_t length = front_length_of( ( const private_buffer * ) buf );
+  pthread_mutex_unlock( ( ( const private_buffer * ) buf )->mutex );
+
+  return length;
+}
+
+
 /*
  * Local variables:
  * c-basic-offset: 2
@@ -37,6 +37,7 @@ typedef struct buffer {
 
 buffer *alloc_buffer( void );
 buffer *alloc_buffer_with_length( size_t length );
+buffer *alloc_buffer_with_data( void *data, size_t length, void ( *release_function )( void *data, void *arg ), void *arg );
 void free_buffer( buffer *buf );
 void *append_front_buffer( buffer *buf, size_t length );
 void *remove_front_buffer( buffer *buf, size_t length );
@@ -44,6 +45,10 @@ void *append_back_buffer( buffer *buf, size_t length );
 buffer *duplicate_buffer( const buffer *buf );
 void dump_buffer( const buffer *buf, void dump_function( const char *format, ... ) );
 void reset_buffer( buffer *buf );
+void reserve_buffer_headroom( buffer *buf, size_t length );
+size_t get_buffer_headroom( const buffer *buf );
+void enable_buffer_cache( void );
+void disable_buffer_cache( void );
 
 
 #endif // BUFFER_H
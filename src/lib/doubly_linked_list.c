@@ -20,19 +20,102 @@
 
 #include <assert.h>
 #include <pthread.h>
+#include "checks.h"
 #include "doubly_linked_list.h"
 #include "wrapper.h"
 
 
+#define DLIST_ELEMENT_CACHE_DEPTH 1024
+
+
 typedef struct private_dlist_element {
   dlist_element public;
   pthread_mutex_t *mutex;
 } private_dlist_element;
 
 
+/*
+ * Freed elements are kept per thread, linked through their next
+ * fields, when the thread has enabled its element cache.
+ */
+typedef struct {
+  bool enabled;
+  dlist_element *free_elements;
+  unsigned int n_free_elements;
+} dlist_element_cache;
+
+static __thread dlist_element_cache cache;
+static pthread_key_t cache_key;
+static pthread_once_t cache_key_once = PTHREAD_ONCE_INIT;
+
+
+static private_dlist_element *
+alloc_dlist_element() {
+  dlist_element *element = cache.free_elements;
+  if ( element != NULL ) {
+    cache.free_elements = element->next;
+    cache.n_free_elements--;
+    return ( private_dlist_element * ) element;
+  }
+
+  return xmalloc( sizeof( private_dlist_element ) );
+}
+
+
+static void
+free_dlist_element( dlist_element *element ) {
+  if ( cache.enabled && cache.n_free_elements < DLIST_ELEMENT_CACHE_DEPTH ) {
+    element->next = cache.free_elements;
+    cache.free_elements = element;
+    cache.n_free_elements++;
+    return;
+  }
+  xfree( ( private_dlist_element * ) element );
+}
+
+
+static void
+release_dlist_element_cache( void *value ) {
+  UNUSED( value );
+
+  cache.enabled = false;
+  while ( cache.free_elements != NULL ) {
+    dlist_element *next = cache.free_elements->next;
+    xfree( ( private_dlist_element * ) cache.free_elements );
+    cache.free_elements = next;
+  }
+  cache.n_free_elements = 0;
+}
+
+
+static void
+create_cache_key() {
+  pthread_key_create( &cache_key, release_dlist_element_cache );
+}
+
+
+/**
+ * Makes the calling thread keep freed dlist elements for reuse. The
+ * cache is released when the thread exits or calls
+ * disable_dlist_element_cache().
+ */
+void
+enable_dlist_element_cache() {
+  pthread_once( &cache_key_once, create_cache_key );
+  pthread_setspecific( cache_key, &cache );
+  cache.enabled = true;
+}
+
+
+void
+disable_dlist_element_cache() {
+  release_dlist_element_cache( NULL );
+}
+
+
 static dlist_element *
 create_dlist_with_mutex( pthread_mutex_t *mutex ) {
-  private_dlist_element *element = xmalloc( sizeof( private_dlist_element ) );
+  private_dlist_element *element = alloc_dlist_element();
 
   element->public.data = NULL;
   element->public.prev = NULL;
@@ -236,7 +319,7 @@ delete_dlist_element( dlist_element *element ) {
   if ( element->next != NULL ) {
     element->next->prev = element->prev;
   }
-  xfree( ( private_dlist_element * ) element );
+  free_dlist_element( element );
 
   pthread_mutex_unlock( mutex );
 
@@ -268,7 +351,7 @@ delete_dlist( dlist_element *element ) {
   for ( e = element; e != NULL; ) {
     dlist_element *delete_me = e;
     e = e->next;
-    xfree( ( private_dlist_element * ) delete_me );
+    free_dlist_element( delete_me );
   }
 
   pthread_mutex_unlock( mutex );
@@ -75,6 +75,8 @@ dlist_element *get_last_element( dlist_element *element );
 dlist_element *find_element( dlist_element *element, const void *data );
 bool delete_dlist_element( dlist_element *element );
 bool delete_dlist( dlist_element *element );
+void enable_dlist_element_cache( void );
+void disable_dlist_element_cache( void );
 
 
 #endif // DOUBLY_LINKED_LIST_H
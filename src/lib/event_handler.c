@@ -20,13 +20,16 @@
 
 #include <errno.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <sys/time.h>
 #include <unistd.h>
 #include "checks.h"
 #include "event_handler.h"
 #include "log.h"
 #include "timer.h"
+#include "wrapper.h"
 
 
 #ifdef UNIT_TESTING
@@ -72,6 +75,7 @@ typedef struct {
   event_fd_callback write_callback;
   void *read_data;
   void *write_data;
+  uint32_t events; // EPOLLIN and/or EPOLLOUT being monitored
 } event_fd;
 
 
@@ -82,50 +86,125 @@ enum {
   EVENT_HANDLER_FINALIZED = 0x8
 };
 
-static int event_handler_state = 0;
+enum {
+  MAX_EVENTS_PER_WAIT = 256,
+  INITIAL_EVENT_FD_SET_SIZE = 64,
+};
 
-static event_fd event_list[ FD_SETSIZE ];
-static event_fd *event_last;
+static int event_handler_state = 0;
 
-static event_fd *event_fd_set[ FD_SETSIZE ];
+static int epoll_fd = -1;
 
-static fd_set event_read_set;
-static fd_set event_write_set;
-static fd_set current_read_set;
-static fd_set current_write_set;
+static event_fd **event_fd_set = NULL; // indexed by fd
+static int event_fd_set_size = 0;
+static int active_fd_count = 0;
 
-static int fd_set_size = 0;
+static struct epoll_event ready_events[ MAX_EVENTS_PER_WAIT ];
 
 static external_callback_t external_callback = ( external_callback_t ) NULL;
 
 
 static void
 _init_event_handler() {
-  event_last = event_list;
   event_handler_state = EVENT_HANDLER_INITIALIZED;
 
-  memset( event_list, 0, sizeof( event_fd ) * FD_SETSIZE );
-  memset( event_fd_set, 0, sizeof( event_fd * ) * FD_SETSIZE );
+  if ( epoll_fd < 0 ) {
+    epoll_fd = epoll_create1( EPOLL_CLOEXEC );
+    if ( epoll_fd < 0 ) {
+      error( "Failed to create an epoll instance ( errno = %s [%d] ).", strerror( errno ), errno );
+    }
+  }
 
-  FD_ZERO( &event_read_set );
-  FD_ZERO( &event_write_set );
+  if ( event_fd_set == NULL ) {
+    event_fd_set_size = INITIAL_EVENT_FD_SET_SIZE;
+    event_fd_set = xcalloc( ( size_t ) event_fd_set_size, sizeof( event_fd * ) );
+  }
+  active_fd_count = 0;
 }
 void ( *init_event_handler )() = _init_event_handler;
 
 
 static void
 _finalize_event_handler() {
-  if ( event_last != event_list ) {
-    warn( "Event Handler finalized with %i fd event handlers still active. (%i, ...)",
-          ( event_last - event_list ), ( event_last > event_list ? event_list->fd : -1 ) );
+  if ( active_fd_count > 0 ) {
+    int fd = -1;
+    for ( int i = 0; i < event_fd_set_size; i++ ) {
+      if ( event_fd_set[ i ] != NULL ) {
+        fd = i;
+        break;
+      }
+    }
+    warn( "Event Handler finalized with %i fd event handlers still active. (%i, ...)", active_fd_count, fd );
     return;
   }
 
+  if ( event_fd_set != NULL ) {
+    xfree( event_fd_set );
+    event_fd_set = NULL;
+    event_fd_set_size = 0;
+  }
+  if ( epoll_fd >= 0 ) {
+    close( epoll_fd );
+    epoll_fd = -1;
+  }
+
   event_handler_state = EVENT_HANDLER_FINALIZED;
 }
 void ( *finalize_event_handler )() = _finalize_event_handler;
 
 
+static event_fd *
+lookup_event_fd( int fd ) {
+  if ( ( fd < 0 ) || ( fd >= event_fd_set_size ) ) {
+    return NULL;
+  }
+
+  return event_fd_set[ fd ];
+}
+
+
+/*
+ * Registers an fd with epoll only while read or write notification is
+ * enabled. epoll always reports hangups and errors, so keeping an idle fd
+ * registered would keep waking the loop up.
+ */
+static void
+update_epoll_events( event_fd *event, uint32_t events ) {
+  if ( event->events == events ) {
+    return;
+  }
+
+  struct epoll_event ev;
+  memset( &ev, 0, sizeof( struct epoll_event ) );
+  ev.events = events;
+  ev.data.fd = event->fd;
+
+  int ret = 0;
+  if ( events == 0 ) {
+    ret = epoll_ctl( epoll_fd, EPOLL_CTL_DEL, event->fd, &ev );
+    if ( ret < 0 && ( errno == ENOENT || errno == EBADF ) ) {
+      ret = 0; // already removed by close()
+    }
+  }
+  else if ( event->events == 0 ) {
+    ret = epoll_ctl( epoll_fd, EPOLL_CTL_ADD, event->fd, &ev );
+  }
+  else {
+    ret = epoll_ctl( epoll_fd, EPOLL_CTL_MOD, event->fd, &ev );
+    if ( ret < 0 && errno == ENOENT ) {
+      ret = epoll_ctl( epoll_fd, EPOLL_CTL_ADD, event->fd, &ev );
+    }
+  }
+  if ( ret < 0 ) {
+    error( "Failed to update epoll events ( fd = %d, events = %#x, errno = %s [%d] ).",
+           event->fd, events, strerror( errno ), errno );
+    return;
+  }
+
+  event->events = events;
+}
+
+
 static bool
 _run_event_handler_once( int timeout_usec ) {
   if ( external_callback != NULL ) {
@@ -135,19 +214,14 @@ _run_event_handler_once( int timeout_usec ) {
     callback();
   }
 
-  memcpy( &current_read_set, &event_read_set, sizeof( fd_set ) );
-  memcpy( &current_write_set, &event_write_set, sizeof( fd_set ) );
-
-  struct timeval timeout;
-  timeout.tv_sec = timeout_usec / 1000000;
-  timeout.tv_usec = timeout_usec % 1000000;
-  int set_count = select( fd_set_size, &current_read_set, &current_write_set, NULL, &timeout );
+  int timeout_msec = ( timeout_usec + 999 ) / 1000;
+  int set_count = epoll_wait( epoll_fd, ready_events, MAX_EVENTS_PER_WAIT, timeout_msec );
 
   if ( set_count == -1 ) {
     if ( errno == EINTR ) {
       return true;
     }
-    error( "Failed to select ( errno = %s [%d] ).", strerror( errno ), errno );
+    error( "Failed to epoll_wait ( errno = %s [%d] ).", strerror( errno ), errno );
     return false;
 
   }
@@ -156,27 +230,29 @@ _run_event_handler_once( int timeout_usec ) {
     return true;
   }
 
-  event_fd *event_itr = event_list;
-
-  while ( event_itr < event_last ) {
-    event_fd current_event = *event_itr;
-
-    if ( FD_ISSET( current_event.fd, &current_write_set ) ) {
-      current_event.write_callback( current_event.fd, current_event.write_data );
+  for ( int i = 0; i < set_count; i++ ) {
+    int fd = ready_events[ i ].data.fd;
+    uint32_t revents = ready_events[ i ].events;
+
+    // Callbacks may delete or modify any handler including this one, so
+    // the handler is looked up again before each callback.
+    event_fd *event = lookup_event_fd( fd );
+    if ( event == NULL ) {
+      debug( "run_event_handler_once: no event handler found for fd %d.", fd );
+      epoll_ctl( epoll_fd, EPOLL_CTL_DEL, fd, NULL );
+      continue;
     }
 
-    if ( FD_ISSET( current_event.fd, &current_read_set ) ) {
-      current_event.read_callback( current_event.fd, current_event.read_data );
+    if ( ( revents & ( EPOLLOUT | EPOLLERR | EPOLLHUP ) ) && ( event->events & EPOLLOUT ) ) {
+      event->write_callback( fd, event->write_data );
     }
 
-    // In the rare cases the current fd is closed, a new one is opened
-    // with the same fd and is put in the same location we can just
-    // wait for the next select call.
-    if ( current_event.fd == event_itr->fd ) {
-      event_itr = event_itr + 1;
+    event = lookup_event_fd( fd );
+    if ( event == NULL ) {
+      continue;
     }
-    else {
-      debug( "run_event_handler_once: event fd is changed ( current = %d, new = %d )", current_event.fd, event_itr->fd ) ;
+    if ( ( revents & ( EPOLLIN | EPOLLERR | EPOLLHUP ) ) && ( event->events & EPOLLIN ) ) {
+      event->read_callback( fd, event->read_data );
     }
   }
 
@@ -225,34 +301,38 @@ _set_fd_handler( int fd,
                  event_fd_callback write_callback, void *write_data ) {
   debug( "Adding event handler for fd %i, %p, %p.", fd, read_callback, write_callback );
 
-  // Currently just issue critical warnings instead of killing the
-  // program."
-  if ( event_fd_set[ fd ] != NULL ) {
-    error( "Tried to add an already active fd event handler." );
-    return;
-  }
-
-  if ( ( fd < 0 ) || ( fd >= FD_SETSIZE ) ) {
+  if ( fd < 0 ) {
     error( "Tried to add an invalid fd." );
     return;
   }
 
-  if ( event_last >= event_list + FD_SETSIZE ) {
-    error( "Event handler list in invalid state." );
+  // Currently just issue critical warnings instead of killing the
+  // program."
+  if ( lookup_event_fd( fd ) != NULL ) {
+    error( "Tried to add an already active fd event handler." );
     return;
   }
 
-  event_last->fd = fd;
-  event_last->read_callback = read_callback;
-  event_last->write_callback = write_callback;
-  event_last->read_data = read_data;
-  event_last->write_data = write_data;
+  if ( fd >= event_fd_set_size ) {
+    int new_size = event_fd_set_size > 0 ? event_fd_set_size : INITIAL_EVENT_FD_SET_SIZE;
+    while ( fd >= new_size ) {
+      new_size *= 2;
+    }
+    event_fd_set = xrealloc( event_fd_set, sizeof( event_fd * ) * ( size_t ) new_size );
+    memset( event_fd_set + event_fd_set_size, 0, sizeof( event_fd * ) * ( size_t ) ( new_size - event_fd_set_size ) );
+    event_fd_set_size = new_size;
+  }
 
-  event_fd_set[ fd ] = event_last++;
+  event_fd *event = xmalloc( sizeof( event_fd ) );
+  event->fd = fd;
+  event->read_callback = read_callback;
+  event->write_callback = write_callback;
+  event->read_data = read_data;
+  event->write_data = write_data;
+  event->events = 0;
 
-  if ( fd >= fd_set_size ) {
-    fd_set_size = fd + 1;
-  }
+  event_fd_set[ fd ] = event;
+  active_fd_count++;
 }
 void ( *set_fd_handler )( int fd, event_fd_callback read_callback, void *read_data, event_fd_callback write_callback, void *write_data ) = _set_fd_handler;
 
@@ -261,73 +341,42 @@ static void
 _delete_fd_handler( int fd ) {
   debug( "Deleting event handler for fd %i.", fd );
 
-  event_fd* event = event_list;
-
-  while ( event != event_last && event->fd != fd ) {
-    event++;
-  }
-
-  if ( ( event >= event_last ) || ( event_fd_set[ fd ] ) == NULL ) {
+  event_fd *event = lookup_event_fd( fd );
+  if ( event == NULL ) {
     error( "Tried to delete an inactive fd event handler." );
     return;
   }
 
-  if ( FD_ISSET( fd, &event_read_set ) ) {
+  if ( event->events & EPOLLIN ) {
     error( "Tried to delete an fd event handler with active read notification." );
-    //    return;
-    FD_CLR( fd, &event_read_set );
   }
 
-  if ( FD_ISSET( fd, &event_write_set ) ) {
+  if ( event->events & EPOLLOUT ) {
     error( "Tried to delete an fd event handler with active write notification." );
-    //    return;
-    FD_CLR( fd, &event_write_set );
   }
 
-  FD_CLR( fd, &current_read_set );
-  FD_CLR( fd, &current_write_set );
+  update_epoll_events( event, 0 );
 
   event_fd_set[ fd ] = NULL;
-
-  if ( event != --event_last ) {
-    memcpy( event, event_last, sizeof( event_fd ) );
-    event_fd_set[ event->fd ] = event;
-  }
-
-  memset( event_last, 0, sizeof( event_fd ) );
-  event_last->fd = -1;
-
-  if ( fd == ( fd_set_size  - 1 ) ) {
-    int i;
-    for ( i = ( fd_set_size - 2 ); i >= 0; --i ) {
-      if ( event_fd_set[ i ] != NULL ) {
-        break;
-      }
-    }
-    fd_set_size = i + 1;
-  }
+  active_fd_count--;
+  xfree( event );
 }
 void ( *delete_fd_handler )( int fd ) = _delete_fd_handler;
 
 
 static void
 _set_readable( int fd, bool state ) {
-  if ( ( fd < 0 ) || ( fd >= FD_SETSIZE ) ) {
-    error( "Invalid fd to set_readable call; %i.", fd );
-    return;
-  }
-
-  if ( ( event_fd_set[ fd ] == NULL ) || ( event_fd_set[ fd ]->read_callback == NULL ) ) {
-    error( "Found fd in invalid state in set_readable; %i, %p.", fd, event_fd_set[ fd ] );
+  event_fd *event = lookup_event_fd( fd );
+  if ( ( event == NULL ) || ( event->read_callback == NULL ) ) {
+    error( "Found fd in invalid state in set_readable; %i, %p.", fd, event );
     return;
   }
 
   if ( state ) {
-    FD_SET( fd, &event_read_set );
+    update_epoll_events( event, event->events | EPOLLIN );
   }
   else {
-    FD_CLR( fd, &event_read_set );
-    FD_CLR( fd, &current_read_set );
+    update_epoll_events( event, event->events & ~( uint32_t ) EPOLLIN );
   }
 }
 void ( *set_readable )( int fd, bool state ) = _set_readable;
@@ -335,22 +384,17 @@ void ( *set_readable )( int fd, bool state ) = _set_readable;
 
 static void
 _set_writable( int fd, bool state ) {
-  if ( ( fd < 0 ) || ( fd >= FD_SETSIZE ) ) {
-    error( "Invalid fd to notify_writeable_event call; %i.", fd );
-    return;
-  }
-
-  if ( ( event_fd_set[ fd ] == NULL ) || ( event_fd_set[ fd ]->write_callback == NULL ) ) {
-    error( "Found fd in invalid state in notify_writeable_event; %i, %p.", fd, event_fd_set[ fd ] );
+  event_fd *event = lookup_event_fd( fd );
+  if ( ( event == NULL ) || ( event->write_callback == NULL ) ) {
+    error( "Found fd in invalid state in notify_writeable_event; %i, %p.", fd, event );
     return;
   }
 
   if ( state ) {
-    FD_SET( fd, &event_write_set );
+    update_epoll_events( event, event->events | EPOLLOUT );
   }
   else {
-    FD_CLR( fd, &event_write_set );
-    FD_CLR( fd, &current_write_set );
+    update_epoll_events( event, event->events & ~( uint32_t ) EPOLLOUT );
   }
 }
 void ( *set_writable )( int fd, bool state ) = _set_writable;
@@ -358,14 +402,18 @@ void ( *set_writable )( int fd, bool state ) = _set_writable;
 
 static bool
 _readable( int fd ) {
-  return FD_ISSET( fd, &event_read_set );
+  event_fd *event = lookup_event_fd( fd );
+
+  return event != NULL && ( event->events & EPOLLIN ) != 0;
 }
 bool ( *readable )( int fd ) = _readable;
 
 
 static bool
 _writable( int fd ) {
-  return FD_ISSET( fd, &event_write_set );
+  event_fd *event = lookup_event_fd( fd );
+
+  return event != NULL && ( event->events & EPOLLOUT ) != 0;
 }
 bool ( *writable )( int fd ) = _writable;
 
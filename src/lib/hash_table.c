@@ -18,22 +18,52 @@
  */
 
 
+/*
+ * Entries are kept in a dense slot array in insertion order, and an
+ * open-addressing index (Robin Hood hashing with backward-shift
+ * deletion) maps hash values to slot numbers.
+ *
+ * Deleting an entry only marks its slot dead and removes it from the
+ * index; slots never move on deletion, so entries can safely be
+ * deleted while iterating. Dead slots are reclaimed (and the slot
+ * array is resized) on insertion, which invalidates iterators.
+ */
+
+
 #include <assert.h>
 #include <pthread.h>
+#include <stdint.h>
 #include <string.h>
 #include "hash_table.h"
 #include "wrapper.h"
 
 
-static const unsigned int default_hash_size = 65521;
+static const unsigned int default_hash_size = 16;
+static const unsigned int min_index_size = 16;
+
+
+typedef struct {
+  hash_entry entry;
+  unsigned int hash;
+  bool live;
+} hash_slot;
 
 
 typedef struct {
   hash_table public;
   pthread_mutex_t *mutex;
+  hash_slot *slots;
+  unsigned int slots_used;
+  unsigned int slots_size;
+  uint32_t *index;
 } private_hash_table;
 
 
+#define EMPTY_INDEX 0
+#define INDEX_TO_SLOT( _index ) ( ( _index ) - 1 )
+#define SLOT_TO_INDEX( _slot ) ( ( _slot ) + 1 )
+
+
 /**
  * Compares two pointer arguments and returns true if they are
  * equal. It can be passed to create_hash() as the key_equal_func
@@ -63,6 +93,23 @@ hash_atom( const void *key ) {
 }
 
 
+static unsigned int
+round_up_to_power_of_two( unsigned int n ) {
+  unsigned int size = min_index_size;
+  while ( size < n && size < ( 1U << 31 ) ) {
+    size <<= 1;
+  }
+  return size;
+}
+
+
+// Index size needed to hold n entries without exceeding 7/8 load.
+static unsigned int
+index_size_for( unsigned int n ) {
+  return round_up_to_power_of_two( n + n / 7 + 1 );
+}
+
+
 /**
  * Creates a new hash_table.
  *
@@ -82,7 +129,7 @@ create_hash( const compare_function compare, const hash_function hash ) {
 
 
 /**
- * Creates a new hash_table by specifying its bucket size.
+ * Creates a new hash_table by specifying its initial size.
  *
  * @param compare a function to check two keys for equality. This is
  *        used when looking up keys in the hash_table. If compare is
@@ -91,49 +138,227 @@ create_hash( const compare_function compare, const hash_function hash ) {
  *        values are used to determine where keys are stored within
  *        the hash_table data structure. If hash_func is NULL,
  *        hash_atom() is used.
- * @param size the number of hash buckets.
+ * @param size the number of entries expected. The table grows and
+ *        shrinks with its load, so this is only a hint.
  * @return a new hash_table.
  */
 hash_table *
 create_hash_with_size( const compare_function compare, const hash_function hash, unsigned int size ) {
+  return create_hash_with_flags( compare, hash, size, 0 );
+}
+
+
+/**
+ * Creates a new hash_table with creation flags.
+ *
+ * @param compare a function to check two keys for equality. If
+ *        compare is NULL, keys are compared by compare_atom().
+ * @param hash a function to create a hash value from a key. If
+ *        hash_func is NULL, hash_atom() is used.
+ * @param size the number of entries expected.
+ * @param flags HASH_TABLE_NO_LOCK to create a table that is not
+ *        protected by a mutex. Such a table must only be accessed by
+ *        a single thread.
+ * @return a new hash_table.
+ */
+hash_table *
+create_hash_with_flags( const compare_function compare, const hash_function hash, unsigned int size, unsigned int flags ) {
   private_hash_table *table = xmalloc( sizeof( private_hash_table ) );
 
-  table->public.number_of_buckets = size;
+  table->public.number_of_buckets = index_size_for( size );
   table->public.compare = compare ? compare : compare_atom;
   table->public.hash = hash ? hash : hash_atom;
   table->public.length = 0;
-  table->public.buckets = xmalloc( sizeof( dlist_element * ) * table->public.number_of_buckets );
-  memset( table->public.buckets, 0, sizeof( dlist_element * ) * table->public.number_of_buckets );
-  table->public.nonempty_bucket_index = create_dlist();
-
-  pthread_mutexattr_t attr;
-  pthread_mutexattr_init( &attr );
-  pthread_mutexattr_settype( &attr, PTHREAD_MUTEX_RECURSIVE_NP );
-  table->mutex = xmalloc( sizeof( pthread_mutex_t ) );
-  pthread_mutex_init( table->mutex, &attr );
+  table->index = xmalloc( sizeof( uint32_t ) * table->public.number_of_buckets );
+  memset( table->index, 0, sizeof( uint32_t ) * table->public.number_of_buckets );
+  table->slots = NULL;
+  table->slots_used = 0;
+  table->slots_size = 0;
+
+  table->mutex = NULL;
+  if ( ( flags & HASH_TABLE_NO_LOCK ) == 0 ) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init( &attr );
+    pthread_mutexattr_settype( &attr, PTHREAD_MUTEX_RECURSIVE_NP );
+    table->mutex = xmalloc( sizeof( pthread_mutex_t ) );
+    pthread_mutex_init( table->mutex, &attr );
+  }
 
   return ( hash_table * ) table;
 }
 
 
+#define MUTEX_LOCK( table )                                              \
+  do {                                                                   \
+    if ( ( ( private_hash_table * ) ( table ) )->mutex != NULL ) {      \
+      pthread_mutex_lock( ( ( private_hash_table * ) ( table ) )->mutex ); \
+    }                                                                    \
+  } while ( 0 )
+#define MUTEX_UNLOCK( table )                                            \
+  do {                                                                   \
+    if ( ( ( private_hash_table * ) ( table ) )->mutex != NULL ) {      \
+      pthread_mutex_unlock( ( ( private_hash_table * ) ( table ) )->mutex ); \
+    }                                                                    \
+  } while ( 0 )
+
+
 static unsigned int
-get_bucket_index( const hash_table *table, const void *key ) {
+get_hash_value( const hash_table *table, const void *key ) {
   assert( table != NULL );
   assert( key != NULL );
 
-  return ( *table->hash )( key ) % table->number_of_buckets;
+  // Mix the user hash so that the low bits used by the index are well
+  // distributed even for hash_atom() and small integer keys.
+  unsigned int h = ( *table->hash )( key );
+  h ^= h >> 16;
+  h *= 0x85ebca6bU;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35U;
+  h ^= h >> 16;
+
+  return h;
+}
+
+
+static unsigned int
+probe_distance( const private_hash_table *table, unsigned int position, uint32_t index ) {
+  unsigned int mask = table->public.number_of_buckets - 1;
+  unsigned int home = table->slots[ INDEX_TO_SLOT( index ) ].hash & mask;
+
+  return ( position - home ) & mask;
+}
+
+
+static void
+insert_index( private_hash_table *table, unsigned int slot ) {
+  unsigned int mask = table->public.number_of_buckets - 1;
+  uint32_t index = SLOT_TO_INDEX( slot );
+  unsigned int position = table->slots[ slot ].hash & mask;
+  unsigned int distance = 0;
+
+  for ( ;; ) {
+    uint32_t occupant = table->index[ position ];
+    if ( occupant == EMPTY_INDEX ) {
+      table->index[ position ] = index;
+      return;
+    }
+    unsigned int occupant_distance = probe_distance( table, position, occupant );
+    if ( occupant_distance < distance ) {
+      table->index[ position ] = index;
+      index = occupant;
+      distance = occupant_distance;
+    }
+    position = ( position + 1 ) & mask;
+    distance++;
+  }
+}
+
+
+static bool
+find_index( const private_hash_table *table, const void *key, unsigned int hash, unsigned int *found ) {
+  unsigned int mask = table->public.number_of_buckets - 1;
+  unsigned int position = hash & mask;
+
+  for ( unsigned int distance = 0;; distance++ ) {
+    uint32_t occupant = table->index[ position ];
+    if ( occupant == EMPTY_INDEX || probe_distance( table, position, occupant ) < distance ) {
+      return false;
+    }
+    const hash_slot *slot = &table->slots[ INDEX_TO_SLOT( occupant ) ];
+    if ( slot->hash == hash && ( *table->public.compare )( key, slot->entry.key ) ) {
+      *found = position;
+      return true;
+    }
+    position = ( position + 1 ) & mask;
+  }
 }
 
 
 static void
-new_bucket( hash_table *table, unsigned int bucket_index ) {
-  table->buckets[ bucket_index ] = create_dlist();
-  table->buckets[ bucket_index ]->data = insert_after_dlist( table->nonempty_bucket_index, ( void * ) ( unsigned long ) bucket_index );
+remove_index( private_hash_table *table, unsigned int position ) {
+  unsigned int mask = table->public.number_of_buckets - 1;
+  unsigned int next = ( position + 1 ) & mask;
+
+  while ( table->index[ next ] != EMPTY_INDEX && probe_distance( table, next, table->index[ next ] ) > 0 ) {
+    table->index[ position ] = table->index[ next ];
+    position = next;
+    next = ( next + 1 ) & mask;
+  }
+  table->index[ position ] = EMPTY_INDEX;
 }
 
 
-#define MUTEX_LOCK( table ) pthread_mutex_lock( ( ( private_hash_table * ) ( table ) )->mutex )
-#define MUTEX_UNLOCK( table ) pthread_mutex_unlock( ( ( private_hash_table * ) ( table ) )->mutex )
+static void
+rebuild_index( private_hash_table *table, unsigned int size ) {
+  if ( size != table->public.number_of_buckets ) {
+    xfree( table->index );
+    table->index = xmalloc( sizeof( uint32_t ) * size );
+    table->public.number_of_buckets = size;
+  }
+  memset( table->index, 0, sizeof( uint32_t ) * size );
+
+  for ( unsigned int i = 0; i < table->slots_used; i++ ) {
+    if ( table->slots[ i ].live ) {
+      insert_index( table, i );
+    }
+  }
+}
+
+
+static void
+compact_slots( private_hash_table *table ) {
+  unsigned int live = 0;
+  for ( unsigned int i = 0; i < table->slots_used; i++ ) {
+    if ( table->slots[ i ].live ) {
+      if ( live != i ) {
+        table->slots[ live ] = table->slots[ i ];
+      }
+      live++;
+    }
+  }
+  table->slots_used = live;
+}
+
+
+static void
+reserve_slot( private_hash_table *table ) {
+  if ( table->slots_used < table->slots_size ) {
+    return;
+  }
+
+  unsigned int live = table->public.length;
+  bool compacted = false;
+  if ( table->slots_used > live ) {
+    // Reclaim dead slots before growing.
+    compact_slots( table );
+    compacted = true;
+  }
+
+  unsigned int size = table->slots_size;
+  if ( size == 0 ) {
+    size = 8;
+  }
+  while ( size < ( live + 1 ) * 2 ) {
+    size *= 2;
+  }
+  while ( size > 8 && size > ( live + 1 ) * 4 ) {
+    size /= 2;
+  }
+  if ( size != table->slots_size ) {
+    hash_slot *slots = xmalloc( sizeof( hash_slot ) * size );
+    if ( table->slots != NULL ) {
+      memcpy( slots, table->slots, sizeof( hash_slot ) * table->slots_used );
+      xfree( table->slots );
+    }
+    table->slots = slots;
+    table->slots_size = size;
+  }
+
+  if ( compacted ) {
+    // Slot numbers have changed.
+    rebuild_index( table, table->public.number_of_buckets );
+  }
+}
 
 
 /**
@@ -153,35 +378,35 @@ insert_hash_entry( hash_table *table, void *key, void *value ) {
 
   MUTEX_LOCK( table );
 
-  void *old_value = NULL;
-  unsigned int i = get_bucket_index( table, key );
+  private_hash_table *t = ( private_hash_table * ) table;
+  unsigned int hash = get_hash_value( table, key );
+  unsigned int position = 0;
 
-  if ( table->buckets[ i ] != NULL ) {
-    dlist_element *old_element = NULL;
-    for ( old_element = table->buckets[ i ]->next; old_element; old_element = old_element->next ) {
-      if ( ( *table->compare )( key, ( ( hash_entry * ) old_element->data )->key ) ) {
-        break;
-      }
-    }
-    if ( old_element != NULL ) {
-      old_value = ( ( hash_entry * ) old_element->data )->value;
-      delete_hash_entry( table, key );
-    }
+  if ( find_index( t, key, hash, &position ) ) {
+    hash_entry *entry = &t->slots[ INDEX_TO_SLOT( t->index[ position ] ) ].entry;
+    void *old_value = entry->value;
+    entry->key = key;
+    entry->value = value;
+    MUTEX_UNLOCK( table );
+    return old_value;
   }
 
-  if ( table->buckets[ i ] == NULL ) {
-    new_bucket( table, i );
+  reserve_slot( t );
+  if ( ( table->length + 1 ) * 8 > table->number_of_buckets * 7 ) {
+    rebuild_index( t, index_size_for( table->length + 1 ) );
   }
 
-  hash_entry *new_entry = xmalloc( sizeof( hash_entry ) );
-  new_entry->key = key;
-  new_entry->value = value;
-  insert_after_dlist( table->buckets[ i ], new_entry );
+  unsigned int slot = t->slots_used++;
+  t->slots[ slot ].entry.key = key;
+  t->slots[ slot ].entry.value = value;
+  t->slots[ slot ].hash = hash;
+  t->slots[ slot ].live = true;
+  insert_index( t, slot );
   table->length++;
 
   MUTEX_UNLOCK( table );
 
-  return old_value;
+  return NULL;
 }
 
 
@@ -199,15 +424,11 @@ lookup_hash_entry( hash_table *table, const void *key ) {
 
   MUTEX_LOCK( table );
 
+  private_hash_table *t = ( private_hash_table * ) table;
   void *value = NULL;
-  unsigned int i = get_bucket_index( table, key );
-  if ( table->buckets[ i ] != NULL ) {
-    for ( dlist_element *e = table->buckets[ i ]->next; e; e = e->next ) {
-      if ( ( *table->compare )( key, ( ( hash_entry * ) e->data )->key ) ) {
-        value = ( ( hash_entry * ) e->data )->value;
-        break;
-      }
-    }
+  unsigned int position = 0;
+  if ( find_index( t, key, get_hash_value( table, key ), &position ) ) {
+    value = t->slots[ INDEX_TO_SLOT( t->index[ position ] ) ].entry.value;
   }
 
   MUTEX_UNLOCK( table );
@@ -216,18 +437,6 @@ lookup_hash_entry( hash_table *table, const void *key ) {
 }
 
 
-static void
-delete_bucket( hash_table *table, unsigned int bucket_index ) {
-  if ( table->buckets[ bucket_index ]->data != NULL ) {
-    delete_dlist_element( table->buckets[ bucket_index ]->data );
-    table->buckets[ bucket_index ]->data = NULL;
-  }
-
-  delete_dlist( table->buckets[ bucket_index ] );
-  table->buckets[ bucket_index ] = NULL;
-}
-
-
 /**
  * Deletes a key and its associated value from a hash_table.
  *
@@ -242,28 +451,23 @@ delete_hash_entry( hash_table *table, const void *key ) {
 
   MUTEX_LOCK( table );
 
-  unsigned int i = get_bucket_index( table, key );
-
-  if ( table->buckets[ i ] == NULL ) {
+  private_hash_table *t = ( private_hash_table * ) table;
+  unsigned int position = 0;
+  if ( !find_index( t, key, get_hash_value( table, key ), &position ) ) {
     MUTEX_UNLOCK( table );
     return NULL;
   }
 
-  void *deleted = NULL;
-  dlist_element *e = NULL;
-  for ( e = table->buckets[ i ]->next; e; e = e->next ) {
-    if ( ( *table->compare )( key, ( ( hash_entry * ) e->data )->key ) ) {
-      hash_entry *delete_me = e->data;
-      deleted = delete_me->value;
-      delete_dlist_element( e );
-      xfree( delete_me );
-      table->length--;
-      break;
-    }
-  }
+  hash_slot *slot = &t->slots[ INDEX_TO_SLOT( t->index[ position ] ) ];
+  void *deleted = slot->entry.value;
+  slot->live = false;
+  remove_index( t, position );
+  table->length--;
 
-  if ( table->buckets[ i ]->next == NULL ) {
-    delete_bucket( table, i );
+  // The index does not refer to slot positions seen by iterators, so
+  // it can shrink right away.
+  if ( table->number_of_buckets > min_index_size && table->length * 8 < table->number_of_buckets ) {
+    rebuild_index( t, index_size_for( table->length * 2 ) );
   }
 
   MUTEX_UNLOCK( table );
@@ -275,7 +479,8 @@ delete_hash_entry( hash_table *table, const void *key ) {
 /**
  * Calls the given function for each of the key/value pairs in the
  * hash_table. The function is passed the key and value of each pair,
- * and the given user_data parameter.
+ * and the given user_data parameter. The function may delete entries
+ * from the hash_table.
  *
  * @param table a hash_table.
  * @param function the function to call for each key/value pair.
@@ -287,18 +492,10 @@ foreach_hash( hash_table *table, void function( void *key, void *value, void *us
 
   MUTEX_LOCK( table );
 
-  for ( dlist_element *nonempty = table->nonempty_bucket_index->next; nonempty; ) {
-    int i = ( int ) ( unsigned long ) nonempty->data;
-    nonempty = nonempty->next;
-
-    if ( table->buckets[ i ] == NULL ) {
-      continue;
-    }
-
-    for ( dlist_element *e = table->buckets[ i ]->next; e != NULL; ) {
-      hash_entry *h = e->data;
-      e = e->next;
-      function( h->key, h->value, user_data );
+  private_hash_table *t = ( private_hash_table * ) table;
+  for ( unsigned int i = 0; i < t->slots_used; i++ ) {
+    if ( t->slots[ i ].live ) {
+      function( t->slots[ i ].entry.key, t->slots[ i ].entry.value, user_data );
     }
   }
 
@@ -308,8 +505,9 @@ foreach_hash( hash_table *table, void function( void *key, void *value, void *us
 
 /**
  * Initializes a key/value pair iterator and associates it with
- * hash_table. Modifying the hash table after calling this function
- * invalidates the returned iterator.
+ * hash_table. Inserting into the hash table after calling this
+ * function invalidates the returned iterator; deleting entries does
+ * not.
  *
  * @param table a hash_table.
  * @param iterator an uninitialized hash_iterator
@@ -319,17 +517,8 @@ init_hash_iterator( hash_table *table, hash_iterator *iterator ) {
   assert( table != NULL );
   assert( iterator != NULL );
 
-  iterator->buckets = table->buckets;
-  if ( table->nonempty_bucket_index->next ) {
-    iterator->bucket_index = table->nonempty_bucket_index->next;
-    iterator->next_bucket_index = iterator->bucket_index->next;
-    assert( iterator->buckets[ ( int ) ( unsigned long ) iterator->bucket_index->data ] != NULL );
-    iterator->element = iterator->buckets[ ( int ) ( unsigned long ) iterator->bucket_index->data ]->next;
-  }
-  else {
-    iterator->bucket_index = NULL;
-    iterator->element = NULL;
-  }
+  iterator->table = table;
+  iterator->position = 0;
 }
 
 
@@ -345,29 +534,18 @@ hash_entry *
 iterate_hash_next( hash_iterator *iterator ) {
   assert( iterator != NULL );
 
-  for ( ;; ) {
-    if ( iterator->bucket_index == NULL ) {
-      return NULL;
-    }
+  private_hash_table *t = ( private_hash_table * ) iterator->table;
+  if ( t == NULL ) {
+    return NULL;
+  }
 
-    dlist_element *e = iterator->element;
-    if ( e == NULL ) { 
-      if ( iterator->next_bucket_index != NULL ) {
-        iterator->bucket_index = iterator->next_bucket_index;
-        iterator->next_bucket_index = iterator->next_bucket_index->next;
-        int bucket_index = ( int ) ( unsigned long ) iterator->bucket_index->data;
-        assert( iterator->buckets[ bucket_index ] != NULL );
-        iterator->element = iterator->buckets[ bucket_index ]->next;
-      }
-      else {
-        return NULL;
-      }
-    }
-    else {
-      iterator->element = e->next;
-      return e->data;
+  while ( iterator->position < t->slots_used ) {
+    hash_slot *slot = &t->slots[ iterator->position++ ];
+    if ( slot->live ) {
+      return &slot->entry;
     }
   }
+
   return NULL;
 }
 
@@ -381,32 +559,22 @@ void
 delete_hash( hash_table *table ) {
   assert( table != NULL );
 
-  pthread_mutex_lock( ( ( private_hash_table * ) table )->mutex );
-  pthread_mutex_t *mutex = ( ( private_hash_table * ) table )->mutex;
-
-  for ( dlist_element *nonempty = table->nonempty_bucket_index->next; nonempty; ) {
-    unsigned int i = ( unsigned int ) ( unsigned long ) nonempty->data;
-    nonempty = nonempty->next;
-    if ( table->buckets[ i ] == NULL ) {
-      continue;
-    }
-
-    for ( dlist_element *e = table->buckets[ i ]->next; e != NULL; ) {
-      dlist_element *delete_me = e;
-      e = e->next;
-      xfree( delete_me->data );
-    }
-
-    delete_bucket( table, i );
+  private_hash_table *t = ( private_hash_table * ) table;
+  pthread_mutex_t *mutex = t->mutex;
+  if ( mutex != NULL ) {
+    pthread_mutex_lock( mutex );
   }
-  xfree( table->buckets );
 
-  delete_dlist( table->nonempty_bucket_index );
-
-  xfree( table );
+  if ( t->slots != NULL ) {
+    xfree( t->slots );
+  }
+  xfree( t->index );
+  xfree( t );
 
-  pthread_mutex_unlock( mutex );
-  xfree( mutex );
+  if ( mutex != NULL ) {
+    pthread_mutex_unlock( mutex );
+    xfree( mutex );
+  }
 }
 
 
@@ -54,9 +54,9 @@
  * value.
  *
  * The hash values should be evenly distributed over a fairly large
- * range. The modulus is taken with the hash table size (a prime
- * number) to find the 'bucket' to place each key into. The function
- * should also be very fast, since it is called for each key lookup.
+ * range. The value is mixed and masked with the (power of two) index
+ * size to find the home slot of each key. The function should also be
+ * very fast, since it is called for each key lookup.
  *
  * @param key a key.
  * @return the hash value corresponding to the key.
@@ -94,8 +94,6 @@ typedef struct {
   compare_function compare;
   hash_function hash;
   unsigned int length;
-  dlist_element **buckets;
-  dlist_element *nonempty_bucket_index;
 } hash_table;
 
 
@@ -106,15 +104,22 @@ typedef struct {
  * initialized with init_hash_iterator().
  */
 typedef struct {
-  dlist_element **buckets;
-  dlist_element *bucket_index;
-  dlist_element *next_bucket_index;
-  dlist_element *element;
+  hash_table *table;
+  unsigned int position;
 } hash_iterator;
 
 
+/**
+ * Flags for create_hash_with_flags().
+ */
+enum {
+  HASH_TABLE_NO_LOCK = 1 << 0, /**< the table is owned by a single thread; skip locking */
+};
+
+
 hash_table *create_hash( const compare_function compare, const hash_function hash );
 hash_table *create_hash_with_size( const compare_function compare, const hash_function hash, unsigned int size );
+hash_table *create_hash_with_flags( const compare_function compare, const hash_function hash, unsigned int size, unsigned int flags );
 void *insert_hash_entry( hash_table *table, void *key, void *value );
 void *lookup_hash_entry( hash_table *table, const void *key );
 void *delete_hash_entry( hash_table *table, const void *key );
@@ -0,0 +1,166 @@
+/*
+ * Intrusive doubly-linked lists
+ *
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <assert.h>
+#include "intrusive_list.h"
+
+
+/**
+ * Initializes a list head, or a link that is not in any list.
+ *
+ * @param link the link to initialize.
+ */
+void
+init_list_link( list_link *link ) {
+  assert( link != NULL );
+
+  link->prev = link;
+  link->next = link;
+}
+
+
+/**
+ * Checks whether a list has no elements.
+ *
+ * @param head the head of the list.
+ * @return true if the list is empty; false otherwise.
+ */
+bool
+list_link_is_empty( const list_link *head ) {
+  assert( head != NULL );
+
+  return head->next == head;
+}
+
+
+/**
+ * Checks whether a link initialized by init_list_link() is currently
+ * in a list.
+ *
+ * @param link the link to check.
+ * @return true if the link is in a list; false otherwise.
+ */
+bool
+list_link_is_linked( const list_link *link ) {
+  assert( link != NULL );
+
+  return link->next != link && link->next != NULL;
+}
+
+
+/**
+ * Inserts a link into a list before the given position.
+ *
+ * @param position the link before which the new link is inserted.
+ * @param link the link to insert.
+ */
+void
+insert_link_before( list_link *position, list_link *link ) {
+  assert( position != NULL );
+  assert( link != NULL );
+
+  link->prev = position->prev;
+  link->next = position;
+  position->prev->next = link;
+  position->prev = link;
+}
+
+
+/**
+ * Inserts a link into a list after the given position.
+ *
+ * @param position the link after which the new link is inserted.
+ * @param link the link to insert.
+ */
+void
+insert_link_after( list_link *position, list_link *link ) {
+  assert( position != NULL );
+
+  insert_link_before( position->next, link );
+}
+
+
+/**
+ * Adds a link on to the end of a list.
+ *
+ * @param head the head of the list.
+ * @param link the link to add.
+ */
+void
+append_link( list_link *head, list_link *link ) {
+  insert_link_before( head, link );
+}
+
+
+/**
+ * Adds a link at the beginning of a list.
+ *
+ * @param head the head of the list.
+ * @param link the link to add.
+ */
+void
+prepend_link( list_link *head, list_link *link ) {
+  insert_link_after( head, link );
+}
+
+
+/**
+ * Removes a link from the list it is in. The link is left initialized
+ * as if by init_list_link(), so it may be removed again safely.
+ *
+ * @param link the link to remove.
+ */
+void
+remove_link( list_link *link ) {
+  assert( link != NULL );
+  assert( link->prev != NULL );
+  assert( link->next != NULL );
+
+  link->prev->next = link->next;
+  link->next->prev = link->prev;
+  init_list_link( link );
+}
+
+
+/**
+ * Gets the number of elements in a list.
+ *
+ * @param head the head of the list.
+ * @return the number of elements in the list.
+ */
+unsigned int
+list_link_length_of( const list_link *head ) {
+  assert( head != NULL );
+
+  unsigned int length = 0;
+  for ( const list_link *l = head->next; l != head; l = l->next ) {
+    length++;
+  }
+
+  return length;
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
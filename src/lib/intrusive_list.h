@@ -0,0 +1,98 @@
+/*
+ * Intrusive doubly-linked lists
+ *
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/**
+ * @file
+ *
+ * @brief Intrusive doubly-linked lists.
+ *
+ * Unlike the Linked Lists and the Doubly-Linked Lists, which allocate
+ * an element for each piece of data, an intrusive list links
+ * structures that embed a list_link themselves. Inserting and
+ * removing never allocates memory. A list is a circular chain of
+ * links with a head link that holds no data.
+ *
+ * @code
+ * typedef struct {
+ *   int value;
+ *   list_link link;
+ * } item;
+ *
+ * list_link items;
+ * init_list_link( &items );
+ *
+ * item alpha = { 1, { NULL, NULL } };
+ * append_link( &items, &alpha.link );
+ *
+ * for ( list_link *l = items.next; l != &items; l = l->next ) {
+ *   item *i = LIST_LINK_ENTRY( l, item, link );
+ * }
+ *
+ * remove_link( &alpha.link );
+ * @endcode
+ */
+
+
+#ifndef INTRUSIVE_LIST_H
+#define INTRUSIVE_LIST_H
+
+
+#include <stddef.h>
+#include "bool.h"
+
+
+/**
+ * The list_link struct is embedded in each structure that is put
+ * into an intrusive list, and is also used as the head of a list.
+ */
+typedef struct list_link {
+  struct list_link *prev; /**< Contains the link to the previous element in the list. */
+  struct list_link *next; /**< Contains the link to the next element in the list. */
+} list_link;
+
+
+/**
+ * Gets the structure of the given type that embeds the link as the
+ * given member.
+ */
+#define LIST_LINK_ENTRY( link, type, member ) \
+  ( ( type * ) ( void * ) ( ( char * ) ( link ) - offsetof( type, member ) ) )
+
+
+void init_list_link( list_link *link );
+bool list_link_is_empty( const list_link *head );
+bool list_link_is_linked( const list_link *link );
+void insert_link_before( list_link *position, list_link *link );
+void insert_link_after( list_link *position, list_link *link );
+void append_link( list_link *head, list_link *link );
+void prepend_link( list_link *head, list_link *link );
+void remove_link( list_link *link );
+unsigned int list_link_length_of( const list_link *head );
+
+
+#endif // INTRUSIVE_LIST_H
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
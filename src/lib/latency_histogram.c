@@ -0,0 +1,159 @@
+/*
+ * Latency histograms
+ *
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <assert.h>
+#include <inttypes.h>
+#include <string.h>
+#include "latency_histogram.h"
+#include "log.h"
+
+
+/**
+ * Clears all samples of a histogram.
+ *
+ * @param histogram the histogram to initialize.
+ */
+void
+init_latency_histogram( latency_histogram *histogram ) {
+  assert( histogram != NULL );
+
+  memset( histogram, 0, sizeof( latency_histogram ) );
+}
+
+
+static unsigned int
+bucket_of( uint64_t usec ) {
+  if ( usec == 0 ) {
+    return 0;
+  }
+  unsigned int bucket = ( unsigned int ) ( 64 - __builtin_clzll( usec ) );
+
+  return bucket < LATENCY_HISTOGRAM_BUCKETS ? bucket : LATENCY_HISTOGRAM_BUCKETS - 1;
+}
+
+
+/**
+ * Adds a sample to a histogram.
+ *
+ * @param histogram the histogram to add the sample to.
+ * @param usec the latency in microseconds.
+ */
+void
+add_latency_sample( latency_histogram *histogram, uint64_t usec ) {
+  assert( histogram != NULL );
+
+  histogram->count++;
+  histogram->total += usec;
+  if ( usec > histogram->max ) {
+    histogram->max = usec;
+  }
+  histogram->buckets[ bucket_of( usec ) ]++;
+}
+
+
+/**
+ * Adds the time elapsed since start on the monotonic clock to a
+ * histogram.
+ *
+ * @param histogram the histogram to add the sample to.
+ * @param start the start time taken with CLOCK_MONOTONIC.
+ * @return the latency in microseconds.
+ */
+uint64_t
+record_latency( latency_histogram *histogram, const struct timespec *start ) {
+  assert( start != NULL );
+
+  struct timespec now;
+  clock_gettime( CLOCK_MONOTONIC, &now );
+  int64_t usec = ( int64_t ) ( now.tv_sec - start->tv_sec ) * 1000000 + ( now.tv_nsec - start->tv_nsec ) / 1000;
+  if ( usec < 0 ) {
+    usec = 0;
+  }
+  add_latency_sample( histogram, ( uint64_t ) usec );
+
+  return ( uint64_t ) usec;
+}
+
+
+/**
+ * Estimates a percentile of the samples in a histogram.
+ *
+ * @param histogram the histogram to look up.
+ * @param percent the percentile, from 0 to 100.
+ * @return the upper bound in microseconds of the bucket that contains
+ *         the percentile, capped at the longest sample. 0 if there are
+ *         no samples.
+ */
+uint64_t
+latency_percentile( const latency_histogram *histogram, unsigned int percent ) {
+  assert( histogram != NULL );
+  assert( percent <= 100 );
+
+  if ( histogram->count == 0 ) {
+    return 0;
+  }
+
+  uint64_t rank = ( histogram->count * percent + 99 ) / 100;
+  if ( rank == 0 ) {
+    rank = 1;
+  }
+  uint64_t seen = 0;
+  for ( unsigned int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++ ) {
+    seen += histogram->buckets[ i ];
+    if ( seen >= rank ) {
+      uint64_t upper = ( uint64_t ) 1 << i;
+      return upper < histogram->max ? upper : histogram->max;
+    }
+  }
+
+  return histogram->max;
+}
+
+
+/**
+ * Logs a summary and the non-empty buckets of a histogram at info
+ * level.
+ *
+ * @param name the name of the histogram to log.
+ * @param histogram the histogram to dump.
+ */
+void
+dump_latency_histogram( const char *name, const latency_histogram *histogram ) {
+  assert( name != NULL );
+  assert( histogram != NULL );
+
+  uint64_t average = histogram->count > 0 ? histogram->total / histogram->count : 0;
+  info( "%s: count = %" PRIu64 ", average = %" PRIu64 " us, p50 = %" PRIu64 " us, p99 = %" PRIu64 " us, max = %" PRIu64 " us",
+        name, histogram->count, average, latency_percentile( histogram, 50 ),
+        latency_percentile( histogram, 99 ), histogram->max );
+  for ( unsigned int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++ ) {
+    if ( histogram->buckets[ i ] > 0 ) {
+      info( "  < %" PRIu64 " us: %" PRIu64, ( uint64_t ) 1 << i, histogram->buckets[ i ] );
+    }
+  }
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,82 @@
+/*
+ * Latency histograms
+ *
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/**
+ * @file
+ *
+ * @brief Fixed-size histograms of latencies in microseconds.
+ *
+ * Each bucket covers a power of two, so recording a sample is a few
+ * instructions and never allocates memory. Percentiles are reported as
+ * the upper bound of the bucket that contains them.
+ *
+ * @code
+ * latency_histogram rtt;
+ * init_latency_histogram( &rtt );
+ *
+ * struct timespec sent_at;
+ * clock_gettime( CLOCK_MONOTONIC, &sent_at );
+ * ...
+ * record_latency( &rtt, &sent_at );
+ * dump_latency_histogram( "echo round-trip time", &rtt );
+ * @endcode
+ */
+
+
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+
+#include <stdint.h>
+#include <time.h>
+
+
+#define LATENCY_HISTOGRAM_BUCKETS 32
+
+
+/**
+ * Bucket i counts the samples below 2^i microseconds that are not
+ * counted by bucket i - 1. The last bucket also counts all longer
+ * samples.
+ */
+typedef struct {
+  uint64_t count;    /**< Number of samples. */
+  uint64_t total;    /**< Sum of the samples in microseconds. */
+  uint64_t max;      /**< Longest sample in microseconds. */
+  uint64_t buckets[ LATENCY_HISTOGRAM_BUCKETS ];
+} latency_histogram;
+
+
+void init_latency_histogram( latency_histogram *histogram );
+void add_latency_sample( latency_histogram *histogram, uint64_t usec );
+uint64_t record_latency( latency_histogram *histogram, const struct timespec *start );
+uint64_t latency_percentile( const latency_histogram *histogram, unsigned int percent );
+void dump_latency_histogram( const char *name, const latency_histogram *histogram );
+
+
+#endif // LATENCY_HISTOGRAM_H
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
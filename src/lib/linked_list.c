@@ -19,10 +19,95 @@
 
 
 #include <assert.h>
+#include <pthread.h>
+#include "checks.h"
 #include "linked_list.h"
 #include "wrapper.h"
 
 
+#define LIST_ELEMENT_CACHE_DEPTH 1024
+
+
+/*
+ * Freed elements are kept per thread, linked through their next
+ * fields, when the thread has enabled its element cache.
+ */
+typedef struct {
+  bool enabled;
+  list_element *free_elements;
+  unsigned int n_free_elements;
+} list_element_cache;
+
+static __thread list_element_cache cache;
+static pthread_key_t cache_key;
+static pthread_once_t cache_key_once = PTHREAD_ONCE_INIT;
+
+
+static list_element *
+alloc_list_element() {
+  list_element *element = cache.free_elements;
+  if ( element != NULL ) {
+    cache.free_elements = element->next;
+    cache.n_free_elements--;
+    return element;
+  }
+
+  return xmalloc( sizeof( list_element ) );
+}
+
+
+static void
+free_list_element( list_element *element ) {
+  if ( cache.enabled && cache.n_free_elements < LIST_ELEMENT_CACHE_DEPTH ) {
+    element->next = cache.free_elements;
+    cache.free_elements = element;
+    cache.n_free_elements++;
+    return;
+  }
+  xfree( element );
+}
+
+
+static void
+release_list_element_cache( void *value ) {
+  UNUSED( value );
+
+  cache.enabled = false;
+  while ( cache.free_elements != NULL ) {
+    list_element *next = cache.free_elements->next;
+    xfree( cache.free_elements );
+    cache.free_elements = next;
+  }
+  cache.n_free_elements = 0;
+}
+
+
+static void
+create_cache_key() {
+  pthread_key_create( &cache_key, release_list_element_cache );
+}
+
+
+/**
+ * Makes the calling thread keep freed list elements for reuse, so
+ * that building and deleting lists does not go to the heap for each
+ * element. The cache is released when the thread exits or calls
+ * disable_list_element_cache().
+ */
+void
+enable_list_element_cache() {
+  pthread_once( &cache_key_once, create_cache_key );
+  pthread_setspecific( cache_key, &cache );
+  cache.enabled = true;
+}
+
+
+void
+disable_list_element_cache() {
+  release_list_element_cache( NULL );
+}
+
+
 /**
  * Initializes a new list by passing the head of the list. Note that
  * the head element should be allocated on caller's stack or heap.
@@ -55,7 +140,7 @@ insert_in_front( list_element **head, void *data ) {
   }
 
   list_element *old_head = *head;
-  list_element *new_head = xmalloc( sizeof( list_element ) );
+  list_element *new_head = alloc_list_element();
 
   new_head->data = data;
   *head = new_head;
@@ -80,7 +165,7 @@ insert_before( list_element **head, const void *sibling, void *data ) {
 
   for ( list_element *e = *head; e->next != NULL; e = e->next ) {
     if ( e->next->data == sibling ) {
-      list_element *new_element = xmalloc( sizeof( list_element ) );
+      list_element *new_element = alloc_list_element();
       new_element->next = e->next;
       new_element->data = data;
       e->next = new_element;
@@ -105,7 +190,7 @@ append_to_tail( list_element **head, void *data ) {
     die( "head must not be NULL" );
   }
 
-  list_element *new_tail = xmalloc( sizeof( list_element ) );
+  list_element *new_tail = alloc_list_element();
   new_tail->data = data;
   new_tail->next = NULL;
 
@@ -157,7 +242,7 @@ delete_element( list_element **head, const void *data ) {
 
   if ( e->data == data ) {
     *head = e->next;
-    xfree( e );
+    free_list_element( e );
     return true;
   }
 
@@ -165,7 +250,7 @@ delete_element( list_element **head, const void *data ) {
     if ( e->next->data == data ) {
       list_element *delete_me = e->next;
       e->next = e->next->next;
-      xfree( delete_me );
+      free_list_element( delete_me );
       return true;
     }
   }
@@ -185,7 +270,7 @@ delete_list( list_element *head ) {
   for ( list_element *e = head; e != NULL; ) {
     list_element *delete_me = e;
     e = e->next;
-    xfree( delete_me );
+    free_list_element( delete_me );
   }
   return true;
 }
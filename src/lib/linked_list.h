@@ -71,6 +71,8 @@ bool append_to_tail( list_element **head, void *data );
 unsigned int list_length_of( const list_element *head );
 bool delete_element( list_element **head, const void *data );
 bool delete_list( list_element *head );
+void enable_list_element_cache( void );
+void disable_list_element_cache( void );
 
 
 #endif // LINKED_LIST_H
@@ -20,15 +20,22 @@
 
 #include <assert.h>
 #include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
 #include <linux/limits.h>
+#include <poll.h>
 #include <pthread.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <syslog.h>
 #include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 #include <sys/time.h>
 #include "bool.h"
+#include "checks.h"
 #include "log.h"
 #include "trema_wrapper.h"
 #include "wrapper.h"
@@ -95,22 +102,34 @@ priority_name_from( int level ) {
 }
 
 
-static const size_t max_message_length = 1024;
+#define LOG_MESSAGE_LENGTH 1024
+#define LOG_RING_SIZE 256 // records per thread, power of two
+#define LOG_RING_CACHE_LINE_SIZE 64
+
+static const size_t max_message_length = LOG_MESSAGE_LENGTH;
+
+
+static void
+write_log_file( int priority, const struct timeval *tv, const char *message ) {
+  char now[ 26 ];
+  strftime( now, sizeof( now ), "%b %e %T", localtime( &tv->tv_sec ) ); // syslog message format look like
+  const char *priority_name = priority_name_from( priority );
+
+  trema_fprintf( fd, "%s.%03d [%s] %s\n", now, tv->tv_usec / 1000, priority_name, message );
+}
+
 
 static void
 log_file( int priority, const char *format, va_list ap ) {
   struct timeval tv;
   gettimeofday( &tv, NULL );
-  char now[ 26 ];
-  strftime( now, sizeof( now ), "%b %e %T", localtime( &tv.tv_sec ) ); // syslog message format look like
-  const char *priority_name = priority_name_from( priority );
 
   char message[ max_message_length ];
   va_list new_ap;
   va_copy( new_ap, ap );
   vsnprintf( message, max_message_length, format, new_ap );
 
-  trema_fprintf( fd, "%s.%03d [%s] %s\n", now, tv.tv_usec / 1000, priority_name, message );
+  write_log_file( priority, &tv, message );
   fflush( fd );
 }
 
@@ -134,6 +153,368 @@ log_syslog( int priority, const char *format, va_list ap ) {
 }
 
 
+static void
+log_formatted( int priority, const char *format, ... ) {
+  va_list args;
+  va_start( args, format );
+  if ( output & LOGGING_TYPE_SYSLOG ) {
+    log_syslog( priority, format, args );
+  }
+  if ( output & LOGGING_TYPE_STDOUT ) {
+    log_stdout( format, args );
+  }
+  va_end( args );
+}
+
+
+/*
+ * Asynchronous logging. Each thread formats its messages into its own
+ * ring, and a writer thread drains the rings in batches. Only the
+ * holder of mutex consumes from the rings.
+ */
+typedef struct {
+  int priority;
+  struct timeval tv;
+  char message[ LOG_MESSAGE_LENGTH ];
+} log_record;
+
+typedef struct log_ring {
+  log_record records[ LOG_RING_SIZE ];
+  struct log_ring *next;
+  uint64_t dropped_reported;
+  char pad0[ LOG_RING_CACHE_LINE_SIZE ];
+  volatile unsigned int head; // next record to write out ( consumer )
+  char pad1[ LOG_RING_CACHE_LINE_SIZE ];
+  volatile unsigned int tail; // next record to fill ( producer )
+  volatile uint64_t dropped;  // records lost because the ring was full
+  volatile bool closed;       // the owner thread has exited
+} log_ring;
+
+
+static volatile bool writer_running = false;
+static volatile bool writer_waiting = false;
+static pthread_t writer_thread;
+static int writer_event_fd = -1;
+static log_ring *log_rings = NULL;
+static unsigned int log_ring_generation = 0;
+static pthread_key_t log_ring_key;
+static pthread_once_t log_ring_key_once = PTHREAD_ONCE_INIT;
+static pthread_once_t log_writer_atfork_once = PTHREAD_ONCE_INIT;
+static __thread log_ring *thread_log_ring = NULL;
+static __thread unsigned int thread_log_ring_generation = 0;
+
+
+static void
+close_thread_log_ring( void *value ) {
+  UNUSED( value );
+
+  // The ring may have been released by stop_log_writer() already.
+  if ( thread_log_ring != NULL && thread_log_ring_generation == log_ring_generation ) {
+    thread_log_ring->closed = true;
+  }
+  thread_log_ring = NULL;
+}
+
+
+static void
+create_log_ring_key() {
+  pthread_key_create( &log_ring_key, close_thread_log_ring );
+}
+
+
+static log_ring *
+get_thread_log_ring() {
+  if ( thread_log_ring != NULL && thread_log_ring_generation == log_ring_generation ) {
+    return thread_log_ring;
+  }
+
+  log_ring *ring = xmalloc( sizeof( log_ring ) );
+  memset( ring, 0, sizeof( log_ring ) );
+
+  pthread_once( &log_ring_key_once, create_log_ring_key );
+  pthread_setspecific( log_ring_key, ring );
+
+  pthread_mutex_lock( &mutex );
+  ring->next = log_rings;
+  log_rings = ring;
+  thread_log_ring = ring;
+  thread_log_ring_generation = log_ring_generation;
+  pthread_mutex_unlock( &mutex );
+
+  return ring;
+}
+
+
+/**
+ * formats a message into the ring of the calling thread. A message
+ * that does not fit is dropped and counted.
+ */
+static void
+push_log_record( int priority, const char *format, va_list ap ) {
+  log_ring *ring = get_thread_log_ring();
+
+  unsigned int tail = ring->tail;
+  if ( tail - ring->head >= LOG_RING_SIZE ) {
+    ring->dropped++;
+    return;
+  }
+
+  log_record *record = &ring->records[ tail & ( LOG_RING_SIZE - 1 ) ];
+  record->priority = priority;
+  gettimeofday( &record->tv, NULL );
+  va_list new_ap;
+  va_copy( new_ap, ap );
+  vsnprintf( record->message, sizeof( record->message ), format, new_ap );
+  va_end( new_ap );
+
+  __sync_synchronize(); // the record must be visible before the new tail
+  ring->tail = tail + 1;
+  __sync_synchronize(); // publish the tail before looking at the flag
+  if ( writer_waiting ) {
+    uint64_t one = 1;
+    ssize_t ret = write( writer_event_fd, &one, sizeof( one ) );
+    UNUSED( ret );
+  }
+}
+
+
+static void
+write_log_record( const log_record *record ) {
+  if ( output & LOGGING_TYPE_FILE ) {
+    write_log_file( record->priority, &record->tv, record->message );
+  }
+  log_formatted( record->priority, "%s", record->message );
+}
+
+
+/**
+ * writes out the records in all rings. Must be called with mutex held.
+ * returns the number of records written.
+ */
+static unsigned int
+drain_log_rings() {
+  unsigned int count = 0;
+
+  for ( log_ring **ring = &log_rings; *ring != NULL; ) {
+    log_ring *r = *ring;
+    unsigned int tail = r->tail;
+    __sync_synchronize(); // records must not be read before the tail
+    for ( unsigned int head = r->head; head != tail; head++ ) {
+      write_log_record( &r->records[ head & ( LOG_RING_SIZE - 1 ) ] );
+      count++;
+    }
+    __sync_synchronize(); // records must be read before they are released
+    r->head = tail;
+
+    uint64_t dropped = r->dropped;
+    if ( dropped != r->dropped_reported ) {
+      log_record record;
+      record.priority = LOG_WARNING;
+      gettimeofday( &record.tv, NULL );
+      snprintf( record.message, sizeof( record.message ), "%" PRIu64 " log messages were dropped.", dropped - r->dropped_reported );
+      write_log_record( &record );
+      r->dropped_reported = dropped;
+      count++;
+    }
+
+    if ( r->closed && r->head == r->tail ) {
+      *ring = r->next;
+      xfree( r );
+      continue;
+    }
+    ring = &r->next;
+  }
+
+  if ( count > 0 ) {
+    if ( ( output & LOGGING_TYPE_FILE ) && fd != NULL ) {
+      fflush( fd );
+    }
+    if ( output & LOGGING_TYPE_STDOUT ) {
+      fflush( stdout );
+    }
+  }
+
+  return count;
+}
+
+
+static bool
+log_rings_are_empty() {
+  bool empty = true;
+
+  pthread_mutex_lock( &mutex );
+  for ( log_ring *ring = log_rings; ring != NULL; ring = ring->next ) {
+    if ( ring->head != ring->tail || ring->dropped != ring->dropped_reported ) {
+      empty = false;
+      break;
+    }
+  }
+  pthread_mutex_unlock( &mutex );
+
+  return empty;
+}
+
+
+static void *
+log_writer_main( void *args ) {
+  UNUSED( args );
+
+  while ( writer_running ) {
+    pthread_mutex_lock( &mutex );
+    unsigned int count = drain_log_rings();
+    pthread_mutex_unlock( &mutex );
+    if ( count > 0 ) {
+      continue;
+    }
+
+    writer_waiting = true;
+    __sync_synchronize(); // announce before looking at the rings again
+    if ( writer_running && log_rings_are_empty() ) {
+      struct pollfd pfd = { .fd = writer_event_fd, .events = POLLIN, .revents = 0 };
+      poll( &pfd, 1, 1000 );
+    }
+    writer_waiting = false;
+
+    uint64_t value;
+    ssize_t ret = read( writer_event_fd, &value, sizeof( value ) );
+    UNUSED( ret );
+  }
+
+  return NULL;
+}
+
+
+/*
+ * Keeps the rings consistent across fork(): mutex is held while the
+ * process is copied, so that the child does not inherit it locked by a
+ * thread that no longer exists.
+ */
+static void
+prepare_log_writer_fork() {
+  pthread_mutex_lock( &mutex );
+}
+
+
+static void
+resume_log_writer_in_parent() {
+  pthread_mutex_unlock( &mutex );
+}
+
+
+/*
+ * The writer thread is not copied into the child. The child logs
+ * synchronously, and leaves the queued messages to the parent. mutex
+ * is initialized again since it is owned by the thread id of the
+ * parent.
+ */
+static void
+reset_log_writer_in_child() {
+  if ( writer_running ) {
+    writer_running = false;
+    writer_waiting = false;
+    while ( log_rings != NULL ) {
+      log_ring *next = log_rings->next;
+      xfree( log_rings );
+      log_rings = next;
+    }
+    log_ring_generation++;
+    close( writer_event_fd );
+    writer_event_fd = -1;
+  }
+
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init( &attr );
+  pthread_mutexattr_settype( &attr, PTHREAD_MUTEX_RECURSIVE_NP );
+  pthread_mutex_init( &mutex, &attr );
+  pthread_mutexattr_destroy( &attr );
+}
+
+
+static void
+register_log_writer_atfork() {
+  pthread_atfork( prepare_log_writer_fork, resume_log_writer_in_parent, reset_log_writer_in_child );
+}
+
+
+/**
+ * Starts writing log messages from a background thread. Messages are
+ * formatted by the calling thread into a per-thread ring and written
+ * out in batches. When a ring is full, messages are dropped and the
+ * number of dropped messages is logged. Critical messages are still
+ * written synchronously, after the messages queued so far. A child
+ * process forked while the writer runs logs synchronously.
+ *
+ * @return true on success; false otherwise.
+ */
+bool
+start_log_writer() {
+  pthread_once( &log_writer_atfork_once, register_log_writer_atfork );
+
+  pthread_mutex_lock( &mutex );
+
+  if ( writer_running ) {
+    pthread_mutex_unlock( &mutex );
+    return true;
+  }
+
+  writer_event_fd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+  if ( writer_event_fd == -1 ) {
+    pthread_mutex_unlock( &mutex );
+    return false;
+  }
+
+  writer_running = true;
+  if ( pthread_create( &writer_thread, NULL, log_writer_main, NULL ) != 0 ) {
+    writer_running = false;
+    close( writer_event_fd );
+    writer_event_fd = -1;
+    pthread_mutex_unlock( &mutex );
+    return false;
+  }
+
+  pthread_mutex_unlock( &mutex );
+
+  return true;
+}
+
+
+/**
+ * Stops the background writer and writes out all queued messages. No
+ * other thread may be logging while this is called.
+ *
+ * @return true on success; false otherwise.
+ */
+bool
+stop_log_writer() {
+  pthread_mutex_lock( &mutex );
+  if ( !writer_running ) {
+    pthread_mutex_unlock( &mutex );
+    return false;
+  }
+  writer_running = false;
+  pthread_mutex_unlock( &mutex );
+
+  uint64_t one = 1;
+  ssize_t ret = write( writer_event_fd, &one, sizeof( one ) );
+  UNUSED( ret );
+  pthread_join( writer_thread, NULL );
+
+  pthread_mutex_lock( &mutex );
+  drain_log_rings();
+  while ( log_rings != NULL ) {
+    log_ring *next = log_rings->next;
+    xfree( log_rings );
+    log_rings = next;
+  }
+  log_ring_generation++;
+  close( writer_event_fd );
+  writer_event_fd = -1;
+  pthread_mutex_unlock( &mutex );
+
+  return true;
+}
+
+
 static void
 unset_ident_string() {
   memset( ident_string, '\0', sizeof( ident_string ) );
@@ -305,6 +686,10 @@ rename_log( const char *new_ident ) {
  */
 bool
 finalize_log() {
+  if ( writer_running ) {
+    stop_log_writer();
+  }
+
   pthread_mutex_lock( &mutex );
 
   level = -1;
@@ -417,12 +802,18 @@ do_log( int priority, const char *format, va_list ap ) {
       trema_abort();                                    \
     }                                                   \
     if ( get_logging_level() >= _priority ) {           \
-      pthread_mutex_lock( &mutex );                     \
       va_list _args;                                    \
       va_start( _args, _format );                       \
-      do_log( _priority, _format, _args );              \
+      if ( writer_running && _priority > LOG_CRIT ) {   \
+        push_log_record( _priority, _format, _args );   \
+      }                                                 \
+      else {                                            \
+        pthread_mutex_lock( &mutex );                   \
+        drain_log_rings();                              \
+        do_log( _priority, _format, _args );            \
+        pthread_mutex_unlock( &mutex );                 \
+      }                                                 \
       va_end( _args );                                  \
-      pthread_mutex_unlock( &mutex );                   \
     }                                                   \
   } while ( 0 )
 
@@ -51,6 +51,8 @@ bool init_log( const char *ident, const char *log_directory, logging_type type )
 void restart_log( const char *new_ident );
 void rename_log( const char *new_ident );
 bool finalize_log( void );
+bool start_log_writer( void );
+bool stop_log_writer( void );
 
 bool set_logging_level( const char *level );
 extern int ( *get_logging_level )( void );
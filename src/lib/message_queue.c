@@ -152,6 +152,35 @@ peek_message( message_queue *queue ) {
 }
 
 
+/**
+ * Stores up to max_messages messages from the head of the queue in
+ * messages without dequeuing them, and returns how many were stored.
+ */
+unsigned int
+peek_messages( message_queue *queue, buffer **messages, unsigned int max_messages ) {
+  if ( queue == NULL ) {
+    die( "queue must not be NULL" );
+  }
+  assert( messages != NULL );
+
+  if ( queue->divider == queue->tail ) {
+    return 0;
+  }
+
+  message_queue_private *priv = (message_queue_private*)queue;
+  if( !lock_mutex(&priv->mutex) ) {
+    return 0;
+  }
+  unsigned int n_messages = 0;
+  message_queue_element *element;
+  for ( element = queue->divider->next; element != NULL && n_messages < max_messages; element = element->next ) {
+    messages[ n_messages++ ] = element->data;
+  }
+  unlock_mutex(&priv->mutex);
+  return n_messages;
+}
+
+
 void foreach_message_queue( message_queue *queue, void function( buffer *message, void *user_data ),     void *user_data ) {
   if ( queue->divider == queue->tail ) {
     return;
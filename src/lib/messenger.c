@@ -23,6 +23,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <linux/limits.h>
 #include <linux/sockios.h>
 #include <stdio.h>
@@ -30,6 +31,7 @@
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <unistd.h>
 #include "doubly_linked_list.h"
@@ -37,6 +39,7 @@
 #include "hash_table.h"
 #include "log.h"
 #include "messenger.h"
+#include "shm_ring.h"
 #include "timer.h"
 #include "wrapper.h"
 
@@ -94,12 +97,24 @@ extern int mock_accept( int sockfd, struct sockaddr *addr, socklen_t *addrlen );
 #define recv mock_recv
 extern ssize_t mock_recv( int sockfd, void *buf, size_t len, int flags );
 
+#ifdef recvmsg
+#undef recvmsg
+#endif
+#define recvmsg mock_recvmsg
+extern ssize_t mock_recvmsg( int sockfd, struct msghdr *msg, int flags );
+
 #ifdef send
 #undef send
 #endif
 #define send mock_send
 extern ssize_t mock_send( int sockfd, const void *buf, size_t len, int flags );
 
+#ifdef sendmsg
+#undef sendmsg
+#endif
+#define sendmsg mock_sendmsg
+extern ssize_t mock_sendmsg( int sockfd, const struct msghdr *msg, int flags );
+
 #ifdef setsockopt
 #undef setsockopt
 #endif
@@ -143,8 +158,13 @@ enum {
   MESSAGE_TYPE_NOTIFY,
   MESSAGE_TYPE_REQUEST,
   MESSAGE_TYPE_REPLY,
+  MESSAGE_TYPE_SHM_OFFER,  // carries a shared memory ring ( SCM_RIGHTS )
+  MESSAGE_TYPE_SHM_REJECT, // sent back if the ring cannot be attached
 };
 
+// memory fd, notify eventfd and space eventfd of a shm_ring.
+#define MESSENGER_SHM_FDS 3
+
 typedef struct message_buffer {
   void *buffer;
   size_t data_length;
@@ -154,6 +174,10 @@ typedef struct message_buffer {
 
 typedef struct messenger_socket {
   int fd;
+  struct receive_queue *queue;
+  shm_ring *ring;
+  bool draining;
+  bool closed;
 } messenger_socket;
 
 typedef struct messenger_context {
@@ -174,6 +198,8 @@ typedef struct receive_queue {
   struct sockaddr_un listen_addr;
   dlist_element *client_sockets;
   message_buffer *buffer;
+  void *scratch;
+  bool dispatching;
 } receive_queue;
 
 typedef struct send_queue {
@@ -183,19 +209,29 @@ typedef struct send_queue {
   struct timespec reconnect_interval;
   struct sockaddr_un server_addr;
   message_buffer *buffer;
+  message_buffer *control_buffer;
   bool running_timer;
   uint32_t overflow;
   uint64_t overflow_total_length;
+  uint32_t control_overflow;
+  uint64_t control_overflow_total_length;
   int socket_buffer_size;
+  shm_ring *ring;
+  bool shm_rejected;
+  bool congested;
+  bool fenced;
 } send_queue;
 
 
 #define MESSENGER_RECV_BUFFER 100000
 static const uint32_t messenger_send_queue_length = MESSENGER_RECV_BUFFER * 4;
+static const uint32_t messenger_control_queue_length = MESSENGER_RECV_BUFFER;
 static const uint32_t messenger_send_length_for_flush = MESSENGER_RECV_BUFFER;
 static const uint32_t messenger_bucket_size = MESSENGER_RECV_BUFFER;
 static const uint32_t messenger_recv_queue_length = MESSENGER_RECV_BUFFER * 2;
 static const uint32_t messenger_recv_queue_reserved = MESSENGER_RECV_BUFFER;
+static const size_t messenger_shm_ring_size = MESSENGER_RECV_BUFFER * 8;
+static const unsigned int messenger_shm_drain_limit = 1024;
 
 char socket_directory[ PATH_MAX ];
 static bool initialized = false;
@@ -206,11 +242,21 @@ static hash_table *context_db = NULL;
 static char *_dump_service_name = NULL;
 static char *_dump_app_name = NULL;
 static uint32_t last_transaction_id = 0;
+static bool shm_transport_enabled = true;
+static uint32_t control_tags[ ( UINT16_MAX + 1 ) / 32 ];
+static unsigned int send_queue_high_watermark = 0; // percent of the bulk lane
+static unsigned int send_queue_low_watermark = 0;
+static callback_send_queue_pressure send_queue_pressure_callback = NULL;
+static void *send_queue_pressure_user_data = NULL;
 
 static void on_accept( int fd, void *data );
 static void on_recv( int fd, void *data );
 static void on_send_write( int fd, void *data );
 static void on_send_read( int fd, void *data );
+static void on_shm_space( int fd, void *data );
+static void on_shm_recv( int fd, void *data );
+static void on_recv( int fd, void *data );
+static void truncate_message_buffer( message_buffer *buf, size_t len );
 
 static void
 _delete_context( void *key, void *value, void *user_data ) {
@@ -271,6 +317,9 @@ init_messenger( const char *working_directory ) {
 
   strcpy( socket_directory, working_directory );
 
+  const char *shm = getenv( "TREMA_MESSENGER_SHM" );
+  shm_transport_enabled = ( shm == NULL || strcmp( shm, "0" ) != 0 );
+
   receive_queues = create_hash_with_size( compare_string, hash_string, 8 );
   send_queues = create_hash_with_size( compare_string, hash_string, 8 );
   context_db = create_hash_with_size( compare_uint32, hash_uint32, 128 );
@@ -309,13 +358,153 @@ get_message_buffer_head( message_buffer *buf ) {
 }
 
 
+/*
+ * message_buffer is a ring. data_length bytes from head_offset are in
+ * use and may wrap around the end of the buffer.
+ */
+static size_t
+message_buffer_position( message_buffer *buf, size_t offset ) {
+  size_t position = buf->head_offset + offset;
+
+  return position < buf->size ? position : position - buf->size;
+}
+
+
+/**
+ * fills iov with len bytes at offset from the head of message_buffer.
+ * The region may be in use or free. Returns the number of iovecs used.
+ */
+static int
+get_message_buffer_iov( message_buffer *buf, size_t offset, size_t len, struct iovec *iov ) {
+  assert( buf != NULL );
+  assert( offset + len <= buf->size );
+
+  size_t position = message_buffer_position( buf, offset );
+  size_t first = buf->size - position;
+
+  iov[ 0 ].iov_base = ( char * ) buf->buffer + position;
+  if ( first >= len ) {
+    iov[ 0 ].iov_len = len;
+    return 1;
+  }
+  iov[ 0 ].iov_len = first;
+  iov[ 1 ].iov_base = buf->buffer;
+  iov[ 1 ].iov_len = len - first;
+
+  return 2;
+}
+
+
+static void
+read_message_buffer( message_buffer *buf, size_t offset, void *data, size_t len ) {
+  struct iovec iov[ 2 ];
+  int n = get_message_buffer_iov( buf, offset, len, iov );
+
+  memcpy( data, iov[ 0 ].iov_base, iov[ 0 ].iov_len );
+  if ( n == 2 ) {
+    memcpy( ( char * ) data + iov[ 0 ].iov_len, iov[ 1 ].iov_base, iov[ 1 ].iov_len );
+  }
+}
+
+
+/**
+ * returns a pointer to len bytes at offset from the head of
+ * message_buffer. The bytes are copied into scratch only if they wrap
+ * around the end of the buffer.
+ */
+static void *
+get_message_buffer_data( message_buffer *buf, size_t offset, size_t len, void *scratch ) {
+  size_t position = message_buffer_position( buf, offset );
+  if ( position + len <= buf->size ) {
+    return ( char * ) buf->buffer + position;
+  }
+  read_message_buffer( buf, offset, scratch, len );
+
+  return scratch;
+}
+
+
+/**
+ * returns the number of bytes waiting in both lanes of send_queue.
+ */
+static size_t
+send_queue_pending_length( send_queue *sq ) {
+  assert( sq != NULL );
+
+  size_t length = 0;
+  if ( sq->buffer != NULL ) {
+    length += sq->buffer->data_length;
+  }
+  if ( sq->control_buffer != NULL ) {
+    length += sq->control_buffer->data_length;
+  }
+
+  return length;
+}
+
+
+/**
+ * notifies the pressure callback when the bulk lane of send_queue
+ * crosses the high or the low watermark. A queue that is not connected
+ * never counts as congested, so a dead receiver does not stall senders.
+ */
+static void
+update_send_queue_pressure( send_queue *sq ) {
+  assert( sq != NULL );
+
+  if ( send_queue_pressure_callback == NULL || sq->buffer == NULL ) {
+    return;
+  }
+
+  uint64_t used = ( uint64_t ) sq->buffer->data_length * 100;
+  uint64_t size = sq->buffer->size;
+  bool connected = sq->server_socket != -1;
+  if ( !sq->congested ) {
+    if ( connected && used >= size * send_queue_high_watermark ) {
+      sq->congested = true;
+      send_queue_pressure_callback( sq->service_name, true, send_queue_pressure_user_data );
+    }
+  }
+  else if ( !connected || used <= size * send_queue_low_watermark ) {
+    sq->congested = false;
+    send_queue_pressure_callback( sq->service_name, false, send_queue_pressure_user_data );
+  }
+}
+
+
+static void
+delete_send_queue_shm_ring( send_queue *sq ) {
+  assert( sq != NULL );
+  assert( sq->ring != NULL );
+
+  debug( "Deleting a shared memory ring ( service_name = %s, fd = %d ).", sq->service_name, sq->ring->memory_fd );
+
+  set_readable( sq->ring->space_fd, false );
+  delete_fd_handler( sq->ring->space_fd );
+  delete_shm_ring( sq->ring );
+  sq->ring = NULL;
+}
+
+
 static void
 delete_send_queue( send_queue *sq ) {
   assert( NULL != sq );
 
   debug( "Deleting a send queue ( service_name = %s, fd = %d ).", sq->service_name, sq->server_socket );
 
+  if ( sq->congested ) {
+    // Report the relief so that the receiver of the callback does not
+    // keep counting a queue that no longer exists.
+    sq->congested = false;
+    if ( send_queue_pressure_callback != NULL ) {
+      send_queue_pressure_callback( sq->service_name, false, send_queue_pressure_user_data );
+    }
+  }
+  if ( sq->ring != NULL ) {
+    delete_send_queue_shm_ring( sq );
+  }
   free_message_buffer( sq->buffer );
+  free_message_buffer( sq->control_buffer );
   if ( sq->server_socket != -1 ) {
     set_readable( sq->server_socket, false );
     set_writable( sq->server_socket, false );
@@ -414,6 +603,27 @@ send_dump_message( uint16_t dump_type, const char *service_name, const void *dat
 }
 
 
+/**
+ * releases a client socket and its shared memory ring. If the ring is
+ * being drained, releasing is deferred until draining returns.
+ */
+static void
+delete_messenger_socket( messenger_socket *socket ) {
+  assert( socket != NULL );
+
+  if ( socket->draining ) {
+    socket->closed = true;
+    return;
+  }
+  if ( socket->ring != NULL ) {
+    set_readable( socket->ring->notify_fd, false );
+    delete_fd_handler( socket->ring->notify_fd );
+    delete_shm_ring( socket->ring );
+  }
+  xfree( socket );
+}
+
+
 /**
  * closes accepted sockets and listening socket, and releases memories.
  */
@@ -443,7 +653,7 @@ delete_receive_queue( void *service_name, void *_rq, void *user_data ) {
     delete_fd_handler( client_socket->fd );
 
     close( client_socket->fd );
-    xfree( client_socket );
+    delete_messenger_socket( client_socket );
     send_dump_message( MESSENGER_DUMP_RECV_CLOSED, rq->service_name, NULL, 0 );
   }
   delete_dlist( rq->client_sockets );
@@ -453,6 +663,7 @@ delete_receive_queue( void *service_name, void *_rq, void *user_data ) {
 
   close( rq->listen_socket );
   free_message_buffer( rq->buffer );
+  xfree( rq->scratch );
   unlink( rq->listen_addr.sun_path );
 
   if ( receive_queues != NULL ) {
@@ -505,6 +716,8 @@ finalize_messenger() {
   if ( context_db != NULL ) {
     delete_context_db();
   }
+  send_queue_pressure_callback = NULL;
+  send_queue_pressure_user_data = NULL;
 
   initialized = false;
   finalized = true;
@@ -593,6 +806,8 @@ create_receive_queue( const char *service_name ) {
   rq->message_callbacks = create_dlist();
   rq->client_sockets = create_dlist();
   rq->buffer = create_message_buffer( messenger_recv_queue_length );
+  rq->scratch = xmalloc( messenger_recv_queue_length );
+  rq->dispatching = false;
 
   insert_hash_entry( receive_queues, rq->service_name, rq );
 
@@ -790,6 +1005,87 @@ message_buffer_remain_bytes( message_buffer *buf ) {
 }
 
 
+static bool
+send_shm_offer( send_queue *sq, shm_ring *ring ) {
+  message_header header;
+  header.version = 0;
+  header.message_type = MESSAGE_TYPE_SHM_OFFER;
+  header.tag = 0;
+  header.message_length = htonl( ( uint32_t ) sizeof( message_header ) );
+
+  int fds[ MESSENGER_SHM_FDS ] = { ring->memory_fd, ring->notify_fd, ring->space_fd };
+  union {
+    struct cmsghdr align;
+    char buf[ CMSG_SPACE( sizeof( fds ) ) ];
+  } control;
+  memset( &control, 0, sizeof( control ) );
+
+  struct iovec iov;
+  iov.iov_base = &header;
+  iov.iov_len = sizeof( message_header );
+  struct msghdr msg;
+  memset( &msg, 0, sizeof( msg ) );
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof( control.buf );
+
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR( &msg );
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN( sizeof( fds ) );
+  memcpy( CMSG_DATA( cmsg ), fds, sizeof( fds ) );
+
+  ssize_t ret = sendmsg( sq->server_socket, &msg, MSG_DONTWAIT );
+  if ( ret != ( ssize_t ) sizeof( message_header ) ) {
+    debug( "Failed to offer a shared memory ring ( service_name = %s, fd = %d, errno = %s [%d] ).",
+           sq->service_name, sq->server_socket, strerror( errno ), errno );
+    return false;
+  }
+
+  return true;
+}
+
+
+/**
+ * switches a connected send_queue to a shared memory ring. The ring is
+ * offered only when nothing is left in the socket path, so that the
+ * receiver sees the messages in order.
+ */
+static void
+offer_shm_ring( send_queue *sq ) {
+  assert( sq != NULL );
+
+  if ( !shm_transport_enabled || sq->shm_rejected || sq->ring != NULL || sq->server_socket == -1 ) {
+    return;
+  }
+  if ( sq->buffer != NULL && sq->buffer->data_length > 0 ) {
+    return;
+  }
+  if ( _dump_service_name != NULL && strcmp( sq->service_name, _dump_service_name ) == 0 ) {
+    return;
+  }
+
+  shm_ring *ring = create_shm_ring( messenger_shm_ring_size );
+  if ( ring == NULL ) {
+    sq->shm_rejected = true;
+    return;
+  }
+  if ( !send_shm_offer( sq, ring ) ) {
+    delete_shm_ring( ring );
+    sq->shm_rejected = true;
+    return;
+  }
+
+  debug( "Sending messages through a shared memory ring ( service_name = %s, fd = %d ).",
+         sq->service_name, ring->memory_fd );
+
+  sq->ring = ring;
+  set_fd_handler( ring->space_fd, on_shm_space, sq, NULL, NULL );
+  set_readable( ring->space_fd, true );
+}
+
+
 /**
  * connects send_queue to the service
  * return value: -1:error, 0:refused (retry), 1:connected
@@ -836,7 +1132,7 @@ send_queue_connect( send_queue *sq ) {
   set_fd_handler( sq->server_socket, on_send_read, sq, &on_send_write, sq );
   set_readable( sq->server_socket, true );
 
-  if ( sq->buffer != NULL && sq->buffer->data_length >= sizeof( message_header ) ) {
+  if ( send_queue_pending_length( sq ) >= sizeof( message_header ) ) {
     set_writable( sq->server_socket, true );
   }
 
@@ -850,6 +1146,8 @@ send_queue_connect( send_queue *sq ) {
 
   send_dump_message( MESSENGER_DUMP_SEND_CONNECTED, sq->service_name, NULL, 0 );
 
+  offer_shm_ring( sq );
+
   return 1;
 }
 
@@ -959,13 +1257,20 @@ create_send_queue( const char *service_name ) {
 
   sq->server_socket = -1;
   sq->buffer = NULL;
+  sq->control_buffer = NULL;
   sq->refused_count = 0;
   sq->reconnect_interval.tv_sec = 0;
   sq->reconnect_interval.tv_nsec = 0;
   sq->running_timer = false;
   sq->overflow = 0;
   sq->overflow_total_length = 0;
+  sq->control_overflow = 0;
+  sq->control_overflow_total_length = 0;
   sq->socket_buffer_size = 0;
+  sq->ring = NULL;
+  sq->shm_rejected = false;
+  sq->congested = false;
+  sq->fenced = false;
 
   if ( send_queue_try_connect( sq ) == -1 ) {
     xfree( sq );
@@ -974,6 +1279,7 @@ create_send_queue( const char *service_name ) {
   }
 
   sq->buffer = create_message_buffer( messenger_send_queue_length );
+  sq->control_buffer = create_message_buffer( messenger_control_queue_length );
 
   insert_hash_entry( send_queues, sq->service_name, sq );
 
@@ -989,26 +1295,208 @@ write_message_buffer( message_buffer *buf, const void *data, size_t len ) {
     return false;
   }
 
-  if ( ( buf->head_offset + buf->data_length + len ) <= buf->size ) {
-    memcpy( ( char * ) get_message_buffer_head( buf ) + buf->data_length, data, len );
+  struct iovec iov[ 2 ];
+  int n = get_message_buffer_iov( buf, buf->data_length, len, iov );
+  memcpy( iov[ 0 ].iov_base, data, iov[ 0 ].iov_len );
+  if ( n == 2 ) {
+    memcpy( iov[ 1 ].iov_base, ( const char * ) data + iov[ 0 ].iov_len, iov[ 1 ].iov_len );
+  }
+  buf->data_length += len;
+
+  return true;
+}
+
+
+/**
+ * sends a copy of len bytes at offset from the head of message_buffer
+ * to the dump service.
+ */
+static void
+dump_message_buffer( uint16_t dump_type, const char *service_name, message_buffer *buf, size_t offset, size_t len ) {
+  if ( !messenger_dump_enabled() ) {
+    return;
+  }
+
+  void *scratch = NULL;
+  if ( message_buffer_position( buf, offset ) + len > buf->size ) {
+    scratch = xmalloc( len );
+  }
+  send_dump_message( dump_type, service_name, get_message_buffer_data( buf, offset, len, scratch ), ( uint32_t ) len );
+  if ( scratch != NULL ) {
+    xfree( scratch );
+  }
+}
+
+
+/*
+ * A fence in the bulk lane must not reach the shared memory ring before
+ * the control messages queued ahead of it reach the socket, since the
+ * receiver handles the socket first.
+ */
+static bool
+fence_is_blocked( send_queue *sq ) {
+  return sq->fenced && sq->control_buffer->data_length > 0;
+}
+
+
+static bool
+bulk_lane_is_empty( send_queue *sq ) {
+  return sq->buffer->data_length == 0 && ( sq->ring == NULL || shm_ring_is_empty( sq->ring ) );
+}
+
+
+/**
+ * moves messages queued in send_queue into its shared memory ring
+ * until the ring becomes full.
+ */
+static void
+flush_send_queue_to_shm_ring( send_queue *sq ) {
+  assert( sq != NULL );
+  assert( sq->ring != NULL );
+
+  while ( sq->buffer->data_length >= sizeof( message_header ) && !fence_is_blocked( sq ) ) {
+    message_header header;
+    read_message_buffer( sq->buffer, 0, &header, sizeof( message_header ) );
+    uint32_t length = ntohl( header.message_length );
+    assert( length >= sizeof( message_header ) );
+    assert( length <= sq->buffer->data_length );
+
+    void *record = reserve_shm_ring( sq->ring, length );
+    if ( record == NULL ) {
+      // on_shm_space() resumes when the receiver has released space.
+      break;
+    }
+    read_message_buffer( sq->buffer, 0, record, length );
+    commit_shm_ring( sq->ring );
+    send_dump_message( MESSENGER_DUMP_SENT, sq->service_name, record, length );
+    truncate_message_buffer( sq->buffer, length );
+  }
+
+  update_send_queue_pressure( sq );
+}
+
+
+static void
+on_shm_space( int fd, void *data ) {
+  send_queue *sq = data;
+
+  assert( sq != NULL );
+
+  clear_shm_ring_notification( fd );
+  if ( sq->ring != NULL ) {
+    flush_send_queue_to_shm_ring( sq );
+  }
+}
+
+
+/**
+ * moves the messages that the receiver has not taken from the shared
+ * memory ring back to the socket path.
+ */
+static void
+fall_back_to_socket( send_queue *sq ) {
+  assert( sq != NULL );
+  assert( sq->ring != NULL );
+
+  warn( "Shared memory ring is rejected. Falling back to socket ( service_name = %s ).", sq->service_name );
+
+  message_buffer *pending = create_message_buffer( sq->ring->header->size + sq->buffer->size );
+  void *record;
+  size_t length;
+  while ( ( record = peek_shm_ring( sq->ring, &length ) ) != NULL ) {
+    write_message_buffer( pending, record, length );
+    consume_shm_ring( sq->ring );
+  }
+  struct iovec iov[ 2 ];
+  int iovcnt = get_message_buffer_iov( sq->buffer, 0, sq->buffer->data_length, iov );
+  for ( int i = 0; i < iovcnt; i++ ) {
+    write_message_buffer( pending, iov[ i ].iov_base, iov[ i ].iov_len );
+  }
+  free_message_buffer( sq->buffer );
+  sq->buffer = pending;
+
+  delete_send_queue_shm_ring( sq );
+  sq->shm_rejected = true;
+
+  if ( sq->buffer->data_length > 0 ) {
+    set_writable( sq->server_socket, true );
+  }
+  update_send_queue_pressure( sq );
+}
+
+
+bool
+set_message_tag_priority( uint16_t tag, int priority ) {
+  if ( priority != MESSENGER_PRIORITY_BULK && priority != MESSENGER_PRIORITY_CONTROL ) {
+    error( "Invalid message priority ( tag = %#x, priority = %d ).", tag, priority );
+    return false;
+  }
+
+  if ( priority == MESSENGER_PRIORITY_CONTROL ) {
+    control_tags[ tag / 32 ] |= 1U << ( tag % 32 );
   }
   else {
-    memmove( buf->buffer, ( char * ) get_message_buffer_head( buf ), buf->data_length );
-    buf->head_offset = 0;
-    memcpy( ( char * ) buf->buffer + buf->data_length, data, len );
+    control_tags[ tag / 32 ] &= ~( 1U << ( tag % 32 ) );
   }
-  buf->data_length += len;
+
+  return true;
+}
+
+
+int
+get_message_tag_priority( uint16_t tag ) {
+  if ( ( control_tags[ tag / 32 ] & ( 1U << ( tag % 32 ) ) ) != 0 ) {
+    return MESSENGER_PRIORITY_CONTROL;
+  }
+
+  return MESSENGER_PRIORITY_BULK;
+}
+
+
+bool
+set_send_queue_watermarks( unsigned int high_percent, unsigned int low_percent, callback_send_queue_pressure callback, void *user_data ) {
+  if ( callback != NULL && ( high_percent == 0 || high_percent > 100 || low_percent >= high_percent ) ) {
+    error( "Invalid send queue watermarks ( high = %u%%, low = %u%% ).", high_percent, low_percent );
+    return false;
+  }
+
+  send_queue_high_watermark = high_percent;
+  send_queue_low_watermark = low_percent;
+  send_queue_pressure_callback = callback;
+  send_queue_pressure_user_data = user_data;
+
+  return true;
+}
+
+
+bool
+get_send_queue_occupancy( const char *service_name, size_t *length, size_t *size ) {
+  assert( service_name != NULL );
+  assert( length != NULL );
+  assert( size != NULL );
+
+  if ( send_queues == NULL ) {
+    return false;
+  }
+  send_queue *sq = lookup_hash_entry( send_queues, service_name );
+  if ( sq == NULL || sq->buffer == NULL ) {
+    return false;
+  }
+
+  *length = sq->buffer->data_length;
+  *size = sq->buffer->size;
 
   return true;
 }
 
 
 static bool
-push_message_to_send_queue( const char *service_name, const uint8_t message_type, const uint16_t tag, const void *data, size_t len ) {
+push_message_to_send_queue( const char *service_name, const uint8_t message_type, const uint16_t tag, const void *data, size_t len, int priority ) {
   assert( service_name != NULL );
+  assert( priority >= MESSENGER_PRIORITY_BULK && priority < MESSENGER_PRIORITY_MAX );
 
-  debug( "Pushing a message to send queue ( service_name = %s, message_type = %#x, tag = %#x, data = %p, len = %u ).",
-         service_name, message_type, tag, data, len );
+  debug( "Pushing a message to send queue ( service_name = %s, message_type = %#x, tag = %#x, data = %p, len = %u, priority = %d ).",
+         service_name, message_type, tag, data, len, priority );
 
   message_header header;
 
@@ -1024,29 +1512,88 @@ push_message_to_send_queue( const char *service_name, const uint8_t message_type
     assert( sq != NULL );
   }
 
+  // A fence goes through the bulk lane, and so do control messages
+  // after it until the bulk lane has been taken by the receiver.
+  if ( priority == MESSENGER_PRIORITY_FENCE ) {
+    sq->fenced = true;
+    priority = MESSENGER_PRIORITY_BULK;
+  }
+  else if ( priority == MESSENGER_PRIORITY_CONTROL && sq->fenced ) {
+    if ( bulk_lane_is_empty( sq ) ) {
+      sq->fenced = false;
+    }
+    else {
+      priority = MESSENGER_PRIORITY_BULK;
+    }
+  }
+
   header.version = 0;
   header.message_type = message_type;
   header.tag = htons( tag );
   uint32_t length = ( uint32_t ) ( sizeof( message_header ) + len );
   header.message_length = htonl( length );
 
-  if ( message_buffer_remain_bytes( sq->buffer ) < length ) {
-    if ( sq->overflow == 0 ) {
-      warn( "Could not write a message to send queue due to overflow ( service_name = %s, fd = %u, length = %u ).", sq->service_name, sq->server_socket, length );
+  // Each lane has its own buffer and overflow accounting, so bulk
+  // traffic never takes space from control traffic.
+  message_buffer *buffer = sq->buffer;
+  uint32_t *overflow = &sq->overflow;
+  uint64_t *overflow_total_length = &sq->overflow_total_length;
+  if ( priority == MESSENGER_PRIORITY_CONTROL ) {
+    buffer = sq->control_buffer;
+    overflow = &sq->control_overflow;
+    overflow_total_length = &sq->control_overflow_total_length;
+  }
+
+  if ( message_buffer_remain_bytes( buffer ) < length ) {
+    if ( *overflow == 0 ) {
+      warn( "Could not write a message to send queue due to overflow ( service_name = %s, fd = %u, length = %u, priority = %d ).", sq->service_name, sq->server_socket, length, priority );
     }
-    ++sq->overflow;
-    sq->overflow_total_length += length;
+    ++( *overflow );
+    *overflow_total_length += length;
     send_dump_message( MESSENGER_DUMP_SEND_OVERFLOW, sq->service_name, NULL, 0 );
+    if ( priority == MESSENGER_PRIORITY_BULK ) {
+      update_send_queue_pressure( sq );
+    }
     return false;
   }
-  if ( sq->overflow > 1 ) {
-    warn( "Could not write a message to send queue due to overflow ( service_name = %s, fd = %u, count = %u, total length = %" PRIu64 " ).", sq->service_name, sq->server_socket, sq->overflow, sq->overflow_total_length );
+  if ( *overflow > 1 ) {
+    warn( "Could not write a message to send queue due to overflow ( service_name = %s, fd = %u, count = %u, total length = %" PRIu64 ", priority = %d ).", sq->service_name, sq->server_socket, *overflow, *overflow_total_length, priority );
+  }
+  *overflow = 0;
+  *overflow_total_length = 0;
+
+  if ( priority == MESSENGER_PRIORITY_CONTROL ) {
+    // Control messages always go through the socket, which the receiver
+    // polls independently of the bulk traffic in the ring.
+    write_message_buffer( buffer, &header, sizeof( message_header ) );
+    write_message_buffer( buffer, data, len );
+    if ( sq->server_socket == -1 ) {
+      send_queue_try_connect( sq );
+      return true;
+    }
+    set_writable( sq->server_socket, true );
+    return true;
+  }
+
+  if ( sq->ring != NULL && sq->buffer->data_length == 0 && !fence_is_blocked( sq ) ) {
+    message_header *record = reserve_shm_ring( sq->ring, length );
+    if ( record != NULL ) {
+      memcpy( record, &header, sizeof( message_header ) );
+      memcpy( record->value, data, len );
+      commit_shm_ring( sq->ring );
+      send_dump_message( MESSENGER_DUMP_SENT, sq->service_name, record, length );
+      return true;
+    }
   }
-  sq->overflow = 0;
-  sq->overflow_total_length = 0;
 
   write_message_buffer( sq->buffer, &header, sizeof( message_header ) );
   write_message_buffer( sq->buffer, data, len );
+  update_send_queue_pressure( sq );
+
+  if ( sq->ring != NULL ) {
+    flush_send_queue_to_shm_ring( sq );
+    return true;
+  }
 
   if ( sq->server_socket == -1 ) {
     debug( "Tried to send message on closed send queue, connecting..." );
@@ -1070,11 +1617,28 @@ _send_message( const char *service_name, const uint16_t tag, const void *data, s
   debug( "Sending a message ( service_name = %s, tag = %#x, data = %p, len = %u ).",
          service_name, tag, data, len );
 
-  return push_message_to_send_queue( service_name, MESSAGE_TYPE_NOTIFY, tag, data, len );
+  return push_message_to_send_queue( service_name, MESSAGE_TYPE_NOTIFY, tag, data, len, get_message_tag_priority( tag ) );
 }
 bool ( *send_message )( const char *service_name, const uint16_t tag, const void *data, size_t len ) = _send_message;
 
 
+static bool
+_send_message_with_priority( const char *service_name, const uint16_t tag, const void *data, size_t len, int priority ) {
+  assert( service_name != NULL );
+
+  debug( "Sending a message ( service_name = %s, tag = %#x, data = %p, len = %u, priority = %d ).",
+         service_name, tag, data, len, priority );
+
+  if ( priority < MESSENGER_PRIORITY_BULK || priority >= MESSENGER_PRIORITY_MAX ) {
+    error( "Invalid message priority ( service_name = %s, priority = %d ).", service_name, priority );
+    return false;
+  }
+
+  return push_message_to_send_queue( service_name, MESSAGE_TYPE_NOTIFY, tag, data, len, priority );
+}
+bool ( *send_message_with_priority )( const char *service_name, const uint16_t tag, const void *data, size_t len, int priority ) = _send_message_with_priority;
+
+
 static messenger_context *
 insert_context( void *user_data ) {
   messenger_context *context = xmalloc( sizeof( messenger_context ) );
@@ -1120,7 +1684,8 @@ _send_request_message( const char *to_service_name, const char *from_service_nam
   p = request_data + handle_len;
   memcpy( p, data, len );
 
-  return_value = push_message_to_send_queue( to_service_name, MESSAGE_TYPE_REQUEST, tag, request_data, handle_len + len );
+  return_value = push_message_to_send_queue( to_service_name, MESSAGE_TYPE_REQUEST, tag, request_data, handle_len + len,
+                                             get_message_tag_priority( tag ) );
 
   xfree( request_data );
 
@@ -1147,7 +1712,8 @@ _send_reply_message( const messenger_context_handle *handle, const uint16_t tag,
   reply_handle->service_name_len = htons( 0 );
   memcpy( reply_handle->service_name, data, len );
 
-  return_value = push_message_to_send_queue( handle->service_name, MESSAGE_TYPE_REPLY, tag, reply_data, sizeof( messenger_context_handle ) + len );
+  return_value = push_message_to_send_queue( handle->service_name, MESSAGE_TYPE_REPLY, tag, reply_data, sizeof( messenger_context_handle ) + len,
+                                             get_message_tag_priority( tag ) );
 
   xfree( reply_data );
 
@@ -1179,12 +1745,15 @@ _clear_send_queue( const char *service_name ) {
     return false;
   }
 
-  if ( sq->buffer->data_length > 0 ) {
+  if ( send_queue_pending_length( sq ) > 0 ) {
     set_writable( sq->server_socket, false );
   }
 
   sq->buffer->head_offset = 0;
   sq->buffer->data_length = 0;
+  sq->control_buffer->head_offset = 0;
+  sq->control_buffer->data_length = 0;
+  update_send_queue_pressure( sq );
 
   return true;
 }
@@ -1217,7 +1786,7 @@ number_of_send_queue( int *connected_count, int *sending_count, int *reconnectin
   while ( ( e = iterate_hash_next( &iter ) ) != NULL ) {
     send_queue *sq = e->value;
     if ( sq->server_socket != -1 ) {
-      if ( sq->buffer->data_length == 0 ) {
+      if ( send_queue_pending_length( sq ) == 0 ) {
           ( *connected_count )++;
       }
       else {
@@ -1250,6 +1819,10 @@ add_recv_queue_client_fd( receive_queue *rq, int fd ) {
 
   socket = xmalloc( sizeof( messenger_socket ) );
   socket->fd = fd;
+  socket->queue = rq;
+  socket->ring = NULL;
+  socket->draining = false;
+  socket->closed = false;
   insert_after_dlist( rq->client_sockets, socket );
 
   set_fd_handler( fd, on_recv, rq, NULL, NULL );
@@ -1312,7 +1885,7 @@ del_recv_queue_client_fd( receive_queue *rq, int fd ) {
 
       debug( "Deleting fd ( %d ).", fd );
       delete_dlist_element( element );
-      xfree( socket );
+      delete_messenger_socket( socket );
       return 1;
     }
   }
@@ -1321,6 +1894,21 @@ del_recv_queue_client_fd( receive_queue *rq, int fd ) {
 }
 
 
+static messenger_socket *
+lookup_recv_queue_client( receive_queue *rq, int fd ) {
+  assert( rq != NULL );
+
+  for ( dlist_element *element = rq->client_sockets->next; element; element = element->next ) {
+    messenger_socket *socket = element->data;
+    if ( socket->fd == fd ) {
+      return socket;
+    }
+  }
+
+  return NULL;
+}
+
+
 static void
 truncate_message_buffer( message_buffer *buf, size_t len ) {
   assert( buf != NULL );
@@ -1333,23 +1921,22 @@ truncate_message_buffer( message_buffer *buf, size_t len ) {
     len = buf->data_length;
   }
 
-  if ( ( buf->head_offset + len ) <= buf->size ) {
-    buf->head_offset += len;
-  }
-  else {
-    memmove( buf->buffer, ( char * ) buf->buffer + buf->head_offset + len, buf->data_length - len );
+  buf->head_offset = message_buffer_position( buf, len );
+  buf->data_length -= len;
+  if ( buf->data_length == 0 ) {
     buf->head_offset = 0;
   }
-  buf->data_length -= len;
 }
 
 
 /**
- * pulls message data from recv_queue.
+ * pulls message data from recv_queue. *data points into the receive
+ * queue, or to rq->scratch if the message wraps around the end of the
+ * queue. The message stays in the queue until it is truncated.
  * returns 1 if succeeded, otherwise 0.
  */
 static int
-pull_from_recv_queue( receive_queue *rq, uint8_t *message_type, uint16_t *tag, void *data, size_t *len, size_t maxlen ) {
+pull_from_recv_queue( receive_queue *rq, uint8_t *message_type, uint16_t *tag, void **data, size_t *len ) {
   assert( rq != NULL );
   assert( message_type != NULL );
   assert( tag != NULL );
@@ -1358,16 +1945,16 @@ pull_from_recv_queue( receive_queue *rq, uint8_t *message_type, uint16_t *tag, v
 
   debug( "Pulling a message from receive queue ( service_name = %s ).", rq->service_name );
 
-  message_header *header;
+  message_header header;
 
   if ( rq->buffer->data_length < sizeof( message_header ) ) {
     debug( "Queue length is smaller than a message header ( queue length = %u ).", rq->buffer->data_length );
     return 0;
   }
 
-  header = ( message_header * ) get_message_buffer_head( rq->buffer );
+  read_message_buffer( rq->buffer, 0, &header, sizeof( message_header ) );
 
-  uint32_t length = ntohl( header->message_length );
+  uint32_t length = ntohl( header.message_length );
   assert( length != 0 );
   assert( length < messenger_recv_queue_length );
   if ( rq->buffer->data_length < length ) {
@@ -1376,14 +1963,13 @@ pull_from_recv_queue( receive_queue *rq, uint8_t *message_type, uint16_t *tag, v
     return 0;
   }
 
-  *message_type = header->message_type;
-  *tag = ntohs( header->tag );
+  *message_type = header.message_type;
+  *tag = ntohs( header.tag );
   *len = length - sizeof( message_header );
-  memcpy( data, header->value, *len > maxlen ? maxlen : *len );
-  truncate_message_buffer( rq->buffer, length );
+  *data = get_message_buffer_data( rq->buffer, sizeof( message_header ), *len, rq->scratch );
 
   debug( "A message is retrieved from receive queue ( message_type = %#x, tag = %#x, len = %u, data = %p ).",
-         *message_type, *tag, *len, data );
+         *message_type, *tag, *len, *data );
 
   return 1;
 }
@@ -1479,6 +2065,224 @@ call_message_callbacks( receive_queue *rq, const uint8_t message_type, const uin
 }
 
 
+/**
+ * receives a packet into iov and the descriptors passed along with it.
+ * *truncated is set if the packet did not fit in iov.
+ */
+static ssize_t
+recv_message_and_fds( int fd, struct iovec *iov, int iovcnt, int *fds, size_t *n_fds, bool *truncated ) {
+  union {
+    struct cmsghdr align;
+    char buf[ CMSG_SPACE( sizeof( int ) * MESSENGER_SHM_FDS ) ];
+  } control;
+
+  struct msghdr msg;
+  memset( &msg, 0, sizeof( msg ) );
+  msg.msg_iov = iov;
+  msg.msg_iovlen = ( size_t ) iovcnt;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof( control.buf );
+
+  *n_fds = 0;
+  *truncated = false;
+  ssize_t ret = recvmsg( fd, &msg, MSG_CMSG_CLOEXEC );
+  if ( ret <= 0 ) {
+    return ret;
+  }
+  *truncated = ( msg.msg_flags & MSG_TRUNC ) != 0;
+
+  for ( struct cmsghdr *cmsg = CMSG_FIRSTHDR( &msg ); cmsg != NULL; cmsg = CMSG_NXTHDR( &msg, cmsg ) ) {
+    if ( cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ) {
+      continue;
+    }
+    size_t n = ( cmsg->cmsg_len - CMSG_LEN( 0 ) ) / sizeof( int );
+    for ( size_t i = 0; i < n; i++ ) {
+      int received;
+      memcpy( &received, CMSG_DATA( cmsg ) + i * sizeof( int ), sizeof( int ) );
+      if ( *n_fds < MESSENGER_SHM_FDS ) {
+        fds[ ( *n_fds )++ ] = received;
+      }
+      else {
+        close( received );
+      }
+    }
+  }
+
+  return ret;
+}
+
+
+/**
+ * attaches the shared memory ring offered by a sender. Messages in the
+ * ring are handled after the ones received through the socket so far.
+ */
+static void
+accept_shm_ring( receive_queue *rq, int fd, message_header header, int *fds, size_t n_fds ) {
+  assert( rq != NULL );
+
+  messenger_socket *socket = lookup_recv_queue_client( rq, fd );
+  shm_ring *ring = NULL;
+  if ( socket != NULL && socket->ring == NULL && header.message_type == MESSAGE_TYPE_SHM_OFFER && n_fds == MESSENGER_SHM_FDS ) {
+    ring = attach_shm_ring( fds[ 0 ], fds[ 1 ], fds[ 2 ] );
+  }
+  if ( ring == NULL ) {
+    warn( "Rejecting a shared memory ring ( service_name = %s, fd = %d ).", rq->service_name, fd );
+    for ( size_t i = 0; i < n_fds; i++ ) {
+      close( fds[ i ] );
+    }
+    header.version = 0;
+    header.message_type = MESSAGE_TYPE_SHM_REJECT;
+    header.tag = 0;
+    header.message_length = htonl( ( uint32_t ) sizeof( message_header ) );
+    if ( send( fd, &header, sizeof( message_header ), MSG_DONTWAIT ) == -1 ) {
+      error( "Failed to reject a shared memory ring ( fd = %d, errno = %s [%d] ).", fd, strerror( errno ), errno );
+    }
+    return;
+  }
+
+  debug( "Receiving messages through a shared memory ring ( service_name = %s, fd = %d ).", rq->service_name, fd );
+
+  socket->ring = ring;
+  set_fd_handler( ring->notify_fd, on_shm_recv, socket, NULL, NULL );
+  set_readable( ring->notify_fd, true );
+}
+
+
+/**
+ * takes the shared memory ring offer out of the recv_len bytes just
+ * received into the free space of recv_queue. A stream may return the
+ * bytes of earlier messages along with the offer, so the offer is looked
+ * up at its message boundary and the bytes around it are kept in order.
+ * *offer is zeroed if no offer is found.
+ * returns the number of received bytes left in the queue.
+ */
+static size_t
+take_shm_offer( receive_queue *rq, size_t recv_len, message_header *offer ) {
+  assert( rq != NULL );
+  assert( offer != NULL );
+
+  message_buffer *buf = rq->buffer;
+  size_t end = buf->data_length + recv_len;
+  size_t offset = 0;
+
+  memset( offer, 0, sizeof( message_header ) );
+  while ( offset + sizeof( message_header ) <= end ) {
+    message_header header;
+    read_message_buffer( buf, offset, &header, sizeof( message_header ) );
+    uint32_t length = ntohl( header.message_length );
+    if ( length < sizeof( message_header ) ) {
+      break;
+    }
+    if ( offset >= buf->data_length && header.message_type == MESSAGE_TYPE_SHM_OFFER && length == sizeof( message_header ) ) {
+      *offer = header;
+      size_t rest = end - offset - sizeof( message_header );
+      if ( rest > 0 ) {
+        void *bytes = xmalloc( rest );
+        read_message_buffer( buf, offset + sizeof( message_header ), bytes, rest );
+        struct iovec iov[ 2 ];
+        int n = get_message_buffer_iov( buf, offset, rest, iov );
+        memcpy( iov[ 0 ].iov_base, bytes, iov[ 0 ].iov_len );
+        if ( n == 2 ) {
+          memcpy( iov[ 1 ].iov_base, ( char * ) bytes + iov[ 0 ].iov_len, iov[ 1 ].iov_len );
+        }
+        xfree( bytes );
+      }
+      return recv_len - sizeof( message_header );
+    }
+    offset += length;
+  }
+
+  return recv_len;
+}
+
+
+/**
+ * handles up to limit messages in the shared memory ring of a client
+ * socket in place.
+ */
+static void
+drain_shm_ring( messenger_socket *socket, unsigned int limit ) {
+  assert( socket != NULL );
+  assert( socket->ring != NULL );
+
+  receive_queue *rq = socket->queue;
+  unsigned int count = 0;
+
+  socket->draining = true;
+  while ( !socket->closed ) {
+    size_t length;
+    message_header *header = peek_shm_ring( socket->ring, &length );
+    if ( header == NULL ) {
+      if ( wait_shm_ring( socket->ring ) ) {
+        break;
+      }
+      continue;
+    }
+    if ( count++ >= limit ) {
+      // Let other events in; come back through notify_fd.
+      wakeup_shm_ring_consumer( socket->ring );
+      break;
+    }
+    if ( length < sizeof( message_header ) || ntohl( header->message_length ) != length ) {
+      error( "Invalid message in shared memory ring ( service_name = %s, length = %zu ).", rq->service_name, length );
+      consume_shm_ring( socket->ring );
+      continue;
+    }
+
+    send_dump_message( MESSENGER_DUMP_RECEIVED, rq->service_name, header, ( uint32_t ) length );
+    call_message_callbacks( rq, header->message_type, ntohs( header->tag ), header->value, length - sizeof( message_header ) );
+    if ( !socket->closed ) {
+      consume_shm_ring( socket->ring );
+    }
+  }
+  socket->draining = false;
+
+  if ( socket->closed ) {
+    delete_messenger_socket( socket );
+  }
+}
+
+
+static void
+on_shm_recv( int fd, void *data ) {
+  messenger_socket *socket = data;
+
+  assert( socket != NULL );
+
+  clear_shm_ring_notification( fd );
+  // Messages written to the socket before the records in the ring are
+  // handled first. on_recv() drains the ring afterwards.
+  on_recv( socket->fd, socket->queue );
+}
+
+
+/**
+ * calls the callbacks for the messages in recv_queue. Messages that
+ * arrive while a callback runs ( e.g. from flush_messenger() ) are
+ * handled by the outermost call.
+ */
+static void
+dispatch_recv_queue( receive_queue *rq ) {
+  assert( rq != NULL );
+
+  if ( rq->dispatching ) {
+    return;
+  }
+
+  uint8_t message_type;
+  uint16_t tag;
+  void *data;
+  size_t len;
+
+  rq->dispatching = true;
+  while ( pull_from_recv_queue( rq, &message_type, &tag, &data, &len ) == 1 ) {
+    call_message_callbacks( rq, message_type, tag, data, len );
+    truncate_message_buffer( rq->buffer, sizeof( message_header ) + len );
+  }
+  rq->dispatching = false;
+}
+
+
 static void
 on_recv( int fd, void *data ) {
   receive_queue *rq = ( receive_queue* )data;
@@ -1488,23 +2292,26 @@ on_recv( int fd, void *data ) {
 
   debug( "Receiving data from remote ( fd = %d, service_name = %s ).", fd, rq->service_name );
 
-  uint8_t buf[ MESSENGER_RECV_BUFFER ];
   ssize_t recv_len;
   size_t buf_len;
-  uint8_t message_type;
-  uint16_t tag;
+  bool closed = false;
 
+  // Packets are received straight into the free space of the receive
+  // queue, which may wrap around the end of the buffer.
   while ( ( buf_len = message_buffer_remain_bytes( rq->buffer ) ) > messenger_recv_queue_reserved ) {
-    if ( buf_len > sizeof( buf ) ) {
-      buf_len = sizeof( buf );
+    if ( buf_len > MESSENGER_RECV_BUFFER ) {
+      buf_len = MESSENGER_RECV_BUFFER;
     }
-    recv_len = recv( fd, buf, buf_len, 0 );
+    struct iovec iov[ 2 ];
+    int iovcnt = get_message_buffer_iov( rq->buffer, rq->buffer->data_length, buf_len, iov );
+    int fds[ MESSENGER_SHM_FDS ];
+    size_t n_fds = 0;
+    bool truncated = false;
+    recv_len = recv_message_and_fds( fd, iov, iovcnt, fds, &n_fds, &truncated );
     if ( recv_len == -1 ) {
       if ( errno != EAGAIN && errno != EWOULDBLOCK ) {
         error( "Failed to recv ( fd = %d, errno = %s [%d] ).", fd, strerror( errno ), errno );
-        send_dump_message( MESSENGER_DUMP_RECV_CLOSED, rq->service_name, NULL, 0 );
-        del_recv_queue_client_fd( rq, fd );
-        close( fd );
+        closed = true;
       }
       else {
         debug( "Failed to recv ( fd = %d, errno = %s [%d] ).", fd, strerror( errno ), errno );
@@ -1513,31 +2320,52 @@ on_recv( int fd, void *data ) {
     }
     else if ( recv_len == 0 ) {
       debug( "Connection closed ( fd = %d, service_name = %s ).", fd, rq->service_name );
-      send_dump_message( MESSENGER_DUMP_RECV_CLOSED, rq->service_name, NULL, 0 );
-      del_recv_queue_client_fd( rq, fd );
-      close( fd );
+      closed = true;
       break;
     }
 
-    if ( !write_message_buffer( rq->buffer, buf, ( size_t ) recv_len ) ) {
+    if ( n_fds > 0 ) {
+      message_header offer;
+      recv_len = ( ssize_t ) take_shm_offer( rq, ( size_t ) recv_len, &offer );
+      accept_shm_ring( rq, fd, offer, fds, n_fds );
+      if ( recv_len == 0 ) {
+        continue;
+      }
+    }
+
+    if ( truncated ) {
       warn( "Could not write a message to receive queue due to overflow ( service_name = %s, len = %u ).", rq->service_name, recv_len );
-      send_dump_message( MESSENGER_DUMP_RECV_OVERFLOW, rq->service_name, buf, ( uint32_t ) recv_len );
+      dump_message_buffer( MESSENGER_DUMP_RECV_OVERFLOW, rq->service_name, rq->buffer, rq->buffer->data_length, ( size_t ) recv_len );
     }
     else {
       debug( "Pushing a message to receive queue ( service_name = %s, len = %u ).", rq->service_name, recv_len );
-      send_dump_message( MESSENGER_DUMP_RECEIVED, rq->service_name, buf, ( uint32_t ) recv_len );
+      dump_message_buffer( MESSENGER_DUMP_RECEIVED, rq->service_name, rq->buffer, rq->buffer->data_length, ( size_t ) recv_len );
+      rq->buffer->data_length += ( size_t ) recv_len;
     }
   }
 
-  while ( pull_from_recv_queue( rq, &message_type, &tag, buf, &buf_len, sizeof( buf ) ) == 1 ) {
-    call_message_callbacks( rq, message_type, tag, buf, buf_len );
+  dispatch_recv_queue( rq );
+
+  // The sender switches to its ring only after the socket path, so the
+  // ring is drained after the messages received through the socket.
+  // Whatever the sender left in the ring is handled before closing.
+  messenger_socket *socket = lookup_recv_queue_client( rq, fd );
+  if ( socket != NULL && socket->ring != NULL ) {
+    drain_shm_ring( socket, closed ? UINT_MAX : messenger_shm_drain_limit );
+  }
+
+  if ( closed ) {
+    send_dump_message( MESSENGER_DUMP_RECV_CLOSED, rq->service_name, NULL, 0 );
+    del_recv_queue_client_fd( rq, fd );
+    close( fd );
   }
 }
 
 
 static uint32_t
-get_send_data( send_queue *sq, size_t offset ) {
+get_send_data( send_queue *sq, message_buffer *buf, size_t offset ) {
   assert( sq != NULL );
+  assert( buf != NULL );
 
   uint32_t bucket_size = messenger_bucket_size;
   if ( sq->socket_buffer_size != 0 ) {
@@ -1556,10 +2384,10 @@ get_send_data( send_queue *sq, size_t offset ) {
   }
 
   uint32_t length = 0;
-  message_header *header;
-  while ( ( sq->buffer->data_length - offset ) >= sizeof( message_header ) ) {
-    header = ( message_header * ) ( ( char * ) get_message_buffer_head( sq->buffer ) + offset );
-    uint32_t message_length = ntohl( header->message_length );
+  message_header header;
+  while ( ( buf->data_length - offset ) >= sizeof( message_header ) ) {
+    read_message_buffer( buf, offset, &header, sizeof( message_header ) );
+    uint32_t message_length = ntohl( header.message_length );
     assert( message_length != 0 );
     assert( message_length < messenger_recv_queue_length );
     if ( length + message_length > bucket_size ) {
@@ -1582,7 +2410,15 @@ on_send_read( int fd, void *data ) {
   char buf[ 256 ];
   send_queue *sq = ( send_queue* )data;
 
-  if ( recv( sq->server_socket, buf, sizeof( buf ), 0 ) <= 0 ) {
+  ssize_t recv_len = recv( sq->server_socket, buf, sizeof( buf ), 0 );
+  if ( recv_len >= ( ssize_t ) sizeof( message_header ) ) {
+    message_header header;
+    memcpy( &header, buf, sizeof( message_header ) );
+    if ( header.message_type == MESSAGE_TYPE_SHM_REJECT && sq->ring != NULL ) {
+      fall_back_to_socket( sq );
+    }
+  }
+  else if ( recv_len <= 0 ) {
     send_dump_message( MESSENGER_DUMP_SEND_CLOSED, sq->service_name, NULL, 0 );
 
     set_readable( sq->server_socket, false );
@@ -1591,9 +2427,13 @@ on_send_read( int fd, void *data ) {
 
     close( sq->server_socket );
     sq->server_socket = -1;
+    if ( sq->ring != NULL ) {
+      delete_send_queue_shm_ring( sq );
+    }
+    update_send_queue_pressure( sq );
 
     // Tries to reconnecting immediately, else adds a reconnect timer.
-    if ( sq->buffer->data_length > 0 ) {
+    if ( send_queue_pending_length( sq ) > 0 ) {
       send_queue_try_connect( sq );
     }
     else {
@@ -1603,29 +2443,34 @@ on_send_read( int fd, void *data ) {
 }
 
 
-static void
-on_send_write( int fd, void *data ) {
-  send_queue *sq = ( send_queue* )data;
-
+/**
+ * sends the messages in buf, one of the lanes of send_queue, until the
+ * socket blocks. returns true if buf becomes empty.
+ */
+static bool
+send_message_buffer( int fd, send_queue *sq, message_buffer *buf ) {
   assert( sq != NULL );
-  assert( fd >= 0 );
-
-  debug( "Sending data to remote ( fd = %d, service_name = %s, buffer = %p, data_length = %u ).",
-         fd, sq->service_name, get_message_buffer_head( sq->buffer ), sq->buffer->data_length );
-
-  if ( sq->buffer->data_length < sizeof( message_header ) ) {
-    set_writable( sq->server_socket, false );
-    return;
-  }
+  assert( buf != NULL );
 
-  void *send_data;
   size_t send_len;
   ssize_t sent_len;
   size_t sent_total = 0;
 
-  while ( ( send_len = get_send_data( sq, sent_total ) ) > 0 ) {
-    send_data = ( ( char * ) get_message_buffer_head( sq->buffer ) + sent_total );
-    sent_len = send( fd, send_data, send_len, MSG_DONTWAIT );
+  while ( ( send_len = get_send_data( sq, buf, sent_total ) ) > 0 ) {
+    // Sends straight from the send queue, in two parts if the data
+    // wraps around the end of the buffer.
+    struct iovec iov[ 2 ];
+    int iovcnt = get_message_buffer_iov( buf, sent_total, send_len, iov );
+    if ( iovcnt == 1 ) {
+      sent_len = send( fd, iov[ 0 ].iov_base, send_len, MSG_DONTWAIT );
+    }
+    else {
+      struct msghdr msg;
+      memset( &msg, 0, sizeof( msg ) );
+      msg.msg_iov = iov;
+      msg.msg_iovlen = ( size_t ) iovcnt;
+      sent_len = sendmsg( fd, &msg, MSG_DONTWAIT );
+    }
     if ( sent_len == -1 ) {
       int err = errno;
       if ( err != EAGAIN && err != EWOULDBLOCK ) {
@@ -1644,22 +2489,58 @@ on_send_write( int fd, void *data ) {
         // Tries to reconnecting immediately, else adds a reconnect timer.
         send_queue_try_connect( sq );
       }
-      truncate_message_buffer( sq->buffer, sent_total );
+      truncate_message_buffer( buf, sent_total );
       if ( err == EMSGSIZE || err == ENOBUFS || err == ENOMEM ) {
-        warn( "Dropping %u bytes data in send queue ( service_name = %s ).", sq->buffer->data_length, sq->service_name );
-        truncate_message_buffer( sq->buffer, sq->buffer->data_length );
+        warn( "Dropping %u bytes data in send queue ( service_name = %s ).", buf->data_length, sq->service_name );
+        truncate_message_buffer( buf, buf->data_length );
       }
-      return;
+      update_send_queue_pressure( sq );
+      return false;
     }
     assert( sent_len != 0 );
     assert( send_len == ( size_t ) sent_len );
-    send_dump_message( MESSENGER_DUMP_SENT, sq->service_name, send_data, ( uint32_t ) sent_len );
+    dump_message_buffer( MESSENGER_DUMP_SENT, sq->service_name, buf, sent_total, send_len );
     sent_total += ( size_t ) sent_len;
   }
 
-  truncate_message_buffer( sq->buffer, sent_total );
-  if ( sq->buffer->data_length == 0 ) {
+  truncate_message_buffer( buf, sent_total );
+  update_send_queue_pressure( sq );
+
+  return buf->data_length == 0;
+}
+
+
+static void
+on_send_write( int fd, void *data ) {
+  send_queue *sq = ( send_queue* )data;
+
+  assert( sq != NULL );
+  assert( fd >= 0 );
+
+  debug( "Sending data to remote ( fd = %d, service_name = %s, buffer = %p, data_length = %u, control_data_length = %u ).",
+         fd, sq->service_name, get_message_buffer_head( sq->buffer ), sq->buffer->data_length, sq->control_buffer->data_length );
+
+  // The control lane is drained before any bulk message is sent.
+  if ( sq->control_buffer->data_length >= sizeof( message_header ) ) {
+    if ( !send_message_buffer( fd, sq, sq->control_buffer ) ) {
+      return;
+    }
+  }
+
+  if ( sq->buffer->data_length < sizeof( message_header ) ) {
+    set_writable( sq->server_socket, false );
+    offer_shm_ring( sq );
+    return;
+  }
+  if ( sq->ring != NULL ) {
+    set_writable( sq->server_socket, false );
+    flush_send_queue_to_shm_ring( sq );
+    return;
+  }
+
+  if ( send_message_buffer( fd, sq, sq->buffer ) ) {
     set_writable( sq->server_socket, false );
+    offer_shm_ring( sq );
   }
 }
 
@@ -108,7 +108,16 @@ typedef struct text_dump_header {
 } text_dump_header;
 
 
+enum {
+  MESSENGER_PRIORITY_BULK,    // default lane
+  MESSENGER_PRIORITY_CONTROL, // drained before bulk, with its own buffer
+  MESSENGER_PRIORITY_FENCE,   // bulk, but never overtaken nor overtaking
+  MESSENGER_PRIORITY_MAX,
+};
+
+
 typedef void ( *callback_message_received )( uint16_t tag, void *data, size_t len );
+typedef void ( *callback_send_queue_pressure )( const char *service_name, bool congested, void *user_data );
 
 
 extern bool ( *add_message_received_callback )( const char *service_name, const callback_message_received function );
@@ -119,6 +128,7 @@ extern bool ( *delete_message_requested_callback )( const char *service_name, vo
 extern bool ( *add_message_replied_callback )( const char *service_name, void ( *callback )( uint16_t tag, void *data, size_t len, void *user_data ) );
 extern bool ( *delete_message_replied_callback )( const char *service_name, void ( *callback )( uint16_t tag, void *data, size_t len, void *user_data ) );
 extern bool ( *send_message )( const char *service_name, const uint16_t tag, const void *data, size_t len );
+extern bool ( *send_message_with_priority )( const char *service_name, const uint16_t tag, const void *data, size_t len, int priority );
 extern bool ( *send_request_message )( const char *to_service_name, const char *from_service_name, const uint16_t tag, const void *data, size_t len, void *user_data );
 extern bool ( *send_reply_message )( const messenger_context_handle *handle, const uint16_t tag, const void *data, size_t len );
 extern bool ( *clear_send_queue ) ( const char *service_name );
@@ -134,6 +144,12 @@ void start_messenger_dump( const char *dump_app_name, const char *dump_service_n
 void stop_messenger_dump( void );
 bool messenger_dump_enabled( void );
 
+bool set_message_tag_priority( uint16_t tag, int priority );
+int get_message_tag_priority( uint16_t tag );
+
+bool set_send_queue_watermarks( unsigned int high_percent, unsigned int low_percent, callback_send_queue_pressure callback, void *user_data );
+bool get_send_queue_occupancy( const char *service_name, size_t *length, size_t *size );
+
 
 #endif // MESSENGER_H
 
@@ -711,6 +711,7 @@ OFP_ASSERT(sizeof(struct ofp_table_mod) == 16);
 /* Flags to configure the table. Reserved for future use. */
 enum ofp_table_config {
     OFPTC_DEPRECATED_MASK = 3, /* Deprecated bits */
+    OFPTC_EVICTION = 1 << 2, /* Authorise table to evict flows (OpenFlow 1.4). */
 };
 
 
@@ -1676,7 +1677,9 @@ enum ofp_flow_removed_reason {
     OFPRR_IDLE_TIMEOUT = 0, /* Flow idle time exceeded idle_timeout. */
     OFPRR_HARD_TIMEOUT = 1, /* Time exceeded hard_timeout. */
     OFPRR_DELETE       = 2, /* Evicted by a DELETE flow mod. */
-    OFPRR_GROUP_DELETE = 3  /* Group was removed. */
+    OFPRR_GROUP_DELETE = 3, /* Group was removed. */
+    OFPRR_METER_DELETE = 4, /* Meter was removed (OpenFlow 1.4). */
+    OFPRR_EVICTION     = 5  /* Switch eviction to free resources (OpenFlow 1.4). */
 };
 
 
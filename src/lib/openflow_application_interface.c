@@ -42,11 +42,11 @@
 #define get_trema_name mock_get_trema_name
 const char *mock_get_trema_name( void );
 
-#ifdef send_message
-#undef send_message
+#ifdef send_message_with_priority
+#undef send_message_with_priority
 #endif
-#define send_message mock_send_message
-bool mock_send_message( char *service_name, uint16_t tag, void *data, size_t len );
+#define send_message_with_priority mock_send_message_with_priority
+bool mock_send_message_with_priority( char *service_name, uint16_t tag, void *data, size_t len, int priority );
 
 #ifdef send_request_message
 #undef send_request_message
@@ -101,12 +101,6 @@ bool mock_clear_send_queue( const char *service_name );
 #define getpid mock_getpid
 pid_t mock_getpid( void );
 
-#ifdef parse_packet
-#undef parse_packet
-#endif
-#define parse_packet mock_parse_packet
-bool mock_parse_packet( buffer *buf );
-
 #ifdef die
 #undef die
 #endif
@@ -153,6 +147,8 @@ static char service_name[ MESSENGER_SERVICE_NAME_LENGTH ];
 
 static void handle_message( uint16_t message_type, void *data, size_t length );
 static void handle_list_switches_reply( uint16_t message_type, void *dpid, size_t length, void *user_data );
+static void record_request_sent( uint64_t datapath_id, const struct ofp_header *header );
+static void record_reply_received( uint64_t datapath_id, const buffer *message );
 
 
 enum {
@@ -161,6 +157,28 @@ enum {
 };
 
 
+// Statistic entry ids + 1 by message type, direction and result. Zero
+// means that the entry is not registered yet.
+static int switch_event_stat_ids[ MESSENGER_OPENFLOW_FAILD_TO_CONNECT + 1 ][ 2 ][ 2 ];
+static int openflow_stat_ids[ UINT8_MAX + 1 ][ 2 ][ 2 ];
+
+
+// Barrier and multipart requests waiting for their replies, indexed by
+// transaction id. A newer request overwrites an older one in the same
+// slot, which is then not measured.
+#define PENDING_REQUESTS 256
+
+typedef struct {
+  uint64_t datapath_id;
+  uint32_t transaction_id;
+  uint8_t type;               // OFPT_BARRIER_REQUEST, OFPT_MULTIPART_REQUEST or 0 if unused
+  struct timespec sent_at;
+} pending_request;
+
+static pending_request pending_requests[ PENDING_REQUESTS ];
+static openflow_latency_stats latency_stats;
+
+
 bool
 openflow_application_interface_is_initialized() {
   return openflow_application_interface_initialized;
@@ -190,6 +208,11 @@ init_openflow_application_interface( const char *custom_service_name ) {
 
   memset( &event_handlers, 0, sizeof( openflow_event_handlers_t ) );
   memset( service_name, '\0', sizeof( service_name ) );
+  memset( switch_event_stat_ids, 0, sizeof( switch_event_stat_ids ) );
+  memset( openflow_stat_ids, 0, sizeof( openflow_stat_ids ) );
+  memset( pending_requests, 0, sizeof( pending_requests ) );
+  init_latency_histogram( &latency_stats.barrier );
+  init_latency_histogram( &latency_stats.multipart );
 
   size_t length = strlen( custom_service_name ) + 1;
   if ( length > MESSENGER_SERVICE_NAME_LENGTH ) {
@@ -221,6 +244,9 @@ finalize_openflow_application_interface() {
 
   memset( &event_handlers, 0, sizeof( openflow_event_handlers_t ) );
   memset( service_name, '\0', sizeof( service_name ) );
+  memset( switch_event_stat_ids, 0, sizeof( switch_event_stat_ids ) );
+  memset( openflow_stat_ids, 0, sizeof( openflow_stat_ids ) );
+  memset( pending_requests, 0, sizeof( pending_requests ) );
 
   openflow_application_interface_initialized = false;
 
@@ -866,6 +892,17 @@ handle_get_config_reply( const uint64_t datapath_id, buffer *data ) {
 }
 
 
+/*
+ * Received messages are dispatched in place. Their data belongs to the
+ * messenger and stays valid until handle_openflow_message() returns.
+ */
+static void
+keep_message_data( void *data, void *arg ) {
+  UNUSED( data );
+  UNUSED( arg );
+}
+
+
 static bool
 empty( const buffer *data ) {
   return ( data == NULL ) || ( ( data != NULL ) && ( data->length == 0 ) );
@@ -893,23 +930,26 @@ handle_packet_in( const uint64_t datapath_id, buffer *data ) {
 
   uint16_t body_length = ( uint16_t ) ( ntohs( _packet_in->header.length ) - offsetof( struct ofp_packet_in, match ) - pad_len - match_len );
 
-  char match_string[ MATCH_STRING_LENGTH ];
-  match_to_string( match, match_string, sizeof( match_string ) );
+  // Because match_to_string() is costly, we check logging_level first.
+  if ( get_logging_level() >= LOG_DEBUG ) {
+    char match_string[ MATCH_STRING_LENGTH ];
+    match_to_string( match, match_string, sizeof( match_string ) );
 
-  debug(
-    "A packet_in message is received from %#" PRIx64
-    " (transaction_id = %#x, buffer_id = %#x, total_len = %#x, reason = %#x, table_id = %#x, "
-    "cookie = %#" PRIx64 ", match = [%s], body length = %u).",
-    datapath_id,
-    transaction_id,
-    buffer_id,
-    total_len,
-    reason,
-    table_id,
-    cookie,
-    match_string,
-    body_length
-  );
+    debug(
+      "A packet_in message is received from %#" PRIx64
+      " (transaction_id = %#x, buffer_id = %#x, total_len = %#x, reason = %#x, table_id = %#x, "
+      "cookie = %#" PRIx64 ", match = [%s], body length = %u).",
+      datapath_id,
+      transaction_id,
+      buffer_id,
+      total_len,
+      reason,
+      table_id,
+      cookie,
+      match_string,
+      body_length
+    );
+  }
 
   if ( event_handlers.packet_in_callback == NULL ) {
     debug( "Callback function for packet_in events is not set." );
@@ -917,14 +957,12 @@ handle_packet_in( const uint64_t datapath_id, buffer *data ) {
   }
 
   if ( body_length > 0 ) {
-    body = duplicate_buffer( data );
-    remove_front_buffer( body, offsetof( struct ofp_packet_in, match ) + pad_len + match_len );
-    bool parse_ok = parse_packet( body );
-    if ( !parse_ok ) {
-      error( "Failed to parse a packet." );
-      // ???: Is it OK to drop malformed packets?
-      goto END;
-    }
+    // The frame is neither copied nor parsed here. Handlers that keep it
+    // after returning must duplicate it, and packet_info is filled in
+    // on the first access.
+    body = alloc_buffer_with_data( ( char * ) data->data + offsetof( struct ofp_packet_in, match ) + pad_len + match_len,
+                                   body_length, keep_message_data, NULL );
+    defer_parse_packet( body );
   }
   else {
     body = NULL;
@@ -1627,6 +1665,16 @@ static void handle_get_async_reply( const uint64_t datapath_id, buffer *data ) {
 
 static void
 update_switch_event_stats( uint16_t type, int send_receive, bool result ) {
+  if ( send_receive != OPENFLOW_MESSAGE_SEND && send_receive != OPENFLOW_MESSAGE_RECEIVE ) {
+    return;
+  }
+  // All undefined events share the first slot.
+  int *id = &switch_event_stat_ids[ type <= MESSENGER_OPENFLOW_FAILD_TO_CONNECT ? type : 0 ][ send_receive ][ result ? 1 : 0 ];
+  if ( *id > 0 ) {
+    increment_stat_by_id( *id - 1 );
+    return;
+  }
+
   char key[ STAT_KEY_LENGTH ];
   char suffix[ 16 ];
   char direction[ 16 ];
@@ -1672,7 +1720,10 @@ update_switch_event_stats( uint16_t type, int send_receive, bool result ) {
     break;
   }
 
-  increment_stat( key );
+  *id = register_stat_entry( key ) + 1;
+  if ( *id > 0 ) {
+    increment_stat_by_id( *id - 1 );
+  }
 }
 
 
@@ -1746,6 +1797,15 @@ handle_switch_events( uint16_t type, void *data, size_t length ) {
 
 static void
 update_openflow_stats( uint8_t type, int send_receive, bool result ) {
+  if ( send_receive != OPENFLOW_MESSAGE_SEND && send_receive != OPENFLOW_MESSAGE_RECEIVE ) {
+    return;
+  }
+  int *id = &openflow_stat_ids[ type ][ send_receive ][ result ? 1 : 0 ];
+  if ( *id > 0 ) {
+    increment_stat_by_id( *id - 1 );
+    return;
+  }
+
   char key[ STAT_KEY_LENGTH ];
   char suffix[ 16 ];
   char direction[ 16 ];
@@ -1869,13 +1929,15 @@ update_openflow_stats( uint8_t type, int send_receive, bool result ) {
     break;
   }
 
-  increment_stat( key );
+  *id = register_stat_entry( key ) + 1;
+  if ( *id > 0 ) {
+    increment_stat_by_id( *id - 1 );
+  }
 }
 
 
 static void
 handle_openflow_message( void *data, size_t length ) {
-  void *p;
   int ret;
   uint64_t datapath_id;
   buffer *buffer;
@@ -1891,14 +1953,12 @@ handle_openflow_message( void *data, size_t length ) {
 
   datapath_id = ntohll( message->datapath_id );
 
-  buffer = alloc_buffer_with_length( length );
+  buffer = alloc_buffer_with_data( ( char * ) data + sizeof( openflow_service_header_t ),
+                                   length - sizeof( openflow_service_header_t ),
+                                   keep_message_data, NULL );
 
   assert( buffer != NULL );
 
-  p = append_back_buffer( buffer, length );
-  memcpy( p, data, length );
-  remove_front_buffer( buffer, sizeof( openflow_service_header_t ) );
-
   ret = validate_openflow_message( buffer );
 
   if ( ret < 0 ) {
@@ -1909,6 +1969,7 @@ handle_openflow_message( void *data, size_t length ) {
   }
 
   header = ( struct ofp_header * ) buffer->data;
+  record_reply_received( datapath_id, buffer );
 
   switch ( header->type ) {
   case OFPT_ERROR:
@@ -1961,6 +2022,75 @@ handle_openflow_message( void *data, size_t length ) {
 }
 
 
+static void
+record_request_sent( uint64_t datapath_id, const struct ofp_header *header ) {
+  if ( header->type != OFPT_BARRIER_REQUEST && header->type != OFPT_MULTIPART_REQUEST ) {
+    return;
+  }
+
+  uint32_t transaction_id = ntohl( header->xid );
+  pending_request *request = &pending_requests[ transaction_id % PENDING_REQUESTS ];
+  request->datapath_id = datapath_id;
+  request->transaction_id = transaction_id;
+  request->type = header->type;
+  clock_gettime( CLOCK_MONOTONIC, &request->sent_at );
+}
+
+
+static void
+record_reply_received( uint64_t datapath_id, const buffer *message ) {
+  const struct ofp_header *header = message->data;
+  latency_histogram *histogram;
+  uint8_t request_type;
+  if ( header->type == OFPT_BARRIER_REPLY ) {
+    histogram = &latency_stats.barrier;
+    request_type = OFPT_BARRIER_REQUEST;
+  }
+  else if ( header->type == OFPT_MULTIPART_REPLY ) {
+    const struct ofp_multipart_reply *multipart_reply = message->data;
+    if ( ( ntohs( multipart_reply->flags ) & OFPMPF_REPLY_MORE ) != 0 ) {
+      return;
+    }
+    histogram = &latency_stats.multipart;
+    request_type = OFPT_MULTIPART_REQUEST;
+  }
+  else {
+    return;
+  }
+
+  uint32_t transaction_id = ntohl( header->xid );
+  pending_request *request = &pending_requests[ transaction_id % PENDING_REQUESTS ];
+  if ( request->type != request_type || request->transaction_id != transaction_id ||
+       request->datapath_id != datapath_id ) {
+    return;
+  }
+  record_latency( histogram, &request->sent_at );
+  request->type = 0;
+}
+
+
+/**
+ * Copies the request-to-reply latency histograms of barriers and
+ * multipart requests into stats.
+ */
+void
+get_openflow_latency_stats( openflow_latency_stats *stats ) {
+  assert( stats != NULL );
+
+  *stats = latency_stats;
+}
+
+
+/**
+ * Logs the request-to-reply latency histograms.
+ */
+void
+dump_openflow_latency_stats( void ) {
+  dump_latency_histogram( "barrier round-trip time", &latency_stats.barrier );
+  dump_latency_histogram( "multipart round-trip time", &latency_stats.multipart );
+}
+
+
 static void
 handle_message( uint16_t type, void *data, size_t length ) {
   assert( data != NULL );
@@ -2046,6 +2176,27 @@ handle_list_switches_reply( uint16_t message_type, void *data, size_t length, vo
 }
 
 
+/*
+ * Packet-outs and statistics requests take the bulk lane so that a burst
+ * of them does not delay flow-mods or echo replies. Barriers are fences
+ * that keep their order with respect to both lanes.
+ */
+static int
+openflow_message_priority( uint8_t type ) {
+  switch ( type ) {
+  case OFPT_PACKET_OUT:
+  case OFPT_MULTIPART_REQUEST:
+    return MESSENGER_PRIORITY_BULK;
+  case OFPT_BARRIER_REQUEST:
+    return MESSENGER_PRIORITY_FENCE;
+  default:
+    break;
+  }
+
+  return MESSENGER_PRIORITY_CONTROL;
+}
+
+
 bool
 send_openflow_message( const uint64_t datapath_id, buffer *message ) {
   bool ret;
@@ -2091,11 +2242,14 @@ send_openflow_message( const uint64_t datapath_id, buffer *message ) {
          datapath_id, service_name, remote_service_name,
          ofp->version, ofp->type, ntohs( ofp->length ), ntohl( ofp->xid ) );
 
-  ret =  send_message( remote_service_name, MESSENGER_OPENFLOW_MESSAGE,
-                       buffer->data, buffer->length );
+  ret =  send_message_with_priority( remote_service_name, MESSENGER_OPENFLOW_MESSAGE,
+                                     buffer->data, buffer->length, openflow_message_priority( ofp->type ) );
 
   free_buffer( buffer );
 
+  if ( ret ) {
+    record_request_sent( datapath_id, ofp );
+  }
   update_openflow_stats( ofp->type, OPENFLOW_MESSAGE_SEND, ret );
 
   return ret;
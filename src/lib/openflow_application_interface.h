@@ -26,6 +26,7 @@
 
 #include <arpa/inet.h>
 #include "buffer.h"
+#include "latency_histogram.h"
 #include "linked_list.h"
 #include "openflow.h"
 #include "openflow_service_interface.h"
@@ -130,7 +131,7 @@ typedef struct {
   uint8_t table_id;
   uint64_t cookie;
   const oxm_matches *match;
-  const buffer *data;
+  const buffer *data; // valid until the handler returns, parsed on first access
   void *user_data;
 } packet_in;
 
@@ -392,6 +393,20 @@ bool send_list_switches_request( void *user_data );
 bool delete_openflow_messages( uint64_t datapath_id );
 
 
+/********************************************************************************
+ * Functions for request-to-reply latency.
+ ********************************************************************************/
+
+typedef struct {
+  latency_histogram barrier;   // barrier request to barrier reply
+  latency_histogram multipart; // multipart request to the last multipart reply
+} openflow_latency_stats;
+
+
+void get_openflow_latency_stats( openflow_latency_stats *stats );
+void dump_openflow_latency_stats( void );
+
+
 #endif // OPENFLOW_APPLICATION_INTERFACE_H
 
 
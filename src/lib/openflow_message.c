@@ -4756,7 +4756,7 @@ validate_flow_removed( const buffer *message ) {
   // flow_removed->cookie
   // flow_removed->priority
 
-  if ( flow_removed->reason > OFPRR_GROUP_DELETE ) {
+  if ( flow_removed->reason > OFPRR_EVICTION ) {
     return ERROR_INVALID_FLOW_REMOVED_REASON;
   }
 
@@ -8291,6 +8291,7 @@ set_match_from_packet( oxm_matches *match, const uint32_t in_port,
   // Note that mask must be filled before calling this function.
 
   assert( packet != NULL );
+  parse_deferred_packet( packet );
   assert( packet->user_data != NULL );
   assert( match != NULL );
 
@@ -58,6 +58,7 @@ copy_packet_info( buffer *dst, const buffer *src ) {
   die_if_NULL( src );
   die_if_NULL( dst );
   
+  parse_deferred_packet( src );
   if ( src->user_data == NULL ) {
     return;
   }
@@ -85,6 +86,7 @@ get_packet_info( const buffer *frame ) {
 
   packet_info info;
 
+  parse_deferred_packet( frame );
   if ( frame->user_data != NULL ) {
     info = *( packet_info * ) frame->user_data;
   }
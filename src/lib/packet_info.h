@@ -216,6 +216,7 @@ typedef struct {
   uint8_t mpls_bos;
   uint32_t pbb_isid;
   uint64_t tunnel_id;
+  uint32_t queue_id;
 
   uint16_t ipv6_exthdr;
 
@@ -235,6 +236,8 @@ typedef struct {
 
 
 bool parse_packet( buffer *buf );
+void defer_parse_packet( buffer *buf );
+void parse_deferred_packet( const buffer *buf );
 
 void calloc_packet_info( buffer *frame );
 void free_packet_info( buffer *frame );
@@ -21,6 +21,7 @@
 #include <arpa/inet.h>
 #include <net/ethernet.h>
 #include <netinet/ip.h>
+#include "checks.h"
 #include "packet_info.h"
 #include "log.h"
 #include "wrapper.h"
@@ -666,16 +667,10 @@ parse_etherip( buffer *buf ) {
 }
 
 
-bool
-parse_packet( buffer *buf ) {
+static void
+parse_headers( buffer *buf ) {
   assert( buf != NULL );
-  assert( buf->data != NULL );
-
-  calloc_packet_info( buf );
-  if ( buf->user_data == NULL ) {
-    error( "Can't alloc memory for packet_info." );
-    return false;
-  }
+  assert( buf->user_data != NULL );
 
   // Parse the L2 header.
   packet_info *packet_info = buf->user_data;
@@ -707,22 +702,22 @@ parse_packet( buffer *buf ) {
   case ETH_ETHTYPE_MPLS_UNI:
   case ETH_ETHTYPE_MPLS_MLT:
     parse_mpls( buf );
-    return true;
+    return;
 
   case ETH_ETHTYPE_PBB:
     parse_pbb( buf );
-    return true;
+    return;
 
   default:
     // Unknown L3 type
-    return true;
+    return;
   }
 
   // Get L4 protocol num.
   if ( packet_info->format & NW_IPV4 ) {
     if ( packet_info->ipv4_frag_off & IP_OFFMASK ) {
       // The ipv4 packet is fragmented.
-      return true;
+      return;
     }
     packet_info->ip_proto = packet_info->ipv4_protocol;
     packet_info->ip_dscp = packet_info->ipv4_dscp;
@@ -735,7 +730,7 @@ parse_packet( buffer *buf ) {
   }
   else {
     // Not IPv4/v6 type
-    return true;
+    return;
   }
 
   // Parse the L4 header.
@@ -779,9 +774,90 @@ parse_packet( buffer *buf ) {
     // Unknown L4 type
     break;
   }
+}
+
+
+bool
+parse_packet( buffer *buf ) {
+  assert( buf != NULL );
+  assert( buf->data != NULL );
+
+  calloc_packet_info( buf );
+  if ( buf->user_data == NULL ) {
+    error( "Can't alloc memory for packet_info." );
+    return false;
+  }
+  parse_headers( buf );
 
   return true;
+}
+
+
+typedef struct {
+  packet_info info; // must be the first member
+  bool parsed;
+} deferred_packet_info;
+
+
+static void
+free_deferred_packet_info( buffer *buf ) {
+  die_if_NULL( buf );
+  die_if_NULL( buf->user_data );
+
+  xfree( buf->user_data );
+  buf->user_data = NULL;
+  buf->user_data_free_function = NULL;
+}
+
+
+/**
+ * Attaches an empty packet_info to a buffer that is filled in by
+ * parse_deferred_packet() on the first access. get_packet_info(),
+ * copy_packet_info() and the packet_type_*() functions do it implicitly.
+ * A duplicate_buffer() copy shares the packet_info of the original, so
+ * parse the original first if the copy is inspected.
+ *
+ * @param buf the buffer that holds an ethernet frame.
+ */
+void
+defer_parse_packet( buffer *buf ) {
+  assert( buf != NULL );
+  assert( buf->data != NULL );
+
+  if ( buf->user_data != NULL && buf->user_data_free_function != NULL ) {
+    ( *buf->user_data_free_function )( buf );
+    assert( buf->user_data == NULL );
+    assert( buf->user_data_free_function == NULL );
+  }
+
+  buf->user_data = xcalloc( 1, sizeof( deferred_packet_info ) );
+  buf->user_data_free_function = free_deferred_packet_info;
+}
+
+
+/**
+ * Parses a buffer prepared with defer_parse_packet() unless it has been
+ * parsed already. Does nothing for other buffers. Call this before
+ * dereferencing buf->user_data directly.
+ *
+ * @param buf the buffer that holds an ethernet frame.
+ */
+void
+parse_deferred_packet( const buffer *buf ) {
+  assert( buf != NULL );
+
+  if ( buf->user_data == NULL || buf->user_data_free_function != free_deferred_packet_info ) {
+    return;
+  }
+  deferred_packet_info *deferred = buf->user_data;
+  if ( deferred->parsed ) {
+    return;
+  }
+  deferred->parsed = true;
 
+  // The parsers only read the frame and write to the packet_info it points to.
+  buffer frame = *buf;
+  parse_headers( &frame );
 }
 
 
@@ -22,8 +22,10 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
-#include <sys/select.h>
+#include <string.h>
+#include <sys/epoll.h>
 #include <sys/time.h>
+#include <unistd.h>
 #include "array_util.h"
 #include "async_lock.h"
 #include "async_util.h"
@@ -34,11 +36,27 @@
 #include "wrapper.h"
 
 
+enum {
+  MAX_EVENTS_PER_WAIT = 256,
+  INITIAL_EVENT_FD_SET_SIZE = 64,
+};
+
+
 static struct event_info_list event_list;
 GET_OBJ_INFO( event )
 DELETE_OBJ_INFO( event )
 
 
+static struct event_fd *
+lookup_event_fd( struct event_info *event, int fd ) {
+  if ( ( fd < 0 ) || ( fd >= event->event_fd_set_size ) ) {
+    return NULL;
+  }
+
+  return event->event_fd_set[ fd ];
+}
+
+
 /*
  * Usually we get an event_info object by calling the get_info().
  * But there is a case (ie packet_out) where the protocol thread calls
@@ -51,8 +69,11 @@ get_event_info_by_fd( int fd ) {
   uint32_t events_nr = event_list.events_nr;
 
   for ( uint32_t i = 0; i < events_nr; i++ ) {
-    if ( event_list.events[ i ]->event_fd_set[ fd ] != NULL &&
-         event_list.events[ i ]->event_fd_set[ fd ]->fd == fd ) {
+    if ( event_list.events[ i ] == NULL ) {
+      continue;
+    }
+    struct event_fd *event_fd = lookup_event_fd( event_list.events[ i ], fd );
+    if ( event_fd != NULL && event_fd->fd == fd ) {
       event = event_list.events[ i ];
       break;
     }
@@ -72,15 +93,17 @@ _init_event_handler() {
   }
   event = ( struct event_info * ) xmalloc( sizeof( *event ) );
   event->thread_id = current_thread();
-  event->event_last = event->event_list;
   event->event_handler_state = EVENT_HANDLER_INITIALIZED;
   event->external_callback = NULL;
 
-  memset( event->event_list, 0, sizeof( struct event_fd ) * FD_SETSIZE );
-  memset( event->event_fd_set, 0, sizeof( struct event_fd * ) * FD_SETSIZE );
-
-  FD_ZERO( &event->event_read_set );
-  FD_ZERO( &event->event_write_set );
+  event->epoll_fd = epoll_create1( EPOLL_CLOEXEC );
+  if ( event->epoll_fd < 0 ) {
+    error( "Failed to create an epoll instance ( errno = %s [%d] ).", strerror( errno ), errno );
+  }
+  event->event_fd_set_size = INITIAL_EVENT_FD_SET_SIZE;
+  event->event_fd_set = xcalloc( ( size_t ) event->event_fd_set_size, sizeof( struct event_fd * ) );
+  event->active_fd_count = 0;
+  event->ready_events = xcalloc( MAX_EVENTS_PER_WAIT, sizeof( struct epoll_event ) );
 
   event_write_begin();
   ALLOC_GROW( event_list.events, event_list.events_nr + 1, event_list.events_alloc ); 
@@ -98,18 +121,71 @@ _finalize_event_handler() {
   event_read_end();
   assert( event != NULL );
 
-  if ( event->event_last != event->event_list ) {
-    warn( "Event Handler finalized with %i fd event handlers still active. (%i, ...)",
-          ( event->event_last - event->event_list ), ( event->event_last > event->event_list ? event->event_list->fd : -1 ) );
+  if ( event->active_fd_count > 0 ) {
+    int fd = -1;
+    for ( int i = 0; i < event->event_fd_set_size; i++ ) {
+      if ( event->event_fd_set[ i ] != NULL ) {
+        fd = i;
+        break;
+      }
+    }
+    warn( "Event Handler finalized with %i fd event handlers still active. (%i, ...)", event->active_fd_count, fd );
     return;
   }
   event_write_begin();
+  xfree( event->event_fd_set );
+  xfree( event->ready_events );
+  if ( event->epoll_fd >= 0 ) {
+    close( event->epoll_fd );
+  }
   delete_event_info( event );
   event_write_end();
 }
 void ( *finalize_event_handler_safe )() = _finalize_event_handler;
 
 
+/*
+ * Registers an fd with epoll only while read or write notification is
+ * enabled. epoll always reports hangups and errors, so keeping an idle fd
+ * registered would keep waking the loop up.
+ */
+static void
+update_epoll_events( struct event_info *event_info, struct event_fd *event, uint32_t events ) {
+  if ( event->events == events ) {
+    return;
+  }
+
+  struct epoll_event ev;
+  memset( &ev, 0, sizeof( struct epoll_event ) );
+  ev.events = events;
+  ev.data.fd = event->fd;
+
+  int ret = 0;
+  if ( events == 0 ) {
+    ret = epoll_ctl( event_info->epoll_fd, EPOLL_CTL_DEL, event->fd, &ev );
+    if ( ret < 0 && ( errno == ENOENT || errno == EBADF ) ) {
+      ret = 0; // already removed by close()
+    }
+  }
+  else if ( event->events == 0 ) {
+    ret = epoll_ctl( event_info->epoll_fd, EPOLL_CTL_ADD, event->fd, &ev );
+  }
+  else {
+    ret = epoll_ctl( event_info->epoll_fd, EPOLL_CTL_MOD, event->fd, &ev );
+    if ( ret < 0 && errno == ENOENT ) {
+      ret = epoll_ctl( event_info->epoll_fd, EPOLL_CTL_ADD, event->fd, &ev );
+    }
+  }
+  if ( ret < 0 ) {
+    error( "Failed to update epoll events ( fd = %d, events = %#x, errno = %s [%d] ).",
+           event->fd, events, strerror( errno ), errno );
+    return;
+  }
+
+  event->events = events;
+}
+
+
 static bool
 _run_event_handler_once( int timeout_usec ) {
   event_read_begin();
@@ -123,19 +199,15 @@ _run_event_handler_once( int timeout_usec ) {
 
     callback();
   }
-  memcpy( &event->current_read_set, &event->event_read_set, sizeof( fd_set ) );
-  memcpy( &event->current_write_set, &event->event_write_set, sizeof( fd_set ) );
 
-  struct timeval timeout;
-  timeout.tv_sec = timeout_usec / 1000000;
-  timeout.tv_usec = timeout_usec % 1000000;
-  int set_count = select( event->fd_set_size, &event->current_read_set, &event->current_write_set, NULL, &timeout );
+  int timeout_msec = ( timeout_usec + 999 ) / 1000;
+  int set_count = epoll_wait( event->epoll_fd, event->ready_events, MAX_EVENTS_PER_WAIT, timeout_msec );
 
   if ( set_count == -1 ) {
     if ( errno == EINTR ) {
       return true;
     }
-    error( "Failed to select ( errno = %s [%d] ).", strerror( errno ), errno );
+    error( "Failed to epoll_wait ( errno = %s [%d] ).", strerror( errno ), errno );
     return false;
 
   }
@@ -144,27 +216,29 @@ _run_event_handler_once( int timeout_usec ) {
     return true;
   }
 
-  struct event_fd *event_itr = event->event_list;
-
-  while ( event_itr < event->event_last ) {
-    struct event_fd current_event = *event_itr;
-
-    if ( FD_ISSET( current_event.fd, &event->current_write_set ) ) {
-      current_event.write_callback( current_event.fd, current_event.write_data );
+  for ( int i = 0; i < set_count; i++ ) {
+    int fd = event->ready_events[ i ].data.fd;
+    uint32_t revents = event->ready_events[ i ].events;
+
+    // Callbacks may delete or modify any handler including this one, so
+    // the handler is looked up again before each callback.
+    struct event_fd *event_fd = lookup_event_fd( event, fd );
+    if ( event_fd == NULL ) {
+      debug( "run_event_handler_once: no event handler found for fd %d.", fd );
+      epoll_ctl( event->epoll_fd, EPOLL_CTL_DEL, fd, NULL );
+      continue;
     }
 
-    if ( FD_ISSET( current_event.fd, &event->current_read_set ) ) {
-      current_event.read_callback( current_event.fd, current_event.read_data );
+    if ( ( revents & ( EPOLLOUT | EPOLLERR | EPOLLHUP ) ) && ( event_fd->events & EPOLLOUT ) ) {
+      event_fd->write_callback( fd, event_fd->write_data );
     }
 
-    // In the rare cases the current fd is closed, a new one is opened
-    // with the same fd and is put in the same location we can just
-    // wait for the next select call.
-    if ( current_event.fd == event_itr->fd ) {
-      event_itr = event_itr + 1;
+    event_fd = lookup_event_fd( event, fd );
+    if ( event_fd == NULL ) {
+      continue;
     }
-    else {
-      debug( "run_event_handler_once: event fd is changed ( current = %d, new = %d )", current_event.fd, event_itr->fd ) ;
+    if ( ( revents & ( EPOLLIN | EPOLLERR | EPOLLHUP ) ) && ( event_fd->events & EPOLLIN ) ) {
+      event_fd->read_callback( fd, event_fd->read_data );
     }
   }
 
@@ -228,34 +302,42 @@ _set_fd_handler( int fd,
   event_read_end();
   assert( event != NULL );
 
-  // Currently just issue critical warnings instead of killing the
-  // program."
-  if ( event->event_fd_set[ fd ] != NULL ) {
-    error( "Tried to add an already active fd event handler." );
-    return;
-  }
-
-  if ( ( fd < 0 ) || ( fd >= FD_SETSIZE ) ) {
+  if ( fd < 0 ) {
     error( "Tried to add an invalid fd." );
     return;
   }
 
-  if ( event->event_last >= event->event_list + FD_SETSIZE ) {
-    error( "Event handler list in invalid state." );
+  // Currently just issue critical warnings instead of killing the
+  // program."
+  if ( lookup_event_fd( event, fd ) != NULL ) {
+    error( "Tried to add an already active fd event handler." );
     return;
   }
 
-  event->event_last->fd = fd;
-  event->event_last->read_callback = read_callback;
-  event->event_last->write_callback = write_callback;
-  event->event_last->read_data = read_data;
-  event->event_last->write_data = write_data;
+  if ( fd >= event->event_fd_set_size ) {
+    int new_size = event->event_fd_set_size > 0 ? event->event_fd_set_size : INITIAL_EVENT_FD_SET_SIZE;
+    while ( fd >= new_size ) {
+      new_size *= 2;
+    }
+    // other threads may look up the fd table in get_event_info_by_fd()
+    event_write_begin();
+    event->event_fd_set = xrealloc( event->event_fd_set, sizeof( struct event_fd * ) * ( size_t ) new_size );
+    memset( event->event_fd_set + event->event_fd_set_size, 0,
+            sizeof( struct event_fd * ) * ( size_t ) ( new_size - event->event_fd_set_size ) );
+    event->event_fd_set_size = new_size;
+    event_write_end();
+  }
 
-  event->event_fd_set[ fd ] = event->event_last++;
+  struct event_fd *event_fd = xmalloc( sizeof( struct event_fd ) );
+  event_fd->fd = fd;
+  event_fd->read_callback = read_callback;
+  event_fd->write_callback = write_callback;
+  event_fd->read_data = read_data;
+  event_fd->write_data = write_data;
+  event_fd->events = 0;
 
-  if ( fd >= event->fd_set_size ) {
-    event->fd_set_size = fd + 1;
-  }
+  event->event_fd_set[ fd ] = event_fd;
+  event->active_fd_count++;
 }
 void ( *set_fd_handler_safe )( int fd, event_fd_callback read_callback, void *read_data, event_fd_callback write_callback, void *write_data ) = _set_fd_handler;
 
@@ -268,75 +350,49 @@ _delete_fd_handler( int fd ) {
   event_read_end();
   assert( event_info != NULL );
 
-  struct event_fd *event = event_info->event_list;
-
-  while ( event != event_info->event_last && event->fd != fd ) {
-    event++;
-  }
-
-  if ( ( event >= event_info->event_last ) || ( event_info->event_fd_set[ fd ] ) == NULL ) {
+  struct event_fd *event = lookup_event_fd( event_info, fd );
+  if ( event == NULL ) {
     error( "Tried to delete an inactive fd event handler." );
     return;
   }
 
-  if ( FD_ISSET( fd, &event_info->event_read_set ) ) {
+  if ( event->events & EPOLLIN ) {
     error( "Tried to delete an fd event handler with active read notification." );
-    FD_CLR( fd, &event_info->event_read_set );
   }
 
-  if ( FD_ISSET( fd, &event_info->event_write_set ) ) {
+  if ( event->events & EPOLLOUT ) {
     error( "Tried to delete an fd event handler with active write notification." );
-    FD_CLR( fd, &event_info->event_write_set );
   }
 
-  FD_CLR( fd, &event_info->current_read_set );
-  FD_CLR( fd, &event_info->current_write_set );
+  update_epoll_events( event_info, event, 0 );
 
+  event_write_begin();
   event_info->event_fd_set[ fd ] = NULL;
-
-  if ( event != --event_info->event_last ) {
-    memcpy( event, event_info->event_last, sizeof( struct event_fd ) );
-    event_info->event_fd_set[ event->fd ] = event;
-  }
-
-  memset( event_info->event_last, 0, sizeof( struct event_fd ) );
-  event_info->event_last->fd = -1;
-
-  if ( fd == ( event_info->fd_set_size  - 1 ) ) {
-    int i;
-    for ( i = ( event_info->fd_set_size - 2 ); i >= 0; --i ) {
-      if ( event_info->event_fd_set[ i ] != NULL ) {
-        break;
-      }
-    }
-    event_info->fd_set_size = i + 1;
-  }
+  event_write_end();
+  event_info->active_fd_count--;
+  xfree( event );
 }
 void ( *delete_fd_handler_safe )( int fd ) = _delete_fd_handler;
 
 
 static void
 _set_readable( int fd, bool state ) {
-  if ( ( fd < 0 ) || ( fd >= FD_SETSIZE ) ) {
-    error( "Invalid fd to set_readable call; %i.", fd );
-    return;
-  }
   event_read_begin();
-  struct event_info *event = get_event_info();
+  struct event_info *event_info = get_event_info();
   event_read_end();
-  assert( event != NULL );
+  assert( event_info != NULL );
 
-  if ( ( event->event_fd_set[ fd ] == NULL ) || ( event->event_fd_set[ fd ]->read_callback == NULL ) ) {
-    error( "Found fd in invalid state in set_readable; %i, %p.", fd, event->event_fd_set[ fd ] );
+  struct event_fd *event = lookup_event_fd( event_info, fd );
+  if ( ( event == NULL ) || ( event->read_callback == NULL ) ) {
+    error( "Found fd in invalid state in set_readable; %i, %p.", fd, event );
     return;
   }
 
   if ( state ) {
-    FD_SET( fd, &event->event_read_set );
+    update_epoll_events( event_info, event, event->events | EPOLLIN );
   }
   else {
-    FD_CLR( fd, &event->event_read_set );
-    FD_CLR( fd, &event->current_read_set );
+    update_epoll_events( event_info, event, event->events & ~( uint32_t ) EPOLLIN );
   }
 }
 void ( *set_readable_safe )( int fd, bool state ) = _set_readable;
@@ -344,30 +400,28 @@ void ( *set_readable_safe )( int fd, bool state ) = _set_readable;
 
 static void
 _set_writable( int fd, bool state ) {
-  if ( ( fd < 0 ) || ( fd >= FD_SETSIZE ) ) {
-    error( "Invalid fd to notify_writeable_event call; %i.", fd );
-    return;
-  }
-
   event_read_begin();
-  struct event_info *event = get_event_info();
-  if ( event->event_fd_set[ fd ] == NULL || event->event_fd_set[ fd ]->fd != fd ) {
-    event = get_event_info_by_fd( fd );
+  struct event_info *event_info = get_event_info();
+  if ( event_info == NULL || lookup_event_fd( event_info, fd ) == NULL ) {
+    event_info = get_event_info_by_fd( fd );
   }
   event_read_end();
-  assert( event != NULL );
+  if ( event_info == NULL ) {
+    error( "Invalid fd to notify_writeable_event call; %i.", fd );
+    return;
+  }
 
-  if ( ( event->event_fd_set[ fd ] == NULL ) || ( event->event_fd_set[ fd ]->write_callback == NULL ) ) {
-    error( "Found fd in invalid state in notify_writeable_event; %i, %p.", fd, event->event_fd_set[ fd ] );
+  struct event_fd *event = lookup_event_fd( event_info, fd );
+  if ( ( event == NULL ) || ( event->write_callback == NULL ) ) {
+    error( "Found fd in invalid state in notify_writeable_event; %i, %p.", fd, event );
     return;
   }
 
   if ( state ) {
-    FD_SET( fd, &event->event_write_set );
+    update_epoll_events( event_info, event, event->events | EPOLLOUT );
   }
   else {
-    FD_CLR( fd, &event->event_write_set );
-    FD_CLR( fd, &event->current_write_set );
+    update_epoll_events( event_info, event, event->events & ~( uint32_t ) EPOLLOUT );
   }
 }
 void ( *set_writable_safe )( int fd, bool state ) = _set_writable;
@@ -376,11 +430,13 @@ void ( *set_writable_safe )( int fd, bool state ) = _set_writable;
 static bool
 _readable( int fd ) {
   event_read_begin();
-  struct event_info *event = get_event_info();
+  struct event_info *event_info = get_event_info();
   event_read_end();
-  assert( event != NULL );
-  
-  return FD_ISSET( fd, &event->event_read_set );
+  assert( event_info != NULL );
+
+  struct event_fd *event = lookup_event_fd( event_info, fd );
+
+  return event != NULL && ( event->events & EPOLLIN ) != 0;
 }
 bool ( *readable_safe )( int fd ) = _readable;
 
@@ -388,11 +444,13 @@ bool ( *readable_safe )( int fd ) = _readable;
 static bool
 _writable( int fd ) {
   event_read_begin();
-  struct event_info *event = get_event_info();
+  struct event_info *event_info = get_event_info();
   event_read_end();
-  assert( event != NULL );
+  assert( event_info != NULL );
+
+  struct event_fd *event = lookup_event_fd( event_info, fd );
 
-  return FD_ISSET( fd, &event->event_write_set );
+  return event != NULL && ( event->events & EPOLLOUT ) != 0;
 }
 bool ( *writable_safe )( int fd ) = _writable;
 
@@ -26,6 +26,8 @@ extern "C" {
 #endif
 
   
+#include <stdint.h>
+#include <sys/epoll.h>
 #include <sys/types.h>
 #include "bool.h"
 #include "event_handler.h"
@@ -45,21 +47,19 @@ struct event_fd {
   event_fd_callback write_callback;
   void *read_data;
   void *write_data;
+  uint32_t events; // EPOLLIN and/or EPOLLOUT being monitored
 };
 
 struct event_info {
-  struct event_fd event_list[ FD_SETSIZE ];
-  struct event_fd *event_last;
-  struct event_fd *event_fd_set[ FD_SETSIZE ];
+  struct event_fd **event_fd_set; // indexed by fd
+  int event_fd_set_size;
+  int active_fd_count;
+  int epoll_fd;
+  struct epoll_event *ready_events;
   external_callback_t external_callback;
-  fd_set event_read_set; 
-  fd_set event_write_set;
-  fd_set current_read_set;
-  fd_set current_write_set;
   pthread_t thread_id;
   pthread_mutex_t mutex;
   int event_handler_state; 
-  int fd_set_size;
 };
 
 struct event_info_list {
@@ -18,6 +18,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <stdbool.h>
 #include <sys/time.h>
@@ -45,7 +46,7 @@ _init_timer() {
 
   timer = ( struct timer_info * ) xmalloc( sizeof( *timer ) );
   timer->thread_id = current_thread();
-  timer->timer_callbacks = create_dlist();
+  timer->timer_callbacks = create_timer_queue();
   timer_write_begin();
   ALLOC_GROW( timer_list.timers, timer_list.timers_nr + 1, timer_list.timers_alloc );
   timer_list.timers[ timer_list.timers_nr++ ] = timer;
@@ -68,10 +69,7 @@ _finalize_timer() {
   debug( "Deleting timer callbacks ( timer_callbacks = %p ).", timer->timer_callbacks );
 
   if ( timer->timer_callbacks != NULL ) {
-    for ( dlist_element *e = timer->timer_callbacks->next; e; e = e->next ) {
-      xfree( e->data );
-    }
-    delete_dlist( timer->timer_callbacks );
+    delete_timer_queue( timer->timer_callbacks );
     timer->timer_callbacks = NULL;
   }
   else {
@@ -87,53 +85,6 @@ _finalize_timer() {
 bool ( *finalize_timer_safe )( void ) = _finalize_timer;
 
 
-static void
-on_timer( timer_callback_info *callback, struct timespec *now ) {
-  assert( callback != NULL );
-  assert( callback->function != NULL );
-
-  debug( "Executing a timer event ( function = %p, expires_at = %u.%09u, interval = %u.%09u, user_data = %p ).",
-         callback->function, callback->expires_at.tv_sec, callback->expires_at.tv_nsec,
-         callback->interval.tv_sec, callback->interval.tv_nsec, callback->user_data );
-
-  if ( VALID_TIMESPEC( &callback->expires_at ) ) {
-    callback->function( callback->user_data );
-    if ( VALID_TIMESPEC( &callback->interval ) ) {
-      ADD_TIMESPEC( &callback->expires_at, &callback->interval, &callback->expires_at );
-      if ( TIMESPEC_LESS_THEN( &callback->expires_at, now ) ) {
-        callback->expires_at.tv_sec = now->tv_sec;
-        callback->expires_at.tv_nsec = now->tv_nsec;
-      }
-    }
-    else {
-      callback->expires_at.tv_sec = 0;
-      callback->expires_at.tv_nsec = 0;
-      callback->function = NULL;
-    }
-    debug( "Set expires_at value to %u.%09u.", callback->expires_at.tv_sec, callback->expires_at.tv_nsec );
-  }
-  else {
-    error( "Invalid expires_at value." );
-  }
-}
-
-
-static void
-insert_timer_callback( struct timer_info *timer, timer_callback_info *new_cb ) {
-  assert( timer->timer_callbacks != NULL );
-  dlist_element *element, *last = timer->timer_callbacks;
-  for ( element = timer->timer_callbacks->next; element != NULL; element = element->next ) {
-    timer_callback_info *cb = element->data;
-    if ( TIMESPEC_LESS_THEN( &new_cb->expires_at, &cb->expires_at ) ) {
-      insert_before_dlist( element, new_cb );
-      return;
-    }
-    last = element;
-  }
-  insert_after_dlist( last, new_cb );
-}
-
-
 static void
 _execute_timer_events( int *next_timeout_usec ) {
   assert( next_timeout_usec != NULL );
@@ -149,39 +100,21 @@ _execute_timer_events( int *next_timeout_usec ) {
   assert( clock_gettime( CLOCK_MONOTONIC, &now ) == 0 );
   assert( timer->timer_callbacks != NULL );
 
-  timer_callback_info *callback = NULL;
-  dlist_element *element_next = NULL;
-  for ( dlist_element *element = timer->timer_callbacks->next; element; element = element_next ) {
-    element_next = element->next;
-    callback = element->data;
-    if ( callback->function != NULL ) {
-      if ( TIMESPEC_LESS_THEN( &now, &callback->expires_at ) ) {
-        break;
-      }
-      on_timer( callback, &now );
-    }
-    delete_dlist_element( element );
-    if ( callback->function == NULL ) {
-      xfree( callback );
-    }
-    else {
-      insert_timer_callback( timer, callback );
-    }
-  }
+  run_timer_entries( timer->timer_callbacks, &now );
 
   struct timespec max_timeout = { ( INT_MAX / 1000000 ), 0 };
   struct timespec min_timeout = { 0, 0 };
-  if ( timer->timer_callbacks->next == NULL ) {
+  const struct timespec *expires_at = get_next_timer_expiry( timer->timer_callbacks );
+  if ( expires_at == NULL ) {
     TIMESPEC_TO_MICROSECONDS( &max_timeout, next_timeout_usec );
   }
   else {
-    callback = timer->timer_callbacks->next->data;
-    if ( TIMESPEC_LESS_THEN( &callback->expires_at, &now ) ) {
+    if ( TIMESPEC_LESS_THEN( expires_at, &now ) ) {
       TIMESPEC_TO_MICROSECONDS( &min_timeout, next_timeout_usec );
     }
     else {
       struct timespec timeout = { 0, 0 };
-      SUB_TIMESPEC( &callback->expires_at, &now, &timeout );
+      SUB_TIMESPEC( expires_at, &now, &timeout );
       if ( TIMESPEC_LESS_THEN( &timeout, &max_timeout ) ) {
         TIMESPEC_TO_MICROSECONDS( &timeout, next_timeout_usec );
       }
@@ -195,51 +128,58 @@ void ( *execute_timer_events_safe )( int * ) = _execute_timer_events;
 
 
 static bool
-_add_timer_event_callback( struct itimerspec *interval, timer_callback callback, void *user_data ) {
-  assert( interval != NULL );
-  assert( callback != NULL );
-
-  timer_read_begin();
-  struct timer_info *timer = get_timer_info();
-  timer_read_end();
-  assert( timer != NULL );
-
-  debug( "Adding a timer event callback ( interval = %u.%09u, initial expiration = %u.%09u, callback = %p, user_data = %p ).",
-         interval->it_interval.tv_sec, interval->it_interval.tv_nsec,
-         interval->it_value.tv_sec, interval->it_value.tv_nsec, callback, user_data );
-
-  timer_callback_info *cb = xmalloc( sizeof( timer_callback_info ) );
-  memset( cb, 0, sizeof( timer_callback_info ) );
-  cb->function = callback;
-  cb->user_data = user_data;
-
+get_expiration_time( struct itimerspec *interval, struct timespec *expires_at ) {
   struct timespec now = { 0, 0 };
   if ( clock_gettime( CLOCK_MONOTONIC, &now ) != 0 ) {
     error( "Failed to retrieve monotonic time ( %s [%d] ).", strerror( errno ), errno );
-    xfree( cb );
     return false;
   }
 
-  cb->interval = interval->it_interval;
-
   if ( VALID_TIMESPEC( &interval->it_value ) ) {
-    ADD_TIMESPEC( &now, &interval->it_value, &cb->expires_at );
+    ADD_TIMESPEC( &now, &interval->it_value, expires_at );
   }
   else if ( VALID_TIMESPEC( &interval->it_interval ) ) {
-    ADD_TIMESPEC( &now, &interval->it_interval, &cb->expires_at );
+    ADD_TIMESPEC( &now, &interval->it_interval, expires_at );
   }
   else {
     error( "Timer must not be zero when a timer event is added." );
-    xfree( cb );
     return false;
   }
 
   debug( "Set an initial expiration time to %u.%09u.", now.tv_sec, now.tv_nsec );
 
+  return true;
+}
+
+
+static timer_handle
+_add_timer_event( struct itimerspec *interval, timer_callback callback, void *user_data ) {
+  assert( interval != NULL );
+  assert( callback != NULL );
+
+  timer_read_begin();
+  struct timer_info *timer = get_timer_info();
+  timer_read_end();
+  assert( timer != NULL );
+
+  debug( "Adding a timer event callback ( interval = %u.%09u, initial expiration = %u.%09u, callback = %p, user_data = %p ).",
+         interval->it_interval.tv_sec, interval->it_interval.tv_nsec,
+         interval->it_value.tv_sec, interval->it_value.tv_nsec, callback, user_data );
+
+  struct timespec expires_at = { 0, 0 };
+  if ( !get_expiration_time( interval, &expires_at ) ) {
+    return INVALID_TIMER_HANDLE;
+  }
+
   assert( timer->timer_callbacks != NULL );
-  insert_timer_callback( timer, cb );
+  return add_timer_entry( timer->timer_callbacks, callback, user_data, &expires_at, &interval->it_interval );
+}
+timer_handle ( *add_timer_event_safe )( struct itimerspec *interval, timer_callback callback, void *user_data ) = _add_timer_event;
 
-  return true;
+
+static bool
+_add_timer_event_callback( struct itimerspec *interval, timer_callback callback, void *user_data ) {
+  return _add_timer_event( interval, callback, user_data ) != INVALID_TIMER_HANDLE;
 }
 bool ( *add_timer_event_callback_safe )( struct itimerspec *interval, timer_callback callback, void *user_data ) = _add_timer_event_callback;
 
@@ -277,18 +217,10 @@ _delete_timer_event( timer_callback callback, void *user_data ) {
     return false;
   }
 
-  for ( dlist_element *e = timer->timer_callbacks->next; e; e = e->next ) {
-    timer_callback_info *cb = e->data;
-    if ( cb->function == callback && cb->user_data == user_data ) {
-      debug( "Deleting a callback ( callback = %p, user_data = %p ).", callback, user_data );
-      cb->function = NULL;
-      cb->user_data = NULL;
-      cb->expires_at.tv_sec = 0;
-      cb->expires_at.tv_nsec = 0;
-      cb->interval.tv_sec = 0;
-      cb->interval.tv_nsec = 0;
-      return true;
-    }
+  timer_handle handle = find_timer_entry( timer->timer_callbacks, callback, user_data );
+  if ( handle != INVALID_TIMER_HANDLE ) {
+    debug( "Deleting a callback ( callback = %p, user_data = %p ).", callback, user_data );
+    return remove_timer_entry( timer->timer_callbacks, handle );
   }
 
   error( "No registered timer event callback found." );
@@ -298,6 +230,49 @@ _delete_timer_event( timer_callback callback, void *user_data ) {
 bool ( *delete_timer_event_safe )( timer_callback callback, void *user_data ) = _delete_timer_event;
 
 
+static bool
+_cancel_timer_event( timer_handle handle ) {
+  timer_read_begin();
+  struct timer_info *timer = get_timer_info();
+  timer_read_end();
+  assert( timer != NULL );
+
+  debug( "Cancelling a timer event ( handle = %#" PRIx64 " ).", handle );
+
+  if ( timer->timer_callbacks == NULL ) {
+    debug( "All timer callbacks are already deleted or not created yet." );
+    return false;
+  }
+
+  return remove_timer_entry( timer->timer_callbacks, handle );
+}
+bool ( *cancel_timer_event_safe )( timer_handle handle ) = _cancel_timer_event;
+
+
+static bool
+_reschedule_timer_event( timer_handle handle, struct itimerspec *interval ) {
+  assert( interval != NULL );
+
+  timer_read_begin();
+  struct timer_info *timer = get_timer_info();
+  timer_read_end();
+  assert( timer != NULL );
+
+  if ( timer->timer_callbacks == NULL ) {
+    debug( "All timer callbacks are already deleted or not created yet." );
+    return false;
+  }
+
+  struct timespec expires_at = { 0, 0 };
+  if ( !get_expiration_time( interval, &expires_at ) ) {
+    return false;
+  }
+
+  return update_timer_entry( timer->timer_callbacks, handle, &expires_at, &interval->it_interval );
+}
+bool ( *reschedule_timer_event_safe )( timer_handle handle, struct itimerspec *interval ) = _reschedule_timer_event;
+
+
 /*
  * Local variables:
  * c-basic-offset: 2
@@ -28,6 +28,7 @@ extern "C" {
 #include <time.h>
 #include "doubly_linked_list.h"
 #include "timer.h"
+#include "timer_queue.h"
 
 
 #define VALID_TIMESPEC( _a )                                  \
@@ -69,15 +70,8 @@ extern "C" {
   while ( 0 )
 
 
-typedef struct timer_callback_info {
-  timer_callback function;
-  struct timespec expires_at;
-  struct timespec interval;
-  void *user_data;
-} timer_callback_info;
-
 struct timer_info {
-  dlist_element *timer_callbacks;
+  timer_queue *timer_callbacks;
   pthread_t thread_id;
 };
 
@@ -94,6 +88,9 @@ void ( *execute_timer_events_safe )( int *next_timeout_usec );
 bool ( *add_timer_event_callback_safe )( struct itimerspec *interval, timer_callback callback, void *user_data );
 extern bool ( *add_periodic_event_callback_safe )( const time_t seconds, timer_callback callback, void *user_data );
 bool ( *delete_timer_event_safe )( timer_callback callback, void *user_data );
+extern timer_handle ( *add_timer_event_safe )( struct itimerspec *interval, timer_callback callback, void *user_data );
+extern bool ( *cancel_timer_event_safe )( timer_handle handle );
+extern bool ( *reschedule_timer_event_safe )( timer_handle handle, struct itimerspec *interval );
 
 
 #ifdef __cplusplus
@@ -0,0 +1,362 @@
+/*
+ * Shared memory byte ring
+ *
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "log.h"
+#include "shm_ring.h"
+#include "wrapper.h"
+
+
+#define SHM_RING_MAGIC 0x54534852 // "TSHR"
+#define SHM_RING_MIN_SIZE 4096
+#define SHM_RING_RECORD_WRAP 1
+
+
+typedef struct {
+  uint32_t length;
+  uint32_t flags;
+} shm_ring_record;
+
+
+static uint32_t
+round_up_to_power_of_two( size_t size ) {
+  uint32_t n = SHM_RING_MIN_SIZE;
+  while ( n < size && n < ( 1U << 30 ) ) {
+    n <<= 1;
+  }
+
+  return n;
+}
+
+
+static uint32_t
+record_size( size_t length ) {
+  return ( uint32_t ) ( ( sizeof( shm_ring_record ) + length + 7 ) & ~( ( size_t ) 7 ) );
+}
+
+
+static void
+notify( int fd ) {
+  uint64_t one = 1;
+  ssize_t ret = write( fd, &one, sizeof( one ) );
+  if ( ret < 0 && errno != EAGAIN ) {
+    error( "Failed to notify a shared memory ring peer ( fd = %d, errno = %s [%d] ).", fd, strerror( errno ), errno );
+  }
+}
+
+
+static shm_ring *
+map_shm_ring( int memory_fd, size_t map_size ) {
+  void *map = mmap( NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, memory_fd, 0 );
+  if ( map == MAP_FAILED ) {
+    error( "Failed to map a shared memory ring ( fd = %d, size = %zu, errno = %s [%d] ).",
+           memory_fd, map_size, strerror( errno ), errno );
+    return NULL;
+  }
+
+  shm_ring *ring = xmalloc( sizeof( shm_ring ) );
+  memset( ring, 0, sizeof( shm_ring ) );
+  ring->header = map;
+  ring->map_size = map_size;
+  ring->memory_fd = memory_fd;
+  ring->notify_fd = -1;
+  ring->space_fd = -1;
+
+  return ring;
+}
+
+
+/*
+ * Creates the producer side of a ring with at least size bytes of
+ * record space. Returns NULL on failure.
+ */
+shm_ring *
+create_shm_ring( size_t size ) {
+  uint32_t data_size = round_up_to_power_of_two( size );
+  size_t map_size = sizeof( shm_ring_header ) + data_size;
+
+  int memory_fd = memfd_create( "trema-shm-ring", MFD_CLOEXEC );
+  if ( memory_fd < 0 ) {
+    error( "Failed to create a shared memory ring ( errno = %s [%d] ).", strerror( errno ), errno );
+    return NULL;
+  }
+  if ( ftruncate( memory_fd, ( off_t ) map_size ) < 0 ) {
+    error( "Failed to resize a shared memory ring ( size = %zu, errno = %s [%d] ).", map_size, strerror( errno ), errno );
+    close( memory_fd );
+    return NULL;
+  }
+
+  shm_ring *ring = map_shm_ring( memory_fd, map_size );
+  if ( ring == NULL ) {
+    close( memory_fd );
+    return NULL;
+  }
+  memset( ring->header, 0, sizeof( shm_ring_header ) );
+  ring->header->magic = SHM_RING_MAGIC;
+  ring->header->size = data_size;
+
+  ring->notify_fd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+  ring->space_fd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+  if ( ring->notify_fd < 0 || ring->space_fd < 0 ) {
+    error( "Failed to create eventfds for a shared memory ring ( errno = %s [%d] ).", strerror( errno ), errno );
+    delete_shm_ring( ring );
+    return NULL;
+  }
+
+  return ring;
+}
+
+
+/*
+ * Creates the consumer side of a ring from descriptors created by
+ * create_shm_ring(). The ring takes ownership of the descriptors on
+ * success; on failure they are left to the caller.
+ */
+shm_ring *
+attach_shm_ring( int memory_fd, int notify_fd, int space_fd ) {
+  struct stat st;
+  if ( fstat( memory_fd, &st ) < 0 || ( size_t ) st.st_size <= sizeof( shm_ring_header ) ) {
+    error( "Invalid shared memory ring ( fd = %d ).", memory_fd );
+    return NULL;
+  }
+
+  shm_ring *ring = map_shm_ring( memory_fd, ( size_t ) st.st_size );
+  if ( ring == NULL ) {
+    return NULL;
+  }
+  shm_ring_header *header = ring->header;
+  if ( header->magic != SHM_RING_MAGIC || header->size == 0 || ( header->size & ( header->size - 1 ) ) != 0 ||
+       sizeof( shm_ring_header ) + header->size > ring->map_size ) {
+    error( "Invalid shared memory ring header ( fd = %d, magic = %#x, size = %u ).", memory_fd, header->magic, header->size );
+    munmap( ring->header, ring->map_size );
+    xfree( ring );
+    return NULL;
+  }
+  ring->notify_fd = notify_fd;
+  ring->space_fd = space_fd;
+
+  return ring;
+}
+
+
+void
+delete_shm_ring( shm_ring *ring ) {
+  assert( ring != NULL );
+
+  munmap( ring->header, ring->map_size );
+  close( ring->memory_fd );
+  if ( ring->notify_fd >= 0 ) {
+    close( ring->notify_fd );
+  }
+  if ( ring->space_fd >= 0 ) {
+    close( ring->space_fd );
+  }
+  xfree( ring );
+}
+
+
+/*
+ * Called from the producer only. Returns a pointer to length bytes of
+ * contiguous record space, or NULL if the ring is full. In the latter
+ * case the consumer will signal space_fd once it has released space.
+ * The record becomes visible to the consumer on commit_shm_ring().
+ */
+void *
+reserve_shm_ring( shm_ring *ring, size_t length ) {
+  assert( ring != NULL );
+
+  shm_ring_header *header = ring->header;
+  uint32_t size = header->size;
+  uint32_t total = record_size( length );
+  if ( total > size / 2 ) {
+    return NULL;
+  }
+
+  uint32_t tail = header->tail;
+  uint32_t offset = tail & ( size - 1 );
+  uint32_t contiguous = size - offset;
+  uint32_t needed = contiguous < total ? contiguous + total : total;
+
+  if ( size - ( tail - header->head ) < needed ) {
+    header->producer_waiting = 1;
+    __sync_synchronize(); // announce before looking at head again
+    if ( size - ( tail - header->head ) < needed ) {
+      return NULL;
+    }
+    header->producer_waiting = 0;
+  }
+  __sync_synchronize(); // space must be released before we overwrite it
+
+  if ( contiguous < total ) {
+    shm_ring_record *pad = ( shm_ring_record * ) ( header->data + offset );
+    pad->length = contiguous - ( uint32_t ) sizeof( shm_ring_record );
+    pad->flags = SHM_RING_RECORD_WRAP;
+    tail += contiguous;
+    offset = 0;
+  }
+
+  shm_ring_record *record = ( shm_ring_record * ) ( header->data + offset );
+  record->length = ( uint32_t ) length;
+  record->flags = 0;
+  ring->next_tail = tail + total;
+
+  return record + 1;
+}
+
+
+void
+commit_shm_ring( shm_ring *ring ) {
+  assert( ring != NULL );
+
+  shm_ring_header *header = ring->header;
+  __sync_synchronize(); // the record must be visible before the new tail
+  header->tail = ring->next_tail;
+  __sync_synchronize(); // publish the tail before looking at the flag
+  if ( header->consumer_waiting ) {
+    header->consumer_waiting = 0;
+    notify( ring->notify_fd );
+  }
+}
+
+
+static void
+release( shm_ring *ring, uint32_t head ) {
+  shm_ring_header *header = ring->header;
+  __sync_synchronize(); // the record must be read before it is released
+  header->head = head;
+  __sync_synchronize();
+  if ( header->producer_waiting ) {
+    header->producer_waiting = 0;
+    notify( ring->space_fd );
+  }
+}
+
+
+/*
+ * Called from the consumer only. Returns the oldest record without
+ * removing it, or NULL if the ring is empty.
+ */
+void *
+peek_shm_ring( shm_ring *ring, size_t *length ) {
+  assert( ring != NULL );
+  assert( length != NULL );
+
+  shm_ring_header *header = ring->header;
+  for ( ;; ) {
+    uint32_t head = header->head;
+    uint32_t tail = header->tail;
+    if ( head == tail ) {
+      return NULL;
+    }
+    __sync_synchronize(); // records must not be read before the tail
+
+    uint32_t size = header->size;
+    uint32_t offset = head & ( size - 1 );
+    shm_ring_record *record = ( shm_ring_record * ) ( header->data + offset );
+    uint32_t total = record_size( record->length );
+    if ( total > size - offset || total > tail - head ) {
+      error( "Corrupted shared memory ring ( head = %u, tail = %u, length = %u ).", head, tail, record->length );
+      release( ring, tail );
+      return NULL;
+    }
+    if ( ( record->flags & SHM_RING_RECORD_WRAP ) != 0 ) {
+      release( ring, head + total );
+      continue;
+    }
+
+    *length = record->length;
+    ring->next_head = head + total;
+
+    return record + 1;
+  }
+}
+
+
+/*
+ * Removes the record returned by the last peek_shm_ring() call.
+ */
+void
+consume_shm_ring( shm_ring *ring ) {
+  assert( ring != NULL );
+
+  release( ring, ring->next_head );
+}
+
+
+bool
+shm_ring_is_empty( shm_ring *ring ) {
+  assert( ring != NULL );
+
+  return ring->header->head == ring->header->tail;
+}
+
+
+/*
+ * Called from the consumer when it has drained the ring. Returns true
+ * if the consumer may sleep until notify_fd becomes readable, or false
+ * if records arrived meanwhile.
+ */
+bool
+wait_shm_ring( shm_ring *ring ) {
+  assert( ring != NULL );
+
+  ring->header->consumer_waiting = 1;
+  __sync_synchronize(); // announce before looking at tail again
+  if ( !shm_ring_is_empty( ring ) ) {
+    ring->header->consumer_waiting = 0;
+    return false;
+  }
+
+  return true;
+}
+
+
+/*
+ * Makes notify_fd readable so that the consumer comes back to the ring
+ * after yielding to other events.
+ */
+void
+wakeup_shm_ring_consumer( shm_ring *ring ) {
+  assert( ring != NULL );
+
+  notify( ring->notify_fd );
+}
+
+
+void
+clear_shm_ring_notification( int fd ) {
+  uint64_t count;
+  while ( read( fd, &count, sizeof( count ) ) > 0 ) {
+  }
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
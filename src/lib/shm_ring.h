@@ -0,0 +1,94 @@
+/*
+ * Shared memory byte ring
+ *
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/*
+ * A single-producer/single-consumer byte ring in a shared memory
+ * segment. Records are variable length and always contiguous in the
+ * mapping, so that the consumer can hand them out without copying.
+ *
+ * The producer and the consumer may live in different processes. The
+ * segment and two eventfds are created by the producer and passed to
+ * the consumer ( e.g. with SCM_RIGHTS ). notify_fd wakes up the
+ * consumer and space_fd wakes up the producer; each side writes the
+ * other's fd only if the other side has announced that it is waiting.
+ */
+
+
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bool.h"
+
+
+#define SHM_RING_CACHE_LINE_SIZE 64
+
+
+typedef struct {
+  uint32_t magic;
+  uint32_t size; // bytes in data[], power of two
+  char pad0[ SHM_RING_CACHE_LINE_SIZE - 8 ];
+  volatile uint32_t head; // written by consumer
+  volatile uint32_t consumer_waiting;
+  char pad1[ SHM_RING_CACHE_LINE_SIZE - 8 ];
+  volatile uint32_t tail; // written by producer
+  volatile uint32_t producer_waiting;
+  char pad2[ SHM_RING_CACHE_LINE_SIZE - 8 ];
+  uint8_t data[ 0 ];
+} shm_ring_header;
+
+
+typedef struct {
+  shm_ring_header *header;
+  size_t map_size;
+  int memory_fd;
+  int notify_fd;
+  int space_fd;
+  uint32_t next_tail; // producer: tail after the reserved record
+  uint32_t next_head; // consumer: head after the peeked record
+} shm_ring;
+
+
+shm_ring *create_shm_ring( size_t size );
+shm_ring *attach_shm_ring( int memory_fd, int notify_fd, int space_fd );
+void delete_shm_ring( shm_ring *ring );
+
+void *reserve_shm_ring( shm_ring *ring, size_t length );
+void commit_shm_ring( shm_ring *ring );
+
+void *peek_shm_ring( shm_ring *ring, size_t *length );
+void consume_shm_ring( shm_ring *ring );
+bool shm_ring_is_empty( shm_ring *ring );
+bool wait_shm_ring( shm_ring *ring );
+void wakeup_shm_ring_consumer( shm_ring *ring );
+void clear_shm_ring_notification( int fd );
+
+
+#endif // SHM_RING_H
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
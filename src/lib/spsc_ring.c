@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <assert.h>
+#include <string.h>
+#include "spsc_ring.h"
+#include "wrapper.h"
+
+
+static unsigned int
+round_up_to_power_of_two( unsigned int size ) {
+  unsigned int n = 1;
+  while ( n < size ) {
+    n <<= 1;
+  }
+
+  return n;
+}
+
+
+spsc_ring *
+create_spsc_ring( unsigned int size ) {
+  assert( size > 0 );
+
+  spsc_ring *ring = xmalloc( sizeof( spsc_ring ) );
+  memset( ring, 0, sizeof( spsc_ring ) );
+  ring->size = round_up_to_power_of_two( size );
+  ring->mask = ring->size - 1;
+  ring->slots = xmalloc( sizeof( buffer * ) * ring->size );
+  memset( ring->slots, 0, sizeof( buffer * ) * ring->size );
+
+  return ring;
+}
+
+
+void
+delete_spsc_ring( spsc_ring *ring ) {
+  assert( ring != NULL );
+
+  buffer *data;
+  while ( ( data = pop_spsc_ring( ring ) ) != NULL ) {
+    free_buffer( data );
+  }
+  xfree( ring->slots );
+  xfree( ring );
+}
+
+
+/*
+ * Called from the producer thread only. Returns false if the ring is full.
+ */
+bool
+push_spsc_ring( spsc_ring *ring, buffer *data ) {
+  assert( ring != NULL );
+  assert( data != NULL );
+
+  unsigned int tail = ring->tail;
+  if ( tail - ring->head >= ring->size ) {
+    return false;
+  }
+  ring->slots[ tail & ring->mask ] = data;
+  __sync_synchronize(); // the slot must be visible before the new tail
+  ring->tail = tail + 1;
+
+  return true;
+}
+
+
+/*
+ * Called from the consumer thread only. Returns NULL if the ring is empty.
+ */
+buffer *
+pop_spsc_ring( spsc_ring *ring ) {
+  buffer *data = NULL;
+  pop_spsc_ring_bulk( ring, &data, 1 );
+
+  return data;
+}
+
+
+unsigned int
+pop_spsc_ring_bulk( spsc_ring *ring, buffer **data, unsigned int max ) {
+  assert( ring != NULL );
+  assert( data != NULL );
+
+  unsigned int head = ring->head;
+  unsigned int n = ring->tail - head;
+  if ( n == 0 ) {
+    return 0;
+  }
+  if ( n > max ) {
+    n = max;
+  }
+  __sync_synchronize(); // slots must not be read before the tail
+  for ( unsigned int i = 0; i < n; i++ ) {
+    data[ i ] = ring->slots[ ( head + i ) & ring->mask ];
+  }
+  __sync_synchronize(); // slots must be read before they are released
+  ring->head = head + n;
+
+  return n;
+}
+
+
+unsigned int
+get_spsc_ring_length( const spsc_ring *ring ) {
+  assert( ring != NULL );
+
+  return ring->tail - ring->head;
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
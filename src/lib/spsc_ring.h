@@ -0,0 +1,62 @@
+/*
+ * Lock-free single-producer/single-consumer ring
+ *
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+
+#include "bool.h"
+#include "buffer.h"
+
+
+#define SPSC_RING_CACHE_LINE_SIZE 64
+
+
+/*
+ * Exactly one thread may push and exactly one thread may pop.
+ */
+typedef struct {
+  buffer **slots;
+  unsigned int size; // power of two
+  unsigned int mask;
+  char pad0[ SPSC_RING_CACHE_LINE_SIZE ];
+  volatile unsigned int head; // next slot to pop ( written by consumer )
+  char pad1[ SPSC_RING_CACHE_LINE_SIZE ];
+  volatile unsigned int tail; // next slot to push ( written by producer )
+} spsc_ring;
+
+
+spsc_ring *create_spsc_ring( unsigned int size );
+void delete_spsc_ring( spsc_ring *ring );
+bool push_spsc_ring( spsc_ring *ring, buffer *data );
+buffer *pop_spsc_ring( spsc_ring *ring );
+unsigned int pop_spsc_ring_bulk( spsc_ring *ring, buffer **data, unsigned int max );
+unsigned int get_spsc_ring_length( const spsc_ring *ring );
+
+
+#endif // SPSC_RING_H
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
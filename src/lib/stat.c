@@ -20,7 +20,9 @@
 
 #include <assert.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <pthread.h>
+#include <string.h>
 #include "bool.h"
 #include "hash_table.h"
 #include "log.h"
@@ -60,16 +62,44 @@ void mock_error( const char *format, ... );
 
 #endif // UNIT_TESTING
 
-static hash_table *stats = NULL;
-static pthread_mutex_t stats_table_mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
-
-
 typedef struct {
   char key[ STAT_KEY_LENGTH ];
   uint64_t value;
+  int id;
 } stat_entry;
 
 
+static hash_table *stats = NULL;
+static pthread_mutex_t stats_table_mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+// Entries indexed by id. The table grows by adding a segment twice as
+// large as the previous one, and neither a segment nor an entry moves
+// once allocated, so that increment_stat_by_id() can update an entry
+// without taking the mutex.
+#define STAT_FIRST_SEGMENT_SIZE 64
+#define STAT_MAX_SEGMENTS 32
+
+static stat_entry **stat_segments[ STAT_MAX_SEGMENTS ];
+static int n_stat_entries = 0;
+
+
+static int
+get_stat_segment( int id ) {
+  unsigned int n = ( unsigned int ) id / STAT_FIRST_SEGMENT_SIZE + 1;
+
+  return ( int ) ( sizeof( n ) * 8 ) - 1 - __builtin_clz( n );
+}
+
+
+static stat_entry **
+get_stat_slot( int id ) {
+  int segment = get_stat_segment( id );
+  int first_id = STAT_FIRST_SEGMENT_SIZE * ( ( 1 << segment ) - 1 );
+
+  return &stat_segments[ segment ][ id - first_id ];
+}
+
+
 static void
 create_stats_table() {
   assert( stats == NULL );
@@ -92,6 +122,20 @@ delete_stats_table() {
   }
   delete_hash( stats );
   stats = NULL;
+
+  for ( int i = 0; i < STAT_MAX_SEGMENTS; i++ ) {
+    if ( stat_segments[ i ] != NULL ) {
+      xfree( stat_segments[ i ] );
+      stat_segments[ i ] = NULL;
+    }
+  }
+  n_stat_entries = 0;
+}
+
+
+static uint64_t
+read_stat_value( stat_entry *entry ) {
+  return __sync_fetch_and_add( &entry->value, 0 );
 }
 
 
@@ -140,12 +184,26 @@ add_stat_entry( const char *key ) {
     return false;
   }
 
+  if ( n_stat_entries == INT_MAX ) {
+    error( "Too many statistic entries ( key = %s ).", key );
+    pthread_mutex_unlock( &stats_table_mutex );
+    return false;
+  }
+
   entry = xmalloc( sizeof( stat_entry ) );
   entry->value = 0;
   strncpy( entry->key, key, STAT_KEY_LENGTH );
   entry->key[ STAT_KEY_LENGTH - 1 ] = '\0';
+  entry->id = n_stat_entries;
 
+  int segment = get_stat_segment( entry->id );
+  if ( stat_segments[ segment ] == NULL ) {
+    stat_segments[ segment ] = xcalloc( ( size_t ) STAT_FIRST_SEGMENT_SIZE << segment, sizeof( stat_entry * ) );
+  }
   insert_hash_entry( stats, entry->key, entry );
+  *get_stat_slot( entry->id ) = entry;
+  __sync_synchronize(); // the entry must be visible before its id
+  n_stat_entries++;
 
   pthread_mutex_unlock( &stats_table_mutex );
 
@@ -153,6 +211,49 @@ add_stat_entry( const char *key ) {
 }
 
 
+/**
+ * returns the id of the statistic entry for key, adding the entry if it
+ * does not exist yet, or -1 on failure. The id stays valid until
+ * finalize_stat() is called.
+ */
+int
+register_stat_entry( const char *key ) {
+  assert( key != NULL );
+  assert( stats != NULL );
+
+  pthread_mutex_lock( &stats_table_mutex );
+
+  stat_entry *entry = lookup_hash_entry( stats, key );
+  if ( entry == NULL ) {
+    if ( add_stat_entry( key ) == false ) {
+      pthread_mutex_unlock( &stats_table_mutex );
+      return -1;
+    }
+    entry = lookup_hash_entry( stats, key );
+  }
+
+  assert( entry != NULL );
+  int id = entry->id;
+
+  pthread_mutex_unlock( &stats_table_mutex );
+
+  return id;
+}
+
+
+/**
+ * increments the statistic entry returned by register_stat_entry().
+ * Neither a lookup nor a lock is involved.
+ */
+void
+increment_stat_by_id( int id ) {
+  assert( id >= 0 );
+  assert( id < n_stat_entries );
+
+  __sync_fetch_and_add( &( *get_stat_slot( id ) )->value, 1 );
+}
+
+
 void
 increment_stat( const char *key ) {
   assert( key != NULL );
@@ -171,7 +272,7 @@ increment_stat( const char *key ) {
 
   assert( entry != NULL );
 
-  ( entry->value )++;
+  __sync_fetch_and_add( &entry->value, 1 );
 
   pthread_mutex_unlock( &stats_table_mutex );
 }
@@ -192,7 +293,7 @@ dump_stats() {
   init_hash_iterator( stats, &iter );
   while ( ( e = iterate_hash_next( &iter ) ) != NULL ) {
     stat_entry *st = e->value;
-    info( "%s: %" PRIu64, st->key, st->value );
+    info( "%s: %" PRIu64, st->key, read_stat_value( st ) );
     n_stats++;
   }
 
@@ -30,6 +30,8 @@ bool init_stat( void );
 bool finalize_stat( void );
 bool add_stat_entry( const char *key );
 void increment_stat( const char *key );
+int register_stat_entry( const char *key );
+void increment_stat_by_id( int id );
 void dump_stats();
 
 
@@ -20,10 +20,11 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <limits.h>
-#include "doubly_linked_list.h"
 #include "log.h"
 #include "timer.h"
+#include "timer_queue.h"
 #include "wrapper.h"
 
 
@@ -52,15 +53,7 @@ void mock_debug( const char *format, ... );
 #endif // UNIT_TESTING
 
 
-typedef struct timer_callback_info {
-  timer_callback function;
-  struct timespec expires_at;
-  struct timespec interval;
-  void *user_data;
-} timer_callback_info;
-
-
-static dlist_element *timer_callbacks = NULL;
+static timer_queue *timer_callbacks = NULL;
 
 
 bool
@@ -70,7 +63,7 @@ _init_timer() {
     return false;
   }
 
-  timer_callbacks = create_dlist();
+  timer_callbacks = create_timer_queue();
 
   debug( "Initializing timer callbacks ( timer_callbacks = %p ).", timer_callbacks );
   return true;
@@ -80,15 +73,10 @@ bool ( *init_timer )( void ) = _init_timer;
 
 bool
 _finalize_timer() {
-  dlist_element *e;
-
   debug( "Deleting timer callbacks ( timer_callbacks = %p ).", timer_callbacks );
 
   if ( timer_callbacks != NULL ) {
-    for ( e = timer_callbacks->next; e; e = e->next ) {
-      xfree( e->data );
-    }
-    delete_dlist( timer_callbacks );
+    delete_timer_queue( timer_callbacks );
     timer_callbacks = NULL;
   }
   else {
@@ -138,96 +126,31 @@ bool ( *finalize_timer )( void ) = _finalize_timer;
   while ( 0 )
 
 
-static void
-on_timer( timer_callback_info *callback, struct timespec *now ) {
-  assert( callback != NULL );
-  assert( callback->function != NULL );
-
-  debug( "Executing a timer event ( function = %p, expires_at = %u.%09u, interval = %u.%09u, user_data = %p ).",
-         callback->function, callback->expires_at.tv_sec, callback->expires_at.tv_nsec,
-         callback->interval.tv_sec, callback->interval.tv_nsec, callback->user_data );
-
-  if ( VALID_TIMESPEC( &callback->expires_at ) ) {
-    callback->function( callback->user_data );
-    if ( VALID_TIMESPEC( &callback->interval ) ) {
-      ADD_TIMESPEC( &callback->expires_at, &callback->interval, &callback->expires_at );
-      if ( TIMESPEC_LESS_THEN( &callback->expires_at, now ) ) {
-        callback->expires_at.tv_sec = now->tv_sec;
-        callback->expires_at.tv_nsec = now->tv_nsec;
-      }
-    }
-    else {
-      callback->expires_at.tv_sec = 0;
-      callback->expires_at.tv_nsec = 0;
-      callback->function = NULL;
-    }
-    debug( "Set expires_at value to %u.%09u.", callback->expires_at.tv_sec, callback->expires_at.tv_nsec );
-  }
-  else {
-    error( "Invalid expires_at value." );
-  }
-}
-
-
-static void
-insert_timer_callback( timer_callback_info *new_cb ) {
-  assert( timer_callbacks != NULL );
-  dlist_element *element, *last = timer_callbacks;
-  for ( element = timer_callbacks->next; element != NULL; element = element->next ) {
-    timer_callback_info *cb = element->data;
-    if ( TIMESPEC_LESS_THEN( &new_cb->expires_at, &cb->expires_at ) ) {
-      insert_before_dlist( element, new_cb );
-      return;
-    }
-    last = element;
-  }
-  insert_after_dlist( last, new_cb );
-}
-
-
 void
 _execute_timer_events( int *next_timeout_usec ) {
   assert( next_timeout_usec != NULL );
   struct timespec now;
-  timer_callback_info *callback;
-  dlist_element *element, *element_next;
 
   debug( "Executing timer events ( timer_callbacks = %p ).", timer_callbacks );
 
   assert( clock_gettime( CLOCK_MONOTONIC, &now ) == 0 );
   assert( timer_callbacks != NULL );
 
-  for ( element = timer_callbacks->next; element; element = element_next ) {
-    element_next = element->next;
-    callback = element->data;
-    if ( callback->function != NULL ) {
-      if ( TIMESPEC_LESS_THEN( &now, &callback->expires_at ) ) {
-        break;
-      }
-      on_timer( callback, &now );
-    }
-    delete_dlist_element( element );
-    if ( callback->function == NULL ) {
-      xfree( callback );
-    }
-    else {
-      insert_timer_callback( callback );
-    }
-  }
+  run_timer_entries( timer_callbacks, &now );
 
   struct timespec max_timeout = { ( INT_MAX / 1000000 ), 0 };
   struct timespec min_timeout = { 0, 0 };
-  if ( timer_callbacks->next == NULL ) {
+  const struct timespec *expires_at = get_next_timer_expiry( timer_callbacks );
+  if ( expires_at == NULL ) {
     TIMESPEC_TO_MICROSECONDS( &max_timeout, next_timeout_usec );
   }
   else {
-    callback = timer_callbacks->next->data;
-    if ( TIMESPEC_LESS_THEN( &callback->expires_at, &now ) ) {
+    if ( TIMESPEC_LESS_THEN( expires_at, &now ) ) {
       TIMESPEC_TO_MICROSECONDS( &min_timeout, next_timeout_usec );
     }
     else {
       struct timespec timeout;
-      SUB_TIMESPEC( &callback->expires_at, &now, &timeout );
+      SUB_TIMESPEC( expires_at, &now, &timeout );
       if ( TIMESPEC_LESS_THEN( &timeout, &max_timeout ) ) {
         TIMESPEC_TO_MICROSECONDS( &timeout, next_timeout_usec );
       }
@@ -240,49 +163,54 @@ _execute_timer_events( int *next_timeout_usec ) {
 void ( *execute_timer_events )( int * ) = _execute_timer_events;
 
 
-bool
-_add_timer_event_callback( struct itimerspec *interval, timer_callback callback, void *user_data ) {
-  assert( interval != NULL );
-  assert( callback != NULL );
-
-  debug( "Adding a timer event callback ( interval = %u.%09u, initial expiration = %u.%09u, callback = %p, user_data = %p ).",
-         interval->it_interval.tv_sec, interval->it_interval.tv_nsec,
-         interval->it_value.tv_sec, interval->it_value.tv_nsec, callback, user_data );
-
-  timer_callback_info *cb;
+static bool
+get_expiration_time( struct itimerspec *interval, struct timespec *expires_at ) {
   struct timespec now;
-
-  cb = xmalloc( sizeof( timer_callback_info ) );
-  memset( cb, 0, sizeof( timer_callback_info ) );
-  cb->function = callback;
-  cb->user_data = user_data;
-
   if ( clock_gettime( CLOCK_MONOTONIC, &now ) != 0 ) {
     error( "Failed to retrieve monotonic time ( %s [%d] ).", strerror( errno ), errno );
-    xfree( cb );
     return false;
   }
 
-  cb->interval = interval->it_interval;
-
   if ( VALID_TIMESPEC( &interval->it_value ) ) {
-    ADD_TIMESPEC( &now, &interval->it_value, &cb->expires_at );
+    ADD_TIMESPEC( &now, &interval->it_value, expires_at );
   }
   else if ( VALID_TIMESPEC( &interval->it_interval ) ) {
-    ADD_TIMESPEC( &now, &interval->it_interval, &cb->expires_at );
+    ADD_TIMESPEC( &now, &interval->it_interval, expires_at );
   }
   else {
     error( "Timer must not be zero when a timer event is added." );
-    xfree( cb );
     return false;
   }
 
   debug( "Set an initial expiration time to %u.%09u.", now.tv_sec, now.tv_nsec );
 
+  return true;
+}
+
+
+timer_handle
+_add_timer_event( struct itimerspec *interval, timer_callback callback, void *user_data ) {
+  assert( interval != NULL );
+  assert( callback != NULL );
+
+  debug( "Adding a timer event callback ( interval = %u.%09u, initial expiration = %u.%09u, callback = %p, user_data = %p ).",
+         interval->it_interval.tv_sec, interval->it_interval.tv_nsec,
+         interval->it_value.tv_sec, interval->it_value.tv_nsec, callback, user_data );
+
+  struct timespec expires_at;
+  if ( !get_expiration_time( interval, &expires_at ) ) {
+    return INVALID_TIMER_HANDLE;
+  }
+
   assert( timer_callbacks != NULL );
-  insert_timer_callback( cb );
+  return add_timer_entry( timer_callbacks, callback, user_data, &expires_at, &interval->it_interval );
+}
+timer_handle ( *add_timer_event )( struct itimerspec *interval, timer_callback callback, void *user_data ) = _add_timer_event;
 
-  return true;
+
+bool
+_add_timer_event_callback( struct itimerspec *interval, timer_callback callback, void *user_data ) {
+  return _add_timer_event( interval, callback, user_data ) != INVALID_TIMER_HANDLE;
 }
 bool ( *add_timer_event_callback )( struct itimerspec *interval, timer_callback callback, void *user_data ) = _add_timer_event_callback;
 
@@ -306,33 +234,54 @@ _add_periodic_event_callback( const time_t seconds, timer_callback callback, voi
 bool ( *add_periodic_event_callback )( const time_t seconds, timer_callback callback, void *user_data ) = _add_periodic_event_callback;
 
 
+bool
+_cancel_timer_event( timer_handle handle ) {
+  debug( "Cancelling a timer event ( handle = %#" PRIx64 " ).", handle );
+
+  if ( timer_callbacks == NULL ) {
+    debug( "All timer callbacks are already deleted or not created yet." );
+    return false;
+  }
+
+  return remove_timer_entry( timer_callbacks, handle );
+}
+bool ( *cancel_timer_event )( timer_handle handle ) = _cancel_timer_event;
+
+
+bool
+_reschedule_timer_event( timer_handle handle, struct itimerspec *interval ) {
+  assert( interval != NULL );
+
+  if ( timer_callbacks == NULL ) {
+    debug( "All timer callbacks are already deleted or not created yet." );
+    return false;
+  }
+
+  struct timespec expires_at;
+  if ( !get_expiration_time( interval, &expires_at ) ) {
+    return false;
+  }
+
+  return update_timer_entry( timer_callbacks, handle, &expires_at, &interval->it_interval );
+}
+bool ( *reschedule_timer_event )( timer_handle handle, struct itimerspec *interval ) = _reschedule_timer_event;
+
+
 bool
 _delete_timer_event( timer_callback callback, void *user_data ) {
   assert( callback != NULL );
 
   debug( "Deleting a timer event ( callback = %p, user_data = %p ).", callback, user_data );
 
-  dlist_element *e;
-
   if ( timer_callbacks == NULL ) {
     debug( "All timer callbacks are already deleted or not created yet." );
     return false;
   }
 
-  for ( e = timer_callbacks->next; e; e = e->next ) {
-    timer_callback_info *cb = e->data;
-    if ( cb->function == callback && cb->user_data == user_data ) {
-      debug( "Deleting a callback ( callback = %p, user_data = %p ).", callback, user_data );
-      //xfree( cb );
-      //delete_dlist_element( e );
-      cb->function = NULL;
-      cb->user_data = NULL;
-      cb->expires_at.tv_sec = 0;
-      cb->expires_at.tv_nsec = 0;
-      cb->interval.tv_sec = 0;
-      cb->interval.tv_nsec = 0;
-      return true;
-    }
+  timer_handle handle = find_timer_entry( timer_callbacks, callback, user_data );
+  if ( handle != INVALID_TIMER_HANDLE ) {
+    debug( "Deleting a callback ( callback = %p, user_data = %p ).", callback, user_data );
+    return remove_timer_entry( timer_callbacks, handle );
   }
 
   error( "No registered timer event callback found." );
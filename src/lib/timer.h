@@ -25,11 +25,20 @@
 
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <time.h>
 
 
 typedef void ( *timer_callback )( void *user_data );
 
+/*
+ * Opaque reference to a timer event. It becomes invalid once the event is
+ * deleted or, for a one-shot event, once its callback has returned.
+ */
+typedef uint64_t timer_handle;
+
+#define INVALID_TIMER_HANDLE ( ( timer_handle ) 0 )
+
 
 extern bool ( *init_timer )( void );
 extern bool ( *finalize_timer )( void );
@@ -39,6 +48,10 @@ extern bool ( *add_periodic_event_callback )( const time_t seconds, timer_callba
 
 extern bool ( *delete_timer_event )( timer_callback callback, void *user_data );
 
+extern timer_handle ( *add_timer_event )( struct itimerspec *interval, timer_callback callback, void *user_data );
+extern bool ( *cancel_timer_event )( timer_handle handle );
+extern bool ( *reschedule_timer_event )( timer_handle handle, struct itimerspec *interval );
+
 extern void ( *execute_timer_events )( int *next_timeout_usec );
 
 
@@ -0,0 +1,391 @@
+/*
+ * Binary min-heap of timer events with handle-based cancellation
+ *
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <assert.h>
+#include <string.h>
+#include "timer_queue.h"
+#include "wrapper.h"
+
+
+enum {
+  TIMER_NOT_QUEUED = UINT32_MAX,
+  INITIAL_TIMER_ENTRIES = 16,
+};
+
+
+static bool
+timespec_less_than( const struct timespec *a, const struct timespec *b ) {
+  if ( a->tv_sec == b->tv_sec ) {
+    return a->tv_nsec < b->tv_nsec;
+  }
+
+  return a->tv_sec < b->tv_sec;
+}
+
+
+static bool
+valid_timespec( const struct timespec *a ) {
+  return a->tv_sec > 0 || a->tv_nsec > 0;
+}
+
+
+static void
+add_timespec( const struct timespec *a, const struct timespec *b, struct timespec *result ) {
+  result->tv_sec = a->tv_sec + b->tv_sec;
+  result->tv_nsec = a->tv_nsec + b->tv_nsec;
+  if ( result->tv_nsec >= 1000000000 ) {
+    result->tv_sec++;
+    result->tv_nsec -= 1000000000;
+  }
+}
+
+
+static timer_handle
+make_handle( timer_queue *queue, uint32_t index ) {
+  return ( ( timer_handle ) queue->entries[ index ].generation << 32 ) | ( timer_handle ) ( index + 1 );
+}
+
+
+static bool
+earlier( timer_queue *queue, uint32_t a, uint32_t b ) {
+  return timespec_less_than( &queue->entries[ queue->heap[ a ] ].expires_at,
+                             &queue->entries[ queue->heap[ b ] ].expires_at );
+}
+
+
+static void
+swap_heap( timer_queue *queue, uint32_t a, uint32_t b ) {
+  uint32_t tmp = queue->heap[ a ];
+  queue->heap[ a ] = queue->heap[ b ];
+  queue->heap[ b ] = tmp;
+  queue->entries[ queue->heap[ a ] ].heap_index = a;
+  queue->entries[ queue->heap[ b ] ].heap_index = b;
+}
+
+
+static void
+sift_up( timer_queue *queue, uint32_t i ) {
+  while ( i > 0 ) {
+    uint32_t parent = ( i - 1 ) / 2;
+    if ( !earlier( queue, i, parent ) ) {
+      break;
+    }
+    swap_heap( queue, i, parent );
+    i = parent;
+  }
+}
+
+
+static void
+sift_down( timer_queue *queue, uint32_t i ) {
+  while ( 1 ) {
+    uint32_t smallest = i;
+    uint32_t left = 2 * i + 1;
+    uint32_t right = left + 1;
+    if ( left < queue->heap_nr && earlier( queue, left, smallest ) ) {
+      smallest = left;
+    }
+    if ( right < queue->heap_nr && earlier( queue, right, smallest ) ) {
+      smallest = right;
+    }
+    if ( smallest == i ) {
+      break;
+    }
+    swap_heap( queue, i, smallest );
+    i = smallest;
+  }
+}
+
+
+static void
+push_heap( timer_queue *queue, uint32_t index ) {
+  uint32_t i = queue->heap_nr++;
+  queue->heap[ i ] = index;
+  queue->entries[ index ].heap_index = i;
+  sift_up( queue, i );
+}
+
+
+static void
+remove_heap( timer_queue *queue, uint32_t index ) {
+  uint32_t i = queue->entries[ index ].heap_index;
+  assert( i < queue->heap_nr );
+
+  uint32_t last = --queue->heap_nr;
+  if ( i != last ) {
+    swap_heap( queue, i, last );
+    sift_down( queue, i );
+    sift_up( queue, i );
+  }
+  queue->entries[ index ].heap_index = TIMER_NOT_QUEUED;
+}
+
+
+static uint32_t
+alloc_entry( timer_queue *queue ) {
+  if ( queue->free_entries_nr > 0 ) {
+    return queue->free_entries[ --queue->free_entries_nr ];
+  }
+
+  if ( queue->entries_nr == queue->entries_alloc ) {
+    uint32_t new_alloc = queue->entries_alloc * 2;
+    queue->entries = xrealloc( queue->entries, sizeof( timer_callback_info ) * new_alloc );
+    queue->free_entries = xrealloc( queue->free_entries, sizeof( uint32_t ) * new_alloc );
+    queue->heap = xrealloc( queue->heap, sizeof( uint32_t ) * new_alloc );
+    memset( &queue->entries[ queue->entries_alloc ], 0, sizeof( timer_callback_info ) * ( new_alloc - queue->entries_alloc ) );
+    queue->entries_alloc = new_alloc;
+  }
+  uint32_t index = queue->entries_nr++;
+  queue->entries[ index ].generation = 1;
+
+  return index;
+}
+
+
+static void
+free_entry( timer_queue *queue, uint32_t index ) {
+  timer_callback_info *entry = &queue->entries[ index ];
+  uint32_t generation = entry->generation + 1;
+  memset( entry, 0, sizeof( timer_callback_info ) );
+  entry->generation = generation > 0 ? generation : 1;
+  entry->heap_index = TIMER_NOT_QUEUED;
+  queue->free_entries[ queue->free_entries_nr++ ] = index;
+}
+
+
+static bool
+handle_to_index( timer_queue *queue, timer_handle handle, uint32_t *index ) {
+  uint32_t i = ( uint32_t ) ( handle & 0xffffffff );
+  if ( i == 0 || i > queue->entries_nr ) {
+    return false;
+  }
+  i--;
+  timer_callback_info *entry = &queue->entries[ i ];
+  if ( entry->function == NULL || entry->cancelled || entry->generation != ( uint32_t ) ( handle >> 32 ) ) {
+    return false;
+  }
+  *index = i;
+
+  return true;
+}
+
+
+timer_queue *
+create_timer_queue() {
+  timer_queue *queue = xmalloc( sizeof( timer_queue ) );
+  memset( queue, 0, sizeof( timer_queue ) );
+  queue->entries_alloc = INITIAL_TIMER_ENTRIES;
+  queue->entries = xcalloc( queue->entries_alloc, sizeof( timer_callback_info ) );
+  queue->free_entries = xmalloc( sizeof( uint32_t ) * queue->entries_alloc );
+  queue->heap = xmalloc( sizeof( uint32_t ) * queue->entries_alloc );
+
+  return queue;
+}
+
+
+void
+delete_timer_queue( timer_queue *queue ) {
+  assert( queue != NULL );
+
+  xfree( queue->entries );
+  xfree( queue->free_entries );
+  xfree( queue->heap );
+  xfree( queue );
+}
+
+
+timer_handle
+add_timer_entry( timer_queue *queue, timer_callback function, void *user_data,
+                 const struct timespec *expires_at, const struct timespec *interval ) {
+  assert( queue != NULL );
+  assert( function != NULL );
+  assert( expires_at != NULL );
+  assert( interval != NULL );
+
+  uint32_t index = alloc_entry( queue );
+  timer_callback_info *entry = &queue->entries[ index ];
+  entry->function = function;
+  entry->user_data = user_data;
+  entry->expires_at = *expires_at;
+  entry->interval = *interval;
+  entry->running = false;
+  entry->cancelled = false;
+  push_heap( queue, index );
+
+  return make_handle( queue, index );
+}
+
+
+timer_callback_info *
+lookup_timer_entry( timer_queue *queue, timer_handle handle ) {
+  assert( queue != NULL );
+
+  uint32_t index;
+  if ( !handle_to_index( queue, handle, &index ) ) {
+    return NULL;
+  }
+
+  return &queue->entries[ index ];
+}
+
+
+/*
+ * Linear search kept for the callback based API. Callers holding a handle
+ * should use it instead.
+ */
+timer_handle
+find_timer_entry( timer_queue *queue, timer_callback function, void *user_data ) {
+  assert( queue != NULL );
+
+  for ( uint32_t i = 0; i < queue->entries_nr; i++ ) {
+    timer_callback_info *entry = &queue->entries[ i ];
+    if ( entry->function == function && entry->user_data == user_data && !entry->cancelled ) {
+      return make_handle( queue, i );
+    }
+  }
+
+  return INVALID_TIMER_HANDLE;
+}
+
+
+bool
+remove_timer_entry( timer_queue *queue, timer_handle handle ) {
+  assert( queue != NULL );
+
+  uint32_t index;
+  if ( !handle_to_index( queue, handle, &index ) ) {
+    return false;
+  }
+
+  timer_callback_info *entry = &queue->entries[ index ];
+  if ( entry->running ) {
+    // released by run_timer_entries() once the callback returns
+    entry->cancelled = true;
+    return true;
+  }
+  remove_heap( queue, index );
+  free_entry( queue, index );
+
+  return true;
+}
+
+
+bool
+update_timer_entry( timer_queue *queue, timer_handle handle,
+                    const struct timespec *expires_at, const struct timespec *interval ) {
+  assert( queue != NULL );
+  assert( expires_at != NULL );
+  assert( interval != NULL );
+
+  uint32_t index;
+  if ( !handle_to_index( queue, handle, &index ) ) {
+    return false;
+  }
+
+  timer_callback_info *entry = &queue->entries[ index ];
+  entry->expires_at = *expires_at;
+  entry->interval = *interval;
+  if ( entry->heap_index != TIMER_NOT_QUEUED ) {
+    sift_down( queue, entry->heap_index );
+    sift_up( queue, entry->heap_index );
+  }
+  else {
+    push_heap( queue, index ); // rescheduled from its own callback
+  }
+
+  return true;
+}
+
+
+/*
+ * Runs the callbacks of expired entries. Each entry queued at the time of
+ * the call runs at most once, so that periodic timers which have fallen
+ * behind cannot starve the caller.
+ */
+void
+run_timer_entries( timer_queue *queue, const struct timespec *now ) {
+  assert( queue != NULL );
+  assert( now != NULL );
+
+  uint32_t budget = queue->heap_nr;
+  while ( budget-- > 0 && queue->heap_nr > 0 ) {
+    uint32_t index = queue->heap[ 0 ];
+    if ( timespec_less_than( now, &queue->entries[ index ].expires_at ) ) {
+      break;
+    }
+    remove_heap( queue, index );
+
+    queue->entries[ index ].running = true;
+    timer_callback function = queue->entries[ index ].function;
+    void *user_data = queue->entries[ index ].user_data;
+    function( user_data );
+
+    // entries may have been reallocated by the callback
+    timer_callback_info *entry = &queue->entries[ index ];
+    entry->running = false;
+    if ( entry->cancelled ) {
+      if ( entry->heap_index != TIMER_NOT_QUEUED ) {
+        remove_heap( queue, index );
+      }
+      free_entry( queue, index );
+      continue;
+    }
+    if ( entry->heap_index != TIMER_NOT_QUEUED ) {
+      continue; // rescheduled by the callback
+    }
+    if ( !valid_timespec( &entry->interval ) ) {
+      free_entry( queue, index );
+      continue;
+    }
+    add_timespec( &entry->expires_at, &entry->interval, &entry->expires_at );
+    if ( timespec_less_than( &entry->expires_at, now ) ) {
+      entry->expires_at = *now;
+    }
+    push_heap( queue, index );
+  }
+}
+
+
+const struct timespec *
+get_next_timer_expiry( timer_queue *queue ) {
+  assert( queue != NULL );
+
+  if ( queue->heap_nr == 0 ) {
+    return NULL;
+  }
+
+  return &queue->entries[ queue->heap[ 0 ] ].expires_at;
+}
+
+
+unsigned int
+get_timer_entry_count( timer_queue *queue ) {
+  assert( queue != NULL );
+
+  return queue->heap_nr;
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
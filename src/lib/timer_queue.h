@@ -0,0 +1,75 @@
+/*
+ * Binary min-heap of timer events with handle-based cancellation
+ *
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef TIMER_QUEUE_H
+#define TIMER_QUEUE_H
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include "timer.h"
+
+
+typedef struct timer_callback_info {
+  timer_callback function;
+  struct timespec expires_at;
+  struct timespec interval;
+  void *user_data;
+  uint32_t generation; // incremented whenever the entry is released
+  uint32_t heap_index; // position in the heap or TIMER_NOT_QUEUED
+  bool running;
+  bool cancelled;
+} timer_callback_info;
+
+typedef struct {
+  timer_callback_info *entries;
+  uint32_t entries_nr;
+  uint32_t entries_alloc;
+  uint32_t *free_entries;
+  uint32_t free_entries_nr;
+  uint32_t *heap; // indices of entries ordered by expires_at
+  uint32_t heap_nr;
+} timer_queue;
+
+
+timer_queue *create_timer_queue( void );
+void delete_timer_queue( timer_queue *queue );
+timer_handle add_timer_entry( timer_queue *queue, timer_callback function, void *user_data,
+                              const struct timespec *expires_at, const struct timespec *interval );
+timer_callback_info *lookup_timer_entry( timer_queue *queue, timer_handle handle );
+timer_handle find_timer_entry( timer_queue *queue, timer_callback function, void *user_data );
+bool remove_timer_entry( timer_queue *queue, timer_handle handle );
+bool update_timer_entry( timer_queue *queue, timer_handle handle,
+                         const struct timespec *expires_at, const struct timespec *interval );
+void run_timer_entries( timer_queue *queue, const struct timespec *now );
+const struct timespec *get_next_timer_expiry( timer_queue *queue );
+unsigned int get_timer_entry_count( timer_queue *queue );
+
+
+#endif // TIMER_QUEUE_H
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -54,6 +54,54 @@ const char DEFAULT_DUMP_SERVICE_NAME[] = "dump_service";
 #define init_log mock_init_log
 bool mock_init_log( const char *ident, const char *log_directory, logging_type type );
 
+#ifdef start_log_writer
+#undef start_log_writer
+#endif
+#define start_log_writer mock_start_log_writer
+bool mock_start_log_writer( void );
+
+#ifdef stop_log_writer
+#undef stop_log_writer
+#endif
+#define stop_log_writer mock_stop_log_writer
+bool mock_stop_log_writer( void );
+
+#ifdef enable_buffer_cache
+#undef enable_buffer_cache
+#endif
+#define enable_buffer_cache mock_enable_buffer_cache
+void mock_enable_buffer_cache( void );
+
+#ifdef disable_buffer_cache
+#undef disable_buffer_cache
+#endif
+#define disable_buffer_cache mock_disable_buffer_cache
+void mock_disable_buffer_cache( void );
+
+#ifdef enable_list_element_cache
+#undef enable_list_element_cache
+#endif
+#define enable_list_element_cache mock_enable_list_element_cache
+void mock_enable_list_element_cache( void );
+
+#ifdef disable_list_element_cache
+#undef disable_list_element_cache
+#endif
+#define disable_list_element_cache mock_disable_list_element_cache
+void mock_disable_list_element_cache( void );
+
+#ifdef enable_dlist_element_cache
+#undef enable_dlist_element_cache
+#endif
+#define enable_dlist_element_cache mock_enable_dlist_element_cache
+void mock_enable_dlist_element_cache( void );
+
+#ifdef disable_dlist_element_cache
+#undef disable_dlist_element_cache
+#endif
+#define disable_dlist_element_cache mock_disable_dlist_element_cache
+void mock_disable_dlist_element_cache( void );
+
 #ifdef error
 #undef error
 #endif
@@ -381,6 +429,10 @@ finalize_trema() {
   finalize_messenger();
   finalize_stat();
   finalize_timer();
+  disable_buffer_cache();
+  disable_list_element_cache();
+  disable_dlist_element_cache();
+  stop_log_writer();
   trema_started = false;
   unlink_pid( get_trema_pid(), get_trema_name() );
   xfree( trema_name );
@@ -532,9 +584,18 @@ set_hup_handler() {
 }
 
 
+static void
+dump_all_stats() {
+  dump_stats();
+  if ( openflow_application_interface_is_initialized() ) {
+    dump_openflow_latency_stats();
+  }
+}
+
+
 static void
 set_dump_stats_as_external_callback() {
-  set_external_callback( dump_stats );
+  set_external_callback( dump_all_stats );
 }
 
 
@@ -652,6 +713,11 @@ start_trema_up() {
   debug( "Starting %s ... (TREMA_HOME = %s)", get_trema_name(), get_trema_home() );
 
   maybe_daemonize();
+  // The writer thread must be started after fork().
+  start_log_writer();
+  enable_buffer_cache();
+  enable_list_element_cache();
+  enable_dlist_element_cache();
   write_pid( get_trema_pid(), get_trema_name() );
   trema_started = true;
 
@@ -36,6 +36,8 @@
 #include "etherip.h"
 #include "event_handler.h"
 #include "hash_table.h"
+#include "intrusive_list.h"
+#include "latency_histogram.h"
 #include "linked_list.h"
 #include "log.h"
 #include "match_table.h"
@@ -50,6 +52,7 @@
 #include "packetin_filter_interface.h"
 #include "safe_event_handler.h"
 #include "safe_timer.h"
+#include "spsc_ring.h"
 #include "stat.h"
 #include "timer.h"
 #include "utility.h"
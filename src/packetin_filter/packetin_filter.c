@@ -183,6 +183,7 @@ handle_packet_in( uint64_t datapath_id, uint32_t transaction_id,
   }
 
   buffer *copy = NULL;
+  parse_deferred_packet( data );
   packet_info *packet_info = data->user_data;
   debug( "Receive packet. ethertype=0x%04x, ipproto=0x%x", packet_info->eth_type, packet_info->ipv4_protocol );
   if ( packet_type_ipv4_etherip( data ) ) {
@@ -328,12 +328,14 @@ parse_frame( buffer *frame ) {
   uint32_t eth_in_port = 0;
   uint64_t metadata = 0;
   uint64_t tunnel_id = 0;
+  uint32_t queue_id = 0;
 
   if ( frame->user_data != NULL ) {
     packet_info *info =  ( packet_info * ) frame->user_data;
     eth_in_port = info->eth_in_port;
     metadata    = info->metadata;
     tunnel_id   = info->tunnel_id;
+    queue_id    = info->queue_id;
     free_packet_info( frame );
   }
 
@@ -350,6 +352,7 @@ parse_frame( buffer *frame ) {
     info->eth_in_port = eth_in_port;
     info->metadata = metadata;
     info->tunnel_id = tunnel_id;
+    info->queue_id = queue_id;
   }
 
   return true;
@@ -1196,31 +1199,37 @@ set_tunnel_id( buffer *frame, uint64_t value ) {
 }
 
 
+/*
+ * Tags are pushed and popped by moving only the link layer header bytes in
+ * front of the tag into/out of the headroom of the frame. The payload stays
+ * in place unless the frame has no headroom left.
+ */
 static void*
 push_linklayer_tag( buffer *frame, void *head, size_t tag_size ) {
   assert( frame != NULL );
   assert( head != NULL );
 
   size_t insert_offset = ( size_t ) ( ( char * ) head - ( char * ) frame->data );
-  append_back_buffer( frame, tag_size );
-  // head would be moved because append_back_buffer() may reallocate memory
+  append_front_buffer( frame, tag_size );
+  // head would be moved because append_front_buffer() may reallocate memory
+  memmove( frame->data, ( char * ) frame->data + tag_size, insert_offset );
   head = ( char * ) frame->data + insert_offset;
-  memmove( ( char * ) head + tag_size, head, frame->length - insert_offset - tag_size );
   memset( head, 0, tag_size );
 
   return head;
 }
 
 
-static void
+static void*
 pop_linklayer_tag( buffer *frame, void *head, size_t tag_size ) {
   assert( frame != NULL );
   assert( head != NULL );
 
-  char *tail = ( char * ) head + tag_size;
-  size_t length = frame->length - ( ( size_t )( ( char * ) head - ( char * ) frame->data ) + tag_size );
-  memmove( head, tail, length );
-  frame->length -= tag_size;
+  size_t remove_offset = ( size_t ) ( ( char * ) head - ( char * ) frame->data );
+  memmove( ( char * ) frame->data + tag_size, frame->data, remove_offset );
+  remove_front_buffer( frame, tag_size );
+
+  return ( char * ) frame->data + remove_offset;
 }
 
 
@@ -1233,12 +1242,12 @@ push_vlan_tag( buffer *frame, void *head ) {
 }
 
 
-static void
+static void*
 pop_vlan_tag( buffer *frame, void *head ) {
   assert( frame != NULL );
   assert( head != NULL );
 
-  pop_linklayer_tag( frame, head, sizeof( vlantag_header_t ) );
+  return pop_linklayer_tag( frame, head, sizeof( vlantag_header_t ) );
 }
 
 
@@ -1251,12 +1260,12 @@ push_mpls_tag( buffer *frame, void *head ) {
 }
 
 
-static void
+static void*
 pop_mpls_tag( buffer *frame, void *head ) {
   assert( frame != NULL );
   assert( head != NULL );
 
-  pop_linklayer_tag( frame, head, sizeof( uint32_t ) );
+  return pop_linklayer_tag( frame, head, sizeof( uint32_t ) );
 }
 
 
@@ -1269,12 +1278,12 @@ push_pbb_tag( buffer *frame, void *head ) {
 }
 
 
-static void
+static void*
 pop_pbb_tag( buffer *frame, void *head ) {
   assert( frame != NULL );
   assert( head != NULL );
 
-  pop_linklayer_tag( frame, head, sizeof( pbb_header_t ) );
+  return pop_linklayer_tag( frame, head, sizeof( pbb_header_t ) );
 }
 
 
@@ -1374,9 +1383,9 @@ execute_action_pop_mpls( buffer *frame, action *pop_mpls ) {
     return true;
   }
 
-  pop_mpls_tag( frame, info->l2_mpls_header );
+  void *payload = pop_mpls_tag( frame, info->l2_mpls_header );
 
-  * ( uint16_t * ) ( ( char * ) info->l2_mpls_header - 2 ) = htons( pop_mpls->ethertype );
+  * ( uint16_t * ) ( ( char * ) payload - 2 ) = htons( pop_mpls->ethertype );
 
   return parse_frame( frame );
 }
@@ -2211,6 +2220,19 @@ execute_action_group( buffer *frame, action *group ) {
 }
 
 
+static bool
+execute_action_set_queue( buffer *frame, action *set_queue ) {
+  assert( frame != NULL );
+  assert( set_queue != NULL );
+
+  packet_info *info = get_packet_info_data( frame );
+  assert( info != NULL );
+  info->queue_id = set_queue->queue_id;
+
+  return true;
+}
+
+
 static bool
 execute_action_output( buffer *frame, action *output ) {
   assert( frame != NULL );
@@ -2365,9 +2387,8 @@ execute_action_list( action_list *list, buffer *frame ) {
 
       case OFPAT_SET_QUEUE:
       {
-        debug( "Executing action (OFPAT_SET_QUEUE)." );
-        warn( "OFPAT_SET_QUEUE is not supported." );
-        ret = false;
+        debug( "Executing action (OFPAT_SET_QUEUE): queue_id = %u.", action->queue_id );
+        ret = execute_action_set_queue( frame, action );
       }
       break;
 
@@ -2538,8 +2559,9 @@ execute_action_set( action_set *set, buffer *frame ) {
 
   if ( set->set_queue != NULL ) {
     debug( "Executing action (OFPAT_SET_QUEUE)." );
-    warn( "OFPAT_SET_QUEUE is not supported" );
-    return OFDPE_FAILED;
+    if ( !execute_action_set_queue( frame, set->set_queue ) ) {
+      return OFDPE_FAILED;
+    }
   }
 
   if ( set->group != NULL ) {
@@ -31,8 +31,8 @@ enum {
   SUPPORTED_ACTIONS = ( ACTION_OUTPUT | ACTION_COPY_TTL_OUT | ACTION_COPY_TTL_IN |
                         ACTION_SET_MPLS_TTL | ACTION_DEC_MPLS_TTL | ACTION_PUSH_VLAN |
                         ACTION_POP_VLAN | ACTION_PUSH_MPLS | ACTION_POP_MPLS |
-                        ACTION_GROUP | ACTION_SET_NW_TTL | ACTION_DEC_NW_TTL |
-                        ACTION_SET_FIELD ),
+                        ACTION_SET_QUEUE | ACTION_GROUP | ACTION_SET_NW_TTL |
+                        ACTION_DEC_NW_TTL | ACTION_SET_FIELD ),
   SUPPORTED_INSTRUCTIONS = ( INSTRUCTION_GOTO_TABLE | INSTRUCTION_WRITE_METADATA |
                              INSTRUCTION_WRITE_ACTIONS | INSTRUCTION_APPLY_ACTIONS |
                              INSTRUCTION_CLEAR_ACTIONS ),
@@ -209,7 +209,7 @@ notify_packet_in( const uint8_t reason, const uint8_t table_id, const uint64_t c
 
 void
 notify_flow_removed( const uint8_t reason, const flow_entry *entry ) {
-  assert( reason <= OFPRR_GROUP_DELETE );
+  assert( reason <= OFPRR_EVICTION );
   assert( entry != NULL );
   assert( entry->match != NULL );
 
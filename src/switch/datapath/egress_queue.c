@@ -0,0 +1,342 @@
+/*
+ * Copyright (C) 2012-2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include "egress_queue.h"
+
+
+static const uint64_t NANOSECONDS_PER_SECOND = 1000000000;
+static const uint64_t MAX_BURST_DIVISOR = 100; // a bucket holds up to 10ms worth of tokens
+
+
+static uint64_t
+rate_to_bytes_per_second( const uint64_t link_rate, const uint16_t rate ) {
+  if ( rate == EGRESS_QUEUE_RATE_UNCFG || rate > 1000 ) {
+    return 0;
+  }
+
+  return link_rate * rate / 1000;
+}
+
+
+static void
+reset_token_bucket( token_bucket *bucket, const uint64_t rate ) {
+  assert( bucket != NULL );
+
+  bucket->rate = rate;
+  bucket->tokens = 0;
+  time_now( &bucket->updated_at );
+}
+
+
+static void
+refill_token_bucket( token_bucket *bucket, const struct timespec *now, const size_t mtu ) {
+  assert( bucket != NULL );
+  assert( now != NULL );
+
+  if ( bucket->rate == 0 ) {
+    return;
+  }
+
+  struct timespec elapsed = { 0, 0 };
+  timespec_diff( bucket->updated_at, *now, &elapsed );
+  if ( elapsed.tv_sec < 0 ) {
+    return;
+  }
+  uint64_t elapsed_nsec = NANOSECONDS_PER_SECOND;
+  if ( elapsed.tv_sec == 0 ) {
+    elapsed_nsec = ( uint64_t ) elapsed.tv_nsec;
+  }
+  uint64_t tokens = bucket->rate * elapsed_nsec / NANOSECONDS_PER_SECOND;
+  if ( tokens == 0 ) {
+    return; // keep updated_at so that fractions are accumulated
+  }
+
+  uint64_t burst = bucket->rate / MAX_BURST_DIVISOR;
+  if ( burst < mtu ) {
+    burst = mtu;
+  }
+  bucket->tokens += tokens;
+  if ( bucket->tokens > burst ) {
+    bucket->tokens = burst;
+  }
+  bucket->updated_at = *now;
+}
+
+
+static void
+consume_token_bucket( token_bucket *bucket, const size_t length ) {
+  assert( bucket != NULL );
+
+  if ( bucket->rate == 0 ) {
+    return;
+  }
+  bucket->tokens = bucket->tokens > length ? bucket->tokens - length : 0;
+}
+
+
+static void
+update_rates( egress_queue *queue, const uint64_t link_rate ) {
+  assert( queue != NULL );
+
+  reset_token_bucket( &queue->min_bucket, rate_to_bytes_per_second( link_rate, queue->config.min_rate ) );
+  reset_token_bucket( &queue->max_bucket, rate_to_bytes_per_second( link_rate, queue->config.max_rate ) );
+}
+
+
+static egress_queue *
+alloc_egress_queue( const egress_queue_config *config, const unsigned int max_queue_length, const size_t mtu,
+                    const uint64_t link_rate ) {
+  assert( config != NULL );
+
+  egress_queue *queue = xmalloc( sizeof( egress_queue ) );
+  memset( queue, 0, sizeof( egress_queue ) );
+  queue->config = *config;
+  if ( queue->config.weight == 0 ) {
+    queue->config.weight = ( uint32_t ) mtu;
+  }
+  queue->buffers = create_packet_buffers( max_queue_length, mtu );
+  update_rates( queue, link_rate );
+  time_now( &queue->created_at );
+
+  return queue;
+}
+
+
+static void
+free_egress_queue( egress_queue *queue ) {
+  assert( queue != NULL );
+
+  delete_packet_buffers( queue->buffers );
+  xfree( queue );
+}
+
+
+egress_scheduler *
+create_egress_scheduler( const unsigned int max_queue_length, const size_t mtu ) {
+  assert( max_queue_length > 0 );
+  assert( mtu > 0 );
+
+  egress_scheduler *scheduler = xmalloc( sizeof( egress_scheduler ) );
+  memset( scheduler, 0, sizeof( egress_scheduler ) );
+  scheduler->max_queue_length = max_queue_length;
+  scheduler->mtu = mtu;
+
+  egress_queue_config config = { EGRESS_QUEUE_DEFAULT_ID, 0, 0, EGRESS_QUEUE_RATE_UNCFG, EGRESS_QUEUE_RATE_UNCFG };
+  add_egress_queue( scheduler, &config );
+
+  return scheduler;
+}
+
+
+void
+delete_egress_scheduler( egress_scheduler *scheduler ) {
+  assert( scheduler != NULL );
+
+  for ( unsigned int i = 0; i < scheduler->n_queues; i++ ) {
+    free_egress_queue( scheduler->queues[ i ] );
+  }
+  if ( scheduler->queues != NULL ) {
+    xfree( scheduler->queues );
+  }
+  xfree( scheduler );
+}
+
+
+egress_queue *
+lookup_egress_queue( egress_scheduler *scheduler, const uint32_t queue_id ) {
+  assert( scheduler != NULL );
+
+  for ( unsigned int i = 0; i < scheduler->n_queues; i++ ) {
+    if ( scheduler->queues[ i ]->config.queue_id == queue_id ) {
+      return scheduler->queues[ i ];
+    }
+  }
+
+  return NULL;
+}
+
+
+bool
+add_egress_queue( egress_scheduler *scheduler, const egress_queue_config *config ) {
+  assert( scheduler != NULL );
+  assert( config != NULL );
+
+  egress_queue *queue = lookup_egress_queue( scheduler, config->queue_id );
+  if ( queue != NULL ) {
+    if ( get_packet_buffers_length( queue->buffers ) > 0 || queue->config.priority != config->priority ) {
+      warn( "Failed to reconfigure an egress queue ( queue_id = %u ).", config->queue_id );
+      return false;
+    }
+    queue->config = *config;
+    if ( queue->config.weight == 0 ) {
+      queue->config.weight = ( uint32_t ) scheduler->mtu;
+    }
+    update_rates( queue, scheduler->link_rate );
+    return true;
+  }
+
+  queue = alloc_egress_queue( config, scheduler->max_queue_length, scheduler->mtu, scheduler->link_rate );
+
+  scheduler->queues = xrealloc( scheduler->queues, sizeof( egress_queue * ) * ( scheduler->n_queues + 1 ) );
+  unsigned int i = scheduler->n_queues;
+  while ( i > 0 && scheduler->queues[ i - 1 ]->config.priority < config->priority ) {
+    scheduler->queues[ i ] = scheduler->queues[ i - 1 ];
+    i--;
+  }
+  scheduler->queues[ i ] = queue;
+  scheduler->n_queues++;
+  scheduler->cursor = 0;
+
+  return true;
+}
+
+
+void
+set_egress_link_rate( egress_scheduler *scheduler, const uint64_t link_rate ) {
+  assert( scheduler != NULL );
+
+  if ( scheduler->link_rate == link_rate ) {
+    return;
+  }
+  scheduler->link_rate = link_rate;
+  for ( unsigned int i = 0; i < scheduler->n_queues; i++ ) {
+    update_rates( scheduler->queues[ i ], link_rate );
+  }
+}
+
+
+static size_t
+head_length( egress_queue *queue ) {
+  buffer *head = peek_packet_buffer( queue->buffers );
+
+  return head != NULL ? head->length : 0;
+}
+
+
+static bool
+is_shaped( const egress_queue *queue, const size_t length ) {
+  return queue->max_bucket.rate > 0 && queue->max_bucket.tokens < length;
+}
+
+
+/*
+ * Picks a queue among [ begin, end ), which share the same priority, in a
+ * deficit round robin manner. Returns NULL if none of them is eligible.
+ */
+static egress_queue *
+schedule_by_drr( egress_scheduler *scheduler, unsigned int begin, unsigned int end ) {
+  bool eligible = false;
+  for ( unsigned int i = begin; i < end; i++ ) {
+    egress_queue *queue = scheduler->queues[ i ];
+    size_t length = head_length( queue );
+    if ( length == 0 ) {
+      queue->deficit = 0;
+    }
+    else if ( !is_shaped( queue, length ) ) {
+      eligible = true;
+    }
+  }
+  if ( !eligible ) {
+    return NULL;
+  }
+
+  if ( scheduler->cursor < begin || scheduler->cursor >= end ) {
+    scheduler->cursor = begin;
+  }
+  while ( 1 ) {
+    egress_queue *queue = scheduler->queues[ scheduler->cursor ];
+    size_t length = head_length( queue );
+    if ( length > 0 && !is_shaped( queue, length ) ) {
+      if ( queue->deficit >= length ) {
+        return queue;
+      }
+      queue->deficit += queue->config.weight;
+    }
+    scheduler->cursor = scheduler->cursor + 1 < end ? scheduler->cursor + 1 : begin;
+  }
+}
+
+
+egress_queue *
+schedule_egress_queue( egress_scheduler *scheduler ) {
+  assert( scheduler != NULL );
+
+  struct timespec now = { 0, 0 };
+  time_now( &now );
+  for ( unsigned int i = 0; i < scheduler->n_queues; i++ ) {
+    refill_token_bucket( &scheduler->queues[ i ]->min_bucket, &now, scheduler->mtu );
+    refill_token_bucket( &scheduler->queues[ i ]->max_bucket, &now, scheduler->mtu );
+  }
+
+  // queues running below their minimum rate are served first
+  for ( unsigned int i = 0; i < scheduler->n_queues; i++ ) {
+    egress_queue *queue = scheduler->queues[ i ];
+    size_t length = head_length( queue );
+    if ( length > 0 && queue->min_bucket.rate > 0 && queue->min_bucket.tokens >= length && !is_shaped( queue, length ) ) {
+      return queue;
+    }
+  }
+
+  unsigned int begin = 0;
+  while ( begin < scheduler->n_queues ) {
+    unsigned int end = begin + 1;
+    while ( end < scheduler->n_queues && scheduler->queues[ end ]->config.priority == scheduler->queues[ begin ]->config.priority ) {
+      end++;
+    }
+    egress_queue *queue = schedule_by_drr( scheduler, begin, end );
+    if ( queue != NULL ) {
+      return queue;
+    }
+    begin = end;
+  }
+
+  return NULL;
+}
+
+
+void
+complete_egress_transmission( egress_queue *queue, const size_t length ) {
+  assert( queue != NULL );
+
+  queue->deficit = queue->deficit > length ? queue->deficit - length : 0;
+  consume_token_bucket( &queue->min_bucket, length );
+  consume_token_bucket( &queue->max_bucket, length );
+  queue->stats.tx_packets++;
+  queue->stats.tx_bytes += length;
+}
+
+
+unsigned int
+get_egress_backlog( egress_scheduler *scheduler ) {
+  assert( scheduler != NULL );
+
+  unsigned int backlog = 0;
+  for ( unsigned int i = 0; i < scheduler->n_queues; i++ ) {
+    backlog += get_packet_buffers_length( scheduler->queues[ i ]->buffers );
+  }
+
+  return backlog;
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
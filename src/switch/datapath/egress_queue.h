@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2012-2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef EGRESS_QUEUE_H
+#define EGRESS_QUEUE_H
+
+
+#include "ofdp_common.h"
+#include "packet_buffer.h"
+
+
+enum {
+  EGRESS_QUEUE_DEFAULT_ID = 0, // frames without set_queue are sent via this queue
+  EGRESS_QUEUE_RATE_UNCFG = OFPQ_MIN_RATE_UNCFG, // rates are in 1/10 of a percent of the link rate
+};
+
+typedef struct {
+  uint32_t queue_id;
+  uint8_t priority; // strict priority class ( larger value is served first )
+  uint32_t weight;  // DRR quantum in bytes among queues of the same priority
+  uint16_t min_rate;
+  uint16_t max_rate;
+} egress_queue_config;
+
+typedef struct {
+  uint64_t tokens;
+  uint64_t rate; // bytes per second
+  struct timespec updated_at;
+} token_bucket;
+
+typedef struct {
+  egress_queue_config config;
+  packet_buffers *buffers;
+  uint64_t deficit;
+  token_bucket min_bucket;
+  token_bucket max_bucket;
+  struct {
+    uint64_t tx_packets;
+    uint64_t tx_bytes;
+    uint64_t tx_errors;
+  } stats;
+  struct timespec created_at;
+} egress_queue;
+
+typedef struct {
+  egress_queue **queues; // sorted by priority in descending order
+  unsigned int n_queues;
+  unsigned int cursor;
+  unsigned int max_queue_length;
+  size_t mtu;
+  uint64_t link_rate; // bytes per second
+} egress_scheduler;
+
+
+egress_scheduler *create_egress_scheduler( const unsigned int max_queue_length, const size_t mtu );
+void delete_egress_scheduler( egress_scheduler *scheduler );
+bool add_egress_queue( egress_scheduler *scheduler, const egress_queue_config *config );
+egress_queue *lookup_egress_queue( egress_scheduler *scheduler, const uint32_t queue_id );
+void set_egress_link_rate( egress_scheduler *scheduler, const uint64_t link_rate );
+egress_queue *schedule_egress_queue( egress_scheduler *scheduler );
+void complete_egress_transmission( egress_queue *queue, const size_t length );
+unsigned int get_egress_backlog( egress_scheduler *scheduler );
+
+
+#endif // EGRESS_QUEUE_H
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
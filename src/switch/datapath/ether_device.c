@@ -128,6 +128,31 @@ make_supported_ofp_port_features( uint32_t features ) {
 }
 
 
+static uint64_t
+get_link_rate( uint32_t ofp_features ) {
+  static const struct {
+    uint32_t features;
+    uint64_t bits_per_second;
+  } rates[] = {
+    { OFPPF_1TB_FD, 1000000000000ULL },
+    { OFPPF_100GB_FD, 100000000000ULL },
+    { OFPPF_40GB_FD, 40000000000ULL },
+    { OFPPF_10GB_FD, 10000000000ULL },
+    { OFPPF_1GB_HD | OFPPF_1GB_FD, 1000000000ULL },
+    { OFPPF_100MB_HD | OFPPF_100MB_FD, 100000000ULL },
+    { OFPPF_10MB_HD | OFPPF_10MB_FD, 10000000ULL },
+  };
+
+  for ( size_t i = 0; i < sizeof( rates ) / sizeof( rates[ 0 ] ); i++ ) {
+    if ( ( ofp_features & rates[ i ].features ) != 0 ) {
+      return rates[ i ].bits_per_second / 8;
+    }
+  }
+
+  return 0;
+}
+
+
 bool
 update_device_status( ether_device *device ) {
   assert( device != NULL );
@@ -212,6 +237,10 @@ update_device_status( ether_device *device ) {
   device->status.curr_speed = 0; // Since we set curr flags, this field might be meaningless.
   device->status.max_speed = 0; // Since we set supported flags, this field might be meaningless.
 
+  if ( device->send_queues != NULL ) {
+    set_egress_link_rate( device->send_queues, get_link_rate( device->status.curr ) );
+  }
+
   return true;
 }
 
@@ -344,6 +373,7 @@ receive_frame( int fd, void *user_data ) {
       frame = device->recv_buffer; // Use recv_buffer as a trash.
     }
     reset_buffer( frame );
+    reserve_buffer_headroom( frame, device->headroom );
     append_back_buffer( frame, device->mtu );
 
 #if WITH_PCAP
@@ -442,6 +472,37 @@ receive_frame( int fd, void *user_data ) {
 }
 
 
+static void
+resume_throttled_send_queues( void *user_data ) {
+  ether_device *device = user_data;
+  assert( device != NULL );
+
+  device->send_queues_throttled = false;
+  if ( get_egress_backlog( device->send_queues ) > 0 ) {
+    set_writable_safe( device->fd, true );
+  }
+}
+
+
+static void
+throttle_send_queues( ether_device *device ) {
+  assert( device != NULL );
+
+  if ( device->send_queues_throttled ) {
+    return;
+  }
+
+  struct itimerspec interval;
+  interval.it_value.tv_sec = 0;
+  interval.it_value.tv_nsec = 1000000;
+  interval.it_interval.tv_sec = 0;
+  interval.it_interval.tv_nsec = 0;
+  if ( add_timer_event_callback_safe( &interval, resume_throttled_send_queues, device ) ) {
+    device->send_queues_throttled = true;
+  }
+}
+
+
 static void
 flush_send_queue( int fd, void *user_data ) {
   UNUSED( fd );
@@ -449,7 +510,7 @@ flush_send_queue( int fd, void *user_data ) {
   ether_device *device = user_data;
   assert( device != NULL );
 
-  debug( "Flushing send queue ( device = %s, queue length = %u ).", device->name, get_packet_buffers_length( device->send_queue ) );
+  debug( "Flushing send queues ( device = %s, queue length = %u ).", device->name, get_egress_backlog( device->send_queues ) );
 
   set_writable_safe( device->fd, false );
 
@@ -458,12 +519,15 @@ flush_send_queue( int fd, void *user_data ) {
   sll.sll_ifindex = device->ifindex;
 
   int count = 0;
-  buffer *buf = NULL;
-  while ( ( buf = peek_packet_buffer( device->send_queue ) ) != NULL && count < 256 ) {
+  egress_queue *queue = NULL;
+  while ( count < 256 && ( queue = schedule_egress_queue( device->send_queues ) ) != NULL ) {
+    buffer *buf = peek_packet_buffer( queue->buffers );
+    assert( buf != NULL );
 #if WITH_PCAP
     if( pcap_sendpacket( device->pcap, buf->data, ( int ) buf->length ) < 0 ){
       error( "Failed to send a message to ethernet device ( device = %s, pcap_err = %s ).",
              device->name, pcap_geterr( device->pcap ) );
+      queue->stats.tx_errors++;
     }
     size_t length = buf->length;
 #else
@@ -473,9 +537,12 @@ flush_send_queue( int fd, void *user_data ) {
         break;
       }
       char error_string[ ERROR_STRING_SIZE ];
-      error( "Failed to send a message to ethernet device ( device = %s, errno = %s [%d] ).",
-             device->name, safe_strerror_r( errno, error_string, sizeof( error_string ) ), errno );
-      return;
+      error( "Failed to send a message to ethernet device ( device = %s, queue_id = %u, errno = %s [%d] ).",
+             device->name, queue->config.queue_id, safe_strerror_r( errno, error_string, sizeof( error_string ) ), errno );
+      queue->stats.tx_errors++;
+      buf = dequeue_packet_buffer( queue->buffers );
+      mark_packet_buffer_as_used( queue->buffers, buf );
+      continue;
     }
 #endif
 
@@ -484,12 +551,19 @@ flush_send_queue( int fd, void *user_data ) {
       break;
     }
 
-    buf = dequeue_packet_buffer( device->send_queue );
-    mark_packet_buffer_as_used( device->send_queue, buf );
+    buf = dequeue_packet_buffer( queue->buffers );
+    mark_packet_buffer_as_used( queue->buffers, buf );
+    complete_egress_transmission( queue, ( size_t ) length );
     count++;
   }
-  if ( get_packet_buffers_length( device->send_queue ) > 0 ) {
-    set_writable_safe( device->fd, true );
+  if ( get_egress_backlog( device->send_queues ) > 0 ) {
+    if ( queue == NULL ) {
+      // all backlogged queues exceed their maximum rates
+      throttle_send_queues( device );
+    }
+    else {
+      set_writable_safe( device->fd, true );
+    }
   }
 }
 
@@ -641,9 +715,10 @@ create_ether_device( const char *name, const size_t max_send_queue, const size_t
   device->status.can_retrieve_link_status = true;
   device->status.can_retrieve_pause = true;
   device->mtu = device_mtu;
-  device->recv_buffer = alloc_buffer_with_length( device->mtu );
-  device->send_queue = create_packet_buffers( ( unsigned int ) max_send_queue, device->mtu );
-  device->recv_queue = create_packet_buffers( ( unsigned int ) max_recv_queue, device->mtu );
+  device->headroom = FRAME_HEADROOM;
+  device->recv_buffer = alloc_buffer_with_length( device->headroom + device->mtu );
+  device->send_queues = create_egress_scheduler( ( unsigned int ) max_send_queue, device->mtu );
+  device->recv_queue = create_packet_buffers( ( unsigned int ) max_recv_queue, device->headroom + device->mtu );
 
   short int flags = get_device_flags( device->name );
   device->original_flags = flags;
@@ -673,7 +748,7 @@ delete_ether_device( ether_device *device ) {
 #endif
   if ( device->fd >= 0 ) {
     set_readable_safe( device->fd, false );
-    if ( get_packet_buffers_length( device->send_queue ) > 0 ) {
+    if ( get_egress_backlog( device->send_queues ) > 0 ) {
       set_writable_safe( device->fd, false );
     }
     delete_fd_handler_safe( device->fd );
@@ -686,7 +761,10 @@ delete_ether_device( ether_device *device ) {
 
   set_device_flags( device->name, device->original_flags );
 
-  delete_packet_buffers( device->send_queue );
+  if ( device->send_queues_throttled ) {
+    delete_timer_event_safe( resume_throttled_send_queues, device );
+  }
+  delete_egress_scheduler( device->send_queues );
   delete_packet_buffers( device->recv_queue );
 
   xfree( device );
@@ -781,28 +859,37 @@ down_ether_device( ether_device *device ) {
 
 
 bool
-send_frame( ether_device *device, buffer *frame ) {
+send_frame_to_queue( ether_device *device, buffer *frame, const uint32_t queue_id ) {
   assert( device != NULL );
-  assert( device->send_queue != NULL );
+  assert( device->send_queues != NULL );
   assert( frame != NULL );
   assert( frame->length > 0 );
 
-  if ( get_max_packet_buffers_length( device->send_queue ) <= get_packet_buffers_length( device->send_queue ) ) {
-    warn( "Send queue is full ( device = %s, usage = %u/%u ).",
-          device->name, get_packet_buffers_length( device->send_queue ), get_max_packet_buffers_length( device->send_queue ) );
+  egress_queue *queue = lookup_egress_queue( device->send_queues, queue_id );
+  if ( queue == NULL ) {
+    debug( "Queue not found. Using the default queue instead ( device = %s, queue_id = %u ).", device->name, queue_id );
+    queue = lookup_egress_queue( device->send_queues, EGRESS_QUEUE_DEFAULT_ID );
+    assert( queue != NULL );
+  }
+
+  if ( get_max_packet_buffers_length( queue->buffers ) <= get_packet_buffers_length( queue->buffers ) ) {
+    warn( "Send queue is full ( device = %s, queue_id = %u, usage = %u/%u ).",
+          device->name, queue->config.queue_id, get_packet_buffers_length( queue->buffers ),
+          get_max_packet_buffers_length( queue->buffers ) );
+    queue->stats.tx_errors++;
     return false;
   }
 
-  debug( "Enqueueing a frame to send queue ( frame = %p, device = %s, queue length = %d, fd = %d ).",
-         frame, device->name, get_packet_buffers_length( device->send_queue ), device->fd );
+  debug( "Enqueueing a frame to send queue ( frame = %p, device = %s, queue_id = %u, queue length = %d, fd = %d ).",
+         frame, device->name, queue->config.queue_id, get_packet_buffers_length( queue->buffers ), device->fd );
 
-  buffer *copy = get_free_packet_buffer( device->send_queue );
+  buffer *copy = get_free_packet_buffer( queue->buffers );
   assert( copy != NULL );
   copy_buffer( copy, frame );
 
-  enqueue_packet_buffer( device->send_queue, copy );
+  enqueue_packet_buffer( queue->buffers, copy );
 
-  if ( ( get_packet_buffers_length( device->send_queue ) > 0 ) && ( device->fd >= 0 ) ) {
+  if ( !device->send_queues_throttled && device->fd >= 0 ) {
     set_writable_safe( device->fd, true );
   }
 
@@ -810,6 +897,12 @@ send_frame( ether_device *device, buffer *frame ) {
 }
 
 
+bool
+send_frame( ether_device *device, buffer *frame ) {
+  return send_frame_to_queue( device, frame, EGRESS_QUEUE_DEFAULT_ID );
+}
+
+
 bool
 set_frame_received_handler( ether_device *device, frame_received_handler callback, void *user_data ) {
   assert( device != NULL );
@@ -25,10 +25,16 @@
 #if WITH_PCAP
 #include <pcap.h>
 #endif
+#include "egress_queue.h"
 #include "ofdp_common.h"
 #include "packet_buffer.h"
 
 
+#ifndef FRAME_HEADROOM
+#define FRAME_HEADROOM 64 // room reserved in front of received frames for pushing tags
+#endif
+
+
 typedef void ( *frame_received_handler )( buffer *frame, void *user_data );
 
 typedef struct {
@@ -66,9 +72,11 @@ typedef struct {
   pcap_t *pcap;
 #endif
   int fd;
-  packet_buffers *send_queue;
+  egress_scheduler *send_queues;
+  bool send_queues_throttled;
   packet_buffers *recv_queue;
   size_t mtu;
+  size_t headroom;
   buffer *recv_buffer;
   frame_received_handler received_callback;
   void *received_user_data;
@@ -80,6 +88,7 @@ void delete_ether_device( ether_device *device );
 bool up_ether_device( ether_device *devive );
 bool down_ether_device( ether_device *device );
 bool send_frame( ether_device *device, buffer *frame );
+bool send_frame_to_queue( ether_device *device, buffer *frame, const uint32_t queue_id );
 bool set_frame_received_handler( ether_device *device, frame_received_handler callback, void *user_data );
 bool update_device_status( ether_device *device );
 bool update_device_stats( ether_device *device );
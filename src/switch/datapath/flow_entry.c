@@ -57,6 +57,7 @@ alloc_flow_entry( match *match, instruction_set *instructions,
   time_now( &entry->created_at );
   entry->last_seen = entry->created_at;
   entry->table_miss = table_miss_flow_entry( entry );
+  init_list_link( &entry->table_link );
 
   if ( instructions->write_actions != NULL && instructions->write_actions->actions != NULL ) {
     action_list *actions = instructions->write_actions->actions;
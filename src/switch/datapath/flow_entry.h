@@ -41,6 +41,8 @@ typedef struct _flow_entry {
   struct timespec created_at;
   struct timespec last_seen;
   bool table_miss;
+  uint32_t eviction_index; // position in the eviction index of the table
+  list_link table_link; // in the entries of the table
 } flow_entry;
 
 
@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include "flow_eviction.h"
+
+
+static const uint64_t NANOSECONDS_PER_SECOND = 1000000000;
+static const uint32_t INITIAL_INDEX_SIZE = 64;
+
+
+static uint64_t
+timespec_to_nsec( const struct timespec *t ) {
+  return ( uint64_t ) t->tv_sec * NANOSECONDS_PER_SECOND + ( uint64_t ) t->tv_nsec;
+}
+
+
+static uint64_t
+get_expiry( const flow_entry *entry ) {
+  uint64_t expiry = UINT64_MAX;
+  if ( entry->hard_timeout > 0 ) {
+    expiry = timespec_to_nsec( &entry->created_at ) + entry->hard_timeout * NANOSECONDS_PER_SECOND;
+  }
+  if ( entry->idle_timeout > 0 ) {
+    uint64_t idle_expiry = timespec_to_nsec( &entry->last_seen ) + entry->idle_timeout * NANOSECONDS_PER_SECOND;
+    if ( idle_expiry < expiry ) {
+      expiry = idle_expiry;
+    }
+  }
+
+  return expiry;
+}
+
+
+static uint64_t
+eviction_key( const uint8_t policy, const flow_entry *entry ) {
+  switch ( policy ) {
+    case FLOW_EVICTION_IMPORTANCE:
+      // priority first, then least recently seen ( in about 65 microseconds granularity )
+      return ( ( uint64_t ) entry->priority << 48 ) | ( ( timespec_to_nsec( &entry->last_seen ) >> 16 ) & 0xffffffffffffULL );
+    case FLOW_EVICTION_EXPIRY:
+      return get_expiry( entry );
+    case FLOW_EVICTION_LRU:
+    default:
+      return timespec_to_nsec( &entry->last_seen );
+  }
+}
+
+
+static void
+set_slot( flow_eviction_index *index, const uint32_t i, const flow_eviction_slot slot ) {
+  index->slots[ i ] = slot;
+  slot.entry->eviction_index = i;
+}
+
+
+static void
+sift_up( flow_eviction_index *index, uint32_t i ) {
+  flow_eviction_slot slot = index->slots[ i ];
+  while ( i > 0 ) {
+    uint32_t parent = ( i - 1 ) / 2;
+    if ( index->slots[ parent ].key <= slot.key ) {
+      break;
+    }
+    set_slot( index, i, index->slots[ parent ] );
+    i = parent;
+  }
+  set_slot( index, i, slot );
+}
+
+
+static void
+sift_down( flow_eviction_index *index, uint32_t i ) {
+  flow_eviction_slot slot = index->slots[ i ];
+  while ( 1 ) {
+    uint32_t child = 2 * i + 1;
+    if ( child >= index->n_slots ) {
+      break;
+    }
+    if ( child + 1 < index->n_slots && index->slots[ child + 1 ].key < index->slots[ child ].key ) {
+      child++;
+    }
+    if ( slot.key <= index->slots[ child ].key ) {
+      break;
+    }
+    set_slot( index, i, index->slots[ child ] );
+    i = child;
+  }
+  set_slot( index, i, slot );
+}
+
+
+void
+init_flow_eviction_index( flow_eviction_index *index, const uint8_t policy ) {
+  assert( index != NULL );
+
+  memset( index, 0, sizeof( flow_eviction_index ) );
+  index->policy = policy;
+}
+
+
+void
+finalize_flow_eviction_index( flow_eviction_index *index ) {
+  assert( index != NULL );
+
+  if ( index->slots != NULL ) {
+    xfree( index->slots );
+  }
+  memset( index, 0, sizeof( flow_eviction_index ) );
+}
+
+
+void
+add_flow_eviction_entry( flow_eviction_index *index, flow_entry *entry ) {
+  assert( index != NULL );
+  assert( entry != NULL );
+
+  if ( entry->table_miss ) {
+    entry->eviction_index = FLOW_EVICTION_NOT_INDEXED; // never evicted
+    return;
+  }
+
+  if ( index->n_slots == index->size ) {
+    index->size = index->size > 0 ? index->size * 2 : INITIAL_INDEX_SIZE;
+    index->slots = xrealloc( index->slots, sizeof( flow_eviction_slot ) * index->size );
+  }
+  flow_eviction_slot slot = { eviction_key( index->policy, entry ), entry };
+  set_slot( index, index->n_slots++, slot );
+  sift_up( index, index->n_slots - 1 );
+}
+
+
+void
+delete_flow_eviction_entry( flow_eviction_index *index, flow_entry *entry ) {
+  assert( index != NULL );
+  assert( entry != NULL );
+
+  uint32_t i = entry->eviction_index;
+  if ( i >= index->n_slots || index->slots[ i ].entry != entry ) {
+    return;
+  }
+  entry->eviction_index = FLOW_EVICTION_NOT_INDEXED;
+  index->n_slots--;
+  if ( i == index->n_slots ) {
+    return;
+  }
+  set_slot( index, i, index->slots[ index->n_slots ] );
+  sift_down( index, i );
+  sift_up( index, i );
+}
+
+
+void
+set_flow_eviction_policy( flow_eviction_index *index, const uint8_t policy ) {
+  assert( index != NULL );
+
+  if ( index->policy == policy ) {
+    return;
+  }
+  index->policy = policy;
+  for ( uint32_t i = 0; i < index->n_slots; i++ ) {
+    index->slots[ i ].key = eviction_key( policy, index->slots[ i ].entry );
+  }
+  for ( uint32_t i = index->n_slots / 2; i > 0; i-- ) {
+    sift_down( index, i - 1 );
+  }
+}
+
+
+/*
+ * Returns the entry to be evicted without removing it from the index.
+ */
+flow_entry *
+select_flow_entry_to_evict( flow_eviction_index *index ) {
+  assert( index != NULL );
+
+  while ( index->n_slots > 0 ) {
+    flow_eviction_slot *top = &index->slots[ 0 ];
+    uint64_t key = eviction_key( index->policy, top->entry );
+    if ( key == top->key ) {
+      return top->entry;
+    }
+    // the entry has been seen since it was indexed
+    top->key = key;
+    sift_down( index, 0 );
+  }
+
+  return NULL;
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
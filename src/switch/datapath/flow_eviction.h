@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef FLOW_EVICTION_H
+#define FLOW_EVICTION_H
+
+
+#include "ofdp_common.h"
+#include "flow_entry.h"
+
+
+enum {
+  FLOW_EVICTION_LRU = 0, // least recently seen first
+  FLOW_EVICTION_IMPORTANCE = 1, // lowest priority first
+  FLOW_EVICTION_EXPIRY = 2, // soonest to expire first
+};
+
+enum {
+  FLOW_EVICTION_NOT_INDEXED = UINT32_MAX,
+};
+
+typedef struct {
+  uint64_t key;
+  flow_entry *entry;
+} flow_eviction_slot;
+
+/*
+ * A binary min-heap of flow entries keyed by the eviction policy. Keys only
+ * grow while an entry is alive ( last_seen moves forward ), so they are not
+ * updated on each lookup but refreshed when an entry is about to be evicted.
+ */
+typedef struct {
+  uint8_t policy;
+  flow_eviction_slot *slots;
+  uint32_t n_slots;
+  uint32_t size;
+} flow_eviction_index;
+
+
+void init_flow_eviction_index( flow_eviction_index *index, const uint8_t policy );
+void finalize_flow_eviction_index( flow_eviction_index *index );
+void add_flow_eviction_entry( flow_eviction_index *index, flow_entry *entry );
+void delete_flow_eviction_entry( flow_eviction_index *index, flow_entry *entry );
+void set_flow_eviction_policy( flow_eviction_index *index, const uint8_t policy );
+flow_entry *select_flow_entry_to_evict( flow_eviction_index *index );
+
+
+#endif // FLOW_EVICTION_H
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
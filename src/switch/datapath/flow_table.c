@@ -23,9 +23,6 @@
 #include "table_manager.h"
 
 
-typedef void ( *flow_entry_handler )( flow_entry *entry, void *user_data );
-
-
 static flow_table flow_tables[ N_FLOW_TABLES ];
 static const time_t AGING_INTERVAL = 1;
 
@@ -219,8 +216,9 @@ delete_flow_entry_from_table( flow_table *table, flow_entry *entry, uint8_t reas
   assert( table != NULL );
   assert( entry != NULL );
 
-  bool ret = delete_element( &table->entries, entry );
-  if ( ret ) {
+  if ( list_link_is_linked( &entry->table_link ) ) {
+    remove_link( &entry->table_link );
+    delete_flow_eviction_entry( &table->eviction, entry );
     decrement_active_count( table->features.table_id );
     if ( notify ) {
       flow_deleted( entry, reason );
@@ -231,7 +229,7 @@ delete_flow_entry_from_table( flow_table *table, flow_entry *entry, uint8_t reas
 }
 
 
-static void
+void
 foreach_flow_entry( const uint8_t table_id, flow_entry_handler callback, void *user_data ) {
   assert( valid_table_id( table_id ) );
   assert( callback != NULL );
@@ -239,13 +237,11 @@ foreach_flow_entry( const uint8_t table_id, flow_entry_handler callback, void *u
   flow_table *table = get_flow_table( table_id );
   assert( table != NULL );
 
-  list_element *e = table->entries;
-  while ( e != NULL ) {
-    list_element *next = e->next; // Current element may be deleted inside the callback function.
-    flow_entry *entry = e->data;
-    assert( entry != NULL );
-    callback( entry, user_data );
-    e = next;
+  list_link *l = table->entries.next;
+  while ( l != &table->entries ) {
+    list_link *next = l->next; // Current entry may be deleted inside the callback function.
+    callback( LIST_LINK_ENTRY( l, flow_entry, table_link ), user_data );
+    l = next;
   }
 }
 
@@ -320,7 +316,8 @@ init_flow_table( const uint8_t table_id, const uint32_t max_flow_entries ) {
   table->counters.active_count = 0;
   table->counters.lookup_count = 0;
   table->counters.matched_count = 0;
-  create_list( &table->entries );
+  init_list_link( &table->entries );
+  init_flow_eviction_index( &table->eviction, FLOW_EVICTION_LRU );
   table->initialized = true;
 
   set_default_flow_table_features( table_id, &table->features );
@@ -347,13 +344,12 @@ finalize_flow_table( const uint8_t table_id ) {
 
   delete_timer_event_safe( age_flow_entries, &table->features.table_id );
 
-  for ( list_element *e = table->entries; e != NULL; e = e->next ) {
-    flow_entry *entry = e->data;
-    if ( entry != NULL ) {
-      free_flow_entry( entry );
-    }
+  while ( !list_link_is_empty( &table->entries ) ) {
+    list_link *l = table->entries.next;
+    remove_link( l );
+    free_flow_entry( LIST_LINK_ENTRY( l, flow_entry, table_link ) );
   }
-  delete_list( table->entries );
+  finalize_flow_eviction_index( &table->eviction );
 
   memset( table, 0, sizeof( flow_table ) );
   table->initialized = false;
@@ -387,9 +383,8 @@ lookup_flow_entries_with_table_id( const uint8_t table_id, const match *match_ke
   list_element *head = NULL;
   create_list( &head );
 
-  for ( list_element *e = table->entries; e != NULL; e = e->next ) {
-    flow_entry *entry = e->data;
-    assert( entry != NULL );
+  for ( list_link *l = table->entries.next; l != &table->entries; l = l->next ) {
+    flow_entry *entry = LIST_LINK_ENTRY( l, flow_entry, table_link );
     
     const match *narrow, *wide;
     if ( update_counters ) {
@@ -553,11 +548,10 @@ insert_flow_entry( flow_table *table, flow_entry *entry, const uint16_t flags )
   assert( table != NULL );
   assert( entry != NULL );
 
-  list_element *element = table->entries;
-  while( element != NULL ) {
-    list_element *next = element->next;
-    flow_entry *e = element->data;
-    assert( e != NULL );
+  list_link *position = table->entries.next;
+  while( position != &table->entries ) {
+    list_link *next = position->next;
+    flow_entry *e = LIST_LINK_ENTRY( position, flow_entry, table_link );
     if ( e->priority < entry->priority ) {
       break;
     }
@@ -578,21 +572,12 @@ insert_flow_entry( flow_table *table, flow_entry *entry, const uint16_t flags )
         delete_flow_entry_from_table( table, e, 0, false );
       }
     }
-    element = next;
+    position = next;
   }
 
-  if ( element == NULL ) {
-    // tail
-    append_to_tail( &table->entries, entry );
-  }
-  else if ( element == table->entries ) {
-    // head
-    insert_in_front( &table->entries, entry );
-  }
-  else {
-    // insert before
-    insert_before( &table->entries, element->data, entry );
-  }
+  // Inserting before the head appends to the tail.
+  insert_link_before( position, &entry->table_link );
+  add_flow_eviction_entry( &table->eviction, entry );
 
   increment_active_count( table->features.table_id );
 
@@ -600,6 +585,34 @@ insert_flow_entry( flow_table *table, flow_entry *entry, const uint16_t flags )
 }
 
 
+/*
+ * Evicts an entry from a full table unless the new entry replaces an
+ * existing one.
+ */
+static OFDPE
+make_room_for_flow_entry( flow_table *table, const flow_entry *entry ) {
+  assert( table != NULL );
+  assert( entry != NULL );
+
+  list_element *replaced = lookup_flow_entries_with_table_id( table->features.table_id, entry->match, entry->priority,
+                                                              true, false );
+  if ( replaced != NULL ) {
+    delete_list( replaced );
+    return OFDPE_SUCCESS;
+  }
+
+  flow_entry *victim = select_flow_entry_to_evict( &table->eviction );
+  if ( victim == NULL ) {
+    return ERROR_OFDPE_FLOW_MOD_FAILED_TABLE_FULL;
+  }
+  debug( "Evicting a flow entry ( table_id = %#x, priority = %u, cookie = %#" PRIx64 " ).",
+         victim->table_id, victim->priority, victim->cookie );
+  delete_flow_entry_from_table( table, victim, OFPRR_EVICTION, true );
+
+  return OFDPE_SUCCESS;
+}
+
+
 OFDPE
 add_flow_entry( const uint8_t table_id, flow_entry *entry, const uint16_t flags ) {
   if ( !valid_table_id( table_id ) ) {
@@ -621,7 +634,8 @@ add_flow_entry( const uint8_t table_id, flow_entry *entry, const uint16_t flags
     return ERROR_OFDPE_FLOW_MOD_FAILED_BAD_TABLE_ID;
   }
 
-  if ( table->features.max_entries <= get_active_count( table_id ) ) {
+  bool full = table->features.max_entries <= get_active_count( table_id );
+  if ( full && ( table->features.config & OFPTC_EVICTION ) == 0 ) {
     if ( !unlock_pipeline() ) {
       return ERROR_UNLOCK;
     }
@@ -629,6 +643,9 @@ add_flow_entry( const uint8_t table_id, flow_entry *entry, const uint16_t flags
   }
 
   OFDPE ret = validate_instruction_set( entry->instructions, table->features.metadata_write );
+  if ( ret == OFDPE_SUCCESS && full ) {
+    ret = make_room_for_flow_entry( table, entry );
+  }
   if ( ret == OFDPE_SUCCESS ) {
     entry->table_id = table_id;
     ret = insert_flow_entry( table, entry, flags );
@@ -1067,11 +1084,10 @@ delete_flow_entries_by_group_id( const uint32_t group_id ) {
   for ( uint8_t table_id = 0; table_id <= FLOW_TABLE_ID_MAX; table_id++ ) {
     flow_table *table = get_flow_table( table_id );
     assert( table != NULL );
-    for ( list_element *e = table->entries; e != NULL; e = e->next ) {
-      assert( e->data != NULL );
-      flow_entry *entry = e->data;
+    for ( list_link *l = table->entries.next; l != &table->entries; l = l->next ) {
+      flow_entry *entry = LIST_LINK_ENTRY( l, flow_entry, table_link );
       if ( instructions_have_output_group( entry->instructions, group_id ) ) {
-        append_to_tail( &delete_us, e->data );
+        append_to_tail( &delete_us, entry );
       }
     }
   }
@@ -1103,12 +1119,11 @@ delete_flow_entries_by_meter_id( const uint32_t meter_id ) {
   for ( uint8_t table_id = 0; table_id <= FLOW_TABLE_ID_MAX; table_id++ ) {
     flow_table *table = get_flow_table( table_id );
     assert( table != NULL );
-    for ( list_element *e = table->entries; e != NULL; e = e->next ) {
-      assert( e->data != NULL );
-      flow_entry *entry = e->data;
+    for ( list_link *l = table->entries.next; l != &table->entries; l = l->next ) {
+      flow_entry *entry = LIST_LINK_ENTRY( l, flow_entry, table_link );
       if ( entry->instructions->meter != NULL ) {
         if ( meter_id == OFPM_ALL || meter_id == entry->instructions->meter->meter_id ) {
-          append_to_tail( &delete_us, e->data );
+          append_to_tail( &delete_us, entry );
         }
       }
     }
@@ -1286,12 +1301,55 @@ get_flow_table_features( const uint8_t table_id, flow_table_features *stats ) {
 }
 
 
+static void
+set_flow_table_config_to_table( flow_table *table, const uint32_t config ) {
+  assert( table != NULL );
+
+  uint8_t policy = ( uint8_t ) ( ( config & FLOW_TABLE_CONFIG_EVICTION_POLICY_MASK ) >> FLOW_TABLE_CONFIG_EVICTION_POLICY_SHIFT );
+  set_flow_eviction_policy( &table->eviction, policy );
+  table->features.config = config;
+}
+
+
 OFDPE
 set_flow_table_config( const uint8_t table_id, const uint32_t config ) {
-  warn( "Chaning flow table config is not supported ( table_id = %#x, config = %#x ).",
-        table_id, config );
+  if ( ( config & ~( uint32_t ) FLOW_TABLE_CONFIG_MASK ) != 0 ||
+       ( config & FLOW_TABLE_CONFIG_EVICTION_POLICY_MASK ) > FLOW_TABLE_CONFIG_EVICTION_EXPIRY ) {
+    warn( "Unsupported flow table config ( table_id = %#x, config = %#x ).", table_id, config );
+    return ERROR_OFDPE_TABLE_MOD_FAILED_BAD_CONFIG;
+  }
+  if ( !valid_table_id( table_id ) && table_id != FLOW_TABLE_ALL ) {
+    return ERROR_OFDPE_TABLE_MOD_FAILED_BAD_TABLE;
+  }
 
-  return ERROR_NOT_SUPPORTED;
+  if ( !lock_pipeline() ) {
+    return ERROR_LOCK;
+  }
+
+  OFDPE ret = OFDPE_SUCCESS;
+  if ( table_id == FLOW_TABLE_ALL ) {
+    for ( uint8_t i = 0; i <= FLOW_TABLE_ID_MAX; i++ ) {
+      flow_table *table = get_flow_table( i );
+      if ( table != NULL ) {
+        set_flow_table_config_to_table( table, config );
+      }
+    }
+  }
+  else {
+    flow_table *table = get_flow_table( table_id );
+    if ( table != NULL ) {
+      set_flow_table_config_to_table( table, config );
+    }
+    else {
+      ret = ERROR_OFDPE_TABLE_MOD_FAILED_BAD_TABLE;
+    }
+  }
+
+  if ( !unlock_pipeline() ) {
+    return ERROR_UNLOCK;
+  }
+
+  return ret;
 }
 
 
@@ -1380,10 +1438,8 @@ dump_flow_table( const uint8_t table_id, void dump_function( const char *format,
 
   ( *dump_function )( "[Entries]" );
 
-  for ( list_element *e = table->entries; e != NULL; e = e->next ) {
-    flow_entry *entry = e->data;
-    assert( entry != NULL );
-    dump_flow_entry( entry, dump_function );
+  for ( list_link *l = table->entries.next; l != &table->entries; l = l->next ) {
+    dump_flow_entry( LIST_LINK_ENTRY( l, flow_entry, table_link ), dump_function );
   }
 
   unlock_pipeline();
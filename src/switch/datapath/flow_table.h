@@ -23,6 +23,7 @@
 #include "ofdp_common.h"
 #include "action.h"
 #include "flow_entry.h"
+#include "flow_eviction.h"
 #include "instruction.h"
 #include "match.h"
 
@@ -33,6 +34,19 @@ enum {
   FLOW_TABLE_ALL = OFPTT_ALL,
 };
 
+/*
+ * Table config bits. OFPTC_EVICTION enables eviction on a full table and
+ * the bits below select which entry is evicted ( datapath extension ).
+ */
+enum {
+  FLOW_TABLE_CONFIG_EVICTION_POLICY_SHIFT = 8,
+  FLOW_TABLE_CONFIG_EVICTION_POLICY_MASK = 0x3 << FLOW_TABLE_CONFIG_EVICTION_POLICY_SHIFT,
+  FLOW_TABLE_CONFIG_EVICTION_LRU = FLOW_EVICTION_LRU << FLOW_TABLE_CONFIG_EVICTION_POLICY_SHIFT,
+  FLOW_TABLE_CONFIG_EVICTION_IMPORTANCE = FLOW_EVICTION_IMPORTANCE << FLOW_TABLE_CONFIG_EVICTION_POLICY_SHIFT,
+  FLOW_TABLE_CONFIG_EVICTION_EXPIRY = FLOW_EVICTION_EXPIRY << FLOW_TABLE_CONFIG_EVICTION_POLICY_SHIFT,
+  FLOW_TABLE_CONFIG_MASK = OFPTC_DEPRECATED_MASK | OFPTC_EVICTION | FLOW_TABLE_CONFIG_EVICTION_POLICY_MASK,
+};
+
 
 typedef struct {
   uint8_t table_id;
@@ -65,13 +79,16 @@ typedef struct {
 
 typedef struct {
   bool initialized;
-  list_element *entries;
+  list_link entries; // flow entries linked by table_link in priority order
   flow_table_stats counters;
   flow_table_features features;
+  flow_eviction_index eviction;
 } flow_table;
 
 typedef struct ofp_table_stats table_stats;
 
+typedef void ( *flow_entry_handler )( flow_entry *entry, void *user_data );
+
 typedef struct {
   uint8_t table_id;
   uint32_t duration_sec;
@@ -119,6 +136,7 @@ OFDPE get_flow_table_features( const uint8_t table_id, flow_table_features *stat
 OFDPE set_flow_table_config( const uint8_t table_id, const uint32_t config );
 OFDPE get_flow_table_config( const uint8_t table_id, uint32_t *config );
 bool valid_table_id( const uint8_t table_id );
+void foreach_flow_entry( const uint8_t table_id, flow_entry_handler callback, void *user_data );
 void dump_flow_table( const uint8_t table_id, void dump_function( const char *format, ... ) );
 void dump_flow_tables( void dump_function( const char *format, ... ) );
 
@@ -475,6 +475,20 @@ decrement_reference_count( const uint32_t group_id ) {
 }
 
 
+void
+foreach_group_entry( void function( group_entry *entry, void *user_data ), void *user_data ) {
+  assert( table != NULL );
+  assert( function != NULL );
+
+  for ( list_element *element = table->entries; element != NULL; element = element->next ) {
+    if ( element->data == NULL ) {
+      continue;
+    }
+    function( element->data, user_data );
+  }
+}
+
+
 void
 dump_group_table( void dump_function( const char *format, ... ) ) {
   assert( table != NULL );
@@ -240,3 +240,17 @@ get_meter_stats( const uint32_t meter_id, meter_entry** entries, uint32_t *count
   }
   return ret;
 }
+
+
+void
+foreach_meter_entry( void function( meter_entry *entry, void *user_data ), void *user_data ) {
+  assert( table != NULL );
+  assert( function != NULL );
+
+  for ( list_element *e = table->entries; e != NULL; e = e->next ) {
+    if ( e->data == NULL ) {
+      continue;
+    }
+    function( e->data, user_data );
+  }
+}
@@ -19,5 +19,6 @@ meter_entry* lookup_meter_entry( const uint32_t meter_id );
 OFDPE ref_meter_id( const uint32_t );
 OFDPE unref_meter_id( const uint32_t );
 OFDPE get_meter_stats( const uint32_t meter_id, meter_entry **entries, uint32_t *count );
+void foreach_meter_entry( void function( meter_entry *entry, void *user_data ), void *user_data );
 
 #endif // METER_TABLE_H
@@ -137,7 +137,8 @@ init_datapath( uint64_t datapath_id, unsigned int n_packet_buffers,
   config.features.n_buffers = n_packet_buffers;
   config.features.n_tables = N_FLOW_TABLES;
   config.features.auxiliary_id = 0;
-  config.features.capabilities = OFPC_FLOW_STATS | OFPC_TABLE_STATS | OFPC_PORT_STATS | OFPC_GROUP_STATS;
+  config.features.capabilities = OFPC_FLOW_STATS | OFPC_TABLE_STATS | OFPC_PORT_STATS | OFPC_GROUP_STATS |
+                                  OFPC_QUEUE_STATS;
 
   memset( &config.config, 0, sizeof( switch_config ) );
   config.config.miss_send_len = MISS_SEND_LEN;
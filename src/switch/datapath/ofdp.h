@@ -34,6 +34,7 @@
 #include "ofdp_error.h"
 #include "openflow_helper.h"
 #include "port_manager.h"
+#include "table_snapshot.h"
 
 
 typedef struct {
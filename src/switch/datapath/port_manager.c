@@ -385,6 +385,7 @@ send_frame_from_switch_port( const uint32_t port_no, buffer *frame ) {
     return OFDPE_FAILED;
   }
   uint32_t in_port = ( ( packet_info * ) frame->user_data )->eth_in_port;
+  uint32_t queue_id = ( ( packet_info * ) frame->user_data )->queue_id;
   if ( in_port == 0 || ( in_port > OFPP_MAX && in_port != OFPP_CONTROLLER ) ) {
     warn( "Invalid eth_in_port found in a parsed frame ( frame = %p, eth_in_port = %u ).", frame, in_port );
     return OFDPE_FAILED;
@@ -402,7 +403,7 @@ send_frame_from_switch_port( const uint32_t port_no, buffer *frame ) {
       continue;
     }
     assert( port->device != NULL );
-    send_frame( port->device, frame );
+    send_frame_to_queue( port->device, frame, queue_id );
   }
 
   if ( ports != NULL ) {
@@ -542,6 +543,185 @@ get_port_description( const uint32_t port_no, port_description **descriptions, u
 }
 
 
+OFDPE
+add_port_queue( const uint32_t port_no, const egress_queue_config *config ) {
+  assert( config != NULL );
+
+  if ( port_no == 0 || port_no > OFPP_MAX ) {
+    return ERROR_OFDPE_QUEUE_OP_FAILED_BAD_PORT;
+  }
+  if ( config->queue_id == OFPQ_ALL ) {
+    return ERROR_OFDPE_QUEUE_OP_FAILED_BAD_QUEUE;
+  }
+
+  if ( !lock_mutex( &mutex ) ) {
+    return ERROR_LOCK;
+  }
+
+  OFDPE ret = OFDPE_SUCCESS;
+  switch_port *port = lookup_switch_port( port_no );
+  if ( port == NULL ) {
+    ret = ERROR_OFDPE_QUEUE_OP_FAILED_BAD_PORT;
+  }
+  else {
+    assert( port->device != NULL );
+    if ( !add_egress_queue( port->device->send_queues, config ) ) {
+      ret = ERROR_OFDPE_QUEUE_OP_FAILED_EPERM;
+    }
+  }
+
+  if ( !unlock_mutex( &mutex ) ) {
+    return ERROR_UNLOCK;
+  }
+
+  return ret;
+}
+
+
+static list_element *
+get_switch_ports_for_queue( const uint32_t port_no ) {
+  list_element *ports = NULL;
+  if ( port_no != OFPP_ANY ) {
+    switch_port *port = lookup_switch_port( port_no );
+    if ( port != NULL ) {
+      create_list( &ports );
+      append_to_tail( &ports, port );
+    }
+  }
+  else {
+    ports = get_all_switch_ports();
+  }
+
+  return ports;
+}
+
+
+OFDPE
+get_queue_stats( const uint32_t port_no, const uint32_t queue_id, queue_stats **stats, uint32_t *n_queues ) {
+  assert( stats != NULL );
+  assert( n_queues != NULL );
+
+  if ( !lock_mutex( &mutex ) ) {
+    return ERROR_LOCK;
+  }
+
+  *n_queues = 0;
+  *stats = NULL;
+
+  list_element *ports = get_switch_ports_for_queue( port_no );
+  if ( ports == NULL ) {
+    if ( !unlock_mutex( &mutex ) ) {
+      return ERROR_UNLOCK;
+    }
+    return port_no == OFPP_ANY ? OFDPE_SUCCESS : ERROR_OFDPE_QUEUE_OP_FAILED_BAD_PORT;
+  }
+
+  uint32_t count = 0;
+  for ( list_element *e = ports; e != NULL; e = e->next ) {
+    switch_port *port = e->data;
+    assert( port->device != NULL );
+    count += port->device->send_queues->n_queues;
+  }
+  if ( count > 0 ) {
+    *stats = xmalloc( count * sizeof( queue_stats ) );
+    memset( *stats, 0, count * sizeof( queue_stats ) );
+  }
+
+  struct timespec now = { 0, 0 };
+  time_now( &now );
+  queue_stats *stat = *stats;
+  for ( list_element *e = ports; e != NULL; e = e->next ) {
+    switch_port *port = e->data;
+    egress_scheduler *scheduler = port->device->send_queues;
+    for ( unsigned int i = 0; i < scheduler->n_queues; i++ ) {
+      egress_queue *queue = scheduler->queues[ i ];
+      if ( queue_id != OFPQ_ALL && queue->config.queue_id != queue_id ) {
+        continue;
+      }
+      stat->port_no = port->port_no;
+      stat->queue_id = queue->config.queue_id;
+      stat->tx_bytes = queue->stats.tx_bytes;
+      stat->tx_packets = queue->stats.tx_packets;
+      stat->tx_errors = queue->stats.tx_errors;
+      struct timespec duration = { 0, 0 };
+      timespec_diff( queue->created_at, now, &duration );
+      stat->duration_sec = ( uint32_t ) duration.tv_sec;
+      stat->duration_nsec = ( uint32_t ) duration.tv_nsec;
+      stat++;
+      ( *n_queues )++;
+    }
+  }
+
+  delete_list( ports );
+
+  if ( !unlock_mutex( &mutex ) ) {
+    return ERROR_UNLOCK;
+  }
+
+  if ( *n_queues == 0 && queue_id != OFPQ_ALL ) {
+    if ( *stats != NULL ) {
+      xfree( *stats );
+      *stats = NULL;
+    }
+    return ERROR_OFDPE_QUEUE_OP_FAILED_BAD_QUEUE;
+  }
+
+  return OFDPE_SUCCESS;
+}
+
+
+OFDPE
+get_queue_configs( const uint32_t port_no, port_queue_config **configs, uint32_t *n_queues ) {
+  assert( configs != NULL );
+  assert( n_queues != NULL );
+
+  if ( port_no == 0 || ( port_no > OFPP_MAX && port_no != OFPP_ANY ) ) {
+    return ERROR_OFDPE_QUEUE_OP_FAILED_BAD_PORT;
+  }
+
+  if ( !lock_mutex( &mutex ) ) {
+    return ERROR_LOCK;
+  }
+
+  *n_queues = 0;
+  *configs = NULL;
+
+  list_element *ports = get_switch_ports_for_queue( port_no );
+  if ( ports == NULL ) {
+    if ( !unlock_mutex( &mutex ) ) {
+      return ERROR_UNLOCK;
+    }
+    return ERROR_OFDPE_QUEUE_OP_FAILED_BAD_PORT;
+  }
+
+  for ( list_element *e = ports; e != NULL; e = e->next ) {
+    switch_port *port = e->data;
+    assert( port->device != NULL );
+    *n_queues += port->device->send_queues->n_queues;
+  }
+  *configs = xmalloc( ( *n_queues ) * sizeof( port_queue_config ) );
+
+  port_queue_config *config = *configs;
+  for ( list_element *e = ports; e != NULL; e = e->next ) {
+    switch_port *port = e->data;
+    egress_scheduler *scheduler = port->device->send_queues;
+    for ( unsigned int i = 0; i < scheduler->n_queues; i++ ) {
+      config->port_no = port->port_no;
+      config->config = scheduler->queues[ i ]->config;
+      config++;
+    }
+  }
+
+  delete_list( ports );
+
+  if ( !unlock_mutex( &mutex ) ) {
+    return ERROR_UNLOCK;
+  }
+
+  return OFDPE_SUCCESS;
+}
+
+
 void
 dump_port_description( const port_description *description, void dump_function( const char *format, ... ) ) {
   assert( description != NULL );
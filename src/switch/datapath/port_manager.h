@@ -20,11 +20,17 @@
 #define PORT_MANAGER_H
 
 
+#include "egress_queue.h"
 #include "ofdp_common.h"
 
 
 typedef struct ofp_port_stats port_stats;
 typedef struct ofp_port port_description;
+typedef struct ofp_queue_stats queue_stats;
+typedef struct {
+  uint32_t port_no;
+  egress_queue_config config;
+} port_queue_config;
 
 
 OFDPE init_port_manager( const size_t max_send_queue, const size_t max_recv_queue );
@@ -35,6 +41,9 @@ OFDPE update_port( const uint32_t port_no, uint32_t config, uint32_t mask );
 OFDPE send_frame_from_switch_port( const uint32_t port_no, buffer *frame );
 OFDPE get_port_stats( const uint32_t port_no, port_stats **stats, uint32_t *n_ports );
 OFDPE get_port_description( const uint32_t port_no, port_description **descriptions, uint32_t *n_ports );
+OFDPE add_port_queue( const uint32_t port_no, const egress_queue_config *config );
+OFDPE get_queue_stats( const uint32_t port_no, const uint32_t queue_id, queue_stats **stats, uint32_t *n_queues );
+OFDPE get_queue_configs( const uint32_t port_no, port_queue_config **configs, uint32_t *n_queues );
 void dump_port_description( const port_description *description, void dump_function( const char *format, ... ) );
 
 
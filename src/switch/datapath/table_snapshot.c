@@ -0,0 +1,854 @@
+/*
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/*
+ * A snapshot is a flat image of the meter, group and flow tables. Records
+ * are stored in host byte order and the image is only loaded by a binary
+ * built with the same match layout ( see snapshot_header.match_size ).
+ *
+ *   snapshot_header
+ *   meter_record { band_record }*
+ *   group_record { bucket_record { action_record [ match ] }* }*
+ *   flow_record match { instruction_record { action_record [ match ] }* }*
+ *
+ * Ages are saved relative to the time of the snapshot so that durations,
+ * idle timeouts and hard timeouts continue from that point when loaded.
+ */
+
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "flow_table.h"
+#include "group_table.h"
+#include "meter_table.h"
+#include "table_manager.h"
+#include "table_snapshot.h"
+
+
+#define SNAPSHOT_MAGIC 0x50414e5350444f46ULL // "OFDPSNAP"
+
+enum {
+  SNAPSHOT_VERSION = 1,
+  MAX_GROUP_RESTORE_PASSES = 8,
+};
+
+typedef struct {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t match_size;
+  uint64_t datapath_id;
+  uint64_t saved_at; // wall clock time in seconds
+  uint32_t n_meters;
+  uint32_t n_groups;
+  uint32_t n_flows;
+  uint32_t pad;
+} snapshot_header;
+
+typedef struct {
+  uint32_t meter_id;
+  uint16_t flags;
+  uint16_t n_bands;
+  uint64_t packet_count;
+  uint64_t byte_count;
+  uint64_t age;
+} meter_record;
+
+typedef struct {
+  uint16_t type;
+  uint8_t prec_level;
+  uint8_t pad;
+  uint32_t rate;
+  uint32_t burst_size;
+  uint32_t pad2;
+  uint64_t packet_count;
+  uint64_t byte_count;
+} band_record;
+
+typedef struct {
+  uint32_t group_id;
+  uint8_t type;
+  uint8_t pad;
+  uint16_t n_buckets;
+  uint64_t packet_count;
+  uint64_t byte_count;
+  uint64_t age;
+} group_record;
+
+typedef struct {
+  uint32_t watch_port;
+  uint32_t watch_group;
+  uint16_t weight;
+  uint16_t n_actions;
+  uint32_t pad;
+  uint64_t packet_count;
+  uint64_t byte_count;
+} bucket_record;
+
+typedef struct {
+  uint16_t type;
+  uint16_t max_len;
+  uint16_t ethertype;
+  uint8_t mpls_ttl;
+  uint8_t nw_ttl;
+  uint32_t port;
+  uint32_t group_id;
+  uint32_t queue_id;
+  uint8_t has_match;
+  uint8_t pad[ 3 ];
+} action_record;
+
+typedef struct {
+  uint16_t type;
+  uint8_t table_id;
+  uint8_t pad;
+  uint32_t meter_id;
+  uint64_t metadata;
+  uint64_t metadata_mask;
+  uint16_t n_actions;
+  uint8_t pad2[ 6 ];
+} instruction_record;
+
+typedef struct {
+  uint8_t table_id;
+  uint8_t pad;
+  uint16_t priority;
+  uint16_t idle_timeout;
+  uint16_t hard_timeout;
+  uint16_t flags;
+  uint16_t n_instructions;
+  uint32_t pad2;
+  uint64_t cookie;
+  uint64_t packet_count;
+  uint64_t byte_count;
+  uint64_t age;
+  uint64_t idle_age;
+} flow_record;
+
+typedef struct {
+  buffer *image;
+  struct timespec now;
+  uint32_t n_records;
+} snapshot_writer;
+
+typedef struct {
+  const char *p;
+  size_t remaining;
+  struct timespec now;
+} snapshot_reader;
+
+typedef struct {
+  meter_record record;
+  band_record *bands;
+} meter_image;
+
+
+static const uint64_t NANOSECONDS_PER_SECOND = 1000000000;
+
+
+static uint64_t
+get_age( const struct timespec *since, const struct timespec *now ) {
+  struct timespec diff = { 0, 0 };
+  timespec_diff( *since, *now, &diff );
+  if ( diff.tv_sec < 0 ) {
+    return 0;
+  }
+
+  return ( uint64_t ) diff.tv_sec * NANOSECONDS_PER_SECOND + ( uint64_t ) diff.tv_nsec;
+}
+
+
+static struct timespec
+get_time_before( const struct timespec *now, const uint64_t age ) {
+  uint64_t t = ( uint64_t ) now->tv_sec * NANOSECONDS_PER_SECOND + ( uint64_t ) now->tv_nsec;
+  t = t > age ? t - age : 0;
+  struct timespec before = { ( time_t ) ( t / NANOSECONDS_PER_SECOND ), ( long ) ( t % NANOSECONDS_PER_SECOND ) };
+
+  return before;
+}
+
+
+static void
+write_record( snapshot_writer *writer, const void *record, const size_t length ) {
+  void *p = append_back_buffer( writer->image, length );
+  memcpy( p, record, length );
+}
+
+
+static bool
+read_record( snapshot_reader *reader, void *record, const size_t length ) {
+  if ( reader->remaining < length ) {
+    error( "Truncated snapshot." );
+    return false;
+  }
+  memcpy( record, reader->p, length );
+  reader->p += length;
+  reader->remaining -= length;
+
+  return true;
+}
+
+
+static uint16_t
+count_actions( action_list *actions ) {
+  uint16_t n_actions = 0;
+  if ( actions == NULL ) {
+    return 0;
+  }
+  for ( dlist_element *e = get_first_element( actions ); e != NULL; e = e->next ) {
+    if ( e->data != NULL ) {
+      n_actions++;
+    }
+  }
+
+  return n_actions;
+}
+
+
+static void
+write_actions( snapshot_writer *writer, action_list *actions ) {
+  if ( actions == NULL ) {
+    return;
+  }
+  for ( dlist_element *e = get_first_element( actions ); e != NULL; e = e->next ) {
+    const action *action = e->data;
+    if ( action == NULL ) {
+      continue;
+    }
+    action_record record;
+    memset( &record, 0, sizeof( action_record ) );
+    record.type = action->type;
+    record.max_len = action->max_len;
+    record.ethertype = action->ethertype;
+    record.mpls_ttl = action->mpls_ttl;
+    record.nw_ttl = action->nw_ttl;
+    record.port = action->port;
+    record.group_id = action->group_id;
+    record.queue_id = action->queue_id;
+    record.has_match = action->match != NULL ? 1 : 0;
+    write_record( writer, &record, sizeof( action_record ) );
+    if ( action->match != NULL ) {
+      write_record( writer, action->match, sizeof( match ) );
+    }
+  }
+}
+
+
+static action_list *
+read_actions( snapshot_reader *reader, const uint16_t n_actions ) {
+  action_list *actions = create_action_list();
+  for ( uint16_t i = 0; i < n_actions; i++ ) {
+    action_record record;
+    if ( !read_record( reader, &record, sizeof( action_record ) ) ) {
+      delete_action_list( actions );
+      return NULL;
+    }
+    action *action = create_action_output( record.port, record.max_len );
+    action->type = record.type;
+    action->ethertype = record.ethertype;
+    action->mpls_ttl = record.mpls_ttl;
+    action->nw_ttl = record.nw_ttl;
+    action->group_id = record.group_id;
+    action->queue_id = record.queue_id;
+    if ( record.has_match ) {
+      action->match = create_match();
+      if ( !read_record( reader, action->match, sizeof( match ) ) ) {
+        delete_action( action );
+        delete_action_list( actions );
+        return NULL;
+      }
+    }
+    if ( append_action( actions, action ) != OFDPE_SUCCESS ) {
+      delete_action( action );
+      delete_action_list( actions );
+      return NULL;
+    }
+  }
+
+  return actions;
+}
+
+
+static void
+write_meter_entry( meter_entry *entry, void *user_data ) {
+  snapshot_writer *writer = user_data;
+
+  meter_record record;
+  memset( &record, 0, sizeof( meter_record ) );
+  record.meter_id = entry->meter_id;
+  record.flags = entry->flags;
+  record.n_bands = ( uint16_t ) entry->bands_count;
+  record.packet_count = entry->packet_count;
+  record.byte_count = entry->byte_count;
+  record.age = get_age( &entry->created_at, &writer->now );
+  write_record( writer, &record, sizeof( meter_record ) );
+
+  for ( size_t i = 0; i < entry->bands_count; i++ ) {
+    band_record band;
+    memset( &band, 0, sizeof( band_record ) );
+    band.type = entry->bands[ i ].type;
+    band.prec_level = entry->bands[ i ].prec_level;
+    band.rate = entry->bands[ i ].rate;
+    band.burst_size = entry->bands[ i ].burst_size;
+    band.packet_count = entry->bands[ i ].packet_count;
+    band.byte_count = entry->bands[ i ].byte_count;
+    write_record( writer, &band, sizeof( band_record ) );
+  }
+  writer->n_records++;
+}
+
+
+static void
+write_group_entry( group_entry *entry, void *user_data ) {
+  snapshot_writer *writer = user_data;
+
+  group_record record;
+  memset( &record, 0, sizeof( group_record ) );
+  record.group_id = entry->group_id;
+  record.type = entry->type;
+  record.n_buckets = ( uint16_t ) get_bucket_count( entry->buckets );
+  record.packet_count = entry->packet_count;
+  record.byte_count = entry->byte_count;
+  record.age = get_age( &entry->created_at, &writer->now );
+  write_record( writer, &record, sizeof( group_record ) );
+
+  for ( dlist_element *e = get_first_element( entry->buckets ); e != NULL; e = e->next ) {
+    const bucket *bucket = e->data;
+    if ( bucket == NULL ) {
+      continue;
+    }
+    bucket_record b;
+    memset( &b, 0, sizeof( bucket_record ) );
+    b.watch_port = bucket->watch_port;
+    b.watch_group = bucket->watch_group;
+    b.weight = bucket->weight;
+    b.n_actions = count_actions( bucket->actions );
+    b.packet_count = bucket->packet_count;
+    b.byte_count = bucket->byte_count;
+    write_record( writer, &b, sizeof( bucket_record ) );
+    write_actions( writer, bucket->actions );
+  }
+  writer->n_records++;
+}
+
+
+static void
+write_instruction( snapshot_writer *writer, const instruction *instruction ) {
+  if ( instruction == NULL ) {
+    return;
+  }
+
+  instruction_record record;
+  memset( &record, 0, sizeof( instruction_record ) );
+  record.type = instruction->type;
+  record.table_id = instruction->table_id;
+  record.meter_id = instruction->meter_id;
+  record.metadata = instruction->metadata;
+  record.metadata_mask = instruction->metadata_mask;
+  record.n_actions = count_actions( instruction->actions );
+  write_record( writer, &record, sizeof( instruction_record ) );
+  write_actions( writer, instruction->actions );
+}
+
+
+static void
+write_flow_entry( flow_entry *entry, void *user_data ) {
+  snapshot_writer *writer = user_data;
+  const instruction_set *instructions = entry->instructions;
+  const instruction *each[] = { instructions->meter, instructions->apply_actions, instructions->clear_actions,
+                                instructions->write_actions, instructions->write_metadata, instructions->goto_table };
+
+  flow_record record;
+  memset( &record, 0, sizeof( flow_record ) );
+  record.table_id = entry->table_id;
+  record.priority = entry->priority;
+  record.idle_timeout = entry->idle_timeout;
+  record.hard_timeout = entry->hard_timeout;
+  record.flags = entry->flags;
+  for ( size_t i = 0; i < sizeof( each ) / sizeof( each[ 0 ] ); i++ ) {
+    if ( each[ i ] != NULL ) {
+      record.n_instructions++;
+    }
+  }
+  record.cookie = entry->cookie;
+  record.packet_count = entry->packet_count;
+  record.byte_count = entry->byte_count;
+  record.age = get_age( &entry->created_at, &writer->now );
+  record.idle_age = get_age( &entry->last_seen, &writer->now );
+  write_record( writer, &record, sizeof( flow_record ) );
+  write_record( writer, entry->match, sizeof( match ) );
+
+  for ( size_t i = 0; i < sizeof( each ) / sizeof( each[ 0 ] ); i++ ) {
+    write_instruction( writer, each[ i ] );
+  }
+  writer->n_records++;
+}
+
+
+static bool
+write_image( const char *file, const buffer *image ) {
+  char tmp_file[ PATH_MAX ];
+  snprintf( tmp_file, sizeof( tmp_file ), "%s.tmp", file );
+
+  int fd = open( tmp_file, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR );
+  if ( fd < 0 ) {
+    error( "Failed to open %s ( errno = %s [%d] ).", tmp_file, strerror( errno ), errno );
+    return false;
+  }
+  const char *p = image->data;
+  size_t remaining = image->length;
+  while ( remaining > 0 ) {
+    ssize_t ret = write( fd, p, remaining );
+    if ( ret < 0 ) {
+      if ( errno == EINTR ) {
+        continue;
+      }
+      error( "Failed to write a snapshot ( errno = %s [%d] ).", strerror( errno ), errno );
+      close( fd );
+      unlink( tmp_file );
+      return false;
+    }
+    p += ret;
+    remaining -= ( size_t ) ret;
+  }
+  fsync( fd );
+  close( fd );
+
+  if ( rename( tmp_file, file ) < 0 ) {
+    error( "Failed to rename %s to %s ( errno = %s [%d] ).", tmp_file, file, strerror( errno ), errno );
+    unlink( tmp_file );
+    return false;
+  }
+
+  return true;
+}
+
+
+OFDPE
+save_table_snapshot( const char *file, const uint64_t datapath_id ) {
+  assert( file != NULL );
+
+  snapshot_writer writer;
+  memset( &writer, 0, sizeof( snapshot_writer ) );
+  writer.image = alloc_buffer_with_length( 65536 );
+
+  snapshot_header header;
+  memset( &header, 0, sizeof( snapshot_header ) );
+  header.magic = SNAPSHOT_MAGIC;
+  header.version = SNAPSHOT_VERSION;
+  header.match_size = sizeof( match );
+  header.datapath_id = datapath_id;
+  header.saved_at = ( uint64_t ) time( NULL );
+  write_record( &writer, &header, sizeof( snapshot_header ) );
+
+  if ( !lock_pipeline() ) {
+    free_buffer( writer.image );
+    return ERROR_LOCK;
+  }
+
+  time_now( &writer.now );
+  foreach_meter_entry( write_meter_entry, &writer );
+  header.n_meters = writer.n_records;
+  writer.n_records = 0;
+  foreach_group_entry( write_group_entry, &writer );
+  header.n_groups = writer.n_records;
+  writer.n_records = 0;
+  for ( uint8_t table_id = 0; table_id <= FLOW_TABLE_ID_MAX; table_id++ ) {
+    foreach_flow_entry( table_id, write_flow_entry, &writer );
+  }
+  header.n_flows = writer.n_records;
+
+  if ( !unlock_pipeline() ) {
+    free_buffer( writer.image );
+    return ERROR_UNLOCK;
+  }
+
+  memcpy( writer.image->data, &header, sizeof( snapshot_header ) );
+  bool ret = write_image( file, writer.image );
+  if ( ret ) {
+    info( "Saved a snapshot to %s ( meters = %u, groups = %u, flows = %u, size = %u ).",
+          file, header.n_meters, header.n_groups, header.n_flows, writer.image->length );
+  }
+  free_buffer( writer.image );
+
+  return ret ? OFDPE_SUCCESS : OFDPE_FAILED;
+}
+
+
+static void
+free_meter_image( meter_image *image ) {
+  if ( image->bands != NULL ) {
+    xfree( image->bands );
+  }
+  xfree( image );
+}
+
+
+static bool
+read_meter_entry( snapshot_reader *reader, list_element **meters ) {
+  meter_image *image = xmalloc( sizeof( meter_image ) );
+  image->bands = NULL;
+  if ( !read_record( reader, &image->record, sizeof( meter_record ) ) ) {
+    xfree( image );
+    return false;
+  }
+  if ( image->record.n_bands > 0 ) {
+    image->bands = xcalloc( image->record.n_bands, sizeof( band_record ) );
+  }
+  for ( uint16_t i = 0; i < image->record.n_bands; i++ ) {
+    if ( !read_record( reader, &image->bands[ i ], sizeof( band_record ) ) ) {
+      free_meter_image( image );
+      return false;
+    }
+  }
+  append_to_tail( meters, image );
+
+  return true;
+}
+
+
+static void
+restore_meter_entries( list_element *meters, const struct timespec *now ) {
+  for ( list_element *e = meters; e != NULL; e = e->next ) {
+    meter_image *image = e->data;
+    const meter_record *record = &image->record;
+
+    list_element *band_list = NULL;
+    create_list( &band_list );
+    struct ofp_meter_band_dscp_remark *ofp_bands = NULL;
+    if ( record->n_bands > 0 ) {
+      ofp_bands = xcalloc( record->n_bands, sizeof( struct ofp_meter_band_dscp_remark ) );
+    }
+    for ( uint16_t i = 0; i < record->n_bands; i++ ) {
+      ofp_bands[ i ].type = image->bands[ i ].type;
+      ofp_bands[ i ].len = sizeof( struct ofp_meter_band_dscp_remark );
+      ofp_bands[ i ].rate = image->bands[ i ].rate;
+      ofp_bands[ i ].burst_size = image->bands[ i ].burst_size;
+      ofp_bands[ i ].prec_level = image->bands[ i ].prec_level;
+      append_to_tail( &band_list, &ofp_bands[ i ] );
+    }
+
+    OFDPE error = add_meter_entry( record->flags, record->meter_id, band_list );
+    if ( error == OFDPE_SUCCESS ) {
+      meter_entry *entry = lookup_meter_entry( record->meter_id );
+      entry->packet_count = record->packet_count;
+      entry->byte_count = record->byte_count;
+      entry->created_at = get_time_before( now, record->age );
+      for ( size_t i = 0; i < entry->bands_count && i < record->n_bands; i++ ) {
+        entry->bands[ i ].packet_count = image->bands[ i ].packet_count;
+        entry->bands[ i ].byte_count = image->bands[ i ].byte_count;
+      }
+    }
+    else {
+      warn( "Failed to restore a meter entry ( meter_id = %#x, error = %d ).", record->meter_id, error );
+    }
+
+    delete_list( band_list );
+    if ( ofp_bands != NULL ) {
+      xfree( ofp_bands );
+    }
+  }
+}
+
+
+static bool
+read_group_entry( snapshot_reader *reader, list_element **pending ) {
+  group_record record;
+  if ( !read_record( reader, &record, sizeof( group_record ) ) ) {
+    return false;
+  }
+
+  bucket_list *buckets = create_action_bucket_list();
+  for ( uint16_t i = 0; i < record.n_buckets; i++ ) {
+    bucket_record b;
+    if ( !read_record( reader, &b, sizeof( bucket_record ) ) ) {
+      delete_action_bucket_list( buckets );
+      return false;
+    }
+    action_list *actions = read_actions( reader, b.n_actions );
+    if ( actions == NULL ) {
+      delete_action_bucket_list( buckets );
+      return false;
+    }
+    bucket *bucket = create_action_bucket( b.weight, b.watch_port, b.watch_group, actions );
+    bucket->packet_count = b.packet_count;
+    bucket->byte_count = b.byte_count;
+    append_action_bucket( buckets, bucket );
+  }
+
+  group_entry *entry = alloc_group_entry( record.type, record.group_id, buckets );
+  if ( entry == NULL ) {
+    delete_action_bucket_list( buckets );
+    return true;
+  }
+  entry->packet_count = record.packet_count;
+  entry->byte_count = record.byte_count;
+  entry->created_at = get_time_before( &reader->now, record.age );
+  append_to_tail( pending, entry );
+
+  return true;
+}
+
+
+/*
+ * A group may refer to other groups, so groups which fail to be added are
+ * retried until no more progress is made.
+ */
+static void
+restore_group_entries( list_element *pending ) {
+  for ( int pass = 0; pass < MAX_GROUP_RESTORE_PASSES && pending != NULL; pass++ ) {
+    bool progress = false;
+    list_element *e = pending;
+    while ( e != NULL ) {
+      list_element *next = e->next;
+      group_entry *entry = e->data;
+      if ( add_group_entry( entry ) == OFDPE_SUCCESS ) {
+        delete_element( &pending, entry );
+        progress = true;
+      }
+      e = next;
+    }
+    if ( !progress ) {
+      break;
+    }
+  }
+
+  for ( list_element *e = pending; e != NULL; e = e->next ) {
+    group_entry *entry = e->data;
+    warn( "Failed to restore a group entry ( group_id = %#x ).", entry->group_id );
+    free_group_entry( entry );
+  }
+  delete_list( pending );
+}
+
+
+static bool
+read_flow_entry( snapshot_reader *reader, list_element **flows ) {
+  flow_record record;
+  if ( !read_record( reader, &record, sizeof( flow_record ) ) ) {
+    return false;
+  }
+  match *match = create_match();
+  if ( !read_record( reader, match, sizeof( *match ) ) ) {
+    delete_match( match );
+    return false;
+  }
+
+  instruction_set *instructions = create_instruction_set();
+  for ( uint16_t i = 0; i < record.n_instructions; i++ ) {
+    instruction_record r;
+    if ( !read_record( reader, &r, sizeof( instruction_record ) ) ) {
+      delete_instruction_set( instructions );
+      delete_match( match );
+      return false;
+    }
+    instruction *instruction = NULL;
+    switch ( r.type ) {
+      case OFPIT_GOTO_TABLE:
+        instruction = alloc_instruction_goto_table( r.table_id );
+      break;
+      case OFPIT_WRITE_METADATA:
+        instruction = alloc_instruction_write_metadata( r.metadata, r.metadata_mask );
+      break;
+      case OFPIT_WRITE_ACTIONS:
+      case OFPIT_APPLY_ACTIONS:
+      {
+        action_list *actions = read_actions( reader, r.n_actions );
+        if ( actions == NULL ) {
+          delete_instruction_set( instructions );
+          delete_match( match );
+          return false;
+        }
+        if ( r.type == OFPIT_WRITE_ACTIONS ) {
+          instruction = alloc_instruction_write_actions( actions );
+        }
+        else {
+          instruction = alloc_instruction_apply_actions( actions );
+        }
+      }
+      break;
+      case OFPIT_CLEAR_ACTIONS:
+        instruction = alloc_instruction_clear_actions();
+      break;
+      case OFPIT_METER:
+        instruction = alloc_instruction_meter( r.meter_id );
+      break;
+      default:
+        error( "Undefined instruction type in a snapshot ( type = %#x ).", r.type );
+        delete_instruction_set( instructions );
+        delete_match( match );
+        return false;
+    }
+    add_instruction( instructions, instruction );
+  }
+
+  flow_entry *entry = alloc_flow_entry( match, instructions, record.priority, record.idle_timeout, record.hard_timeout,
+                                        record.flags, record.cookie );
+  if ( entry == NULL ) {
+    delete_instruction_set( instructions );
+    delete_match( match );
+    return true;
+  }
+  // the timestamps are restored first since the eviction index is
+  // ordered by them when the entry is added
+  entry->table_id = record.table_id;
+  entry->packet_count = record.packet_count;
+  entry->byte_count = record.byte_count;
+  entry->created_at = get_time_before( &reader->now, record.age );
+  entry->last_seen = get_time_before( &reader->now, record.idle_age );
+  append_to_tail( flows, entry );
+
+  return true;
+}
+
+
+static void
+restore_flow_entries( list_element *flows ) {
+  for ( list_element *e = flows; e != NULL; e = e->next ) {
+    flow_entry *entry = e->data;
+    OFDPE ret = add_flow_entry( entry->table_id, entry, 0 );
+    if ( ret != OFDPE_SUCCESS ) {
+      warn( "Failed to restore a flow entry ( table_id = %#x, priority = %u, error = %d ).",
+            entry->table_id, entry->priority, ret );
+      free_flow_entry( entry );
+    }
+  }
+}
+
+
+/*
+ * The whole image is decoded before anything is installed, so that the
+ * tables are left untouched by a truncated or corrupt snapshot.
+ */
+static bool
+read_image( snapshot_reader *reader, const uint64_t datapath_id ) {
+  snapshot_header header;
+  if ( !read_record( reader, &header, sizeof( snapshot_header ) ) ) {
+    return false;
+  }
+  if ( header.magic != SNAPSHOT_MAGIC || header.version != SNAPSHOT_VERSION || header.match_size != sizeof( match ) ) {
+    error( "Incompatible snapshot ( magic = %#" PRIx64 ", version = %u, match_size = %u ).",
+           header.magic, header.version, header.match_size );
+    return false;
+  }
+  if ( header.datapath_id != datapath_id ) {
+    error( "Snapshot is taken from another datapath ( datapath_id = %#" PRIx64 " ).", header.datapath_id );
+    return false;
+  }
+
+  list_element *meters = NULL;
+  create_list( &meters );
+  list_element *groups = NULL;
+  create_list( &groups );
+  list_element *flows = NULL;
+  create_list( &flows );
+
+  bool ret = true;
+  for ( uint32_t i = 0; i < header.n_meters && ret; i++ ) {
+    ret = read_meter_entry( reader, &meters );
+  }
+  for ( uint32_t i = 0; i < header.n_groups && ret; i++ ) {
+    ret = read_group_entry( reader, &groups );
+  }
+  for ( uint32_t i = 0; i < header.n_flows && ret; i++ ) {
+    ret = read_flow_entry( reader, &flows );
+  }
+  if ( ret && reader->remaining > 0 ) {
+    error( "Trailing data in snapshot ( length = %zu ).", reader->remaining );
+    ret = false;
+  }
+
+  if ( ret && lock_pipeline() ) {
+    restore_meter_entries( meters, &reader->now );
+    restore_group_entries( groups );
+    groups = NULL;
+    restore_flow_entries( flows );
+    ret = unlock_pipeline();
+  }
+  else {
+    ret = false;
+    for ( list_element *e = groups; e != NULL; e = e->next ) {
+      free_group_entry( e->data );
+    }
+    for ( list_element *e = flows; e != NULL; e = e->next ) {
+      free_flow_entry( e->data );
+    }
+  }
+
+  for ( list_element *e = meters; e != NULL; e = e->next ) {
+    free_meter_image( e->data );
+  }
+  delete_list( meters );
+  delete_list( groups );
+  delete_list( flows );
+
+  if ( ret ) {
+    info( "Loaded a snapshot taken %" PRIu64 " seconds ago ( meters = %u, groups = %u, flows = %u ).",
+          ( uint64_t ) time( NULL ) - header.saved_at, header.n_meters, header.n_groups, header.n_flows );
+  }
+
+  return ret;
+}
+
+
+OFDPE
+load_table_snapshot( const char *file, const uint64_t datapath_id ) {
+  assert( file != NULL );
+
+  int fd = open( file, O_RDONLY );
+  if ( fd < 0 ) {
+    if ( errno == ENOENT ) {
+      return ERROR_NOT_FOUND;
+    }
+    error( "Failed to open %s ( errno = %s [%d] ).", file, strerror( errno ), errno );
+    return OFDPE_FAILED;
+  }
+  struct stat st;
+  if ( fstat( fd, &st ) < 0 || st.st_size < ( off_t ) sizeof( snapshot_header ) ) {
+    error( "Invalid snapshot ( %s ).", file );
+    close( fd );
+    return OFDPE_FAILED;
+  }
+  void *image = mmap( NULL, ( size_t ) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+  close( fd );
+  if ( image == MAP_FAILED ) {
+    error( "Failed to map %s ( errno = %s [%d] ).", file, strerror( errno ), errno );
+    return OFDPE_FAILED;
+  }
+
+  snapshot_reader reader;
+  reader.p = image;
+  reader.remaining = ( size_t ) st.st_size;
+  time_now( &reader.now );
+  bool ret = read_image( &reader, datapath_id );
+
+  munmap( image, ( size_t ) st.st_size );
+
+  return ret ? OFDPE_SUCCESS : OFDPE_FAILED;
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
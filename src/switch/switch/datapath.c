@@ -31,37 +31,60 @@
 #include "switch.h"
 
 
-void
-notify_protocol( int fd, void *user_data ) {
-  assert( fd >= 0 );
-  struct datapath *datapath = user_data;
-  assert( datapath != NULL );
-
-  ssize_t ret = write( datapath->peer_efd, &datapath->send_count, sizeof( datapath->send_count ) );
-  if ( ret < 0 ) {
-    if ( ret == EAGAIN || errno == EINTR ) {
-      return;
-    }
+static void
+notify_protocol( struct datapath *datapath ) {
+  if ( !notify_event( datapath->peer_notifier ) ) {
     char buf[ 256 ];
     memset( buf, '\0', sizeof( buf ) );
-    char *error_string = strerror_r( errno, buf, sizeof( buf ) - 1 );    
-    error( "Failed to notify protocol count= " PRIu64 ", ret = %d errno %s [%d]", datapath->send_count, ret, error_string, errno );
-    return;
+    char *error_string = strerror_r( errno, buf, sizeof( buf ) - 1 );
+    error( "Failed to notify protocol errno %s [%d]", error_string, errno );
   }
-  else if ( ret != sizeof( datapath->send_count ) ) {
-    error( "Failed to notify protocol count= " PRIu64 ",ret = %d", datapath->send_count, ret );
+}
+
+
+static void
+discard_datapath_message( buffer *packet ) {
+  struct ofp_header *hdr = packet->data;
+  if ( packet->length > sizeof( struct ofp_header ) && hdr->type == OFPT_PACKET_IN ) {
+    packet_in_event *pin = ( packet_in_event * ) ( ( char * ) packet->data + sizeof( *hdr ) );
+    if ( pin->packet != NULL && pin->packet->length > 0 ) {
+      free_buffer( pin->packet );
+    }
   }
-  datapath->send_count = 0;
-  set_writable_safe( fd, false );
+  free_buffer( packet );
 }
 
 
+/*
+ * discards the messages left in the ring to the protocol thread, along
+ * with the packets of the packet-ins among them.
+ */
+void
+discard_datapath_messages( spsc_ring *ring ) {
+  buffer *packet;
+  while ( ( packet = pop_spsc_ring( ring ) ) != NULL ) {
+    discard_datapath_message( packet );
+  }
+}
+
+
+/*
+ * The protocol thread is woken up only when it has drained everything
+ * pushed before, so a burst of events results in a single write().
+ */
 static void
 push_datapath_message_to_peer( buffer *packet, struct datapath *datapath ) {
   if ( is_datapath() ) {
-    enqueue_message( datapath->peer_queue, packet );
-    datapath->send_count++;
-    set_writable_safe( datapath->peer_efd, true );
+    if ( !push_spsc_ring( datapath->peer_ring, packet ) ) {
+      if ( datapath->discarded_count++ == 0 ) {
+        warn( "Message ring to protocol is full. Messages are discarded." );
+      }
+      discard_datapath_message( packet );
+    }
+    else {
+      datapath->discarded_count = 0;
+    }
+    notify_protocol( datapath );
   } else if ( is_protocol() ) {
     handle_datapath_packet( packet, get_protocol() );
   }
@@ -84,20 +107,9 @@ static void
 wakened( int fd, void *user_data ) {
   assert( fd >= 0 );
   assert( user_data != NULL );
+  struct datapath *datapath = user_data;
 
-  uint64_t count = 0;
-
-  ssize_t ret = read( fd, &count, sizeof( uint64_t ) );
-  if ( ret < 0 ) {
-    if ( ret != EAGAIN || errno == EINTR ) {
-      return;
-    }
-    char buf[ 256 ];
-    memset( buf, '\0', sizeof( buf ) );
-    char *error_string = strerror_r( errno, buf, sizeof( buf ) - 1 );    
-    error( "Failed to retrieve notify count from protocol errno %s [%d]", error_string, errno );
-    count = 0;
-  }
+  clear_event( datapath->own_notifier );
 }
 
 
@@ -137,6 +149,54 @@ parse_argument_device_option( const char *datapath_ports ) {
 }
 
 
+/*
+ * Each queue is given as "port_no/queue_id:priority:weight:min_rate:max_rate".
+ * Trailing fields may be omitted. Rates are in 1/10 of a percent of the link
+ * rate and a value greater than 1000 means not configured.
+ */
+static bool
+add_port_queues( const char *port_queues ) {
+  char *optarg = strdup( port_queues );
+  bool ret = true;
+
+  char *save_ptr = NULL;
+  char *p = strtok_r( optarg, ",", &save_ptr );
+  while ( p != NULL ) {
+    uint32_t port_no = ( uint32_t ) strtoul( p, &p, 0 );
+    if ( *p != '/' ) {
+      error( "Invalid queue configuration ( %s ).", port_queues );
+      ret = false;
+      break;
+    }
+    egress_queue_config config = { 0, 0, 0, EGRESS_QUEUE_RATE_UNCFG, EGRESS_QUEUE_RATE_UNCFG };
+    config.queue_id = ( uint32_t ) strtoul( p + 1, &p, 0 );
+    if ( *p == ':' ) {
+      config.priority = ( uint8_t ) strtoul( p + 1, &p, 0 );
+    }
+    if ( *p == ':' ) {
+      config.weight = ( uint32_t ) strtoul( p + 1, &p, 0 );
+    }
+    if ( *p == ':' ) {
+      config.min_rate = ( uint16_t ) strtoul( p + 1, &p, 0 );
+    }
+    if ( *p == ':' ) {
+      config.max_rate = ( uint16_t ) strtoul( p + 1, &p, 0 );
+    }
+    OFDPE result = add_port_queue( port_no, &config );
+    if ( result != OFDPE_SUCCESS ) {
+      error( "Failed to add a queue ( port_no = %u, queue_id = %u, ret = %d ).", port_no, config.queue_id, result );
+      ret = false;
+      break;
+    }
+
+    p = strtok_r( NULL, ",", &save_ptr );
+  }
+  xfree( optarg );
+
+  return ret;
+}
+
+
 static void 
 datapath_packet_in( void *event, void *user_data ) {
   packet_in_event *pin = event;
@@ -239,12 +299,50 @@ dump_group( int signum ) {
 }
 
 
+static const char *snapshot_file = NULL;
+static uint64_t snapshot_datapath_id = 0;
+
+
+static void
+save_snapshot_actually() {
+  OFDPE ret = save_table_snapshot( snapshot_file, snapshot_datapath_id );
+  if ( ret != OFDPE_SUCCESS ) {
+    error( "Failed to save a snapshot to %s ( ret = %d ).", snapshot_file, ret );
+  }
+}
+
+
+static void
+save_snapshot( int signum ) {
+  UNUSED( signum );
+
+  set_external_callback_safe( save_snapshot_actually );
+}
+
+
+static void
+save_snapshot_and_exit_actually() {
+  save_snapshot_actually();
+  raise( SIGINT );
+}
+
+
+static void
+save_snapshot_and_exit( int signum ) {
+  UNUSED( signum );
+
+  set_external_callback_safe( save_snapshot_and_exit_actually );
+}
+
+
 static void
-set_signal_handlers() {
+set_signal_handlers( const struct switch_arguments *args ) {
   sigset_t signals;
   sigemptyset( &signals );
   sigaddset( &signals, SIGUSR1 );
   sigaddset( &signals, SIGUSR2 );
+  sigaddset( &signals, SIGHUP );
+  sigaddset( &signals, SIGTERM );
   pthread_sigmask( SIG_UNBLOCK, &signals, NULL );
 
   struct sigaction signal_dump_table;
@@ -254,6 +352,39 @@ set_signal_handlers() {
 
   signal_dump_table.sa_handler = dump_group;
   sigaction( SIGUSR2, &signal_dump_table, NULL );
+
+  if ( args->snapshot != NULL && strlen( args->snapshot ) > 0 ) {
+    snapshot_file = args->snapshot;
+    snapshot_datapath_id = args->datapath_id;
+
+    struct sigaction signal_snapshot;
+    memset( &signal_snapshot, 0, sizeof( struct sigaction ) );
+    signal_snapshot.sa_handler = save_snapshot;
+    sigaction( SIGHUP, &signal_snapshot, NULL );
+
+    signal_snapshot.sa_handler = save_snapshot_and_exit;
+    sigaction( SIGTERM, &signal_snapshot, NULL );
+  }
+}
+
+
+/*
+ * A snapshot which cannot be loaded leaves the tables empty, so the switch
+ * starts as if it had none.
+ */
+static void
+load_snapshot( const struct switch_arguments *args ) {
+  if ( args->snapshot == NULL || strlen( args->snapshot ) == 0 ) {
+    return;
+  }
+
+  OFDPE ret = load_table_snapshot( args->snapshot, args->datapath_id );
+  if ( ret == ERROR_NOT_FOUND ) {
+    info( "No snapshot found ( %s ).", args->snapshot );
+  }
+  else if ( ret != OFDPE_SUCCESS ) {
+    warn( "Ignoring a snapshot which cannot be loaded from %s. Starting with empty tables ( ret = %d ).", args->snapshot, ret );
+  }
 }
 
 
@@ -262,7 +393,7 @@ serve_datapath( void *data ) {
   struct datapath *datapath = data;
   const struct switch_arguments *args = datapath->args;
 
-  set_signal_handlers();
+  set_signal_handlers( args );
 
   OFDPE ret = init_datapath( args->datapath_id, NUM_CONTROLLER_BUFFER, MAX_SEND_QUEUE, MAX_RECV_QUEUE, args->max_flow_entries );
   if ( ret != OFDPE_SUCCESS ) {
@@ -271,15 +402,10 @@ serve_datapath( void *data ) {
   }
   datapath->running = OFDPE_SUCCESS;
 
-  datapath->own_efd = args->efd[ 1 ];
-  datapath->peer_efd = args->efd[ 0 ];
-  datapath->peer_queue = args->to_protocol_queue;
-  datapath->send_count = 0;
-  
-  set_fd_handler_safe( datapath->peer_efd, NULL, NULL, notify_protocol, datapath );
-  set_writable_safe( datapath->peer_efd, false );
-  set_fd_handler_safe( datapath->own_efd, wakened, datapath, NULL, NULL );
-  set_readable_safe( datapath->own_efd, true );
+  datapath->own_notifier = args->to_datapath_notifier;
+  datapath->peer_notifier = args->to_protocol_notifier;
+  datapath->peer_ring = args->to_protocol_ring;
+  datapath->discarded_count = 0;
 
   list_element *datapath_ports = parse_argument_device_option( args->datapath_ports );
   for( list_element *e = datapath_ports; e != NULL; e = e->next ) {
@@ -296,10 +422,23 @@ serve_datapath( void *data ) {
   }
   delete_list( datapath_ports );
 
+  if ( !add_port_queues( args->port_queues ) ) {
+    return -1;
+  }
+
+  load_snapshot( args );
+
+  set_fd_handler_safe( datapath->own_notifier->fd, wakened, datapath, NULL, NULL );
+  set_readable_safe( datapath->own_notifier->fd, true );
   set_event_handlers( datapath );
   post_datapath_status( datapath );
 
   ret = start_datapath();
+
+  // must be unregistered before the event handler is finalized
+  set_readable_safe( datapath->own_notifier->fd, false );
+  delete_fd_handler_safe( datapath->own_notifier->fd );
+
   if ( ret != OFDPE_SUCCESS ) {
     error( "Failed to start datapath ( ret = %d ).", ret );
     return -1;
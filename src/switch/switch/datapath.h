@@ -37,11 +37,11 @@ extern "C" {
 struct datapath {
   struct async thread;
   const struct switch_arguments *args; 
-  message_queue *peer_queue;
-  uint64_t send_count;
+  spsc_ring *peer_ring;
+  uint64_t discarded_count;
   void *data;
-  int own_efd;
-  int peer_efd;
+  event_notifier *own_notifier;
+  event_notifier *peer_notifier;
   int running;
 };
 
@@ -52,6 +52,7 @@ struct datapath_ctrl {
 
 
 pthread_t start_async_datapath( struct switch_arguments *args );
+void discard_datapath_messages( spsc_ring *ring );
 
 
 #ifdef __cplusplus
@@ -33,6 +33,9 @@ static char const * const switch_usage[] = {
   "  -c --server_ip=ipv4_addr                   set server's ipv4 address to connect to",
   "  -p --server_port=port                      set server's port to connect to",
   "  -e --switch_ports=<interface/logical port> one or more comma separated list of switch ports",
+  "  -q --port_queues=<port/queue:priority:weight:min_rate:max_rate>",
+  "                                             one or more comma separated list of egress queues",
+  "  -s --snapshot=file                         save tables to file on SIGHUP/SIGTERM and restore them at start",
   "  -h --help                                  display usage and exit",
   NULL
 };
@@ -56,6 +59,8 @@ set_default_opts( struct switch_arguments *args, const struct option long_option
   args->log_type = LOGGING_TYPE_UNSET,
   args->log_level = "info",
   args->datapath_ports = "",
+  args->port_queues = "",
+  args->snapshot = "",
   args->datapath_id = 1,
   args->server_ip = 0x7f000001,
   args->server_port = 6653,
@@ -76,10 +81,12 @@ _parse_options( struct switch_arguments *args, int argc, char **argv ) {
     { "server_ip", required_argument, 0, 'c' },
     { "server_port", required_argument, 0, 'p' },
     { "switch_ports", optional_argument, 0, 'e' },
+    { "port_queues", required_argument, 0, 'q' },
+    { "snapshot", required_argument, 0, 's' },
     { "help", no_argument, 0, 'h' },
     { 0, 0, 0, 0 },
   };
-  static const char *short_options = "t:l:di:c:p:e:h";
+  static const char *short_options = "t:l:di:c:p:e:q:s:h";
   set_default_opts( args, long_options );
   
   int c, index = 0;
@@ -153,6 +160,16 @@ _parse_options( struct switch_arguments *args, int argc, char **argv ) {
           args->datapath_ports = optarg;
         }
       break;
+      case 'q':
+        if ( optarg ) {
+          args->port_queues = optarg;
+        }
+      break;
+      case 's':
+        if ( optarg ) {
+          args->snapshot = optarg;
+        }
+      break;
       default:
       break;
     }
@@ -28,6 +28,9 @@ extern "C" {
 #include "trema.h"
 
 
+#define TO_PROTOCOL_RING_SIZE 8192
+
+
 struct switch_arguments {
   const char *progname;
   logging_type log_type;
@@ -35,9 +38,12 @@ struct switch_arguments {
   const struct option *options;
 
   const char *datapath_ports;
+  const char *port_queues;
+  const char *snapshot;
   uint64_t datapath_id;
-  int efd[ 2 ]; // event descriptors associated with the to_protocol_queue
-  message_queue *to_protocol_queue;
+  event_notifier *to_protocol_notifier; // notified when to_protocol_ring becomes non-empty
+  event_notifier *to_datapath_notifier;
+  spsc_ring *to_protocol_ring;
   uint32_t server_ip;
   bool run_as_daemon;
   uint16_t server_port;
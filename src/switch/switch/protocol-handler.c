@@ -504,8 +504,12 @@ _handle_table_mod( uint32_t transaction_id, uint8_t table_id, uint32_t config,
   void *user_data ) {
   UNUSED( user_data );
   
-  if ( set_flow_table_config( table_id, config ) != OFDPE_SUCCESS ) {
-    send_error_message( transaction_id, OFPET_TABLE_MOD_FAILED, OFPTMFC_EPERM );    
+  OFDPE ret = set_flow_table_config( table_id, config );
+  if ( ret != OFDPE_SUCCESS ) {
+    uint16_t type = OFPET_TABLE_MOD_FAILED;
+    uint16_t code = OFPTMFC_EPERM;
+    get_ofp_error( ret, &type, &code );
+    send_error_message( transaction_id, type, code );
   }
 }
 void ( *handle_table_mod )( uint32_t transaction_id, uint8_t table_id, uint32_t config,
@@ -715,6 +719,64 @@ _handle_multipart_request( uint32_t transaction_id, uint16_t type, uint16_t flag
 void ( *handle_multipart_request )( uint32_t transaction_id, uint16_t type, uint16_t flags, const buffer *body, void *user_data ) = _handle_multipart_request;
 
 
+static struct ofp_packet_queue *
+assign_packet_queue( const port_queue_config *config ) {
+  uint16_t length = ( uint16_t ) ( offsetof( struct ofp_packet_queue, properties ) +
+                                   sizeof( struct ofp_queue_prop_min_rate ) + sizeof( struct ofp_queue_prop_max_rate ) );
+  struct ofp_packet_queue *packet_queue = xcalloc( 1, length );
+  packet_queue->queue_id = config->config.queue_id;
+  packet_queue->port = config->port_no;
+  packet_queue->len = length;
+
+  struct ofp_queue_prop_min_rate *min_rate = ( struct ofp_queue_prop_min_rate * ) packet_queue->properties;
+  min_rate->prop_header.property = OFPQT_MIN_RATE;
+  min_rate->prop_header.len = sizeof( struct ofp_queue_prop_min_rate );
+  min_rate->rate = config->config.min_rate;
+
+  struct ofp_queue_prop_max_rate *max_rate = ( struct ofp_queue_prop_max_rate * ) ( min_rate + 1 );
+  max_rate->prop_header.property = OFPQT_MAX_RATE;
+  max_rate->prop_header.len = sizeof( struct ofp_queue_prop_max_rate );
+  max_rate->rate = config->config.max_rate;
+
+  return packet_queue;
+}
+
+
+static void
+_handle_queue_get_config_request( uint32_t transaction_id, uint32_t port, void *user_data ) {
+  UNUSED( user_data );
+
+  port_queue_config *configs = NULL;
+  uint32_t nr_queues = 0;
+  OFDPE ret = get_queue_configs( port, &configs, &nr_queues );
+  if ( ret != OFDPE_SUCCESS ) {
+    uint16_t type = OFPET_QUEUE_OP_FAILED;
+    uint16_t code = OFPQOFC_BAD_PORT;
+    get_ofp_error( ret, &type, &code );
+    send_error_message( transaction_id, type, code );
+    return;
+  }
+
+  list_element *queues = NULL;
+  create_list( &queues );
+  for ( uint32_t i = 0; i < nr_queues; i++ ) {
+    append_to_tail( &queues, assign_packet_queue( &configs[ i ] ) );
+  }
+  buffer *queue_get_config_reply = create_queue_get_config_reply( transaction_id, port, queues );
+  switch_send_openflow_message( queue_get_config_reply );
+  free_buffer( queue_get_config_reply );
+
+  for ( list_element *e = queues; e != NULL; e = e->next ) {
+    xfree( e->data );
+  }
+  delete_list( queues );
+  if ( configs != NULL ) {
+    xfree( configs );
+  }
+}
+void ( *handle_queue_get_config_request )( uint32_t transaction_id, uint32_t port, void *user_data ) = _handle_queue_get_config_request;
+
+
 static void
 _handle_barrier_request( uint32_t transaction_id, void *user_data ) {
   UNUSED( user_data );
@@ -92,6 +92,7 @@ void ( *handle_multipart_request )( uint32_t transaction_id,
         const buffer *body,
         void *user_data );
 void ( *handle_barrier_request )( uint32_t transaction_id, void *user_data );
+void ( *handle_queue_get_config_request )( uint32_t transaction_id, uint32_t port, void *user_data );
 
 
 #ifdef __cplusplus
@@ -33,35 +33,14 @@
 #include "protocol.h"
 
 
-static void
-notify_datapath( int fd, void *user_data ) {
-  assert( fd >= 0 );
-  struct protocol *protocol = user_data;
-  assert( protocol != NULL );
-
-  ssize_t ret = write( protocol->peer_efd, &protocol->send_count, sizeof( protocol->send_count ) );
-  if ( ret < 0 ) {
-    if ( ret == EAGAIN || errno == EINTR ) {
-      return;
-    }
+void
+wakeup_datapath( struct protocol *protocol ) {
+  if ( !notify_event( protocol->peer_notifier ) ) {
     char buf[ 256 ];
     memset( buf, '\0', sizeof( buf ) );
-    char *error_string = strerror_r( errno, buf, sizeof( buf ) - 1 );    
-    error( "Failed to notify datapath count= " PRIu64 ", ret = %d errno %s [%d]", protocol->send_count, ret, error_string, errno );
-    return;
+    char *error_string = strerror_r( errno, buf, sizeof( buf ) - 1 );
+    error( "Failed to notify datapath errno %s [%d]", error_string, errno );
   }
-  else if ( ret != sizeof( protocol->send_count ) ) {
-    error( "Failed to notify datapath count= " PRIu64 ",ret = %d", protocol->send_count, ret );
-  }
-  protocol->send_count = 0;
-  set_writable_safe( fd, false );
-}
-
-
-void
-wakeup_datapath( struct protocol *protocol ) {
-  protocol->send_count++;
-  set_writable_safe( protocol->peer_efd, true );
 }
 
 
@@ -155,6 +134,7 @@ handle_controller_connected( void *user_data ) {
   set_multipart_request_handler( handle_multipart_request, user_data );
   set_barrier_request_handler( handle_barrier_request, user_data );
   set_get_config_request_handler( handle_get_config_request, user_data );
+  set_queue_get_config_request_handler( handle_queue_get_config_request, user_data );
 
   active_protocol = user_data;
 }
@@ -204,23 +184,23 @@ retrieve_packet_from_datapath( int fd, void *user_data ) {
   assert( user_data != NULL );
   struct protocol *protocol = user_data;
 
-  uint64_t count = 0;
+  clear_event( protocol->own_notifier );
 
-  ssize_t ret = read( fd, &count, sizeof( uint64_t ) );
-  if ( ret < 0 ) {
-    if ( ret != EAGAIN || errno == EINTR ) {
+  buffer *packets[ DATAPATH_MESSAGE_BATCH ];
+  unsigned int retrieved = 0;
+  while ( retrieved < MAX_DATAPATH_MESSAGES_PER_WAKEUP ) {
+    unsigned int n = pop_spsc_ring_bulk( protocol->input_ring, packets, DATAPATH_MESSAGE_BATCH );
+    if ( n == 0 ) {
       return;
     }
-    char buf[ 256 ];
-    memset( buf, '\0', sizeof( buf ) );
-    char *error_string = strerror_r( errno, buf, sizeof( buf ) - 1 );    
-    error( "Failed to retrieve packet from datapath errno %s [%d]", error_string, errno );
-    count = 0;
+    for ( unsigned int i = 0; i < n; i++ ) {
+      handle_datapath_packet( packets[ i ], protocol );
+    }
+    retrieved += n;
   }
-  for ( uint64_t i = 0; i < count; i++ ) {
-    buffer *packet = dequeue_message( protocol->input_queue );
-    assert( packet != NULL );
-    handle_datapath_packet( packet, protocol );
+  if ( get_spsc_ring_length( protocol->input_ring ) > 0 ) {
+    // let other events be served before the rest is retrieved
+    notify_event( protocol->own_notifier );
   }
 }
 
@@ -236,17 +216,19 @@ serve_protocol( void *data ) {
   init_oxm();
 
   const struct switch_arguments *args = protocol->args;
-  protocol->own_efd = args->efd[ 0 ];
-  protocol->peer_efd = args->efd[ 1 ];
-  protocol->input_queue = args->to_protocol_queue;
-  protocol->send_count = 0;
+  protocol->own_notifier = args->to_protocol_notifier;
+  protocol->peer_notifier = args->to_datapath_notifier;
+  protocol->input_ring = args->to_protocol_ring;
+
+  set_fd_handler_safe( protocol->own_notifier->fd, retrieve_packet_from_datapath, protocol, NULL, NULL );
+  set_readable_safe( protocol->own_notifier->fd, true );
+
+  int ret = start_event_handler_safe();
 
-  set_fd_handler_safe( protocol->own_efd, retrieve_packet_from_datapath, protocol, NULL, NULL );
-  set_readable_safe( protocol->own_efd, true );
-  set_fd_handler_safe( protocol->peer_efd, NULL, NULL, notify_datapath, protocol );
-  set_writable_safe( protocol->peer_efd, false );
+  set_readable_safe( protocol->own_notifier->fd, false );
+  delete_fd_handler_safe( protocol->own_notifier->fd );
 
-  return start_event_handler_safe();
+  return ret;
 }
 
 
@@ -26,6 +26,8 @@ extern "C" {
 
 
 #define MAX_OUTSTANDING_REQUESTS  16
+#define DATAPATH_MESSAGE_BATCH  64
+#define MAX_DATAPATH_MESSAGES_PER_WAKEUP  1024
 
 
 /*
@@ -49,11 +51,10 @@ struct protocol_ctrl {
 struct protocol {
   struct async thread;
   const struct switch_arguments *args;
-  message_queue *input_queue;
-  uint64_t send_count;
+  spsc_ring *input_ring;
   void *data;
-  int own_efd;
-  int peer_efd;
+  event_notifier *own_notifier;
+  event_notifier *peer_notifier;
   struct protocol_ctrl ctrl;
 };
 
@@ -1047,12 +1047,37 @@ void ( *handle_port_desc )( const uint32_t transaction_id ) = _handle_port_desc;
 
 static void
 _handle_queue_stats( const struct ofp_queue_stats_request *req, const uint32_t transaction_id, const uint32_t capabilities ) {
-  UNUSED( req );
-
   if ( ( capabilities & OFPC_QUEUE_STATS ) != OFPC_QUEUE_STATS ) {
     send_error_message( transaction_id, OFPET_BAD_REQUEST, OFPBRC_BAD_MULTIPART );
     return;
   }
+
+  queue_stats *stats = NULL;
+  uint32_t nr_queue_stats = 0;
+  OFDPE ret;
+
+  if ( ( ret = get_queue_stats( req->port_no, req->queue_id, &stats, &nr_queue_stats ) ) == OFDPE_SUCCESS ) {
+    list_element *list = NULL;
+    for ( uint32_t i = 0; i < nr_queue_stats; i++ ) {
+      if ( !i ) {
+        list = new_list();
+      }
+      append_to_tail( &list, ( void * ) &stats[ i ] );
+    }
+    SEND_STATS( queue, transaction_id, 0, list );
+    if ( nr_queue_stats ) {
+      delete_list( list );
+    }
+    if ( stats != NULL ) {
+      xfree( stats );
+    }
+  }
+  else {
+    uint16_t type = OFPET_QUEUE_OP_FAILED;
+    uint16_t code = OFPQOFC_BAD_QUEUE;
+    get_ofp_error( ret, &type, &code );
+    send_error_message( transaction_id, type, code );
+  }
 }
 void ( *handle_queue_stats )( const struct ofp_queue_stats_request *req, const uint32_t transaction_id, const uint32_t capabilities ) = _handle_queue_stats;
 
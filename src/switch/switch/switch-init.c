@@ -110,19 +110,21 @@ init_parse_args( int argc, char **argv ) {
   init_log( name, switch_log, log_output_type );
   xfree( switch_log );
 
-  int efd[ 2 ];
-  uint32_t i;
-  for ( i = 0; i < sizeof( efd ) / sizeof( efd[ 0 ] ); i++ ) {
-    efd[ i ] = create_event_fd();
-    if ( efd[ i ] == -1 ) {
-      error( "failed to create_event_fd %d", errno );
-      xfree( args );
-      return NULL;
+  args->to_protocol_notifier = create_event_notifier();
+  args->to_datapath_notifier = create_event_notifier();
+  if ( args->to_protocol_notifier == NULL || args->to_datapath_notifier == NULL ) {
+    error( "failed to create_event_notifier %d", errno );
+    if ( args->to_protocol_notifier != NULL ) {
+      delete_event_notifier( args->to_protocol_notifier );
     }
+    if ( args->to_datapath_notifier != NULL ) {
+      delete_event_notifier( args->to_datapath_notifier );
+    }
+    xfree( args );
+    return NULL;
   }
-  memcpy( args->efd, &efd, sizeof( efd ) );
-  args->to_protocol_queue = create_message_queue();
-  assert( args->to_protocol_queue != NULL );
+  args->to_protocol_ring = create_spsc_ring( TO_PROTOCOL_RING_SIZE );
+  assert( args->to_protocol_ring != NULL );
 
   ignore_sigpipe();
   if ( args->run_as_daemon == true ) {
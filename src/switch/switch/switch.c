@@ -81,8 +81,15 @@ is_datapath( ) {
 static void
 stop_switch( struct switch_arguments *args ) {
   finalize_openflow_switch_interface();
-  if ( args->to_protocol_queue != NULL ) {
-    delete_message_queue( args->to_protocol_queue );
+  if ( args->to_protocol_ring != NULL ) {
+    discard_datapath_messages( args->to_protocol_ring );
+    delete_spsc_ring( args->to_protocol_ring );
+  }
+  if ( args->to_protocol_notifier != NULL ) {
+    delete_event_notifier( args->to_protocol_notifier );
+  }
+  if ( args->to_datapath_notifier != NULL ) {
+    delete_event_notifier( args->to_datapath_notifier );
   }
 }
 
@@ -94,6 +101,8 @@ set_signal_mask() {
   sigaddset( &signals, SIGPIPE );
   sigaddset( &signals, SIGUSR1 );
   sigaddset( &signals, SIGUSR2 );
+  sigaddset( &signals, SIGHUP );
+  sigaddset( &signals, SIGTERM );
   sigprocmask( SIG_BLOCK, &signals, 0 );
 }
 
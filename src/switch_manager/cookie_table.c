@@ -20,6 +20,7 @@
 
 #include <inttypes.h>
 #include <openflow.h>
+#include <stddef.h>
 #include <string.h>
 #include "cookie_table.h"
 #include "trema.h"
@@ -32,6 +33,16 @@ static const time_t COOKIE_ENTRY_LIFETIME = 86400 * 30;
 static const unsigned int BUCKETS_SIZE = 131063;
 
 
+/*
+ * Service names are interned, so that an application entry is keyed by
+ * the pair of its cookie and a service name id.
+ */
+typedef struct service_name_entry {
+  char name[ MESSENGER_SERVICE_NAME_LENGTH ];
+  uint32_t id;
+} service_name_entry_t;
+
+
 static uint64_t
 generate_cookie( void ) {
   uint64_t initial_value = ( cookie_dough != ( INVALID_COOKIE - 1 ) ) ? ++cookie_dough : 1;
@@ -72,41 +83,101 @@ compare_application( const void *x, const void *y ) {
   const application_entry_t *ex = x;
   const application_entry_t *ey = y;
 
-  if ( ex->cookie != ey->cookie ) {
-    return false;
-  }
-  if ( strcmp( ex->service_name, ey->service_name ) != 0 ) {
-    return false;
-  }
-  return true;
+  return ex->cookie == ey->cookie && ex->service_id == ey->service_id;
 }
 
 
 static unsigned int
 hash_application( const void *key ) {
-  return hash_core( key, ( int ) sizeof( uint64_t ) );
+  return hash_core( key, ( int ) offsetof( application_entry_t, flags ) );
 }
 
 
-static cookie_entry_t *
-allocate_cookie_entry( uint64_t *original_cookie, char *service_name, uint16_t flags ) {
-  cookie_entry_t *new_entry;
+static service_name_entry_t *
+lookup_service_name( const char *service_name ) {
+  service_name_entry_t *entry = cookie_table.last_service_name;
+  if ( entry != NULL && strcmp( entry->name, service_name ) == 0 ) {
+    return entry;
+  }
 
-  new_entry = xmalloc( sizeof ( cookie_entry_t ) );
-  memset( new_entry, 0, sizeof( cookie_entry_t ) );
+  char name[ MESSENGER_SERVICE_NAME_LENGTH ];
+  strncpy( name, service_name, MESSENGER_SERVICE_NAME_LENGTH );
+  name[ MESSENGER_SERVICE_NAME_LENGTH - 1 ] = '\0';
+  entry = lookup_hash_entry( cookie_table.service_names, name );
+  if ( entry != NULL ) {
+    cookie_table.last_service_name = entry;
+  }
 
-  new_entry->cookie = generate_cookie();
-  new_entry->application.cookie = *original_cookie;
+  return entry;
+}
+
+
+static service_name_entry_t *
+intern_service_name( const char *service_name ) {
+  service_name_entry_t *entry = lookup_service_name( service_name );
+  if ( entry != NULL ) {
+    return entry;
+  }
 
   if ( strlen( service_name ) + 1 > MESSENGER_SERVICE_NAME_LENGTH ) {
     warn( "Too long service name ( service_name = %s ).", service_name );
   }
-  strncpy( new_entry->application.service_name, service_name, MESSENGER_SERVICE_NAME_LENGTH );
-  new_entry->application.service_name[ MESSENGER_SERVICE_NAME_LENGTH - 1 ] = '\0';
+  entry = xmalloc( sizeof( service_name_entry_t ) );
+  strncpy( entry->name, service_name, MESSENGER_SERVICE_NAME_LENGTH );
+  entry->name[ MESSENGER_SERVICE_NAME_LENGTH - 1 ] = '\0';
+  entry->id = ++cookie_table.last_service_id;
+  insert_hash_entry( cookie_table.service_names, entry->name, entry );
+  cookie_table.last_service_name = entry;
+
+  return entry;
+}
+
+
+static void
+free_service_name_walker( void *key, void *value, void *user_data ) {
+  UNUSED( key );
+  UNUSED( user_data );
 
+  xfree( value );
+}
+
+
+/*
+ * Entries are kept on a list in order of expiration, so that aging
+ * only visits the entries that are due. Freed entries are kept for
+ * reuse.
+ */
+static void
+set_expiration( cookie_entry_t *entry ) {
+  entry->expire_at = time( NULL ) + COOKIE_ENTRY_LIFETIME;
+  if ( list_link_is_linked( &entry->link ) ) {
+    remove_link( &entry->link );
+  }
+  append_link( &cookie_table.entries, &entry->link );
+}
+
+
+static cookie_entry_t *
+allocate_cookie_entry( uint64_t *original_cookie, service_name_entry_t *service_name, uint16_t flags ) {
+  cookie_entry_t *new_entry;
+
+  if ( list_link_is_empty( &cookie_table.free_entries ) ) {
+    new_entry = xmalloc( sizeof ( cookie_entry_t ) );
+  }
+  else {
+    new_entry = LIST_LINK_ENTRY( cookie_table.free_entries.next, cookie_entry_t, link );
+    remove_link( &new_entry->link );
+  }
+  memset( new_entry, 0, sizeof( cookie_entry_t ) );
+  init_list_link( &new_entry->link );
+
+  new_entry->cookie = generate_cookie();
+  new_entry->application.cookie = *original_cookie;
+  new_entry->application.service_id = service_name->id;
+  new_entry->application.service_name = service_name->name;
   new_entry->application.flags = flags;
   new_entry->reference_count = 1;
-  new_entry->expire_at = time( NULL ) + COOKIE_ENTRY_LIFETIME;
+  set_expiration( new_entry );
 
   return new_entry;
 }
@@ -114,35 +185,47 @@ allocate_cookie_entry( uint64_t *original_cookie, char *service_name, uint16_t f
 
 static void
 free_cookie_entry( cookie_entry_t *free_entry ) {
-  xfree( free_entry );
+  if ( list_link_is_linked( &free_entry->link ) ) {
+    remove_link( &free_entry->link );
+  }
+  append_link( &cookie_table.free_entries, &free_entry->link );
 }
 
 
 static void
-free_cookie_table_walker( void *key, void *value, void *user_data ) {
-  cookie_entry_t *entry = value;
-
-  UNUSED( key );
-  UNUSED( user_data );
-
-  free_cookie_entry( entry );
+free_cookie_entries( list_link *head ) {
+  while ( !list_link_is_empty( head ) ) {
+    list_link *link = head->next;
+    remove_link( link );
+    xfree( LIST_LINK_ENTRY( link, cookie_entry_t, link ) );
+  }
 }
 
 
 void
 init_cookie_table( void ) {
-  cookie_table.global = create_hash_with_size( compare_cookie, hash_cookie_entry, BUCKETS_SIZE );
-  cookie_table.application = create_hash_with_size( compare_application, hash_application, BUCKETS_SIZE );
+  cookie_table.global = create_hash_with_flags( compare_cookie, hash_cookie_entry, BUCKETS_SIZE, HASH_TABLE_NO_LOCK );
+  cookie_table.application = create_hash_with_flags( compare_application, hash_application, BUCKETS_SIZE, HASH_TABLE_NO_LOCK );
+  cookie_table.service_names = create_hash_with_flags( compare_string, hash_string, 16, HASH_TABLE_NO_LOCK );
+  cookie_table.last_service_name = NULL;
+  cookie_table.last_service_id = 0;
+  init_list_link( &cookie_table.entries );
+  init_list_link( &cookie_table.free_entries );
 }
 
 
 void
 finalize_cookie_table( void ) {
-  foreach_hash( cookie_table.global, free_cookie_table_walker, NULL );
+  free_cookie_entries( &cookie_table.entries );
+  free_cookie_entries( &cookie_table.free_entries );
   delete_hash( cookie_table.global );
   delete_hash( cookie_table.application );
+  foreach_hash( cookie_table.service_names, free_service_name_walker, NULL );
+  delete_hash( cookie_table.service_names );
   cookie_table.global = NULL;
   cookie_table.application = NULL;
+  cookie_table.service_names = NULL;
+  cookie_table.last_service_name = NULL;
 }
 
 
@@ -153,20 +236,25 @@ insert_cookie_entry( uint64_t *original_cookie, char *service_name, uint16_t fla
   debug( "Inserting cookie entry ( original_cookie = %#" PRIx64 ", service_name = %s, flags = %#x ).",
          *original_cookie, service_name, flags );
 
-  new_entry = lookup_cookie_entry_by_application( original_cookie, service_name );
+  service_name_entry_t *service = intern_service_name( service_name );
+  application_entry_t key = { *original_cookie, service->id, 0, NULL };
+  new_entry = lookup_hash_entry( cookie_table.application, &key );
   if ( new_entry != NULL ) {
     new_entry->reference_count++;
-    new_entry->expire_at = time( NULL ) + COOKIE_ENTRY_LIFETIME;
+    set_expiration( new_entry );
     new_entry->application.flags |= flags; // FIXME: save flags for each flow individually
 
     return &new_entry->cookie;
   }
 
-  new_entry = allocate_cookie_entry( original_cookie, service_name, flags );
-  conflict_entry = lookup_cookie_entry_by_cookie( &new_entry->cookie );
-  if ( conflict_entry != NULL ) {
-    warn( "Conflicted cookie ( cookie = %#" PRIx64 " ).", new_entry->cookie );
-    delete_cookie_entry( conflict_entry );
+  new_entry = allocate_cookie_entry( original_cookie, service, flags );
+  // generate_cookie() returns an unused cookie unless it runs out
+  if ( new_entry->cookie == RESERVED_COOKIE ) {
+    conflict_entry = lookup_cookie_entry_by_cookie( &new_entry->cookie );
+    if ( conflict_entry != NULL ) {
+      warn( "Conflicted cookie ( cookie = %#" PRIx64 " ).", new_entry->cookie );
+      delete_cookie_entry( conflict_entry );
+    }
   }
   insert_hash_entry( cookie_table.global, &new_entry->cookie, new_entry );
   insert_hash_entry( cookie_table.application, &new_entry->application, new_entry );
@@ -210,33 +298,28 @@ lookup_cookie_entry_by_cookie( uint64_t *cookie ) {
 
 cookie_entry_t *
 lookup_cookie_entry_by_application( uint64_t *cookie, char *service_name ) {
-  application_entry_t key;
-  cookie_entry_t *entry;
-
-  memset( &key, 0, sizeof( application_entry_t ) );
-  key.cookie = *cookie;
-  strncpy( key.service_name, service_name, MESSENGER_SERVICE_NAME_LENGTH );
-  key.service_name[ MESSENGER_SERVICE_NAME_LENGTH - 1 ] = '\0';
+  service_name_entry_t *service = lookup_service_name( service_name );
+  if ( service == NULL ) {
+    return NULL;
+  }
 
-  entry = lookup_hash_entry( cookie_table.application, &key );
+  application_entry_t key = { *cookie, service->id, 0, NULL };
 
-  return entry;
+  return lookup_hash_entry( cookie_table.application, &key );
 }
 
 
 static void
 age_cookie_entry( cookie_entry_t *entry ) {
-  if ( entry->expire_at < time( NULL ) ) {
-    // TODO: check if the target flow is still alive or not
-    warn( "Aging out cookie entry ( cookie = %#" PRIx64 ", application = [ cookie = %#" PRIx64 ", service_name = %s, "
-          "flags = %#x ], reference_count = %d, expire_at = %u ).",
-          entry->cookie, entry->application.cookie, entry->application.service_name,
-          entry->application.flags, entry->reference_count, entry->expire_at );
-
-    delete_hash_entry( cookie_table.global, &entry->cookie );
-    delete_hash_entry( cookie_table.application, &entry->application );
-    free_cookie_entry( entry );
-  }
+  // TODO: check if the target flow is still alive or not
+  warn( "Aging out cookie entry ( cookie = %#" PRIx64 ", application = [ cookie = %#" PRIx64 ", service_name = %s, "
+        "flags = %#x ], reference_count = %d, expire_at = %u ).",
+        entry->cookie, entry->application.cookie, entry->application.service_name,
+        entry->application.flags, entry->reference_count, entry->expire_at );
+
+  delete_hash_entry( cookie_table.global, &entry->cookie );
+  delete_hash_entry( cookie_table.application, &entry->application );
+  free_cookie_entry( entry );
 }
 
 
@@ -244,12 +327,13 @@ void
 age_cookie_table( void *user_data ) {
   UNUSED( user_data );
 
-  hash_iterator iter;
-  hash_entry *e;
-
-  init_hash_iterator( cookie_table.global, &iter );
-  while ( ( e = iterate_hash_next( &iter ) ) != NULL ) {
-    age_cookie_entry( e->value );
+  time_t now = time( NULL );
+  while ( !list_link_is_empty( &cookie_table.entries ) ) {
+    cookie_entry_t *entry = LIST_LINK_ENTRY( cookie_table.entries.next, cookie_entry_t, link );
+    if ( entry->expire_at >= now ) {
+      break;
+    }
+    age_cookie_entry( entry );
   }
 }
 
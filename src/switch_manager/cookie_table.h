@@ -32,10 +32,12 @@
 #define RESERVED_COOKIE 0
 
 
+// cookie and service_id are the key of the application table
 typedef struct application_entry {
   uint64_t cookie;
-  char service_name[ MESSENGER_SERVICE_NAME_LENGTH ];
+  uint32_t service_id;
   uint16_t flags;
+  char *service_name;
 } application_entry_t;
 
 typedef struct cookie_entry {
@@ -43,11 +45,17 @@ typedef struct cookie_entry {
   application_entry_t application;
   int reference_count;
   time_t expire_at;
+  list_link link;
 } cookie_entry_t;
 
 typedef struct cookie_table {
   hash_table *global;
   hash_table *application;
+  hash_table *service_names;
+  struct service_name_entry *last_service_name;
+  uint32_t last_service_id;
+  list_link entries;      // in order of expiration
+  list_link free_entries;
 } cookie_table_t;
 
 
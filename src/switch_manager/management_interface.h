@@ -29,6 +29,7 @@ enum {
   DUMP_XID_TABLE = 0,
   DUMP_COOKIE_TABLE,
   TOGGLE_COOKIE_AGING,
+  DUMP_LATENCY,
 };
 
 
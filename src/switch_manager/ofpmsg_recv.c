@@ -25,6 +25,7 @@
 #include "cookie_table.h"
 #include "ofpmsg_recv.h"
 #include "ofpmsg_send.h"
+#include "packet_in_table.h"
 #include "service_interface.h"
 #include "switch.h"
 #include "xid_table.h"
@@ -257,6 +258,19 @@ int
 ofpmsg_recv_packetin( struct switch_info *sw_info, buffer *buf ) {
   ofpmsg_debug( "Receive 'packet in' from a switch." );
 
+  if ( sw_info->packet_in_table != NULL && suppress_packet_in( sw_info->packet_in_table, buf ) ) {
+    free_buffer( buf );
+    return 0;
+  }
+
+  struct ofp_packet_in *packet_in = buf->data;
+  uint32_t buffer_id = ntohl( packet_in->buffer_id );
+  if ( buffer_id != OFP_NO_BUFFER ) {
+    struct packet_in_timestamp *timestamp = &sw_info->latency.packet_ins[ buffer_id % PACKET_IN_TIMESTAMPS ];
+    timestamp->buffer_id = buffer_id;
+    clock_gettime( CLOCK_MONOTONIC, &timestamp->received_at );
+  }
+
   service_send_to_application( sw_info->packetin_service_name_list,
                                MESSENGER_OPENFLOW_MESSAGE,
                                &sw_info->datapath_id, buf );
@@ -381,6 +395,12 @@ int
 ofpmsg_recv_barrierreply( struct switch_info *sw_info, buffer *buf ) {
   ofpmsg_debug( "Receive 'barrier reply' from a switch." );
 
+  struct ofp_header *header = buf->data;
+  xid_entry_t *xid_entry = lookup_xid_entry( ntohl( header->xid ) );
+  if ( xid_entry != NULL && VALID_TIMESPEC( &xid_entry->sent_at ) ) {
+    record_latency( &sw_info->latency.barrier, &xid_entry->sent_at );
+  }
+
   send_transaction_reply( sw_info, buf );
 
   return 0;
@@ -24,6 +24,7 @@
 #include <string.h>
 #include "cookie_table.h"
 #include "ofpmsg_send.h"
+#include "packet_in_table.h"
 #include "secure_channel_sender.h"
 #include "switch.h"
 #include "trema.h"
@@ -193,6 +194,36 @@ update_flowmod_cookie( buffer *buf, char *service_name ) {
 }
 
 
+/*
+ * Records the time from a buffered packet-in to the flow mod or
+ * packet out that uses its buffer.
+ */
+static void
+record_packet_in_response( struct switch_info *sw_info, buffer *buf ) {
+  struct ofp_header *header = buf->data;
+  uint32_t buffer_id;
+  if ( header->type == OFPT_FLOW_MOD ) {
+    buffer_id = ntohl( ( ( struct ofp_flow_mod * ) header )->buffer_id );
+  }
+  else if ( header->type == OFPT_PACKET_OUT ) {
+    buffer_id = ntohl( ( ( struct ofp_packet_out * ) header )->buffer_id );
+  }
+  else {
+    return;
+  }
+  if ( buffer_id == OFP_NO_BUFFER ) {
+    return;
+  }
+
+  struct packet_in_timestamp *timestamp = &sw_info->latency.packet_ins[ buffer_id % PACKET_IN_TIMESTAMPS ];
+  if ( timestamp->buffer_id != buffer_id ) {
+    return;
+  }
+  record_latency( &sw_info->latency.packet_in_response, &timestamp->received_at );
+  timestamp->buffer_id = OFP_NO_BUFFER;
+}
+
+
 int
 ofpmsg_send( struct switch_info *sw_info, buffer *buf, char *service_name ) {
   int ret;
@@ -203,6 +234,9 @@ ofpmsg_send( struct switch_info *sw_info, buffer *buf, char *service_name ) {
 
   new_xid = insert_xid_entry( ntohl( ofp_header->xid ), service_name );
   ofp_header->xid = htonl( new_xid );
+  if ( ofp_header->type == OFPT_BARRIER_REQUEST ) {
+    clock_gettime( CLOCK_MONOTONIC, &lookup_xid_entry( new_xid )->sent_at );
+  }
 
   if ( ofp_header->type == OFPT_FLOW_MOD && sw_info->cookie_translation ) {
     ret = update_flowmod_cookie( buf, service_name );
@@ -212,6 +246,10 @@ ofpmsg_send( struct switch_info *sw_info, buffer *buf, char *service_name ) {
       return ret;
     }
   }
+  if ( sw_info->packet_in_table != NULL ) {
+    clear_packet_in_window( sw_info->packet_in_table, buf );
+  }
+  record_packet_in_response( sw_info, buf );
 
   ret = send_to_secure_channel( sw_info, buf );
   if ( ret == 0 ) {
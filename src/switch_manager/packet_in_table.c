@@ -0,0 +1,444 @@
+/*
+ * OpenFlow Switch Manager
+ *
+ * Copyright (C) 2008-2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <arpa/inet.h>
+#include <assert.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <openflow.h>
+#include <stddef.h>
+#include <string.h>
+#include "trema.h"
+#include "arp.h"
+#include "ether.h"
+#include "ipv4.h"
+#include "ipv6.h"
+#include "packet_in_table.h"
+
+
+#ifdef UNIT_TESTING
+#define static
+
+#ifdef clock_gettime
+#undef clock_gettime
+#endif
+#define clock_gettime mock_clock_gettime
+int mock_clock_gettime( clockid_t clk_id, struct timespec *tp );
+#endif // UNIT_TESTING
+
+
+#define PACKET_IN_TABLE_MAX_ENTRIES 4096
+
+static const unsigned int FNV_OFFSET_BASIS = 2166136261U;
+static const unsigned int FNV_PRIME = 16777619U;
+static const uint16_t IPV4_FRAGMENT_OFFSET_MASK = 0x1fff;
+
+
+static bool
+key_is_complete( const packet_in_key_t *key ) {
+  return key->length <= sizeof( key->bytes );
+}
+
+
+static void
+append_key( packet_in_key_t *key, const void *data, size_t length ) {
+  if ( !key_is_complete( key ) || length > sizeof( key->bytes ) - key->length ) {
+    // does not fit; the key is left incomplete
+    key->length = UINT16_MAX;
+    return;
+  }
+  memcpy( key->bytes + key->length, data, length );
+  key->length = ( uint16_t ) ( key->length + length );
+}
+
+
+static uint16_t
+read_uint16( const uint8_t *data ) {
+  uint16_t value;
+  memcpy( &value, data, sizeof( value ) );
+
+  return ntohs( value );
+}
+
+
+static void
+append_transport( packet_in_key_t *key, uint8_t protocol, const uint8_t *data, size_t length ) {
+  switch ( protocol ) {
+  case IPPROTO_TCP:
+  case IPPROTO_UDP:
+  case IPPROTO_SCTP:
+    // source and destination ports
+    append_key( key, data, length < 4 ? length : 4 );
+    break;
+  case IPPROTO_ICMP:
+  case IPPROTO_ICMPV6:
+    // type and code
+    append_key( key, data, length < 2 ? length : 2 );
+    break;
+  default:
+    break;
+  }
+}
+
+
+static void
+append_ipv4( packet_in_key_t *key, const uint8_t *data, size_t length ) {
+  ipv4_header_t ip;
+  if ( length < sizeof( ip ) ) {
+    return;
+  }
+  memcpy( &ip, data, sizeof( ip ) );
+
+  append_key( key, &ip.protocol, sizeof( ip.protocol ) );
+  append_key( key, &ip.saddr, sizeof( ip.saddr ) );
+  append_key( key, &ip.daddr, sizeof( ip.daddr ) );
+
+  size_t header_length = ( size_t ) ip.ihl * 4;
+  if ( ( ntohs( ip.frag_off ) & IPV4_FRAGMENT_OFFSET_MASK ) != 0 ||
+       header_length < sizeof( ip ) || header_length > length ) {
+    return;
+  }
+
+  append_transport( key, ip.protocol, data + header_length, length - header_length );
+}
+
+
+static void
+append_ipv6( packet_in_key_t *key, const uint8_t *data, size_t length ) {
+  ipv6_header_t ip;
+  if ( length < sizeof( ip ) ) {
+    return;
+  }
+  memcpy( &ip, data, sizeof( ip ) );
+
+  append_key( key, &ip.nexthdr, sizeof( ip.nexthdr ) );
+  append_key( key, ip.saddr, sizeof( ip.saddr ) );
+  append_key( key, ip.daddr, sizeof( ip.daddr ) );
+
+  append_transport( key, ip.nexthdr, data + sizeof( ip ), length - sizeof( ip ) );
+}
+
+
+/*
+ * Appends the fields of an Ethernet frame that stay the same for all
+ * packets of a flow: addresses, VLAN tags, protocols and ports. Fields
+ * that change from packet to packet such as the IP identification or
+ * the TCP sequence number are left out.
+ */
+static void
+append_flow( packet_in_key_t *key, const uint8_t *frame, size_t length ) {
+  if ( length < sizeof( ether_header_t ) ) {
+    append_key( key, frame, length );
+    return;
+  }
+
+  append_key( key, frame, offsetof( ether_header_t, type ) );
+  size_t offset = offsetof( ether_header_t, type );
+  uint16_t type = read_uint16( frame + offset );
+  offset += sizeof( uint16_t );
+  while ( ( type == ETH_ETHTYPE_TPID || type == ETH_ETHTYPE_TPID1 ) &&
+          offset + sizeof( vlantag_header_t ) <= length ) {
+    append_key( key, frame + offset, sizeof( uint16_t ) );
+    type = read_uint16( frame + offset + offsetof( vlantag_header_t, type ) );
+    offset += sizeof( vlantag_header_t );
+  }
+  append_key( key, &type, sizeof( type ) );
+
+  switch ( type ) {
+  case ETH_ETHTYPE_IPV4:
+    append_ipv4( key, frame + offset, length - offset );
+    break;
+  case ETH_ETHTYPE_IPV6:
+    append_ipv6( key, frame + offset, length - offset );
+    break;
+  case ETH_ETHTYPE_ARP:
+    append_key( key, frame + offset,
+                length - offset < sizeof( arp_header_t ) ? length - offset : sizeof( arp_header_t ) );
+    break;
+  default:
+    break;
+  }
+}
+
+
+/*
+ * Makes the key of a frame. Only the flow fields are filled in, so
+ * that the key can be looked up in the flow table.
+ */
+static bool
+make_flow_key( packet_in_key_t *key, const uint8_t *frame, size_t length ) {
+  key->length = 0;
+  append_flow( key, frame, length );
+  key->flow_length = key->length;
+
+  return key_is_complete( key );
+}
+
+
+static unsigned int
+hash_flow_key( const void *key ) {
+  const packet_in_key_t *flow_key = key;
+
+  unsigned int hash = FNV_OFFSET_BASIS;
+  for ( size_t i = 0; i < flow_key->flow_length; i++ ) {
+    hash ^= flow_key->bytes[ i ];
+    hash *= FNV_PRIME;
+  }
+
+  return hash;
+}
+
+
+static bool
+compare_flow_key( const void *x, const void *y ) {
+  const packet_in_key_t *key_x = x;
+  const packet_in_key_t *key_y = y;
+
+  return key_x->flow_length == key_y->flow_length &&
+         memcmp( key_x->bytes, key_y->bytes, key_x->flow_length ) == 0;
+}
+
+
+packet_in_table_t *
+create_packet_in_table( unsigned int interval_msec ) {
+  assert( interval_msec > 0 );
+
+  packet_in_table_t *table = xmalloc( sizeof( packet_in_table_t ) );
+  memset( table, 0, sizeof( packet_in_table_t ) );
+  table->flows = create_hash( compare_flow_key, hash_flow_key );
+  table->buffers = create_hash( compare_uint32, hash_uint32 );
+  init_list_link( &table->entries );
+  init_list_link( &table->free_entries );
+  table->interval.tv_sec = ( time_t ) ( interval_msec / 1000 );
+  table->interval.tv_nsec = ( long ) ( interval_msec % 1000 ) * 1000000;
+
+  return table;
+}
+
+
+static void
+free_packet_in_entries( list_link *head ) {
+  while ( !list_link_is_empty( head ) ) {
+    list_link *link = head->next;
+    remove_link( link );
+    xfree( LIST_LINK_ENTRY( link, packet_in_entry_t, link ) );
+  }
+}
+
+
+void
+delete_packet_in_table( packet_in_table_t *table ) {
+  assert( table != NULL );
+
+  free_packet_in_entries( &table->entries );
+  free_packet_in_entries( &table->free_entries );
+  delete_hash( table->flows );
+  delete_hash( table->buffers );
+  xfree( table );
+}
+
+
+static void
+delete_packet_in_entry( packet_in_table_t *table, packet_in_entry_t *entry ) {
+  if ( entry->suppressed > 0 ) {
+    debug( "Suppressed %u packet-ins ( table_id = %u, reason = %u, buffer_id = %#" PRIx32 " ).",
+           entry->suppressed, entry->table_id, entry->reason, entry->buffer_id );
+  }
+
+  delete_hash_entry( table->flows, &entry->key );
+  if ( entry->buffer_id != OFP_NO_BUFFER && lookup_hash_entry( table->buffers, &entry->buffer_id ) == entry ) {
+    delete_hash_entry( table->buffers, &entry->buffer_id );
+  }
+  remove_link( &entry->link );
+  append_link( &table->free_entries, &entry->link );
+  table->n_entries--;
+}
+
+
+static packet_in_entry_t *
+oldest_packet_in_entry( packet_in_table_t *table ) {
+  if ( list_link_is_empty( &table->entries ) ) {
+    return NULL;
+  }
+  return LIST_LINK_ENTRY( table->entries.next, packet_in_entry_t, link );
+}
+
+
+/*
+ * Closes the windows that are older than the interval. All windows
+ * have the same length, so the list is in expiration order.
+ */
+static void
+expire_packet_in_entries( packet_in_table_t *table, const struct timespec *now ) {
+  packet_in_entry_t *oldest;
+  while ( ( oldest = oldest_packet_in_entry( table ) ) != NULL && !TIMESPEC_LESS_THEN( now, &oldest->expire_at ) ) {
+    delete_packet_in_entry( table, oldest );
+  }
+}
+
+
+static void
+insert_packet_in_entry( packet_in_table_t *table, const packet_in_key_t *key,
+                        const struct ofp_packet_in *packet_in, const struct timespec *now ) {
+  if ( table->n_entries >= PACKET_IN_TABLE_MAX_ENTRIES ) {
+    delete_packet_in_entry( table, oldest_packet_in_entry( table ) );
+  }
+
+  packet_in_entry_t *entry;
+  if ( list_link_is_empty( &table->free_entries ) ) {
+    entry = xmalloc( sizeof( packet_in_entry_t ) );
+    init_list_link( &entry->link );
+  }
+  else {
+    entry = LIST_LINK_ENTRY( table->free_entries.next, packet_in_entry_t, link );
+    remove_link( &entry->link );
+  }
+  memcpy( &entry->key, key, offsetof( packet_in_key_t, bytes ) + key->length );
+  entry->buffer_id = ntohl( packet_in->buffer_id );
+  entry->table_id = packet_in->table_id;
+  entry->reason = packet_in->reason;
+  entry->suppressed = 0;
+  ADD_TIMESPEC( now, &table->interval, &entry->expire_at );
+
+  insert_hash_entry( table->flows, &entry->key, entry );
+  if ( entry->buffer_id != OFP_NO_BUFFER ) {
+    packet_in_entry_t *old = insert_hash_entry( table->buffers, &entry->buffer_id, entry );
+    if ( old != NULL ) {
+      // The switch has reused the buffer.
+      old->buffer_id = OFP_NO_BUFFER;
+    }
+  }
+  append_link( &table->entries, &entry->link );
+  table->n_entries++;
+}
+
+
+/**
+ * Returns true if packet_in repeats a packet-in that was forwarded
+ * within the interval, with the same table id, reason, match and flow.
+ * Otherwise opens a window for the flow and returns false.
+ */
+bool
+suppress_packet_in( packet_in_table_t *table, const buffer *packet_in ) {
+  assert( table != NULL );
+  assert( packet_in != NULL );
+
+  const struct ofp_packet_in *header = packet_in->data;
+  size_t match_length = ntohs( header->match.length );
+  size_t data_offset = offsetof( struct ofp_packet_in, match ) + match_length + PADLEN_TO_64( match_length ) + 2;
+  if ( match_length < offsetof( struct ofp_match, oxm_fields ) || packet_in->length < data_offset ) {
+    return false;
+  }
+
+  struct timespec now;
+  clock_gettime( CLOCK_MONOTONIC, &now );
+  expire_packet_in_entries( table, &now );
+
+  const uint8_t *data = packet_in->data;
+  packet_in_key_t key;
+  bool complete = make_flow_key( &key, data + data_offset, packet_in->length - data_offset );
+  if ( complete ) {
+    append_key( &key, header->match.oxm_fields, match_length - offsetof( struct ofp_match, oxm_fields ) );
+    complete = key_is_complete( &key );
+  }
+  if ( !complete ) {
+    // too long to be remembered
+    table->stats.forwarded++;
+    return false;
+  }
+
+  packet_in_entry_t *entry = lookup_hash_entry( table->flows, &key );
+  if ( entry == NULL ) {
+    insert_packet_in_entry( table, &key, header, &now );
+  }
+  else if ( entry->table_id == header->table_id && entry->reason == header->reason &&
+            entry->key.length == key.length &&
+            memcmp( entry->key.bytes + key.flow_length, key.bytes + key.flow_length,
+                    ( size_t ) ( key.length - key.flow_length ) ) == 0 ) {
+    entry->suppressed++;
+    table->stats.suppressed++;
+    return true;
+  }
+  table->stats.forwarded++;
+
+  return false;
+}
+
+
+/**
+ * Closes the window of the flow that message, a flow mod or a packet
+ * out from an application, has taken care of. The window is found by
+ * the buffer id, or by the packet data of an unbuffered packet out.
+ */
+void
+clear_packet_in_window( packet_in_table_t *table, const buffer *message ) {
+  assert( table != NULL );
+  assert( message != NULL );
+
+  const struct ofp_header *header = message->data;
+  packet_in_entry_t *entry = NULL;
+  if ( header->type == OFPT_FLOW_MOD && message->length >= offsetof( struct ofp_flow_mod, match ) ) {
+    const struct ofp_flow_mod *flow_mod = message->data;
+    uint32_t buffer_id = ntohl( flow_mod->buffer_id );
+    if ( buffer_id != OFP_NO_BUFFER ) {
+      entry = lookup_hash_entry( table->buffers, &buffer_id );
+    }
+  }
+  else if ( header->type == OFPT_PACKET_OUT && message->length >= sizeof( struct ofp_packet_out ) ) {
+    const struct ofp_packet_out *packet_out = message->data;
+    uint32_t buffer_id = ntohl( packet_out->buffer_id );
+    size_t data_offset = sizeof( struct ofp_packet_out ) + ntohs( packet_out->actions_len );
+    if ( buffer_id != OFP_NO_BUFFER ) {
+      entry = lookup_hash_entry( table->buffers, &buffer_id );
+    }
+    else if ( message->length > data_offset ) {
+      const uint8_t *data = message->data;
+      packet_in_key_t key;
+      if ( make_flow_key( &key, data + data_offset, message->length - data_offset ) ) {
+        entry = lookup_hash_entry( table->flows, &key );
+      }
+    }
+  }
+
+  if ( entry != NULL ) {
+    table->stats.cleared++;
+    delete_packet_in_entry( table, entry );
+  }
+}
+
+
+/**
+ * Copies the counters of table into stats.
+ */
+void
+get_packet_in_table_stats( const packet_in_table_t *table, packet_in_table_stats_t *stats ) {
+  assert( table != NULL );
+  assert( stats != NULL );
+
+  *stats = table->stats;
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
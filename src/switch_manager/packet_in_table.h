@@ -0,0 +1,80 @@
+/*
+ * OpenFlow Switch Manager
+ *
+ * Copyright (C) 2008-2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef PACKET_IN_TABLE_H
+#define PACKET_IN_TABLE_H
+
+
+#include <time.h>
+#include "trema.h"
+
+
+#define PACKET_IN_KEY_LENGTH 192
+
+
+typedef struct packet_in_key {
+  uint16_t flow_length;        // flow fields of the frame,
+  uint16_t length;             // followed by the match
+  uint8_t bytes[ PACKET_IN_KEY_LENGTH ];
+} packet_in_key_t;
+
+typedef struct packet_in_entry {
+  packet_in_key_t key;
+  uint32_t buffer_id;
+  uint8_t table_id;
+  uint8_t reason;
+  uint32_t suppressed;
+  struct timespec expire_at;
+  list_link link;
+} packet_in_entry_t;
+
+typedef struct {
+  uint64_t forwarded;
+  uint64_t suppressed;
+  uint64_t cleared;            // windows closed by flow mods or packet outs
+} packet_in_table_stats_t;
+
+typedef struct packet_in_table {
+  hash_table *flows;           // packet_in_entry_t keyed by the flow fields of key
+  hash_table *buffers;         // packet_in_entry_t keyed by buffer_id
+  list_link entries;           // in expiration order
+  list_link free_entries;
+  unsigned int n_entries;
+  struct timespec interval;
+  packet_in_table_stats_t stats;
+} packet_in_table_t;
+
+
+packet_in_table_t *create_packet_in_table( unsigned int interval_msec );
+void delete_packet_in_table( packet_in_table_t *table );
+bool suppress_packet_in( packet_in_table_t *table, const buffer *packet_in );
+void clear_packet_in_window( packet_in_table_t *table, const buffer *message );
+void get_packet_in_table_stats( const packet_in_table_t *table, packet_in_table_stats_t *stats );
+
+
+#endif // PACKET_IN_TABLE_H
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
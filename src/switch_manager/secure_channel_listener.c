@@ -107,6 +107,18 @@ int mock_execvp( const char *file, char *const argv[] );
 #define exit mock_exit
 void mock_exit( int status );
 
+#ifdef socketpair
+#undef socketpair
+#endif
+#define socketpair mock_socketpair
+int mock_socketpair( int domain, int type, int protocol, int sv[ 2 ] );
+
+#ifdef sendmsg
+#undef sendmsg
+#endif
+#define sendmsg mock_sendmsg
+ssize_t mock_sendmsg( int sockfd, const struct msghdr *msg, int flags );
+
 #endif // UNIT_TESTING
 
 
@@ -166,18 +178,13 @@ secure_channel_listen_start( struct listener_info *listener_info ) {
 
 
 static char **
-make_switch_daemon_args( struct listener_info *listener_info, struct sockaddr_in *addr, int accept_fd ) {
+make_daemon_args( struct listener_info *listener_info, const char *name, const char *fd_option, int fd ) {
   int argc = SWITCH_MANAGER_DEFAULT_ARGC + listener_info->switch_daemon_argc + 1;
   char **argv = xcalloc( ( size_t ) argc, sizeof( char * ) );
-  char *command_name = xasprintf( "%s%s:%u", SWITCH_MANAGER_COMMAND_PREFIX,
-                                  inet_ntoa( addr->sin_addr ),
-                                   ntohs( addr->sin_port ) );
-  char *service_name = xasprintf( "%s%s%s:%u", SWITCH_MANAGER_NAME_OPTION,
-                                  SWITCH_MANAGER_PREFIX,
-                                  inet_ntoa( addr->sin_addr ),
-                                  ntohs( addr->sin_port ) );
-  char *socket_opt = xasprintf( "%s%d", SWITCH_MANAGER_SOCKET_OPTION,
-                                accept_fd );
+  char *command_name = xasprintf( "%s%s", SWITCH_MANAGER_COMMAND_PREFIX, name );
+  char *service_name = xasprintf( "%s%s%s", SWITCH_MANAGER_NAME_OPTION,
+                                  SWITCH_MANAGER_PREFIX, name );
+  char *socket_opt = xasprintf( "%s%d", fd_option, fd );
   char *daemonize_opt = xstrdup( SWITCH_MANAGER_DAEMONIZE_OPTION );
   char *notify_opt = xasprintf( "%s%s", SWITCH_MANAGER_STATE_PREFIX,
                                 get_trema_name() );
@@ -197,6 +204,26 @@ make_switch_daemon_args( struct listener_info *listener_info, struct sockaddr_in
 }
 
 
+static char **
+make_switch_daemon_args( struct listener_info *listener_info, struct sockaddr_in *addr, int accept_fd ) {
+  char *name = xasprintf( "%s:%u", inet_ntoa( addr->sin_addr ), ntohs( addr->sin_port ) );
+  char **argv = make_daemon_args( listener_info, name, SWITCH_MANAGER_SOCKET_OPTION, accept_fd );
+  xfree( name );
+
+  return argv;
+}
+
+
+static char **
+make_shard_args( struct listener_info *listener_info, int shard, int control_fd ) {
+  char *name = xasprintf( "%s%d", SWITCH_MANAGER_SHARD_PREFIX, shard );
+  char **argv = make_daemon_args( listener_info, name, SWITCH_MANAGER_CONTROL_OPTION, control_fd );
+  xfree( name );
+
+  return argv;
+}
+
+
 static void
 free_switch_daemon_args( char **argv ) {
   int i;
@@ -210,6 +237,120 @@ free_switch_daemon_args( char **argv ) {
 static const int ACCEPT_FD = 3;
 
 
+static void
+exec_switch_daemon( struct listener_info *listener_info, char **argv ) {
+  int in_fd = open( "/dev/null", O_RDONLY );
+  if ( in_fd != 0 ) {
+    dup2( in_fd, 0 );
+    close( in_fd );
+  }
+  int out_fd = open( "/dev/null", O_WRONLY );
+  if ( out_fd != 1 ) {
+    dup2( out_fd, 1 );
+    close( out_fd );
+  }
+  int err_fd = open( "/dev/null", O_WRONLY );
+  if ( err_fd != 2 ) {
+    dup2( err_fd, 2 );
+    close( err_fd );
+  }
+
+  execvp( listener_info->switch_daemon, argv );
+  error( "Failed to execvp: %s(%s) %s %s. %s.",
+    argv[ 0 ], listener_info->switch_daemon,
+    argv[ 1 ], argv[ 2 ], strerror( errno ) );
+
+  free_switch_daemon_args( argv );
+
+  die( "UNREACHABLE" );
+}
+
+
+/*
+ * Starts the switch daemons that serve all switch connections in
+ * multi-switch mode. Each one gets its end of a socketpair over which
+ * accepted connections are passed.
+ */
+bool
+start_switch_daemon_shards( struct listener_info *listener_info ) {
+  listener_info->shard_fds = xcalloc( ( size_t ) listener_info->n_shards, sizeof( int ) );
+  listener_info->next_shard = 0;
+
+  for ( int i = 0; i < listener_info->n_shards; i++ ) {
+    int sv[ 2 ];
+    if ( socketpair( AF_UNIX, SOCK_SEQPACKET, 0, sv ) < 0 ) {
+      error( "Failed to create a control socket. %s.", strerror( errno ) );
+      return false;
+    }
+    int pid = fork();
+    if ( pid < 0 ) {
+      error( "Failed to fork. %s.", strerror( errno ) );
+      close( sv[ 0 ] );
+      close( sv[ 1 ] );
+      return false;
+    }
+    if ( pid == 0 ) {
+      close( listener_info->listen_fd );
+      close( sv[ 0 ] );
+      for ( int j = 0; j < i; j++ ) {
+        close( listener_info->shard_fds[ j ] );
+      }
+      int control_fd = sv[ 1 ];
+      if ( control_fd < ACCEPT_FD ) {
+        dup2( control_fd, ACCEPT_FD );
+        close( control_fd );
+        control_fd = ACCEPT_FD;
+      }
+
+      exec_switch_daemon( listener_info, make_shard_args( listener_info, i, control_fd ) );
+    }
+    else {
+      /* parent */
+      close( sv[ 1 ] );
+      listener_info->shard_fds[ i ] = sv[ 0 ];
+    }
+  }
+
+  return true;
+}
+
+
+static bool
+pass_to_switch_daemon( int control_fd, int accept_fd, struct sockaddr_in *addr ) {
+  struct iovec iov = { addr, sizeof( struct sockaddr_in ) };
+  char control[ CMSG_SPACE( sizeof( int ) ) ];
+  memset( control, 0, sizeof( control ) );
+  struct msghdr msg;
+  memset( &msg, 0, sizeof( msg ) );
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof( control );
+
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR( &msg );
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN( sizeof( int ) );
+  memcpy( CMSG_DATA( cmsg ), &accept_fd, sizeof( int ) );
+
+  return sendmsg( control_fd, &msg, MSG_NOSIGNAL ) >= 0;
+}
+
+
+static void
+dispatch_to_switch_daemon( struct listener_info *listener_info, int accept_fd, struct sockaddr_in *addr ) {
+  for ( int i = 0; i < listener_info->n_shards; i++ ) {
+    int shard = ( int ) ( listener_info->next_shard++ % ( unsigned int ) listener_info->n_shards );
+    if ( pass_to_switch_daemon( listener_info->shard_fds[ shard ], accept_fd, addr ) ) {
+      close( accept_fd );
+      return;
+    }
+    error( "Failed to pass a switch connection to switch daemon %d. %s.", shard, strerror( errno ) );
+  }
+  close( accept_fd );
+}
+
+
 void
 secure_channel_accept( int fd, void *data ) {
   struct listener_info *listener_info = data;
@@ -225,6 +366,10 @@ secure_channel_accept( int fd, void *data ) {
     error( "Failed to accept from switch. :%s.", strerror( errno )  );
     return;
   }
+  if ( listener_info->n_shards > 0 ) {
+    dispatch_to_switch_daemon( listener_info, accept_fd, &addr );
+    return;
+  }
   pid = fork();
   if ( pid < 0 ) {
     error( "Failed to fork. %s.", strerror( errno ) );
@@ -239,32 +384,7 @@ secure_channel_accept( int fd, void *data ) {
       accept_fd = ACCEPT_FD;
     }
 
-    char **argv = make_switch_daemon_args( listener_info, &addr, accept_fd );
-
-    int in_fd = open( "/dev/null", O_RDONLY );
-    if ( in_fd != 0 ) {
-      dup2( in_fd, 0 );
-      close( in_fd );
-    }
-    int out_fd = open( "/dev/null", O_WRONLY );
-    if ( out_fd != 1 ) {
-      dup2( out_fd, 1 );
-      close( out_fd );
-    }
-    int err_fd = open( "/dev/null", O_WRONLY );
-    if ( err_fd != 2 ) {
-      dup2( err_fd, 2 );
-      close( err_fd );
-    }
-
-    execvp( listener_info->switch_daemon, argv );
-    error( "Failed to execvp: %s(%s) %s %s. %s.",
-      argv[ 0 ], listener_info->switch_daemon,
-      argv[ 1 ], argv[ 2 ], strerror( errno ) );
-
-    free_switch_daemon_args( argv );
-
-    die( "UNREACHABLE" );
+    exec_switch_daemon( listener_info, make_switch_daemon_args( listener_info, &addr, accept_fd ) );
   }
   else {
     /* parent */
@@ -29,6 +29,7 @@
 
 bool secure_channel_listen_start( struct listener_info *listener_info );
 void secure_channel_accept( int fd, void *data );
+bool start_switch_daemon_shards( struct listener_info *listener_info );
 
 
 #endif // SECURE_CANNEL_LISTENER_H
@@ -27,11 +27,142 @@
 #include "trema.h"
 #include "message_queue.h"
 #include "ofpmsg_recv.h"
+#include "openflow_service_interface.h"
 #include "ofpmsg_send.h"
 #include "secure_channel_receiver.h"
 
 
 static const size_t RECEIVE_BUFFFER_SIZE = UINT16_MAX + sizeof(struct ofp_packet_in) - 2;
+static const size_t RECEIVE_SLAB_SIZE = ( UINT16_MAX + sizeof(struct ofp_packet_in) - 2 ) * 4;
+// room for the service header that goes in front of messages to applications
+static const size_t RECEIVE_HEADROOM = sizeof( openflow_service_header_t );
+
+
+/*
+ * Data read from a secure channel goes into a slab, and each complete
+ * message in it is handed over as a buffer referring to the slab. The
+ * slab is freed when the switch and all such buffers have released it.
+ *
+ * Each message has RECEIVE_HEADROOM bytes of headroom, which is either
+ * reserved at the start of the slab or the tail of the message before
+ * it. Messages are handled in order and usually freed before the next
+ * one is handled, so the headroom is free by the time it is used.
+ * Otherwise the message is copied before it is handled.
+ */
+struct receive_slab {
+  size_t length;       // bytes read into the slab
+  size_t offset;       // bytes already framed into messages
+  unsigned int refs;
+  unsigned int queued; // messages framed but not handled yet
+  char data[];
+};
+
+
+static struct receive_slab *
+alloc_receive_slab() {
+  struct receive_slab *slab = xmalloc( sizeof( struct receive_slab ) + RECEIVE_SLAB_SIZE );
+  slab->length = RECEIVE_HEADROOM;
+  slab->offset = RECEIVE_HEADROOM;
+  slab->refs = 1;
+  slab->queued = 0;
+
+  return slab;
+}
+
+
+static void
+unref_receive_slab( struct receive_slab *slab ) {
+  assert( slab != NULL );
+
+  if ( __sync_sub_and_fetch( &slab->refs, 1 ) == 0 ) {
+    xfree( slab );
+  }
+}
+
+
+static void
+release_message_data( void *data, void *arg ) {
+  UNUSED( data );
+
+  unref_receive_slab( arg );
+}
+
+
+static buffer *
+alloc_message_in_slab( struct receive_slab *slab, size_t offset, size_t length ) {
+  assert( offset >= RECEIVE_HEADROOM );
+
+  __sync_add_and_fetch( &slab->refs, 1 );
+
+  buffer *message = alloc_buffer_with_data( slab->data + offset - RECEIVE_HEADROOM, RECEIVE_HEADROOM + length,
+                                            release_message_data, slab );
+  remove_front_buffer( message, RECEIVE_HEADROOM );
+  // cleared when the message is dequeued, see handle_messages_from_secure_channel()
+  message->user_data = slab;
+
+  return message;
+}
+
+
+/*
+ * Makes room for the next read. Only the bytes of a message that is
+ * not complete yet are copied, and only when the slab runs short of
+ * space for a full-sized message.
+ */
+static void
+prepare_receive_slab( struct switch_info *sw_info ) {
+  struct receive_slab *slab = sw_info->recv_slab;
+  if ( slab == NULL ) {
+    sw_info->recv_slab = alloc_receive_slab();
+    return;
+  }
+
+  size_t pending = slab->length - slab->offset;
+  bool unreferenced = slab->refs == 1;
+  if ( unreferenced && pending == 0 ) {
+    slab->length = RECEIVE_HEADROOM;
+    slab->offset = RECEIVE_HEADROOM;
+    return;
+  }
+  if ( RECEIVE_SLAB_SIZE - slab->length >= RECEIVE_BUFFFER_SIZE ) {
+    return;
+  }
+
+  if ( unreferenced ) {
+    memmove( slab->data + RECEIVE_HEADROOM, slab->data + slab->offset, pending );
+  }
+  else {
+    struct receive_slab *new_slab = alloc_receive_slab();
+    memcpy( new_slab->data + RECEIVE_HEADROOM, slab->data + slab->offset, pending );
+    unref_receive_slab( slab );
+    slab = sw_info->recv_slab = new_slab;
+  }
+  slab->length = RECEIVE_HEADROOM + pending;
+  slab->offset = RECEIVE_HEADROOM;
+}
+
+
+static size_t
+receive_length_of( const struct receive_slab *slab ) {
+  size_t remaining_length = RECEIVE_SLAB_SIZE - slab->length;
+
+  return remaining_length < RECEIVE_BUFFFER_SIZE ? remaining_length : RECEIVE_BUFFFER_SIZE;
+}
+
+
+/**
+ * Releases the receive slab of a switch. Messages already framed from
+ * it remain valid until they are freed.
+ */
+void
+release_receive_slab( struct switch_info *sw_info ) {
+  assert( sw_info != NULL );
+
+  if ( sw_info->recv_slab != NULL ) {
+    unref_receive_slab( sw_info->recv_slab );
+    sw_info->recv_slab = NULL;
+  }
+}
 
 
 static int
@@ -40,10 +171,10 @@ recv_from_secure_channel_tcp( struct switch_info *sw_info ) {
   assert( sw_info->recv_queue != NULL );
   assert( !sw_info->tls );
   assert( sw_info->ssl == NULL );
-  assert( sw_info->fragment_buf != NULL );
+  assert( sw_info->recv_slab != NULL );
 
-  size_t remaining_length = RECEIVE_BUFFFER_SIZE - sw_info->fragment_buf->length;
-  char *recv_buf = ( char * ) sw_info->fragment_buf->data + sw_info->fragment_buf->length;
+  size_t remaining_length = receive_length_of( sw_info->recv_slab );
+  char *recv_buf = sw_info->recv_slab->data + sw_info->recv_slab->length;
   ssize_t recv_length = read( sw_info->secure_channel_fd, recv_buf, remaining_length );
   if ( recv_length < 0 ) {
     if ( errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK ) {
@@ -56,7 +187,7 @@ recv_from_secure_channel_tcp( struct switch_info *sw_info ) {
     debug( "Connection closed by peer." );
     return -1;
   }
-  sw_info->fragment_buf->length += ( size_t ) recv_length;
+  sw_info->recv_slab->length += ( size_t ) recv_length;
 
   return 1;
 }
@@ -68,10 +199,10 @@ recv_from_secure_channel_tls( struct switch_info *sw_info ) {
   assert( sw_info->recv_queue != NULL );
   assert( sw_info->tls );
   assert( sw_info->ssl != NULL );
-  assert( sw_info->fragment_buf != NULL );
+  assert( sw_info->recv_slab != NULL );
 
-  size_t remaining_length = RECEIVE_BUFFFER_SIZE - sw_info->fragment_buf->length;
-  char *recv_buf = ( char * ) sw_info->fragment_buf->data + sw_info->fragment_buf->length;
+  size_t remaining_length = receive_length_of( sw_info->recv_slab );
+  char *recv_buf = sw_info->recv_slab->data + sw_info->recv_slab->length;
   int recv_length = SSL_read( sw_info->ssl, recv_buf, ( int ) remaining_length );
   if ( recv_length < 0 ) {
     int error_no = SSL_get_error( sw_info->ssl, recv_length );
@@ -89,7 +220,7 @@ recv_from_secure_channel_tls( struct switch_info *sw_info ) {
     debug( "Connection closed by peer." );
     return -1;
   }
-  sw_info->fragment_buf->length += ( size_t ) recv_length;
+  sw_info->recv_slab->length += ( size_t ) recv_length;
 
   return 1;
 }
@@ -105,9 +236,7 @@ recv_from_secure_channel( struct switch_info *sw_info ) {
     return 0;
   }
 
-  if ( sw_info->fragment_buf == NULL ) {
-    sw_info->fragment_buf = alloc_buffer_with_length( RECEIVE_BUFFFER_SIZE );
-  }
+  prepare_receive_slab( sw_info );
 
   int ret = -1;
   if ( sw_info->tls ) {
@@ -121,39 +250,53 @@ recv_from_secure_channel( struct switch_info *sw_info ) {
     return ret;
   }
 
-  size_t read_total = 0;
-  while ( sw_info->fragment_buf->length >= sizeof( struct ofp_header ) ) {
-    struct ofp_header *header = sw_info->fragment_buf->data;
+  struct receive_slab *slab = sw_info->recv_slab;
+  while ( slab->length - slab->offset >= sizeof( struct ofp_header ) ) {
+    size_t pending = slab->length - slab->offset;
+    struct ofp_header *header = ( struct ofp_header * ) ( slab->data + slab->offset );
     if ( header->version != OFP_VERSION ) {
       error( "Receive error: invalid version (version %d)", header->version );
-      ofpmsg_send_error_msg( sw_info,
-                             OFPET_BAD_REQUEST, OFPBRC_BAD_VERSION, sw_info->fragment_buf );
+      buffer *data = alloc_message_in_slab( slab, slab->offset, pending );
+      ofpmsg_send_error_msg( sw_info, OFPET_BAD_REQUEST, OFPBRC_BAD_VERSION, data );
+      free_buffer( data );
       return -1;
     }
     uint16_t message_length = ntohs( header->length );
-    if ( message_length > sw_info->fragment_buf->length ) {
+    if ( message_length < sizeof( struct ofp_header ) ) {
+      error( "Receive error: invalid length (length %u)", message_length );
+      return -1;
+    }
+    if ( message_length > pending ) {
       break;
     }
-    buffer *message = alloc_buffer_with_length( message_length );
-    char *p = append_back_buffer( message, message_length );
-    memcpy( p, sw_info->fragment_buf->data, message_length );
-    remove_front_buffer( sw_info->fragment_buf, message_length ); 
+    buffer *message = alloc_message_in_slab( slab, slab->offset, message_length );
+    slab->offset += message_length;
+    slab->queued++;
     enqueue_message( sw_info->recv_queue, message );
-    read_total += message_length;
-  }
-
-  // remove headroom manually for next call
-  if ( read_total > 0 ) {
-    memmove( ( char * ) sw_info->fragment_buf->data - read_total,
-             sw_info->fragment_buf->data,
-             sw_info->fragment_buf->length );
-    sw_info->fragment_buf->data = ( char * ) sw_info->fragment_buf->data - read_total;
   }
 
   return 0;
 }
 
 
+/*
+ * Tells whether a message handled earlier from the slab of the message
+ * being handled is still referenced, in which case the headroom of the
+ * message must not be written. The slab may no longer be the one the
+ * switch reads into.
+ */
+static bool
+earlier_message_is_alive( const struct switch_info *sw_info, const struct receive_slab *slab ) {
+  assert( slab != NULL );
+
+  // the switch if it still reads into the slab, the message being
+  // handled and those still queued
+  unsigned int owners = ( slab == sw_info->recv_slab ? 2U : 1U ) + slab->queued;
+
+  return slab->refs > owners;
+}
+
+
 int
 handle_messages_from_secure_channel( struct switch_info *sw_info ) {
   assert( sw_info != NULL );
@@ -164,6 +307,17 @@ handle_messages_from_secure_channel( struct switch_info *sw_info ) {
   buffer *message;
 
   while ( ( message = dequeue_message( sw_info->recv_queue ) ) != NULL ) {
+    struct receive_slab *slab = message->user_data;
+    message->user_data = NULL;
+    assert( slab != NULL );
+    assert( slab->queued > 0 );
+    slab->queued--;
+    if ( earlier_message_is_alive( sw_info, slab ) ) {
+      // its tail is the headroom of this message
+      buffer *copy = duplicate_buffer( message );
+      free_buffer( message );
+      message = copy;
+    }
     ret = ofpmsg_recv( sw_info, message );
     if ( ret < 0 ) {
       error( "Failed to handle message to application." );
@@ -29,6 +29,7 @@
 
 int recv_from_secure_channel( struct switch_info *sw_info );
 int handle_messages_from_secure_channel( struct switch_info *sw_info );
+void release_receive_slab( struct switch_info *sw_info );
 
 
 #endif // SECURE_CHANNEL_RECEIVER_H
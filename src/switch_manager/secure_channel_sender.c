@@ -20,8 +20,13 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <openflow.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include "event_handler.h"
 #include "message_queue.h"
@@ -49,39 +54,35 @@ send_to_secure_channel( struct switch_info *sw_info, buffer *buf ) {
 }
 
 
-typedef struct {
-  struct iovec *iov;
-  int iovcnt;
-} writev_args;
+// Largest plaintext that fits in a single TLS record
+#define TLS_RECORD_SIZE 16384
+#define SEND_BATCHES_PER_FLUSH 16
 
 
-static void
-append_to_writev_args( buffer *message, void *user_data ) {
-  writev_args *args = user_data;
+static buffer *batch_messages[ IOV_MAX ];
+static struct iovec batch_iov[ IOV_MAX ];
+
 
-  args->iov[ args->iovcnt ].iov_base = message->data;
-  args->iov[ args->iovcnt ].iov_len = message->length;
-  args->iovcnt++;
+static void
+set_cork( int fd, int cork ) {
+  // fails harmlessly if the secure channel is not a TCP socket
+  setsockopt( fd, IPPROTO_TCP, TCP_CORK, &cork, sizeof( cork ) );
 }
 
 
+/*
+ * Writes as many queued messages as a single writev() takes. Returns 1
+ * if they were all written, 0 if the socket could not take them all,
+ * or -1 on error.
+ */
 static int
-flush_secure_channel_tcp( struct switch_info *sw_info ) {
-  assert( sw_info != NULL );
-  assert( !sw_info->tls );
-  assert( sw_info->ssl == NULL );
-  assert( sw_info->send_queue->length > 0 );
-
-  writev_args args;
-  args.iov = xmalloc( sizeof( struct iovec ) * ( size_t ) sw_info->send_queue->length );
-  args.iovcnt = 0;
-  foreach_message_queue( sw_info->send_queue, append_to_writev_args, &args );
-  if ( args.iovcnt == 0 ) {
-    xfree( args.iov );
-    return 0;
+write_batch_tcp( struct switch_info *sw_info ) {
+  unsigned int n_messages = peek_messages( sw_info->send_queue, batch_messages, IOV_MAX );
+  for ( unsigned int i = 0; i < n_messages; i++ ) {
+    batch_iov[ i ].iov_base = batch_messages[ i ]->data;
+    batch_iov[ i ].iov_len = batch_messages[ i ]->length;
   }
-  ssize_t write_length = writev( sw_info->secure_channel_fd, args.iov, args.iovcnt );
-  xfree( args.iov );
+  ssize_t write_length = writev( sw_info->secure_channel_fd, batch_iov, ( int ) n_messages );
   if ( write_length < 0 ) {
     if ( errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK ) {
       set_writable( sw_info->secure_channel_fd, true );
@@ -91,17 +92,12 @@ flush_secure_channel_tcp( struct switch_info *sw_info ) {
            strerror( errno ), errno );
     return -1;
   }
-  if ( write_length == 0 ) {
-    return 0;
-  }
-  buffer *buf = NULL;
-  while ( ( buf = peek_message( sw_info->send_queue ) ) != NULL ) {
-    if ( write_length == 0 ) {
-      set_writable( sw_info->secure_channel_fd, true );
-      return 0;
-    }
+  for ( unsigned int i = 0; i < n_messages; i++ ) {
+    buffer *buf = batch_messages[ i ];
     if ( ( size_t ) write_length < buf->length ) {
-      remove_front_buffer( buf, ( size_t ) write_length );
+      if ( write_length > 0 ) {
+        remove_front_buffer( buf, ( size_t ) write_length );
+      }
       set_writable( sw_info->secure_channel_fd, true );
       return 0;
     }
@@ -110,7 +106,64 @@ flush_secure_channel_tcp( struct switch_info *sw_info ) {
     free_buffer( buf );
   }
 
-  return 0;
+  return 1;
+}
+
+
+static int
+flush_secure_channel_tcp( struct switch_info *sw_info ) {
+  assert( sw_info != NULL );
+  assert( !sw_info->tls );
+  assert( sw_info->ssl == NULL );
+  assert( sw_info->send_queue->length > 0 );
+
+  // Only a backlog longer than one writev() is corked, and it is
+  // uncorked before returning, so no message waits for a later flush.
+  bool cork = sw_info->send_queue->length > IOV_MAX;
+  if ( cork ) {
+    set_cork( sw_info->secure_channel_fd, 1 );
+  }
+  int ret = 1;
+  for ( int i = 0; i < SEND_BATCHES_PER_FLUSH && ret > 0 && sw_info->send_queue->length > 0; i++ ) {
+    ret = write_batch_tcp( sw_info );
+  }
+  if ( cork ) {
+    set_cork( sw_info->secure_channel_fd, 0 );
+  }
+  if ( ret > 0 && sw_info->send_queue->length > 0 ) {
+    set_writable( sw_info->secure_channel_fd, true );
+  }
+
+  return ret < 0 ? -1 : 0;
+}
+
+
+/*
+ * Packs queued messages into the TLS record until the next one would
+ * make it larger than TLS_RECORD_SIZE. A larger message goes alone.
+ */
+static void
+fill_tls_record( struct switch_info *sw_info ) {
+  if ( sw_info->tls_record == NULL ) {
+    sw_info->tls_record = alloc_buffer_with_length( TLS_RECORD_SIZE );
+  }
+
+  buffer *record = sw_info->tls_record;
+  buffer *message = NULL;
+  while ( ( message = peek_message( sw_info->send_queue ) ) != NULL ) {
+    if ( record->length > 0 && record->length + message->length > TLS_RECORD_SIZE ) {
+      break;
+    }
+    memcpy( append_back_buffer( record, message->length ), message->data, message->length );
+    message = dequeue_message( sw_info->send_queue );
+    free_buffer( message );
+  }
+}
+
+
+static bool
+tls_record_is_pending( struct switch_info *sw_info ) {
+  return sw_info->tls_record != NULL && sw_info->tls_record->length > 0;
 }
 
 
@@ -119,15 +172,22 @@ flush_secure_channel_tls( struct switch_info *sw_info ) {
   assert( sw_info != NULL );
   assert( sw_info->tls );
   assert( sw_info->ssl != NULL );
-  assert( sw_info->send_queue->length > 0 );
 
-  buffer *buf = NULL;
-  while ( ( buf = peek_message( sw_info->send_queue ) ) != NULL ) {
-    int write_length = SSL_write( sw_info->ssl, buf->data, ( int ) buf->length );
+  // A record that SSL_write() could not take is retried as it is.
+  while ( tls_record_is_pending( sw_info ) || sw_info->send_queue->length > 0 ) {
+    if ( !tls_record_is_pending( sw_info ) ) {
+      fill_tls_record( sw_info );
+    }
+    buffer *record = sw_info->tls_record;
+    int write_length = SSL_write( sw_info->ssl, record->data, ( int ) record->length );
     if ( write_length < 0 ) {
       int error_no = SSL_get_error( sw_info->ssl, write_length );
       switch ( error_no ) {
         case SSL_ERROR_WANT_READ:
+          if ( secure_channel_read_paused() ) {
+            // Retried when reads from switches are resumed.
+            return 0;
+          }
           set_readable( sw_info->secure_channel_fd, true );
         case SSL_ERROR_WANT_WRITE:
           set_writable( sw_info->secure_channel_fd, true );
@@ -142,13 +202,12 @@ flush_secure_channel_tls( struct switch_info *sw_info ) {
       set_writable( sw_info->secure_channel_fd, true );
       return 0;
     }
-    if ( ( size_t ) write_length < buf->length ) {
-      remove_front_buffer( buf, ( size_t ) write_length );
+    if ( ( size_t ) write_length < record->length ) {
+      remove_front_buffer( record, ( size_t ) write_length );
       set_writable( sw_info->secure_channel_fd, true );
       return 0;
     }
-    buf = dequeue_message( sw_info->send_queue );
-    free_buffer( buf );
+    reset_buffer( record );
   }
 
   return 0;
@@ -161,12 +220,12 @@ flush_secure_channel( struct switch_info *sw_info ) {
   assert( sw_info->send_queue != NULL );
   assert( sw_info->secure_channel_fd >= 0 );
 
-  if ( sw_info->send_queue->length == 0 ) {
+  set_writable( sw_info->secure_channel_fd, false );
+
+  if ( sw_info->send_queue->length == 0 && !tls_record_is_pending( sw_info ) ) {
     return 0;
   }
 
-  set_writable( sw_info->secure_channel_fd, false );
-
   int ret = -1;
   if ( sw_info->tls ) {
     ret = flush_secure_channel_tls( sw_info );
@@ -26,6 +26,22 @@
 #include "trema.h"
 
 
+static void
+set_service_header( openflow_service_header_t *message, uint64_t *datapath_id ) {
+  if ( datapath_id == NULL ) {
+    message->datapath_id = ~0U; // FIXME: defined invalid datapath_id
+  } else {
+    message->datapath_id = htonll( *datapath_id );
+  }
+  message->service_name_length = htons( 0 );
+  // TODO: append ipaddress and port
+}
+
+
+/*
+ * Puts the service header in the headroom of data if it has enough,
+ * and otherwise copies data behind the header into a new buffer.
+ */
 static buffer *
 create_openflow_application_message( uint64_t *datapath_id, buffer *data ) {
   openflow_service_header_t *message;
@@ -33,18 +49,19 @@ create_openflow_application_message( uint64_t *datapath_id, buffer *data ) {
   void *append;
   size_t append_len = 0;
 
+  if ( data != NULL && get_buffer_headroom( data ) >= sizeof( openflow_service_header_t ) ) {
+    message = append_front_buffer( data, sizeof( openflow_service_header_t ) );
+    set_service_header( message, datapath_id );
+
+    return data;
+  }
+
   if ( data != NULL ) {
      append_len = data->length;
   }
   buf = alloc_buffer_with_length( sizeof( openflow_service_header_t ) + append_len );
   message = append_back_buffer( buf, sizeof( openflow_service_header_t ) );
-  if ( datapath_id == NULL ) {
-    message->datapath_id = ~0U; // FIXME: defined invalid datapath_id
-  } else {
-    message->datapath_id = htonll( *datapath_id );
-  }
-  message->service_name_length = htons( 0 );
-  // TODO: append ipaddress and port
+  set_service_header( message, datapath_id );
   if ( append_len > 0 ) {
     append = append_back_buffer( buf, append_len );
     memcpy( append, data->data, append_len );
@@ -54,6 +71,46 @@ create_openflow_application_message( uint64_t *datapath_id, buffer *data ) {
 }
 
 
+static void
+free_openflow_application_message( buffer *buf, buffer *data ) {
+  if ( buf == data ) {
+    remove_front_buffer( data, sizeof( openflow_service_header_t ) );
+    return;
+  }
+  free_buffer( buf );
+}
+
+
+/*
+ * Packet-ins and statistics replies may come in bursts, so they take
+ * the bulk lane and never delay state notifications or other replies.
+ * Barrier replies are fences so that they never overtake the messages
+ * that the switch sent before them.
+ */
+static int
+message_priority( uint16_t message_type, buffer *data ) {
+  if ( message_type != MESSENGER_OPENFLOW_MESSAGE ) {
+    return MESSENGER_PRIORITY_CONTROL;
+  }
+  if ( data == NULL || data->length < sizeof( struct ofp_header ) ) {
+    return MESSENGER_PRIORITY_BULK;
+  }
+
+  struct ofp_header *header = data->data;
+  switch ( header->type ) {
+  case OFPT_PACKET_IN:
+  case OFPT_MULTIPART_REPLY:
+    return MESSENGER_PRIORITY_BULK;
+  case OFPT_BARRIER_REPLY:
+    return MESSENGER_PRIORITY_FENCE;
+  default:
+    break;
+  }
+
+  return MESSENGER_PRIORITY_CONTROL;
+}
+
+
 void
 service_send_to_reply( char *service_name, uint16_t message_type, uint64_t *datapath_id, buffer *data ) {
   buffer *buf;
@@ -62,11 +119,12 @@ service_send_to_reply( char *service_name, uint16_t message_type, uint64_t *data
     return;
   }
 
+  int priority = message_priority( message_type, data );
   buf = create_openflow_application_message( datapath_id, data );
-  if ( !send_message( service_name, message_type, buf->data, buf->length ) ) {
+  if ( !send_message_with_priority( service_name, message_type, buf->data, buf->length, priority ) ) {
     error( "Failed to send to reply ( service_name = %s ).", service_name );
   }
-  free_buffer( buf );
+  free_openflow_application_message( buf, data );
 }
 
 
@@ -80,13 +138,14 @@ service_send_to_application( list_element *service_name_list, uint16_t message_t
     return;
   }
 
+  int priority = message_priority( message_type, data );
   buf = create_openflow_application_message( datapath_id, data );
 
   static const char *error_service_name = NULL;
   for ( list = service_name_list; list != NULL; list = list->next ) {
     service_name = list->data;
-    if ( !send_message( service_name, message_type, 
-                        buf->data, buf->length ) ) {
+    if ( !send_message_with_priority( service_name, message_type,
+                                      buf->data, buf->length, priority ) ) {
       if ( error_service_name != service_name ) {
         warn( "Failed to send message ( service_name = %s ).", service_name );
       }
@@ -96,7 +155,7 @@ service_send_to_application( list_element *service_name_list, uint16_t message_t
       error_service_name = NULL;
     }
   }
-  free_buffer( buf );
+  free_openflow_application_message( buf, data );
 }
 
 
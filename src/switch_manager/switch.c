@@ -18,6 +18,9 @@
  */
 
 
+#include <arpa/inet.h>
+#include <assert.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
 #include <inttypes.h>
@@ -27,6 +30,7 @@
 #include <signal.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -38,6 +42,7 @@
 #include "messenger.h"
 #include "ofpmsg_send.h"
 #include "openflow_service_interface.h"
+#include "packet_in_table.h"
 #include "secure_channel_receiver.h"
 #include "secure_channel_sender.h"
 #include "service_interface.h"
@@ -64,6 +69,8 @@ enum long_options_val {
   TLS_OPTION_VALUE = 4,
   TLS_CERT_FILE_OPTION_VALUE = 5,
   TLS_KEY_FILE_OPTION_VALUE = 6,
+  CONTROL_OPTION_VALUE = 7,
+  SUPPRESS_PACKET_IN_OPTION_VALUE = 8,
 };
 
 static struct option long_options[] = {
@@ -74,17 +81,40 @@ static struct option long_options[] = {
   { "tls", 0, NULL, TLS_OPTION_VALUE },
   { "cert", 1, NULL, TLS_CERT_FILE_OPTION_VALUE },
   { "key", 1, NULL, TLS_KEY_FILE_OPTION_VALUE },
+  { "control", 1, NULL, CONTROL_OPTION_VALUE },
+  { "suppress-packet-in", 1, NULL, SUPPRESS_PACKET_IN_OPTION_VALUE },
   { NULL, 0, NULL, 0  },
 };
 
 static char short_options[] = "s:";
 
 
+/*
+ * The switch served by this process. In multi-switch mode it only
+ * holds the options, and each connection passed over the control
+ * socket gets its own switch_info copied from it.
+ */
 struct switch_info switch_info;
 
+// Control socket from the switch manager in multi-switch mode, or -1.
+static int control_fd = -1;
+// switch_info of ready switches keyed by datapath id in multi-switch mode.
+static hash_table *switches = NULL;
+// All switch_info allocated in multi-switch mode.
+static list_element *connections = NULL;
+
 static const time_t COOKIE_TABLE_AGING_INTERVAL = 3600;
 static const time_t ECHO_REQUEST_INTERVAL = 60;
+static const time_t ECHO_REQUEST_INTERVAL_SLOW = 5;
 static const time_t ECHO_REPLY_TIMEOUT = 2;
+static const time_t ECHO_REPLY_TIMEOUT_MAX = 30;
+
+// Send queue occupancy, in percent, at which reading from switches
+// pauses and resumes.
+static const unsigned int SEND_QUEUE_HIGH_WATERMARK = 75;
+static const unsigned int SEND_QUEUE_LOW_WATERMARK = 25;
+// Number of application services above the high watermark.
+static int congested_services = 0;
 
 static bool age_cookie_table_enabled = false;
 
@@ -109,6 +139,10 @@ usage() {
     "  --tls                       use TLS as transport protocol instead of TCP\n"
     "  --cert=CERT_FILE            set TLS certificate file\n"
     "  --key=KEY_FILE              set TLS key file\n"
+    "  --control=fd                serve all switch connections passed over\n"
+    "                              the control socket (multi-switch mode)\n"
+    "  --suppress-packet-in=MSEC   forward only the first of the packet-ins for\n"
+    "                              the same flow within MSEC milliseconds\n"
     "  -h, --help                  display this help and exit\n"
     "\n"
     "DESTINATION-RULE:\n"
@@ -140,6 +174,20 @@ strtofd( const char *str ) {
 }
 
 
+static unsigned int
+strtomsec( const char *str ) {
+  char *ep;
+  long l;
+
+  l = strtol( str, &ep, 0 );
+  if ( l < 0 || l > INT_MAX || *ep != '\0' ) {
+    die( "Invalid interval (%s).", str );
+    return 0;
+  }
+  return ( unsigned int ) l;
+}
+
+
 static void
 option_parser( int argc, char *argv[] ) {
   int c;
@@ -148,6 +196,7 @@ option_parser( int argc, char *argv[] ) {
   switch_info.flow_cleanup = true;
   switch_info.cookie_translation = true;
   switch_info.deny_packet_in_on_startup = false;
+  switch_info.packet_in_suppression_interval = 0;
   switch_info.tls = false;
   switch_info.ssl = NULL;
   memset( &switch_info.cert_file, '\0', sizeof( switch_info.cert_file ) );
@@ -186,6 +235,15 @@ option_parser( int argc, char *argv[] ) {
         }
         break;
 
+      case SUPPRESS_PACKET_IN_OPTION_VALUE:
+        switch_info.packet_in_suppression_interval = strtomsec( optarg );
+        break;
+
+      case CONTROL_OPTION_VALUE:
+        control_fd = strtofd( optarg );
+        switch_info.secure_channel_fd = -1;
+        break;
+
       default:
         usage();
         exit( EXIT_SUCCESS );
@@ -237,19 +295,43 @@ service_send_state( struct switch_info *sw_info, uint64_t *dpid, uint16_t tag )
 }
 
 
+static bool
+multi_switch_mode() {
+  return control_fd >= 0;
+}
+
+
+static struct switch_info *
+lookup_switch( uint64_t datapath_id ) {
+  if ( multi_switch_mode() ) {
+    return lookup_hash_entry( switches, &datapath_id );
+  }
+  if ( datapath_id != switch_info.datapath_id ) {
+    return NULL;
+  }
+
+  return &switch_info;
+}
+
+
 static void
 secure_channel_read( int fd, void* data ) {
   UNUSED( fd );
-  UNUSED( data );
 
-  if ( recv_from_secure_channel( &switch_info ) < 0 ) {
-    switch_event_disconnected( &switch_info );
+  struct switch_info *sw_info = data;
+
+  if ( recv_from_secure_channel( sw_info ) < 0 ) {
+    switch_event_disconnected( sw_info );
     return;
   }
 
-  if ( switch_info.recv_queue->length > 0 ) {
-    int ret = handle_messages_from_secure_channel( &switch_info );
+  if ( sw_info->recv_queue->length > 0 ) {
+    int ret = handle_messages_from_secure_channel( sw_info );
     if ( ret < 0 ) {
+      if ( multi_switch_mode() ) {
+        switch_event_disconnected( sw_info );
+        return;
+      }
       stop_event_handler();
       stop_messenger();
     }
@@ -260,64 +342,135 @@ secure_channel_read( int fd, void* data ) {
 static void
 secure_channel_write( int fd, void* data ) {
   UNUSED( fd );
-  UNUSED( data );
 
-  if ( flush_secure_channel( &switch_info ) < 0 ) {
-    switch_event_disconnected( &switch_info );
+  struct switch_info *sw_info = data;
+
+  if ( flush_secure_channel( sw_info ) < 0 ) {
+    switch_event_disconnected( sw_info );
+    return;
+  }
+}
+
+
+bool
+secure_channel_read_paused( void ) {
+  return congested_services > 0;
+}
+
+
+/*
+ * A TLS write which needed to read from the switch while reads were
+ * paused is retried through the write handler when they are resumed.
+ */
+static void
+set_secure_channel_readable( struct switch_info *sw_info, bool readable ) {
+  if ( sw_info->state != SWITCH_STATE_COMPLETED || sw_info->secure_channel_fd < 0 ) {
+    return;
+  }
+  set_readable( sw_info->secure_channel_fd, readable );
+  if ( readable && sw_info->tls ) {
+    set_writable( sw_info->secure_channel_fd, true );
+  }
+}
+
+
+/*
+ * Stops reading from the switches while any application is not taking
+ * the messages sent to it, so that the messages stay in the socket
+ * buffers of the switches instead of overflowing the send queues.
+ */
+static void
+handle_send_queue_pressure( const char *service_name, bool congested, void *user_data ) {
+  UNUSED( user_data );
+
+  if ( congested ) {
+    if ( congested_services++ > 0 ) {
+      return;
+    }
+    info( "Send queue to %s is congested. Pausing reads from switches.", service_name );
+  }
+  else {
+    assert( congested_services > 0 );
+    if ( --congested_services > 0 ) {
+      return;
+    }
+    info( "Send queue to %s is drained. Resuming reads from switches.", service_name );
+  }
+
+  bool readable = !secure_channel_read_paused();
+  if ( !multi_switch_mode() ) {
+    set_secure_channel_readable( &switch_info, readable );
     return;
   }
+  for ( list_element *e = connections; e != NULL; e = e->next ) {
+    set_secure_channel_readable( e->data, readable );
+  }
 }
 
 
 static void
-switch_set_timeout( long sec, timer_callback callback, void *user_data ) {
+switch_set_timeout( struct switch_info *sw_info, long sec, timer_callback callback ) {
   struct itimerspec interval;
 
   interval.it_value.tv_sec = sec;
   interval.it_value.tv_nsec = 0;
   interval.it_interval.tv_sec = 0;
   interval.it_interval.tv_nsec = 0;
-  add_timer_event_callback( &interval, callback, user_data );
-  switch_info.running_timer = true;
+  add_timer_event_callback( &interval, callback, sw_info );
+  sw_info->running_timer = true;
 }
 
 
 static void
-switch_unset_timeout( timer_callback callback, void *user_data ) {
-  if ( switch_info.running_timer ) {
-    switch_info.running_timer = false;
-    delete_timer_event( callback, user_data );
+switch_unset_timeout( struct switch_info *sw_info, timer_callback callback ) {
+  if ( sw_info->running_timer ) {
+    sw_info->running_timer = false;
+    delete_timer_event( callback, sw_info );
   }
 }
 
 
+static void
+switch_event_timeout_handshake( void *user_data ) {
+  struct switch_info *sw_info = user_data;
+
+  if ( sw_info->state != SWITCH_STATE_CONNECTED ) {
+    return;
+  }
+  sw_info->running_timer = false;
+
+  error( "TLS handshake timeout. fd:%d.", sw_info->secure_channel_fd );
+  switch_event_disconnected( sw_info );
+}
+
+
 static void
 switch_event_timeout_hello( void *user_data ) {
-  UNUSED( user_data );
+  struct switch_info *sw_info = user_data;
 
-  if ( switch_info.state != SWITCH_STATE_WAIT_HELLO ) {
+  if ( sw_info->state != SWITCH_STATE_WAIT_HELLO ) {
     return;
   }
-  switch_info.running_timer = false;
+  sw_info->running_timer = false;
 
   error( "Hello timeout. state:%d, dpid:%#" PRIx64 ", fd:%d.",
-         switch_info.state, switch_info.datapath_id, switch_info.secure_channel_fd );
-  switch_event_disconnected( &switch_info );
+         sw_info->state, sw_info->datapath_id, sw_info->secure_channel_fd );
+  switch_event_disconnected( sw_info );
 }
 
 
 static void
 switch_event_timeout_features_reply( void *user_data ) {
-  UNUSED( user_data );
+  struct switch_info *sw_info = user_data;
 
-  if ( switch_info.state != SWITCH_STATE_WAIT_FEATURES_REPLY ) {
+  if ( sw_info->state != SWITCH_STATE_WAIT_FEATURES_REPLY ) {
     return;
   }
-  switch_info.running_timer = false;
+  sw_info->running_timer = false;
 
   error( "Features Reply timeout. state:%d, dpid:%#" PRIx64 ", fd:%d.",
-         switch_info.state, switch_info.datapath_id, switch_info.secure_channel_fd );
-  switch_event_disconnected( &switch_info );
+         sw_info->state, sw_info->datapath_id, sw_info->secure_channel_fd );
+  switch_event_disconnected( sw_info );
 }
 
 
@@ -334,7 +487,7 @@ switch_event_connected( struct switch_info *sw_info ) {
   }
   sw_info->state = SWITCH_STATE_WAIT_HELLO;
 
-  switch_set_timeout( SWITCH_STATE_TIMEOUT_HELLO, switch_event_timeout_hello, NULL );
+  switch_set_timeout( sw_info, SWITCH_STATE_TIMEOUT_HELLO, switch_event_timeout_hello );
 
   return 0;
 }
@@ -346,7 +499,7 @@ switch_event_recv_hello( struct switch_info *sw_info ) {
 
   if ( sw_info->state == SWITCH_STATE_WAIT_HELLO ) {
     // cancel to hello_wait-timeout timer
-    switch_unset_timeout( switch_event_timeout_hello, NULL );
+    switch_unset_timeout( sw_info, switch_event_timeout_hello );
 
     if ( sw_info->deny_packet_in_on_startup ) {
       ret = ofpmsg_send_deny_all( sw_info );
@@ -361,8 +514,8 @@ switch_event_recv_hello( struct switch_info *sw_info ) {
     }
     sw_info->state = SWITCH_STATE_WAIT_FEATURES_REPLY;
 
-    switch_set_timeout( SWITCH_STATE_TIMEOUT_FEATURES_REPLY,
-                        switch_event_timeout_features_reply, NULL );
+    switch_set_timeout( sw_info, SWITCH_STATE_TIMEOUT_FEATURES_REPLY,
+                        switch_event_timeout_features_reply );
   }
 
   return 0;
@@ -371,10 +524,66 @@ switch_event_recv_hello( struct switch_info *sw_info ) {
 
 static void
 echo_reply_timeout( void *user_data ) {
-  UNUSED( user_data );
+  struct switch_info *sw_info = user_data;
+
+  sw_info->running_timer = false;
+
+  if ( secure_channel_read_paused() ) {
+    // The reply may be waiting unread in the socket buffer.
+    switch_set_timeout( sw_info, sw_info->echo_timeout, echo_reply_timeout );
+    return;
+  }
 
-  error( "Echo request timeout ( datapath id %#" PRIx64 ").", switch_info.datapath_id );
-  switch_event_disconnected( &switch_info );
+  error( "Echo request timeout ( datapath id %#" PRIx64 ").", sw_info->datapath_id );
+  switch_event_disconnected( sw_info );
+}
+
+
+static void echo_request_interval( void *user_data );
+
+
+/*
+ * Sets the echo reply timeout to the smoothed round-trip time plus
+ * four times its variation, as TCP does for retransmissions. While a
+ * round trip takes more than twice the smoothed value, echo requests
+ * are sent more often to follow the slow down.
+ */
+static void
+adapt_echo_timers( struct switch_info *sw_info, uint64_t rtt ) {
+  struct switch_latency *latency = &sw_info->latency;
+
+  bool slow = latency->smoothed_echo_rtt > 0 && rtt > latency->smoothed_echo_rtt * 2;
+  if ( latency->smoothed_echo_rtt == 0 ) {
+    latency->smoothed_echo_rtt = rtt;
+    latency->echo_rtt_variation = rtt / 2;
+  }
+  else {
+    uint64_t difference = rtt > latency->smoothed_echo_rtt ? rtt - latency->smoothed_echo_rtt : latency->smoothed_echo_rtt - rtt;
+    latency->echo_rtt_variation = ( latency->echo_rtt_variation * 3 + difference ) / 4;
+    latency->smoothed_echo_rtt = ( latency->smoothed_echo_rtt * 7 + rtt ) / 8;
+  }
+
+  uint64_t timeout_usec = latency->smoothed_echo_rtt + latency->echo_rtt_variation * 4;
+  time_t timeout = ( time_t ) ( ( timeout_usec + 999999 ) / 1000000 );
+  if ( timeout < ECHO_REPLY_TIMEOUT ) {
+    timeout = ECHO_REPLY_TIMEOUT;
+  }
+  if ( timeout > ECHO_REPLY_TIMEOUT_MAX ) {
+    timeout = ECHO_REPLY_TIMEOUT_MAX;
+  }
+  sw_info->echo_timeout = timeout;
+
+  time_t interval = slow ? ECHO_REQUEST_INTERVAL_SLOW : ECHO_REQUEST_INTERVAL;
+  if ( interval <= timeout ) {
+    interval = timeout + 1;
+  }
+  if ( interval != sw_info->echo_interval ) {
+    debug( "Echo request interval is changed from %ld to %ld seconds ( datapath id %#" PRIx64 " ).",
+           ( long ) sw_info->echo_interval, ( long ) interval, sw_info->datapath_id );
+    delete_timer_event( echo_request_interval, sw_info );
+    add_periodic_event_callback( interval, echo_request_interval, sw_info );
+    sw_info->echo_interval = interval;
+  }
 }
 
 
@@ -392,7 +601,7 @@ switch_event_recv_echoreply( struct switch_info *sw_info, buffer *buf ) {
   if ( ntohll( body->datapath_id ) != sw_info->datapath_id ) {
     return 0;
   }
-  switch_unset_timeout( echo_reply_timeout, NULL );
+  switch_unset_timeout( sw_info, echo_reply_timeout );
   struct timespec now, tim;
   clock_gettime( CLOCK_MONOTONIC, &now );
   tim.tv_sec = ( time_t ) ntohl( body->sec );
@@ -402,6 +611,10 @@ switch_event_recv_echoreply( struct switch_info *sw_info, buffer *buf ) {
 
   info( "echo round-trip time %u.%09u.", ( uint32_t ) tim.tv_sec, ( uint32_t ) tim.tv_nsec );
 
+  uint64_t rtt = ( uint64_t ) tim.tv_sec * 1000000 + ( uint64_t ) tim.tv_nsec / 1000;
+  add_latency_sample( &sw_info->latency.echo, rtt );
+  adapt_echo_timers( sw_info, rtt );
+
   return 0;
 }
 
@@ -410,9 +623,14 @@ static void
 echo_request_interval( void *user_data ) {
   struct switch_info *sw_info = user_data;
 
+  if ( sw_info->running_timer ) {
+    // The previous request is still waiting for its reply.
+    return;
+  }
+
   buffer *buf = alloc_buffer();
   echo_body *body = append_back_buffer( buf, sizeof( echo_body ) );
-  body->datapath_id = htonll( switch_info.datapath_id );
+  body->datapath_id = htonll( sw_info->datapath_id );
   struct timespec now;
   clock_gettime( CLOCK_MONOTONIC, &now );
   body->sec = htonl( ( uint32_t ) now.tv_sec );
@@ -421,11 +639,51 @@ echo_request_interval( void *user_data ) {
 
   int err = ofpmsg_send_echorequest( sw_info, sw_info->echo_request_xid, buf );
   if ( err < 0 ) {
-    switch_event_disconnected( &switch_info );
+    switch_event_disconnected( sw_info );
     return;
   }
 
-  switch_set_timeout( ECHO_REPLY_TIMEOUT, echo_reply_timeout, NULL );
+  switch_set_timeout( sw_info, sw_info->echo_timeout, echo_reply_timeout );
+}
+
+
+/*
+ * Makes a switch reachable as its own messenger service in
+ * multi-switch mode. A switch with the same datapath id that is
+ * already served by this process is disconnected first.
+ */
+static bool
+register_switch( struct switch_info *sw_info, const char *service_name ) {
+  struct switch_info *old_sw_info = lookup_hash_entry( switches, &sw_info->datapath_id );
+  if ( old_sw_info != NULL ) {
+    // duplicated
+    switch_event_disconnected( old_sw_info );
+  }
+  else if ( get_trema_process_from_name( service_name ) > 0 ) {
+    error( "Switch ( datapath id %#" PRIx64 " ) is already served by another process.", sw_info->datapath_id );
+    return false;
+  }
+
+  sw_info->dpid_service_name = xstrdup( service_name );
+  insert_hash_entry( switches, &sw_info->datapath_id, sw_info );
+  add_message_received_callback( sw_info->dpid_service_name, service_recv );
+
+  return true;
+}
+
+
+static void
+unregister_switch( struct switch_info *sw_info ) {
+  if ( sw_info->dpid_service_name == NULL ) {
+    return;
+  }
+
+  delete_message_received_callback( sw_info->dpid_service_name, service_recv );
+  if ( lookup_hash_entry( switches, &sw_info->datapath_id ) == sw_info ) {
+    delete_hash_entry( switches, &sw_info->datapath_id );
+  }
+  xfree( sw_info->dpid_service_name );
+  sw_info->dpid_service_name = NULL;
 }
 
 
@@ -442,28 +700,36 @@ switch_event_recv_featuresreply( struct switch_info *sw_info, uint64_t *dpid ) {
     sw_info->state = SWITCH_STATE_COMPLETED;
 
     // cancel to features_reply_wait-timeout timer
-    switch_unset_timeout( switch_event_timeout_features_reply, NULL );
+    switch_unset_timeout( sw_info, switch_event_timeout_features_reply );
 
     // TODO: set keepalive-timeout
     snprintf( new_service_name, new_service_name_len, "%s%#" PRIx64, SWITCH_MANAGER_PREFIX, sw_info->datapath_id );
 
-    // checking duplicate service
-    pid_t pid = get_trema_process_from_name( new_service_name );
-    if ( pid > 0 ) {
-      // duplicated
-      if ( !terminate_trema_process( pid ) ) {
+    if ( multi_switch_mode() ) {
+      if ( !register_switch( sw_info, new_service_name ) ) {
         return -1;
       }
+      debug( "Add service name %s.", new_service_name );
     }
-    // rename service_name of messenger
-    rename_message_received_callback( get_trema_name(), new_service_name );
+    else {
+      // checking duplicate service
+      pid_t pid = get_trema_process_from_name( new_service_name );
+      if ( pid > 0 ) {
+        // duplicated
+        if ( !terminate_trema_process( pid ) ) {
+          return -1;
+        }
+      }
+      // rename service_name of messenger
+      rename_message_received_callback( get_trema_name(), new_service_name );
 
-    debug( "Rename service name from %s to %s.", get_trema_name(), new_service_name );
-    if ( messenger_dump_enabled() ) {
-      stop_messenger_dump();
-      start_messenger_dump( new_service_name, DEFAULT_DUMP_SERVICE_NAME );
+      debug( "Rename service name from %s to %s.", get_trema_name(), new_service_name );
+      if ( messenger_dump_enabled() ) {
+        stop_messenger_dump();
+        start_messenger_dump( new_service_name, DEFAULT_DUMP_SERVICE_NAME );
+      }
+      set_trema_name( new_service_name );
     }
-    set_trema_name( new_service_name );
 
     // notify state and datapath_id
     service_send_state( sw_info, &sw_info->datapath_id, MESSENGER_OPENFLOW_READY );
@@ -473,13 +739,16 @@ switch_event_recv_featuresreply( struct switch_info *sw_info, uint64_t *dpid ) {
     if ( ret < 0 ) {
       return ret;
     }
-    if ( switch_info.flow_cleanup ) {
+    if ( sw_info->flow_cleanup ) {
       ret = ofpmsg_send_delete_all_flows( sw_info );
       if ( ret < 0 ) {
         return ret;
       }
     }
-    add_periodic_event_callback( ECHO_REQUEST_INTERVAL, echo_request_interval, sw_info );
+    add_periodic_event_callback( sw_info->echo_interval, echo_request_interval, sw_info );
+    if ( secure_channel_read_paused() ) {
+      set_secure_channel_readable( sw_info, false );
+    }
     break;
 
   case SWITCH_STATE_COMPLETED:
@@ -497,19 +766,71 @@ switch_event_recv_featuresreply( struct switch_info *sw_info, uint64_t *dpid ) {
 }
 
 
+static void
+free_switch_info( void *user_data ) {
+  struct switch_info *sw_info = user_data;
+
+  delete_element( &connections, sw_info );
+  xfree( sw_info );
+}
+
+
+/*
+ * Frees a disconnected switch once the event handler that noticed
+ * the disconnection has returned.
+ */
+static void
+free_switch_info_later( struct switch_info *sw_info ) {
+  struct itimerspec interval;
+
+  interval.it_value.tv_sec = 0;
+  interval.it_value.tv_nsec = 1;
+  interval.it_interval.tv_sec = 0;
+  interval.it_interval.tv_nsec = 0;
+  add_timer_event_callback( &interval, free_switch_info, sw_info );
+}
+
+
 int
 switch_event_disconnected( struct switch_info *sw_info ) {
   int old_state = sw_info->state;
 
+  if ( multi_switch_mode() && old_state == SWITCH_STATE_DISCONNECTED ) {
+    return 0;
+  }
+
   sw_info->state = SWITCH_STATE_DISCONNECTED;
 
   if ( old_state == SWITCH_STATE_COMPLETED ) {
     delete_timer_event( echo_request_interval, sw_info );
   }
 
-  if ( sw_info->fragment_buf != NULL ) {
-    free_buffer( sw_info->fragment_buf );
-    sw_info->fragment_buf = NULL;
+  switch ( old_state ) {
+  case SWITCH_STATE_CONNECTED:
+    switch_unset_timeout( sw_info, switch_event_timeout_handshake );
+    break;
+  case SWITCH_STATE_WAIT_HELLO:
+    switch_unset_timeout( sw_info, switch_event_timeout_hello );
+    break;
+  case SWITCH_STATE_WAIT_FEATURES_REPLY:
+    switch_unset_timeout( sw_info, switch_event_timeout_features_reply );
+    break;
+  case SWITCH_STATE_COMPLETED:
+    switch_unset_timeout( sw_info, echo_reply_timeout );
+    break;
+  default:
+    break;
+  }
+
+  release_receive_slab( sw_info );
+
+  if ( sw_info->packet_in_table != NULL ) {
+    packet_in_table_stats_t stats;
+    get_packet_in_table_stats( sw_info->packet_in_table, &stats );
+    info( "Packet-ins from %#" PRIx64 ": forwarded = %" PRIu64 ", suppressed = %" PRIu64 ", cleared = %" PRIu64 ".",
+          sw_info->datapath_id, stats.forwarded, stats.suppressed, stats.cleared );
+    delete_packet_in_table( sw_info->packet_in_table );
+    sw_info->packet_in_table = NULL;
   }
 
   if ( sw_info->send_queue != NULL ) {
@@ -517,15 +838,20 @@ switch_event_disconnected( struct switch_info *sw_info ) {
     sw_info->send_queue = NULL;
   }
 
+  if ( sw_info->tls_record != NULL ) {
+    free_buffer( sw_info->tls_record );
+    sw_info->tls_record = NULL;
+  }
+
   if ( sw_info->recv_queue != NULL ) {
     delete_message_queue( sw_info->recv_queue );
     sw_info->recv_queue = NULL;
   }
 
   if ( sw_info->secure_channel_fd >= 0 ) {
-    set_readable( switch_info.secure_channel_fd, false );
-    set_writable( switch_info.secure_channel_fd, false );
-    delete_fd_handler( switch_info.secure_channel_fd );
+    set_readable( sw_info->secure_channel_fd, false );
+    set_writable( sw_info->secure_channel_fd, false );
+    delete_fd_handler( sw_info->secure_channel_fd );
 
     if ( sw_info->tls && sw_info->ssl != NULL ) {
       finalize_tls_session( sw_info->ssl );
@@ -545,6 +871,12 @@ switch_event_disconnected( struct switch_info *sw_info ) {
   }
   flush_messenger();
 
+  if ( multi_switch_mode() ) {
+    unregister_switch( sw_info );
+    free_switch_info_later( sw_info );
+    return 0;
+  }
+
   stop_trema();
 
   return 0;
@@ -553,26 +885,26 @@ switch_event_disconnected( struct switch_info *sw_info ) {
 
 int
 switch_event_recv_from_application( uint64_t *datapath_id, char *application_service_name, buffer *buf ) {
-
-  if ( *datapath_id != switch_info.datapath_id ) {
+  struct switch_info *sw_info = lookup_switch( *datapath_id );
+  if ( sw_info == NULL ) {
     error( "Invalid datapath id %#" PRIx64 ".", *datapath_id );
     free_buffer( buf );
 
     return -1;
   }
 
-  return ofpmsg_send( &switch_info, buf, application_service_name );
+  return ofpmsg_send( sw_info, buf, application_service_name );
 }
 
 
 int
 switch_event_disconnect_request( uint64_t *datapath_id ) {
-
-  if ( *datapath_id != switch_info.datapath_id ) {
+  struct switch_info *sw_info = lookup_switch( *datapath_id );
+  if ( sw_info == NULL ) {
     error( "Invalid datapath id %#" PRIx64 ".", *datapath_id );
     return -1;
   }
-  return switch_event_disconnected( &switch_info );
+  return switch_event_disconnected( sw_info );
 }
 
 
@@ -586,6 +918,38 @@ switch_event_recv_error( struct switch_info *sw_info ) {
 }
 
 
+static void
+dump_switch_latency( struct switch_info *sw_info ) {
+  if ( sw_info->state != SWITCH_STATE_COMPLETED ) {
+    return;
+  }
+
+  info( "#### LATENCY ( datapath id %#" PRIx64 " ) ####", sw_info->datapath_id );
+  info( "echo interval = %ld s, echo timeout = %ld s, smoothed echo rtt = %" PRIu64 " us, echo rtt variation = %" PRIu64 " us",
+        ( long ) sw_info->echo_interval, ( long ) sw_info->echo_timeout,
+        sw_info->latency.smoothed_echo_rtt, sw_info->latency.echo_rtt_variation );
+  dump_latency_histogram( "echo round-trip time", &sw_info->latency.echo );
+  dump_latency_histogram( "barrier round-trip time", &sw_info->latency.barrier );
+  dump_latency_histogram( "packet-in response time", &sw_info->latency.packet_in_response );
+  info( "#### END ####" );
+}
+
+
+static void
+init_switch_latency( struct switch_info *sw_info ) {
+  init_latency_histogram( &sw_info->latency.echo );
+  init_latency_histogram( &sw_info->latency.barrier );
+  init_latency_histogram( &sw_info->latency.packet_in_response );
+  sw_info->latency.smoothed_echo_rtt = 0;
+  sw_info->latency.echo_rtt_variation = 0;
+  for ( int i = 0; i < PACKET_IN_TIMESTAMPS; i++ ) {
+    sw_info->latency.packet_ins[ i ].buffer_id = OFP_NO_BUFFER;
+  }
+  sw_info->echo_interval = ECHO_REQUEST_INTERVAL;
+  sw_info->echo_timeout = ECHO_REPLY_TIMEOUT;
+}
+
+
 static void
 management_recv( uint16_t tag, void *data, size_t data_len ) {
   UNUSED( data );
@@ -603,6 +967,16 @@ management_recv( uint16_t tag, void *data, size_t data_len ) {
     dump_cookie_table();
     break;
 
+  case DUMP_LATENCY:
+    if ( !multi_switch_mode() ) {
+      dump_switch_latency( &switch_info );
+      break;
+    }
+    for ( list_element *e = connections; e != NULL; e = e->next ) {
+      dump_switch_latency( e->data );
+    }
+    break;
+
   case TOGGLE_COOKIE_AGING:
     if ( !switch_info.cookie_translation ) {
       break;
@@ -623,9 +997,167 @@ management_recv( uint16_t tag, void *data, size_t data_len ) {
 }
 
 
+static bool
+connect_switch( struct switch_info *sw_info ) {
+  set_fd_handler( sw_info->secure_channel_fd, secure_channel_read, sw_info, secure_channel_write, sw_info );
+  set_readable( sw_info->secure_channel_fd, true );
+  set_writable( sw_info->secure_channel_fd, false );
+
+  if ( switch_event_connected( sw_info ) < 0 ) {
+    error( "Failed to set connected state." );
+    return false;
+  }
+  flush_secure_channel( sw_info );
+
+  return true;
+}
+
+
+/*
+ * Advances the TLS handshake whenever the secure channel gets ready, so
+ * that a slow or stalled peer never blocks the other switches sharing
+ * the event loop.
+ */
+static void
+secure_channel_handshake( int fd, void *data ) {
+  struct switch_info *sw_info = data;
+
+  bool want_write = false;
+  int ret = accept_tls_session( sw_info->ssl, &want_write );
+  if ( ret == 0 ) {
+    set_readable( fd, !want_write );
+    set_writable( fd, want_write );
+    return;
+  }
+
+  switch_unset_timeout( sw_info, switch_event_timeout_handshake );
+  set_readable( fd, false );
+  set_writable( fd, false );
+  delete_fd_handler( fd );
+  if ( ret < 0 || !connect_switch( sw_info ) ) {
+    switch_event_disconnected( sw_info );
+  }
+}
+
+
+static bool
+start_switch( struct switch_info *sw_info ) {
+  fcntl( sw_info->secure_channel_fd, F_SETFL, O_NONBLOCK );
+
+  // default switch configuration
+  sw_info->config_flags = OFPC_FRAG_NORMAL;
+  sw_info->miss_send_len = OFPCML_MAX;
+
+  sw_info->recv_slab = NULL;
+  sw_info->send_queue = create_message_queue();
+  sw_info->tls_record = NULL;
+  sw_info->recv_queue = create_message_queue();
+  sw_info->packet_in_table = NULL;
+  if ( sw_info->packet_in_suppression_interval > 0 ) {
+    sw_info->packet_in_table = create_packet_in_table( sw_info->packet_in_suppression_interval );
+  }
+  sw_info->running_timer = false;
+  sw_info->echo_request_xid = 0;
+  init_switch_latency( sw_info );
+
+  if ( !sw_info->tls ) {
+    return connect_switch( sw_info );
+  }
+
+  sw_info->ssl = init_tls_session( sw_info->secure_channel_fd );
+  if ( sw_info->ssl == NULL ) {
+    error( "Failed to accept TLS session." );
+    return false;
+  }
+  set_fd_handler( sw_info->secure_channel_fd, secure_channel_handshake, sw_info, secure_channel_handshake, sw_info );
+  set_readable( sw_info->secure_channel_fd, true );
+  set_writable( sw_info->secure_channel_fd, false );
+  switch_set_timeout( sw_info, SWITCH_STATE_TIMEOUT_HANDSHAKE, switch_event_timeout_handshake );
+
+  return true;
+}
+
+
+/*
+ * Receives a switch connection accepted by the switch manager. The
+ * descriptor comes as ancillary data and the peer address as the
+ * message body.
+ */
+static int
+recv_secure_channel_fd( int fd, struct sockaddr_in *addr ) {
+  struct iovec iov = { addr, sizeof( struct sockaddr_in ) };
+  char control[ CMSG_SPACE( sizeof( int ) ) ];
+  struct msghdr msg;
+  memset( &msg, 0, sizeof( msg ) );
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof( control );
+
+  ssize_t ret = recvmsg( fd, &msg, 0 );
+  if ( ret <= 0 ) {
+    return ( int ) ret;
+  }
+
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR( &msg );
+  if ( cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ) {
+    errno = EINVAL;
+    return -1;
+  }
+  int secure_channel_fd;
+  memcpy( &secure_channel_fd, CMSG_DATA( cmsg ), sizeof( int ) );
+
+  return secure_channel_fd;
+}
+
+
 static void
 stop_switch_daemon( void ) {
-  switch_event_disconnected( &switch_info );
+  if ( !multi_switch_mode() ) {
+    switch_event_disconnected( &switch_info );
+    return;
+  }
+
+  for ( list_element *e = connections; e != NULL; e = e->next ) {
+    switch_event_disconnected( e->data );
+  }
+  stop_trema();
+}
+
+
+static void
+control_read( int fd, void *data ) {
+  UNUSED( data );
+
+  struct sockaddr_in addr;
+  int secure_channel_fd = recv_secure_channel_fd( fd, &addr );
+  if ( secure_channel_fd == 0 ) {
+    info( "Switch manager closed the control socket." );
+    stop_switch_daemon();
+    return;
+  }
+  if ( secure_channel_fd < 0 ) {
+    if ( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR ) {
+      error( "Failed to receive a switch connection ( %s [%d] ).", strerror( errno ), errno );
+    }
+    return;
+  }
+
+  debug( "Switch connected from %s:%u ( fd = %d ).",
+         inet_ntoa( addr.sin_addr ), ntohs( addr.sin_port ), secure_channel_fd );
+
+  struct switch_info *sw_info = xmalloc( sizeof( struct switch_info ) );
+  memcpy( sw_info, &switch_info, sizeof( struct switch_info ) );
+  sw_info->secure_channel_fd = secure_channel_fd;
+  sw_info->ssl = NULL;
+  sw_info->dpid_service_name = NULL;
+  sw_info->datapath_id = 0;
+  sw_info->state = SWITCH_STATE_CONNECTED;
+  insert_in_front( &connections, sw_info );
+
+  if ( !start_switch( sw_info ) ) {
+    switch_event_disconnected( sw_info );
+  }
 }
 
 
@@ -641,18 +1173,20 @@ handle_sigterm( int signum ) {
 
 int
 main( int argc, char *argv[] ) {
-  int ret;
   int i;
   char *service_name;
   char management_service_name[ MESSENGER_SERVICE_NAME_LENGTH ];
 
   init_trema( &argc, &argv );
   option_parser( argc, argv );
+  set_send_queue_watermarks( SEND_QUEUE_HIGH_WATERMARK, SEND_QUEUE_LOW_WATERMARK,
+                             handle_send_queue_pressure, NULL );
 
   create_list( &switch_info.vendor_service_name_list );
   create_list( &switch_info.packetin_service_name_list );
   create_list( &switch_info.portstatus_service_name_list );
   create_list( &switch_info.state_service_name_list );
+  create_list( &connections );
 
   // FIXME
 #define VENDER_PREFIX "vendor::"
@@ -690,27 +1224,14 @@ main( int argc, char *argv[] ) {
       error( "Failed to initialize TLS server." );
       return -1;
     }
-    switch_info.ssl = init_tls_session( switch_info.secure_channel_fd );
-    if ( switch_info.ssl == NULL ) {
-      error( "Failed to accept TLS session." );
-      return -1;
-    }
   }
 
-  fcntl( switch_info.secure_channel_fd, F_SETFL, O_NONBLOCK );
-  set_fd_handler( switch_info.secure_channel_fd, secure_channel_read, NULL, secure_channel_write, NULL );
-  set_readable( switch_info.secure_channel_fd, true );
-  set_writable( switch_info.secure_channel_fd, false );
-
-  // default switch configuration
-  switch_info.config_flags = OFPC_FRAG_NORMAL;
-  switch_info.miss_send_len = OFPCML_MAX;
-
-  switch_info.fragment_buf = NULL;
-  switch_info.send_queue = create_message_queue();
-  switch_info.recv_queue = create_message_queue();
-  switch_info.running_timer = false;
-  switch_info.echo_request_xid = 0;
+  if ( multi_switch_mode() ) {
+    switches = create_hash( compare_datapath_id, hash_datapath_id );
+    fcntl( control_fd, F_SETFL, O_NONBLOCK );
+    set_fd_handler( control_fd, control_read, NULL, NULL, NULL );
+    set_readable( control_fd, true );
+  }
 
   init_xid_table();
   if ( switch_info.cookie_translation ) {
@@ -724,12 +1245,9 @@ main( int argc, char *argv[] ) {
   management_service_name[ MESSENGER_SERVICE_NAME_LENGTH - 1 ] = '\0';
   add_message_received_callback( management_service_name, management_recv );
 
-  ret = switch_event_connected( &switch_info );
-  if ( ret < 0 ) {
-    error( "Failed to set connected state." );
+  if ( !multi_switch_mode() && !start_switch( &switch_info ) ) {
     return -1;
   }
-  flush_secure_channel( &switch_info );
 
   start_trema();
 
@@ -738,7 +1256,17 @@ main( int argc, char *argv[] ) {
     finalize_cookie_table();
   }
 
-  if ( switch_info.secure_channel_fd >= 0 ) {
+  if ( multi_switch_mode() ) {
+    set_readable( control_fd, false );
+    delete_fd_handler( control_fd );
+    close( control_fd );
+    while ( connections != NULL ) {
+      free_switch_info( connections->data );
+    }
+    delete_hash( switches );
+    switches = NULL;
+  }
+  else if ( switch_info.secure_channel_fd >= 0 ) {
     delete_fd_handler( switch_info.secure_channel_fd );
 
     if ( switch_info.tls && switch_info.ssl != NULL ) {
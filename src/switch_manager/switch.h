@@ -32,6 +32,7 @@
 #define MESSENGER_SERVICE_TYPE_SUBSCRIBE  2
 #define MESSENGER_SERVICE_TYPE_NOTIFY     3
 
+#define SWITCH_STATE_TIMEOUT_HANDSHAKE 5      // in seconds
 #define SWITCH_STATE_TIMEOUT_HELLO 5          // in seconds
 #define SWITCH_STATE_TIMEOUT_FEATURES_REPLY 5 // in seconds
 
@@ -47,6 +48,7 @@ int switch_event_recv_featuresreply( struct switch_info *switch_info, uint64_t *
 int switch_event_recv_from_application( uint64_t *datapath_id, char *application_service_name, buffer *buf );
 int switch_event_disconnect_request( uint64_t *datapath_id );
 int switch_event_recv_error( struct switch_info *sw_info );
+bool secure_channel_read_paused( void );
 
 
 #endif // SWITCH_MANAGER_H
@@ -39,6 +39,8 @@ const char SWITCH_MANAGER_NAME_OPTION[] = "--name=";
 const uint SWITCH_MANAGER_NAME_OPTION_STR_LEN = sizeof( SWITCH_MANAGER_NAME_OPTION );
 const char SWITCH_MANAGER_SOCKET_OPTION[] = "--socket=";
 const uint SWITCH_MANAGER_SOCKET_OPTION_STR_LEN = sizeof( SWITCH_MANAGER_SOCKET_OPTION );
+const char SWITCH_MANAGER_CONTROL_OPTION[] = "--control=";
+const char SWITCH_MANAGER_SHARD_PREFIX[] = "shard";
 const char SWITCH_MANAGER_DAEMONIZE_OPTION[] = "--daemonize";
 const uint SWITCH_MANAGER_SOCKET_STR_LEN = sizeof( "2147483647" );
 const char SWITCH_MANAGER_COMMAND_PREFIX[] = "switch.";
@@ -157,10 +159,11 @@ struct listener_info listener_info;
 static struct option long_options[] = {
   { "port", 1, NULL, 'p' },
   { "switch", 1, NULL, 's' },
+  { "multi-switch", 1, NULL, 'm' },
   { NULL, 0, NULL, 0  },
 };
 
-static char short_options[] = "p:s:";
+static char short_options[] = "p:s:m:";
 
 
 void
@@ -172,6 +175,7 @@ usage() {
 	 "  -s, --switch=PATH           the command path of switch\n"
 	 "  -n, --name=SERVICE_NAME     service name\n"
          "  -p, --port=PORT             server listen port (default %u)\n"
+         "  -m, --multi-switch=NUM      serve all switches from NUM switch processes\n"
 	 "  -d, --daemonize             run in the background\n"
 	 "  -l, --logging_level=LEVEL   set logging level\n"
 	 "  -h, --help                  display this help and exit\n"
@@ -272,6 +276,15 @@ finalize_listener_info(  struct listener_info *listener_info ) {
     xfree( (void *)( uintptr_t )listener_info->switch_daemon );
     listener_info->switch_daemon = NULL;
   }
+  if ( listener_info->shard_fds != NULL ) {
+    for ( int i = 0; i < listener_info->n_shards; i++ ) {
+      if ( listener_info->shard_fds[ i ] > 0 ) {
+        close( listener_info->shard_fds[ i ] );
+      }
+    }
+    xfree( listener_info->shard_fds );
+    listener_info->shard_fds = NULL;
+  }
   if ( listener_info->listen_fd >= 0 ) {
     set_readable( listener_info->listen_fd, false );
     delete_fd_handler( listener_info->listen_fd );
@@ -296,6 +309,20 @@ strtoport( const char *str ) {
 }
 
 
+static int
+strtoshards( const char *str ) {
+  char *ep;
+  long l;
+
+  l = strtol( str, &ep, 0 );
+  if ( l <= 0 || l > INT_MAX || *ep != '\0' ) {
+    die( "Invalid number of switch processes. %s", str );
+    return 0;
+  }
+  return ( int ) l;
+}
+
+
 static bool
 parse_argument( struct listener_info *listener_info, int argc, char *argv[] ) {
   int c;
@@ -312,6 +339,12 @@ parse_argument( struct listener_info *listener_info, int argc, char *argv[] ) {
         xfree( (void *)( uintptr_t )listener_info->switch_daemon );
         listener_info->switch_daemon = xstrdup( optarg );
         break;
+      case 'm':
+        listener_info->n_shards = strtoshards( optarg );
+        if ( listener_info->n_shards == 0 ) {
+          return false;
+        }
+        break;
       default:
         usage();
         exit( EXIT_SUCCESS );
@@ -436,6 +469,14 @@ main( int argc, char *argv[] ) {
     exit( EXIT_FAILURE );
   }
 
+  if ( listener_info.n_shards > 0 ) {
+    ret = start_switch_daemon_shards( &listener_info );
+    if ( !ret ) {
+      finalize_listener_info( &listener_info );
+      exit( EXIT_FAILURE );
+    }
+  }
+
   set_fd_handler( listener_info.listen_fd, secure_channel_accept, &listener_info, NULL, NULL );
   set_readable( listener_info.listen_fd, true );
 
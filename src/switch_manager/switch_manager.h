@@ -31,6 +31,8 @@ extern const char SWITCH_MANAGER_NAME_OPTION[];
 extern const uint SWITCH_MANAGER_NAME_OPTION_STR_LEN;
 extern const char SWITCH_MANAGER_SOCKET_OPTION[];
 extern const uint SWITCH_MANAGER_SOCKET_OPTION_STR_LEN;
+extern const char SWITCH_MANAGER_CONTROL_OPTION[];
+extern const char SWITCH_MANAGER_SHARD_PREFIX[];
 extern const char SWITCH_MANAGER_DAEMONIZE_OPTION[];
 extern const uint SWITCH_MANAGER_SOCKET_STR_LEN;
 extern const char SWITCH_MANAGER_COMMAND_PREFIX[];
@@ -49,6 +51,9 @@ struct listener_info {
   char **switch_daemon_argv;
   uint16_t listen_port;
   int listen_fd;
+  int n_shards;             // serves all switches from this many switch daemons if positive
+  int *shard_fds;           // control sockets to the switch daemons
+  unsigned int next_shard;
 };
 
 
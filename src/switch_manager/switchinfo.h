@@ -23,6 +23,8 @@
 
 
 #include <limits.h>
+#include <time.h>
+#include "latency_histogram.h"
 #include "message_queue.h"
 #include "tls.h"
 
@@ -33,6 +35,24 @@
 #define SWITCH_STATE_COMPLETED           3
 #define SWITCH_STATE_DISCONNECTED        4
 
+// Number of buffered packet-ins whose arrival time is kept per switch.
+#define PACKET_IN_TIMESTAMPS 256
+
+
+struct packet_in_timestamp {
+  uint32_t buffer_id;           // OFP_NO_BUFFER if unused
+  struct timespec received_at;
+};
+
+struct switch_latency {
+  latency_histogram echo;               // echo request to echo reply
+  latency_histogram barrier;            // barrier request to barrier reply
+  latency_histogram packet_in_response; // packet-in to flow mod or packet out
+  uint64_t smoothed_echo_rtt;           // microseconds
+  uint64_t echo_rtt_variation;          // microseconds
+  struct packet_in_timestamp packet_ins[ PACKET_IN_TIMESTAMPS ]; // indexed by buffer id
+};
+
 
 struct switch_info {
   list_element *vendor_service_name_list;     // vender manager service
@@ -48,6 +68,7 @@ struct switch_info {
   bool flow_cleanup;
   bool cookie_translation;
   bool deny_packet_in_on_startup;
+  unsigned int packet_in_suppression_interval; // msec, 0 to forward all packet-ins
 
   int state;                    // state of switch secure channel
   uint64_t datapath_id;
@@ -56,15 +77,22 @@ struct switch_info {
   uint16_t miss_send_len;       /* Max bytes of new flow that datapath should
                                    send to the controller. */
 
-  buffer *fragment_buf;         /* openflow message fragmentation buffer of
-                                   secure channel receiver */
+  struct receive_slab *recv_slab; /* openflow message fragmentation buffer of
+                                     secure channel receiver */
 
   message_queue *send_queue;
+  buffer *tls_record;           // messages packed for a single SSL_write()
   message_queue *recv_queue;
 
+  struct packet_in_table *packet_in_table; // recent packet-ins, or NULL
+
   bool running_timer;
 
   uint32_t echo_request_xid;
+  time_t echo_interval;         // seconds, adapted to the echo round-trip time
+  time_t echo_timeout;          // seconds, adapted to the echo round-trip time
+
+  struct switch_latency latency;
 
   SSL *ssl;
   bool tls;
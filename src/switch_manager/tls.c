@@ -85,19 +85,47 @@ init_tls_session( const int fd ) {
     return NULL;
   }
 
-  ret = SSL_accept( ssl );
-  if ( ret != 1 ) {
-    int error_no = SSL_get_error( ssl, ret );
-    error( "Failed to initialize TLS handshake ( fd = %d, ctx = %p, ssl = %p, error = %d ).",
-           fd, ctx, ssl, error_no );
-    SSL_free( ssl );
-    return NULL;
-  }
+  // the handshake is driven by accept_tls_session() from fd events
+  SSL_set_accept_state( ssl );
 
   return ssl;
 }
 
 
+/**
+ * Advances the server side TLS handshake on a non-blocking socket.
+ * Returns 1 when the handshake is completed, 0 when it has to be
+ * resumed once the socket is readable ( or writable if *want_write is
+ * set ), and -1 on failure.
+ */
+int
+accept_tls_session( SSL *ssl, bool *want_write ) {
+  assert( ssl != NULL );
+  assert( want_write != NULL );
+
+  *want_write = false;
+  int ret = SSL_accept( ssl );
+  if ( ret == 1 ) {
+    debug( "TLS handshake completed ( ssl = %p ).", ssl );
+    return 1;
+  }
+
+  int error_no = SSL_get_error( ssl, ret );
+  switch ( error_no ) {
+  case SSL_ERROR_WANT_READ:
+    return 0;
+  case SSL_ERROR_WANT_WRITE:
+    *want_write = true;
+    return 0;
+  default:
+    break;
+  }
+
+  error( "Failed to complete TLS handshake ( ctx = %p, ssl = %p, error = %d ).", ctx, ssl, error_no );
+  return -1;
+}
+
+
 bool
 finalize_tls_session( SSL *ssl ) {
   debug( "Finalizing TLS session ( ssl = %p, ctx = %p ).", ssl, ctx );
@@ -30,6 +30,7 @@
 bool init_tls_server( const char *cert_file, const char *key_file );
 bool finalize_tls_server();
 SSL *init_tls_session( const int fd );
+int accept_tls_session( SSL *ssl, bool *want_write );
 bool finalize_tls_session( SSL *ssl );
 
 
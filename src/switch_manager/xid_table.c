@@ -19,20 +19,43 @@
 
 
 #include <assert.h>
+#include <inttypes.h>
 #include <openflow.h>
 #include <string.h>
+#include <time.h>
 #include "trema.h"
 #include "xid_table.h"
 
 
+#ifdef UNIT_TESTING
+#define static
+
+#ifdef clock_gettime
+#undef clock_gettime
+#endif
+#define clock_gettime mock_clock_gettime
+int mock_clock_gettime( clockid_t clk_id, struct timespec *tp );
+#endif // UNIT_TESTING
+
+
 static uint32_t transaction_id = 0U;
 
-#define XID_MAX_ENTRIES 4096
+// Replies rarely take more than a few seconds; anything older is lost.
+static const time_t XID_ENTRY_LIFETIME = 60;
+#define XID_MAX_ENTRIES 262144
 
+/*
+ * Entries are kept in insertion order, so that the oldest ones are
+ * expired from the head. Deleted entries go to a free list and are
+ * reused by later insertions.
+ */
 typedef struct xid_table {
-  xid_entry_t *entries[ XID_MAX_ENTRIES ];
   hash_table *hash;
-  int next_index;
+  list_link entries;
+  list_link free_entries;
+  xid_table_stats_t stats;
+  bool evicting; // warned that the table is full
+  uint64_t evicted_before; // stats.evicted when evictions started
 } xid_table_t;
 
 static xid_table_t xid_table;
@@ -61,14 +84,24 @@ generate_xid( void ) {
 
 
 static xid_entry_t *
-allocate_xid_entry( uint32_t original_xid, char *service_name, int index ) {
+allocate_xid_entry( uint32_t original_xid, char *service_name ) {
   xid_entry_t *new_entry;
 
-  new_entry = xmalloc( sizeof ( xid_entry_t ) );
+  if ( list_link_is_empty( &xid_table.free_entries ) ) {
+    new_entry = xmalloc( sizeof ( xid_entry_t ) );
+    init_list_link( &new_entry->link );
+  }
+  else {
+    new_entry = LIST_LINK_ENTRY( xid_table.free_entries.next, xid_entry_t, link );
+    remove_link( &new_entry->link );
+  }
   new_entry->xid = generate_xid();
   new_entry->original_xid = original_xid;
   new_entry->service_name = xstrdup( service_name );
-  new_entry->index = index;
+  clock_gettime( CLOCK_MONOTONIC, &new_entry->expire_at );
+  new_entry->expire_at.tv_sec += XID_ENTRY_LIFETIME;
+  new_entry->sent_at.tv_sec = 0;
+  new_entry->sent_at.tv_nsec = 0;
 
   return new_entry;
 }
@@ -77,7 +110,26 @@ allocate_xid_entry( uint32_t original_xid, char *service_name, int index ) {
 static void
 free_xid_entry( xid_entry_t *free_entry ) {
   xfree( free_entry->service_name );
-  xfree( free_entry );
+  free_entry->service_name = NULL;
+  if ( list_link_is_linked( &free_entry->link ) ) {
+    remove_link( &free_entry->link );
+    xid_table.stats.in_flight--;
+  }
+  append_link( &xid_table.free_entries, &free_entry->link );
+}
+
+
+static void
+free_xid_entries( list_link *head ) {
+  while ( !list_link_is_empty( head ) ) {
+    list_link *link = head->next;
+    remove_link( link );
+    xid_entry_t *entry = LIST_LINK_ENTRY( link, xid_entry_t, link );
+    if ( entry->service_name != NULL ) {
+      xfree( entry->service_name );
+    }
+    xfree( entry );
+  }
 }
 
 
@@ -85,21 +137,59 @@ void
 init_xid_table( void ) {
   memset( &xid_table, 0, sizeof( xid_table_t ) );
   xid_table.hash = create_hash( compare_uint32, hash_uint32 );
-  xid_table.next_index = 0;
+  init_list_link( &xid_table.entries );
+  init_list_link( &xid_table.free_entries );
 }
 
 
 void
 finalize_xid_table( void ) {
-  for( int i = 0; i < XID_MAX_ENTRIES; i++ ) {
-    if ( xid_table.entries[ i ] != NULL ) {
-      free_xid_entry( xid_table.entries[ i ] );
-      xid_table.entries[ i ] = NULL;
-    }
-  }
+  free_xid_entries( &xid_table.entries );
+  free_xid_entries( &xid_table.free_entries );
   delete_hash( xid_table.hash );
   xid_table.hash = NULL;
-  xid_table.next_index = 0;
+  memset( &xid_table.stats, 0, sizeof( xid_table_stats_t ) );
+}
+
+
+static xid_entry_t *
+oldest_xid_entry( void ) {
+  if ( list_link_is_empty( &xid_table.entries ) ) {
+    return NULL;
+  }
+  return LIST_LINK_ENTRY( xid_table.entries.next, xid_entry_t, link );
+}
+
+
+/*
+ * Deletes entries whose replies did not come within their lifetime, and
+ * the oldest entry if the table is full.
+ */
+static void
+expire_xid_entries( void ) {
+  struct timespec now;
+  clock_gettime( CLOCK_MONOTONIC, &now );
+  xid_entry_t *oldest;
+  while ( ( oldest = oldest_xid_entry() ) != NULL && !TIMESPEC_LESS_THEN( &now, &oldest->expire_at ) ) {
+    xid_table.stats.expired++;
+    delete_xid_entry( oldest );
+  }
+
+  // Evictions are logged once when they start and once when they stop,
+  // since every insertion evicts an entry while the table stays full.
+  if ( xid_table.stats.in_flight >= XID_MAX_ENTRIES ) {
+    if ( !xid_table.evicting ) {
+      warn( "Too many transactions in flight. Evicting the oldest xid entries ( max = %d ).", XID_MAX_ENTRIES );
+      xid_table.evicting = true;
+      xid_table.evicted_before = xid_table.stats.evicted;
+    }
+    xid_table.stats.evicted++;
+    delete_xid_entry( oldest_xid_entry() );
+  }
+  else if ( xid_table.evicting ) {
+    info( "Stopped evicting xid entries ( evicted = %" PRIu64 " ).", xid_table.stats.evicted - xid_table.evicted_before );
+    xid_table.evicting = false;
+  }
 }
 
 
@@ -110,22 +200,18 @@ insert_xid_entry( uint32_t original_xid, char *service_name ) {
   debug( "Inserting xid entry ( original_xid = %#lx, service_name = %s ).",
          original_xid, service_name );
 
-  if ( xid_table.next_index >= XID_MAX_ENTRIES ) {
-    xid_table.next_index = 0;
-  }
-
-  if ( xid_table.entries[ xid_table.next_index ] != NULL ) {
-    delete_xid_entry( xid_table.entries[ xid_table.next_index ] );
-  }
+  expire_xid_entries();
 
-  new_entry = allocate_xid_entry( original_xid, service_name, xid_table.next_index );
+  new_entry = allocate_xid_entry( original_xid, service_name );
   xid_entry_t *old = insert_hash_entry( xid_table.hash, &new_entry->xid, new_entry );
   if ( old != NULL ) {
-    xid_table.entries[ old->index ] = NULL;
     free_xid_entry( old );
   }
-  xid_table.entries[ xid_table.next_index ] = new_entry;
-  xid_table.next_index++;
+  append_link( &xid_table.entries, &new_entry->link );
+  xid_table.stats.in_flight++;
+  if ( xid_table.stats.in_flight > xid_table.stats.peak_in_flight ) {
+    xid_table.stats.peak_in_flight = xid_table.stats.in_flight;
+  }
 
   return new_entry->xid;
 }
@@ -133,8 +219,8 @@ insert_xid_entry( uint32_t original_xid, char *service_name ) {
 
 void
 delete_xid_entry( xid_entry_t *delete_entry ) {
-  debug( "Deleting xid entry ( xid = %#lx, original_xid = %#lx, service_name = %s, index = %d ).",
-         delete_entry->xid, delete_entry->original_xid, delete_entry->service_name, delete_entry->index );
+  debug( "Deleting xid entry ( xid = %#lx, original_xid = %#lx, service_name = %s ).",
+         delete_entry->xid, delete_entry->original_xid, delete_entry->service_name );
 
   xid_entry_t *deleted = delete_hash_entry( xid_table.hash, &delete_entry->xid );
 
@@ -144,7 +230,6 @@ delete_xid_entry( xid_entry_t *delete_entry ) {
     return;
   }
 
-  xid_table.entries[ deleted->index ] = NULL;
   free_xid_entry( deleted );
 }
 
@@ -155,10 +240,22 @@ lookup_xid_entry( uint32_t xid ) {
 }
 
 
+/**
+ * Copies the counters of the xid table into stats.
+ */
+void
+get_xid_table_stats( xid_table_stats_t *stats ) {
+  assert( stats != NULL );
+
+  *stats = xid_table.stats;
+}
+
+
 static void
 dump_xid_entry( xid_entry_t *entry ) {
-  info( "xid = %#lx, original_xid = %#lx, service_name = %s, index = %d",
-        entry->xid, entry->original_xid, entry->service_name, entry->index );
+  info( "xid = %#lx, original_xid = %#lx, service_name = %s, expire_at = %ld.%09ld",
+        entry->xid, entry->original_xid, entry->service_name,
+        ( long ) entry->expire_at.tv_sec, ( long ) entry->expire_at.tv_nsec );
 }
 
 
@@ -172,6 +269,9 @@ dump_xid_table( void ) {
   while ( ( e = iterate_hash_next( &iter ) ) != NULL ) {
     dump_xid_entry( e->value );
   }
+  info( "in_flight = %u, peak_in_flight = %u, expired = %" PRIu64 ", evicted = %" PRIu64,
+        xid_table.stats.in_flight, xid_table.stats.peak_in_flight,
+        xid_table.stats.expired, xid_table.stats.evicted );
   info( "#### END ####" );
 }
 
@@ -24,6 +24,7 @@
 #define XID_TABLE_H
 
 
+#include <time.h>
 #include "trema.h"
 
 
@@ -31,9 +32,18 @@ typedef struct xid_entry {
   uint32_t xid;
   uint32_t original_xid;
   char *service_name;
-  int index;
+  struct timespec expire_at;    // CLOCK_MONOTONIC
+  struct timespec sent_at;     // barrier requests only, zero otherwise
+  list_link link;
 } xid_entry_t;
 
+typedef struct {
+  unsigned int in_flight;      // entries waiting for replies
+  unsigned int peak_in_flight;
+  uint64_t expired;            // entries deleted after their lifetime
+  uint64_t evicted;            // entries deleted because the table was full
+} xid_table_stats_t;
+
 
 uint32_t generate_xid( void );
 void init_xid_table( void );
@@ -41,6 +51,7 @@ void finalize_xid_table( void );
 uint32_t insert_xid_entry( uint32_t original_xid, char *service_name );
 void delete_xid_entry( xid_entry_t *entry );
 xid_entry_t *lookup_xid_entry( uint32_t xid );
+void get_xid_table_stats( xid_table_stats_t *stats );
 void dump_xid_table( void );
 
 
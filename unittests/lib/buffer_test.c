@@ -44,6 +44,11 @@ typedef struct private_buffer {
   size_t real_length;
   void *top;
   pthread_mutex_t *mutex;
+  pthread_mutex_t embedded_mutex;
+  unsigned int size_class;
+  struct private_buffer *next;
+  void ( *release_data )( void *data, void *arg );
+  void *release_arg;
 } private_buffer;
 
 
@@ -69,6 +74,44 @@ test_alloc_buffer_with_length_succeeds() {
 }
 
 
+static void
+release_data( void *data, void *arg ) {
+  check_expected( data );
+  check_expected( arg );
+}
+
+
+static void
+test_alloc_buffer_with_data_succeeds() {
+  char data[] = "tea";
+  buffer *buf = alloc_buffer_with_data( data, sizeof( data ), release_data, &data );
+  assert_true( buf != NULL );
+  assert_true( buf->data == data );
+  assert_int_equal( buf->length, sizeof( data ) );
+  assert_int_equal( get_buffer_headroom( buf ), 0 );
+
+  expect_value( release_data, data, data );
+  expect_value( release_data, arg, &data );
+  free_buffer( buf );
+}
+
+
+static void
+test_append_front_buffer_copies_data_not_owned() {
+  char data[] = "tea";
+  buffer *buf = alloc_buffer_with_data( data, sizeof( data ), release_data, NULL );
+
+  expect_value( release_data, data, data );
+  expect_value( release_data, arg, NULL );
+  append_front_buffer( buf, 1 );
+  assert_true( buf->data != data );
+  assert_int_equal( buf->length, sizeof( data ) + 1 );
+  assert_string_equal( ( char * ) buf->data + 1, "tea" );
+
+  free_buffer( buf );
+}
+
+
 static void
 test_free_buffer_succeeds() {
   buffer *buf = alloc_buffer();
@@ -140,6 +183,45 @@ test_append_front_buffer_resize_succeeds() {
 }
 
 
+static void
+test_append_front_buffer_uses_headroom() {
+  buffer *buf = alloc_buffer_with_length( sizeof( tea ) * 2 );
+  assert_true( buf != NULL );
+
+  reserve_buffer_headroom( buf, sizeof( tea ) );
+  assert_true( get_buffer_headroom( buf ) == sizeof( tea ) );
+
+  void *data_pointer = append_back_buffer( buf, sizeof( tea ) );
+  memcpy( data_pointer, &CEYLON, sizeof( tea ) );
+
+  data_pointer = append_front_buffer( buf, sizeof( tea ) );
+  assert_true( data_pointer != NULL );
+  assert_true( buf->length == sizeof( tea ) * 2 );
+  assert_true( get_buffer_headroom( buf ) == 0 );
+
+  tea *tea_data = ( tea * ) ( ( char * ) data_pointer + sizeof( tea ) );
+  assert_true( 0 == strcmp( tea_data->name, CEYLON.name ) );
+
+  free_buffer( buf );
+}
+
+
+static void
+test_reserve_buffer_headroom_resize_succeeds() {
+  buffer *buf = alloc_buffer_with_length( sizeof( tea ) );
+  assert_true( buf != NULL );
+
+  reserve_buffer_headroom( buf, sizeof( tea ) * 2 );
+  assert_true( buf->length == 0 );
+  assert_true( get_buffer_headroom( buf ) == sizeof( tea ) * 2 );
+
+  reset_buffer( buf );
+  assert_true( get_buffer_headroom( buf ) == 0 );
+
+  free_buffer( buf );
+}
+
+
 static void
 test_remove_front_buffer_succeeds() {
   buffer *buf = alloc_buffer_with_length( sizeof( tea ) * 2 );
@@ -326,6 +408,60 @@ test_dump_buffer() {
 }
 
 
+static void
+test_freed_buffer_is_reused_if_buffer_cache_is_enabled() {
+  enable_buffer_cache();
+
+  buffer *buf = alloc_buffer_with_length( sizeof( tea ) );
+  append_back_buffer( buf, sizeof( tea ) );
+  void *data = buf->data;
+  free_buffer( buf );
+
+  buffer *reused = alloc_buffer_with_length( sizeof( tea ) );
+  assert_true( reused == buf );
+  assert_true( reused->data == data );
+  assert_int_equal( reused->length, 0 );
+  assert_true( reused->user_data == NULL );
+  free_buffer( reused );
+
+  disable_buffer_cache();
+}
+
+
+static void
+test_large_buffer_is_not_reused_as_small_buffer() {
+  enable_buffer_cache();
+
+  buffer *large = alloc_buffer_with_length( 4096 );
+  free_buffer( large );
+
+  buffer *small = alloc_buffer_with_length( sizeof( tea ) );
+  assert_true( small != large );
+  free_buffer( small );
+
+  disable_buffer_cache();
+}
+
+
+static void
+test_buffer_is_reused_within_its_size_class() {
+  enable_buffer_cache();
+
+  buffer *buf = alloc_buffer_with_length( 3000 );
+  free_buffer( buf );
+
+  buffer *same_class = alloc_buffer_with_length( 4000 );
+  assert_true( same_class == buf );
+  free_buffer( same_class );
+
+  buffer *next_class = alloc_buffer_with_length( 5000 );
+  assert_true( next_class != buf );
+  free_buffer( next_class );
+
+  disable_buffer_cache();
+}
+
+
 /********************************************************************************
  * Run tests.
  ********************************************************************************/
@@ -335,6 +471,8 @@ main() {
   const UnitTest tests[] = {
     unit_test( test_alloc_buffer_succeeds ),
     unit_test( test_alloc_buffer_with_length_succeeds ),
+    unit_test( test_alloc_buffer_with_data_succeeds ),
+    unit_test( test_append_front_buffer_copies_data_not_owned ),
 
     unit_test( test_free_buffer_succeeds ),
 
@@ -342,6 +480,8 @@ main() {
     unit_test( test_append_front_buffer_succeeds ),
     unit_test( test_append_front_buffer_resize_succeeds ),
     unit_test( test_append_front_buffer_new_alloc_succeeds ),
+    unit_test( test_append_front_buffer_uses_headroom ),
+    unit_test( test_reserve_buffer_headroom_resize_succeeds ),
 
     unit_test( test_remove_front_buffer_succeeds ),
     unit_test( test_remove_front_buffer_text_insert_succeeds ),
@@ -356,6 +496,10 @@ main() {
     unit_test( test_duplicate_buffer_succeeds_if_initialize_length_is_0 ),
 
     unit_test( test_dump_buffer ),
+
+    unit_test( test_freed_buffer_is_reused_if_buffer_cache_is_enabled ),
+    unit_test( test_large_buffer_is_not_reused_as_small_buffer ),
+    unit_test( test_buffer_is_reused_within_its_size_class ),
   };
   setup_leak_detector();
   return run_tests( tests );
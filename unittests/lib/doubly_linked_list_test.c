@@ -295,6 +295,28 @@ test_delete_dlist_aborts_with_NULL_dlist() {
 }
 
 
+static void
+test_deleted_elements_are_reused_if_element_cache_is_enabled() {
+  char element_data[] = "alpha";
+
+  enable_dlist_element_cache();
+
+  dlist_element *new_element = create_dlist();
+  dlist_element *deleted = insert_after_dlist( new_element, element_data );
+  assert_true( delete_dlist_element( deleted ) );
+
+  dlist_element *reused = insert_before_dlist( new_element, element_data );
+  assert_true( reused == deleted );
+  assert_true( reused->prev == NULL );
+  assert_true( reused->next == new_element );
+  assert_true( get_first_element( new_element ) == reused );
+
+  delete_dlist( new_element );
+
+  disable_dlist_element_cache();
+}
+
+
 /********************************************************************************
  * Run tests.
  ********************************************************************************/
@@ -332,6 +354,8 @@ main() {
 
     unit_test_setup_teardown( test_delete_dlist_aborts_with_NULL_dlist,
                               setup, teardown ),
+
+    unit_test( test_deleted_elements_are_reused_if_element_cache_is_enabled ),
   };
   setup_leak_detector();
   return run_tests( tests );
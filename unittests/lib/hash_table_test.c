@@ -247,6 +247,74 @@ test_iterate_empty_hash() {
 }
 
 
+static void
+test_grow_and_shrink() {
+  table = create_hash( compare_atom, hash_atom );
+  unsigned int initial_size = table->number_of_buckets;
+
+  for ( uintptr_t i = 1; i <= 1000; i++ ) {
+    insert_hash_entry( table, ( void * ) i, ( void * ) ( i * 2 ) );
+  }
+  assert_int_equal( table->length, 1000 );
+  assert_true( table->number_of_buckets > initial_size );
+  for ( uintptr_t i = 1; i <= 1000; i++ ) {
+    assert_true( lookup_hash_entry( table, ( void * ) i ) == ( void * ) ( i * 2 ) );
+  }
+
+  unsigned int grown_size = table->number_of_buckets;
+  for ( uintptr_t i = 1; i <= 990; i++ ) {
+    assert_true( delete_hash_entry( table, ( void * ) i ) == ( void * ) ( i * 2 ) );
+  }
+  assert_int_equal( table->length, 10 );
+  assert_true( table->number_of_buckets < grown_size );
+  for ( uintptr_t i = 1; i <= 1000; i++ ) {
+    void *expected = i > 990 ? ( void * ) ( i * 2 ) : NULL;
+    assert_true( lookup_hash_entry( table, ( void * ) i ) == expected );
+  }
+
+  delete_hash( table );
+}
+
+
+static void
+test_no_lock_table() {
+  table = create_hash_with_flags( compare_string, hash_string, 4, HASH_TABLE_NO_LOCK );
+
+  insert_hash_entry( table, alpha, bravo );
+  assert_true( insert_hash_entry( table, alpha, charlie ) == bravo );
+  assert_true( lookup_hash_entry( table, alpha ) == charlie );
+  assert_true( delete_hash_entry( table, alpha ) == charlie );
+  assert_true( lookup_hash_entry( table, alpha ) == NULL );
+
+  delete_hash( table );
+}
+
+
+static void
+delete_entry_foreach( void *key, void *value, void *user_data ) {
+  UNUSED( value );
+  delete_hash_entry( user_data, key );
+}
+
+
+static void
+test_delete_in_foreach() {
+  table = create_hash( compare_atom, hash_atom );
+  for ( uintptr_t i = 1; i <= 100; i++ ) {
+    insert_hash_entry( table, ( void * ) i, ( void * ) i );
+  }
+
+  foreach_hash( table, delete_entry_foreach, table );
+
+  assert_int_equal( table->length, 0 );
+  hash_iterator iter;
+  init_hash_iterator( table, &iter );
+  assert_true( iterate_hash_next( &iter ) == NULL );
+
+  delete_hash( table );
+}
+
+
 /********************************************************************************
  * Run tests.
  ********************************************************************************/
@@ -264,6 +332,9 @@ main() {
     unit_test( test_iterator ),
     unit_test( test_multiple_inserts_and_deletes_then_iterate ),
     unit_test( test_iterate_empty_hash ),
+    unit_test( test_grow_and_shrink ),
+    unit_test( test_no_lock_table ),
+    unit_test( test_delete_in_foreach ),
   };
   setup_leak_detector();
   return run_tests( tests );
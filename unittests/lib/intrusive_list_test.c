@@ -0,0 +1,159 @@
+/*
+ * Unit tests for intrusive lists.
+ *
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "cmockery_trema.h"
+#include "intrusive_list.h"
+
+
+typedef struct {
+  const char *name;
+  list_link link;
+} item;
+
+
+static list_link items;
+static item alpha = { "alpha", { NULL, NULL } };
+static item bravo = { "bravo", { NULL, NULL } };
+static item charlie = { "charlie", { NULL, NULL } };
+
+
+/********************************************************************************
+ * Setup and teardown.
+ ********************************************************************************/
+
+static void
+setup() {
+  init_list_link( &items );
+  init_list_link( &alpha.link );
+  init_list_link( &bravo.link );
+  init_list_link( &charlie.link );
+}
+
+
+static void
+teardown() {
+}
+
+
+static const char *
+name_at( list_link *link ) {
+  return LIST_LINK_ENTRY( link, item, link )->name;
+}
+
+
+/********************************************************************************
+ * Tests.
+ ********************************************************************************/
+
+static void
+test_init_list_link() {
+  assert_true( list_link_is_empty( &items ) );
+  assert_int_equal( list_link_length_of( &items ), 0 );
+  assert_false( list_link_is_linked( &alpha.link ) );
+}
+
+
+static void
+test_append_link() {
+  append_link( &items, &alpha.link );
+  append_link( &items, &bravo.link );
+  append_link( &items, &charlie.link );
+
+  assert_false( list_link_is_empty( &items ) );
+  assert_int_equal( list_link_length_of( &items ), 3 );
+  assert_string_equal( name_at( items.next ), "alpha" );
+  assert_string_equal( name_at( items.next->next ), "bravo" );
+  assert_string_equal( name_at( items.next->next->next ), "charlie" );
+  assert_true( items.next->next->next->next == &items );
+  assert_string_equal( name_at( items.prev ), "charlie" );
+}
+
+
+static void
+test_prepend_link() {
+  prepend_link( &items, &alpha.link );
+  prepend_link( &items, &bravo.link );
+
+  assert_string_equal( name_at( items.next ), "bravo" );
+  assert_string_equal( name_at( items.prev ), "alpha" );
+}
+
+
+static void
+test_insert_link_before_and_after() {
+  append_link( &items, &bravo.link );
+  insert_link_before( &bravo.link, &alpha.link );
+  insert_link_after( &bravo.link, &charlie.link );
+
+  assert_string_equal( name_at( items.next ), "alpha" );
+  assert_string_equal( name_at( items.next->next ), "bravo" );
+  assert_string_equal( name_at( items.next->next->next ), "charlie" );
+  assert_true( charlie.link.next == &items );
+}
+
+
+static void
+test_remove_link() {
+  append_link( &items, &alpha.link );
+  append_link( &items, &bravo.link );
+  append_link( &items, &charlie.link );
+
+  remove_link( &bravo.link );
+
+  assert_int_equal( list_link_length_of( &items ), 2 );
+  assert_false( list_link_is_linked( &bravo.link ) );
+  assert_true( alpha.link.next == &charlie.link );
+  assert_true( charlie.link.prev == &alpha.link );
+
+  remove_link( &bravo.link );
+  assert_int_equal( list_link_length_of( &items ), 2 );
+
+  remove_link( &alpha.link );
+  remove_link( &charlie.link );
+  assert_true( list_link_is_empty( &items ) );
+}
+
+
+/********************************************************************************
+ * Run tests.
+ ********************************************************************************/
+
+int
+main() {
+  const UnitTest tests[] = {
+    unit_test_setup_teardown( test_init_list_link, setup, teardown ),
+    unit_test_setup_teardown( test_append_link, setup, teardown ),
+    unit_test_setup_teardown( test_prepend_link, setup, teardown ),
+    unit_test_setup_teardown( test_insert_link_before_and_after, setup, teardown ),
+    unit_test_setup_teardown( test_remove_link, setup, teardown ),
+  };
+  setup_leak_detector();
+  return run_tests( tests );
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
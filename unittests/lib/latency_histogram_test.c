@@ -0,0 +1,129 @@
+/*
+ * Unit tests for latency histograms.
+ *
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "cmockery_trema.h"
+#include "latency_histogram.h"
+
+
+static latency_histogram histogram;
+
+
+/********************************************************************************
+ * Setup and teardown.
+ ********************************************************************************/
+
+static void
+setup() {
+  init_latency_histogram( &histogram );
+}
+
+
+static void
+teardown() {
+}
+
+
+/********************************************************************************
+ * Tests.
+ ********************************************************************************/
+
+static void
+test_init_latency_histogram() {
+  add_latency_sample( &histogram, 10 );
+  init_latency_histogram( &histogram );
+
+  assert_int_equal( histogram.count, 0 );
+  assert_int_equal( histogram.total, 0 );
+  assert_int_equal( histogram.max, 0 );
+  assert_int_equal( latency_percentile( &histogram, 50 ), 0 );
+}
+
+
+static void
+test_add_latency_sample() {
+  add_latency_sample( &histogram, 0 );
+  add_latency_sample( &histogram, 1 );
+  add_latency_sample( &histogram, 3 );
+  add_latency_sample( &histogram, 4 );
+  add_latency_sample( &histogram, UINT64_MAX / 2 );
+
+  assert_int_equal( histogram.count, 5 );
+  assert_int_equal( histogram.max, UINT64_MAX / 2 );
+  assert_int_equal( histogram.buckets[ 0 ], 1 );
+  assert_int_equal( histogram.buckets[ 1 ], 1 );
+  assert_int_equal( histogram.buckets[ 2 ], 1 );
+  assert_int_equal( histogram.buckets[ 3 ], 1 );
+  assert_int_equal( histogram.buckets[ LATENCY_HISTOGRAM_BUCKETS - 1 ], 1 );
+}
+
+
+static void
+test_latency_percentile() {
+  for ( uint64_t usec = 1; usec <= 100; usec++ ) {
+    add_latency_sample( &histogram, usec );
+  }
+
+  assert_int_equal( histogram.total, 5050 );
+  assert_int_equal( latency_percentile( &histogram, 0 ), 2 );
+  assert_int_equal( latency_percentile( &histogram, 50 ), 64 );
+  assert_int_equal( latency_percentile( &histogram, 99 ), 100 );
+  assert_int_equal( latency_percentile( &histogram, 100 ), 100 );
+}
+
+
+static void
+test_record_latency() {
+  struct timespec start;
+  clock_gettime( CLOCK_MONOTONIC, &start );
+  start.tv_sec -= 1;
+
+  uint64_t usec = record_latency( &histogram, &start );
+
+  assert_true( usec >= 1000000 );
+  assert_int_equal( histogram.count, 1 );
+  assert_int_equal( histogram.max, usec );
+}
+
+
+/********************************************************************************
+ * Run tests.
+ ********************************************************************************/
+
+int
+main() {
+  const UnitTest tests[] = {
+    unit_test_setup_teardown( test_init_latency_histogram, setup, teardown ),
+    unit_test_setup_teardown( test_add_latency_sample, setup, teardown ),
+    unit_test_setup_teardown( test_latency_percentile, setup, teardown ),
+    unit_test_setup_teardown( test_record_latency, setup, teardown ),
+  };
+  setup_leak_detector();
+  return run_tests( tests );
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
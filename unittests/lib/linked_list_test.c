@@ -293,6 +293,26 @@ test_delete_list() {
 }
 
 
+static void
+test_deleted_elements_are_reused_if_element_cache_is_enabled() {
+  enable_list_element_cache();
+
+  create_list( &new_list );
+  append_to_tail( &new_list, alpha );
+  list_element *deleted = new_list;
+  delete_list( new_list );
+
+  create_list( &new_list );
+  insert_in_front( &new_list, bravo );
+  assert_true( new_list == deleted );
+  assert_string_equal( new_list->data, "bravo" );
+  assert_true( new_list->next == NULL );
+  delete_list( new_list );
+
+  disable_list_element_cache();
+}
+
+
 /********************************************************************************
  * Run tests.
  ********************************************************************************/
@@ -329,6 +349,8 @@ main() {
     unit_test( test_list_length_of_empty_list ),
 
     unit_test( test_delete_list ),
+
+    unit_test( test_deleted_elements_are_reused_if_element_cache_is_enabled ),
   };
   setup_leak_detector();
   return run_tests( tests );
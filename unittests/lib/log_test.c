@@ -24,6 +24,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <syslog.h>
+#include <unistd.h>
+#include <sys/wait.h>
 #include "checks.h"
 #include "cmockery_trema.h"
 #include "log.h"
@@ -488,6 +490,75 @@ test_output_to_syslog() {
 }
 
 
+/********************************************************************************
+ * Log writer tests.
+ ********************************************************************************/
+
+void
+test_log_writer_writes_queued_messages_in_order() {
+  expect_string( mock_fprintf, output, "First message.\n" );
+  expect_string( mock_fprintf, output, "Second message.\n" );
+
+  assert_true( start_log_writer() );
+  info( "First message." );
+  info( "Second message." );
+  assert_true( stop_log_writer() );
+}
+
+
+void
+test_critical_is_written_after_queued_messages() {
+  expect_string( mock_fprintf, output, "INFO message.\n" );
+  expect_string( mock_fprintf, output, "CRITICAL message.\n" );
+
+  assert_true( start_log_writer() );
+  info( "INFO message." );
+  critical( "CRITICAL message." );
+  assert_true( stop_log_writer() );
+}
+
+
+static bool child_message_written = false;
+
+static int
+mock_fprintf_in_child( FILE *stream, const char *format, ... ) {
+  UNUSED( stream );
+  UNUSED( format );
+
+  child_message_written = true;
+
+  return 0;
+}
+
+
+void
+test_child_logs_synchronously_after_fork() {
+  assert_true( start_log_writer() );
+
+  pid_t pid = fork();
+  if ( pid == 0 ) {
+    trema_fprintf = mock_fprintf_in_child;
+    info( "Child message." );
+    _exit( child_message_written && !stop_log_writer() ? 0 : 1 );
+  }
+  assert_true( pid > 0 );
+  int status;
+  assert_int_equal( waitpid( pid, &status, 0 ), pid );
+  assert_true( WIFEXITED( status ) );
+  assert_int_equal( WEXITSTATUS( status ), 0 );
+
+  expect_string( mock_fprintf, output, "Parent message.\n" );
+  info( "Parent message." );
+  assert_true( stop_log_writer() );
+}
+
+
+void
+test_stop_log_writer_fails_if_not_started() {
+  assert_false( stop_log_writer() );
+}
+
+
 /********************************************************************************
  * Run tests.
  ********************************************************************************/
@@ -570,6 +641,15 @@ main() {
                               setup_logger_file_stdout, teardown ),
     unit_test_setup_teardown( test_output_to_syslog,
                               setup_logger_syslog, teardown ),
+
+    unit_test_setup_teardown( test_log_writer_writes_queued_messages_in_order,
+                              setup_logger_file, teardown ),
+    unit_test_setup_teardown( test_critical_is_written_after_queued_messages,
+                              setup_logger_file, teardown ),
+    unit_test_setup_teardown( test_child_logs_synchronously_after_fork,
+                              setup_logger_file, teardown ),
+    unit_test_setup_teardown( test_stop_log_writer_fails_if_not_started,
+                              setup_logger_file, teardown ),
   };
   return run_tests( tests );
 }
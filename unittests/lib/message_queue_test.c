@@ -258,6 +258,35 @@ test_peek_message_if_queue_is_not_created() {
 }
 
 
+static void
+test_peek_messages() {
+  message_queue *queue = create_message_queue();
+  assert_true( queue != NULL );
+
+  buffer *messages[ 2 ];
+  assert_int_equal( peek_messages( queue, messages, 2 ), 0 );
+
+  buffer *first_buf = alloc_buffer();
+  assert_true( enqueue_message( queue, first_buf ) );
+  buffer *second_buf = alloc_buffer();
+  assert_true( enqueue_message( queue, second_buf ) );
+  buffer *third_buf = alloc_buffer();
+  assert_true( enqueue_message( queue, third_buf ) );
+
+  assert_int_equal( peek_messages( queue, messages, 2 ), 2 );
+  assert_true( messages[ 0 ] == first_buf );
+  assert_true( messages[ 1 ] == second_buf );
+  assert_int_equal( queue->length, 3 );
+
+  free_buffer( dequeue_message( queue ) );
+  free_buffer( dequeue_message( queue ) );
+  assert_int_equal( peek_messages( queue, messages, 2 ), 1 );
+  assert_true( messages[ 0 ] == third_buf );
+
+  assert_true( delete_message_queue( queue ) );
+}
+
+
 /*************************************************************************
  * foreach_message_queue tests.
  *************************************************************************/
@@ -363,6 +392,7 @@ main() {
     unit_test_setup_teardown( test_dequeue_message_if_queue_is_not_created, setup, teardown ),
     unit_test_setup_teardown( test_peek_message, setup, teardown ),
     unit_test_setup_teardown( test_peek_message_if_queue_is_not_created, setup, teardown ),
+    unit_test_setup_teardown( test_peek_messages, setup, teardown ),
     unit_test_setup_teardown( test_foreach_message_queue, setup, teardown ),
     unit_test_setup_teardown( test_foreach_message_queue_if_queue_is_empty, setup, teardown ),
   };
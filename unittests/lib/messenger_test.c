@@ -47,12 +47,15 @@ enum {
   MESSAGE_TYPE_NOTIFY,
   MESSAGE_TYPE_REQUEST,
   MESSAGE_TYPE_REPLY,
+  MESSAGE_TYPE_SHM_OFFER,
+  MESSAGE_TYPE_SHM_REJECT,
 };
 
 typedef struct message_buffer {
   void *buffer;
   size_t data_length;
   size_t size;
+  size_t head_offset;
 } message_buffer;
 
 typedef struct messenger_socket {
@@ -100,7 +103,7 @@ static void on_send( int fd, send_queue *queue );
 static receive_queue *create_receive_queue( const char *service_name );
 static void delete_all_receive_queues( void );
 static void delete_receive_queue( void *service_name, void *queue, void *user_data );
-static int pull_from_recv_queue( receive_queue *queue, uint8_t *message_type, uint16_t *tag, void *data, size_t *len, size_t maxlen );
+static int pull_from_recv_queue( receive_queue *queue, uint8_t *message_type, uint16_t *tag, void **data, size_t *len );
 static void set_recv_queue_fd_set( fd_set *read_set );
 static void check_recv_queue_fd_isset( fd_set *read_set );
 static void add_recv_queue_client_fd( receive_queue *queue, int fd );
@@ -112,7 +115,7 @@ static int send_queue_connect( send_queue *queue );
 static void delete_all_send_queues( void );
 static void delete_send_queue( send_queue *sq );
 static void number_of_send_queue( int *connected_count, int *sending_count, int *reconnecting_count, int *closed_count );
-static bool push_message_to_send_queue( const char *service_name, const uint8_t message_type, const uint16_t tag, const void *data, size_t len );
+static bool push_message_to_send_queue( const char *service_name, const uint8_t message_type, const uint16_t tag, const void *data, size_t len, int priority );
 static void set_send_queue_fd_set( fd_set *read_set, fd_set *write_set );
 static void check_send_queue_fd_isset( fd_set *read_set, fd_set *write_set );
 
@@ -124,6 +127,8 @@ static size_t message_buffer_remain_bytes( message_buffer *buf );
 
 static void delete_timer_callbacks( void );
 
+static bool shm_transport_enabled;
+
 static messenger_context* insert_context( void *user_data );
 static messenger_context* get_context( uint32_t transaction_id );
 static void delete_context( messenger_context *context );
@@ -238,12 +243,71 @@ mock_recv( int sockfd, void *buf, size_t len, int flags ) {
 
 
 static bool fail_mock_send = false;
+static int shm_reject_count = 0;
 ssize_t
 mock_send( int sockfd, const void *buf, size_t len, int flags ) {
+  if ( len >= sizeof( message_header ) && ( ( const message_header * ) buf )->message_type == MESSAGE_TYPE_SHM_REJECT ) {
+    shm_reject_count++;
+  }
   return fail_mock_send ? -1 : send( sockfd, buf, len, flags );
 }
 
 
+static bool fail_mock_recvmsg = false;
+static bool coalesce_mock_recvmsg = false;
+ssize_t
+mock_recvmsg( int sockfd, struct msghdr *msg, int flags ) {
+  if ( fail_mock_recvmsg ) {
+    return -1;
+  }
+
+  size_t controllen = msg->msg_controllen;
+  ssize_t ret = recvmsg( sockfd, msg, flags );
+  if ( !coalesce_mock_recvmsg || ret <= 0 || msg->msg_controllen > 0 ) {
+    return ret;
+  }
+
+  // Returns the next packet along with this one as a stream socket does.
+  struct iovec iov[ 2 ];
+  size_t n = 0;
+  size_t skip = ( size_t ) ret;
+  for ( size_t i = 0; i < msg->msg_iovlen && n < 2; i++ ) {
+    if ( skip >= msg->msg_iov[ i ].iov_len ) {
+      skip -= msg->msg_iov[ i ].iov_len;
+      continue;
+    }
+    iov[ n ].iov_base = ( char * ) msg->msg_iov[ i ].iov_base + skip;
+    iov[ n ].iov_len = msg->msg_iov[ i ].iov_len - skip;
+    skip = 0;
+    n++;
+  }
+  if ( n == 0 ) {
+    return ret;
+  }
+  struct msghdr next;
+  memset( &next, 0, sizeof( next ) );
+  next.msg_iov = iov;
+  next.msg_iovlen = n;
+  next.msg_control = msg->msg_control;
+  next.msg_controllen = controllen;
+  ssize_t more = recvmsg( sockfd, &next, flags | MSG_DONTWAIT );
+  if ( more <= 0 ) {
+    return ret;
+  }
+  msg->msg_controllen = next.msg_controllen;
+  msg->msg_flags |= next.msg_flags;
+
+  return ret + more;
+}
+
+
+static bool fail_mock_sendmsg = false;
+ssize_t
+mock_sendmsg( int sockfd, const struct msghdr *msg, int flags ) {
+  return fail_mock_sendmsg ? -1 : sendmsg( sockfd, msg, flags );
+}
+
+
 int
 mock_setsockopt( int s, int level, int optname, const void *optval, socklen_t optlen ) {
   UNUSED( s );
@@ -400,6 +464,301 @@ test_send_then_message_received_callback_is_called() {
 }
 
 
+static void
+test_send_without_shm_ring_then_message_received_callback_is_called() {
+  init_messenger( "/tmp" );
+  shm_transport_enabled = false;
+
+  const char service_name[] = "Say HELLO over socket";
+
+  expect_value( callback_hello, tag, 43556 );
+  expect_string( callback_hello, data, "HELLO" );
+  expect_value( callback_hello, len, 6 );
+
+  add_message_received_callback( service_name, callback_hello );
+  send_message( service_name, 43556, "HELLO", strlen( "HELLO" ) + 1 );
+  start_messenger();
+  start_event_handler();
+
+  delete_message_received_callback( service_name, callback_hello );
+  delete_send_queue( lookup_hash_entry( send_queues, service_name ) );
+
+  finalize_messenger();
+  shm_transport_enabled = true;
+}
+
+
+static void
+test_send_falls_back_to_socket_if_shm_ring_is_not_passed() {
+  init_messenger( "/tmp" );
+  fail_mock_sendmsg = true;
+
+  const char service_name[] = "Say HELLO without ring";
+
+  expect_value( callback_hello, tag, 43556 );
+  expect_string( callback_hello, data, "HELLO" );
+  expect_value( callback_hello, len, 6 );
+
+  add_message_received_callback( service_name, callback_hello );
+  send_message( service_name, 43556, "HELLO", strlen( "HELLO" ) + 1 );
+  start_messenger();
+  start_event_handler();
+
+  delete_message_received_callback( service_name, callback_hello );
+  delete_send_queue( lookup_hash_entry( send_queues, service_name ) );
+
+  finalize_messenger();
+  fail_mock_sendmsg = false;
+}
+
+
+static const char coalesced_service_name[] = "Say HELLO then offer a ring";
+
+static void
+callback_send_through_ring( uint16_t tag, void *data, size_t len ) {
+  UNUSED( data );
+  UNUSED( len );
+
+  check_expected( tag );
+
+  if ( tag == 1 ) {
+    // The ring is offered once the first message leaves the socket.
+    assert_true( send_message( coalesced_service_name, 2, "RING", 5 ) );
+    return;
+  }
+  stop_event_handler();
+  stop_messenger();
+}
+
+
+static void
+test_message_received_with_shm_ring_offer_in_one_read() {
+  init_messenger( "/tmp" );
+  coalesce_mock_recvmsg = true;
+  shm_reject_count = 0;
+
+  expect_value( callback_send_through_ring, tag, 1 );
+  expect_value( callback_send_through_ring, tag, 2 );
+
+  add_message_received_callback( coalesced_service_name, callback_send_through_ring );
+  // Connects without a ring so that it is offered right after the message.
+  shm_transport_enabled = false;
+  send_message( coalesced_service_name, 1, "SOCKET", strlen( "SOCKET" ) + 1 );
+  shm_transport_enabled = true;
+  start_messenger();
+  start_event_handler();
+  assert_int_equal( shm_reject_count, 0 );
+
+  delete_message_received_callback( coalesced_service_name, callback_send_through_ring );
+  delete_send_queue( lookup_hash_entry( send_queues, coalesced_service_name ) );
+
+  finalize_messenger();
+  coalesce_mock_recvmsg = false;
+}
+
+
+static int received_count = 0;
+static int expected_count = 0;
+
+static void
+callback_count( uint16_t tag, void *data, size_t len ) {
+  UNUSED( data );
+  UNUSED( len );
+
+  check_expected( tag );
+
+  if ( ++received_count == expected_count ) {
+    stop_event_handler();
+    stop_messenger();
+  }
+}
+
+
+static void
+test_control_message_is_sent_before_bulk_messages() {
+  init_messenger( "/tmp" );
+  shm_transport_enabled = false;
+  received_count = 0;
+  expected_count = 2;
+
+  const char service_name[] = "Say HELLO in lanes";
+
+  expect_value( callback_count, tag, 2 );
+  expect_value( callback_count, tag, 1 );
+
+  add_message_received_callback( service_name, callback_count );
+  assert_true( send_message_with_priority( service_name, 1, "BULK", 5, MESSENGER_PRIORITY_BULK ) );
+  assert_true( send_message_with_priority( service_name, 2, "CONTROL", 8, MESSENGER_PRIORITY_CONTROL ) );
+  start_messenger();
+  start_event_handler();
+
+  delete_message_received_callback( service_name, callback_count );
+  delete_send_queue( lookup_hash_entry( send_queues, service_name ) );
+
+  finalize_messenger();
+  shm_transport_enabled = true;
+}
+
+
+static void
+test_fence_keeps_order_with_both_lanes() {
+  init_messenger( "/tmp" );
+  shm_transport_enabled = false;
+  received_count = 0;
+  expected_count = 4;
+
+  const char service_name[] = "Say HELLO behind a fence";
+
+  expect_value( callback_count, tag, 1 );
+  expect_value( callback_count, tag, 2 );
+  expect_value( callback_count, tag, 3 );
+  expect_value( callback_count, tag, 4 );
+
+  add_message_received_callback( service_name, callback_count );
+  assert_true( send_message_with_priority( service_name, 1, "CONTROL", 8, MESSENGER_PRIORITY_CONTROL ) );
+  assert_true( send_message_with_priority( service_name, 2, "BULK", 5, MESSENGER_PRIORITY_BULK ) );
+  assert_true( send_message_with_priority( service_name, 3, "FENCE", 6, MESSENGER_PRIORITY_FENCE ) );
+  assert_true( send_message_with_priority( service_name, 4, "CONTROL", 8, MESSENGER_PRIORITY_CONTROL ) );
+  start_messenger();
+  start_event_handler();
+
+  delete_message_received_callback( service_name, callback_count );
+  delete_send_queue( lookup_hash_entry( send_queues, service_name ) );
+
+  finalize_messenger();
+  shm_transport_enabled = true;
+}
+
+
+static void
+test_message_tag_priority() {
+  assert_int_equal( get_message_tag_priority( 4321 ), MESSENGER_PRIORITY_BULK );
+  assert_true( set_message_tag_priority( 4321, MESSENGER_PRIORITY_CONTROL ) );
+  assert_int_equal( get_message_tag_priority( 4321 ), MESSENGER_PRIORITY_CONTROL );
+  assert_int_equal( get_message_tag_priority( 4320 ), MESSENGER_PRIORITY_BULK );
+  assert_true( set_message_tag_priority( 4321, MESSENGER_PRIORITY_BULK ) );
+  assert_int_equal( get_message_tag_priority( 4321 ), MESSENGER_PRIORITY_BULK );
+  assert_false( set_message_tag_priority( 4321, MESSENGER_PRIORITY_FENCE ) );
+  assert_false( set_message_tag_priority( 4321, MESSENGER_PRIORITY_MAX ) );
+}
+
+
+static void
+callback_send_queue_pressure_count( const char *service_name, bool congested, void *user_data ) {
+  check_expected( service_name );
+  check_expected( congested );
+  check_expected( user_data );
+}
+
+
+static void
+test_send_queue_watermarks() {
+  init_messenger( "/tmp" );
+  shm_transport_enabled = false;
+
+  const char service_name[] = "Say HELLO under pressure";
+  char data[ 1000 ];
+  memset( data, 0, sizeof( data ) );
+  size_t length, size;
+
+  assert_false( set_send_queue_watermarks( 25, 75, callback_send_queue_pressure_count, NULL ) );
+  assert_false( set_send_queue_watermarks( 101, 25, callback_send_queue_pressure_count, NULL ) );
+  assert_true( set_send_queue_watermarks( 75, 25, callback_send_queue_pressure_count, data ) );
+  assert_false( get_send_queue_occupancy( service_name, &length, &size ) );
+
+  add_message_received_callback( service_name, callback_hello );
+  assert_true( send_message( service_name, 1, data, sizeof( data ) ) );
+  assert_true( get_send_queue_occupancy( service_name, &length, &size ) );
+  assert_true( length >= sizeof( data ) );
+
+  expect_string( callback_send_queue_pressure_count, service_name, service_name );
+  expect_value( callback_send_queue_pressure_count, congested, true );
+  expect_value( callback_send_queue_pressure_count, user_data, data );
+  while ( length * 100 < size * 75 ) {
+    assert_true( send_message( service_name, 1, data, sizeof( data ) ) );
+    assert_true( get_send_queue_occupancy( service_name, &length, &size ) );
+  }
+
+  expect_string( callback_send_queue_pressure_count, service_name, service_name );
+  expect_value( callback_send_queue_pressure_count, congested, false );
+  expect_value( callback_send_queue_pressure_count, user_data, data );
+  assert_true( clear_send_queue( service_name ) );
+  assert_true( get_send_queue_occupancy( service_name, &length, &size ) );
+  assert_int_equal( length, 0 );
+
+  delete_message_received_callback( service_name, callback_hello );
+  delete_send_queue( lookup_hash_entry( send_queues, service_name ) );
+
+  finalize_messenger();
+  shm_transport_enabled = true;
+}
+
+
+static void
+test_delete_congested_send_queue_reports_relief() {
+  init_messenger( "/tmp" );
+  shm_transport_enabled = false;
+
+  const char service_name[] = "Say HELLO and leave";
+  char data[ 1000 ];
+  memset( data, 0, sizeof( data ) );
+  size_t length = 0, size = 1;
+
+  assert_true( set_send_queue_watermarks( 75, 25, callback_send_queue_pressure_count, data ) );
+  add_message_received_callback( service_name, callback_hello );
+
+  expect_string( callback_send_queue_pressure_count, service_name, service_name );
+  expect_value( callback_send_queue_pressure_count, congested, true );
+  expect_value( callback_send_queue_pressure_count, user_data, data );
+  while ( length * 100 < size * 75 ) {
+    assert_true( send_message( service_name, 1, data, sizeof( data ) ) );
+    assert_true( get_send_queue_occupancy( service_name, &length, &size ) );
+  }
+
+  expect_string( callback_send_queue_pressure_count, service_name, service_name );
+  expect_value( callback_send_queue_pressure_count, congested, false );
+  expect_value( callback_send_queue_pressure_count, user_data, data );
+  delete_send_queue( lookup_hash_entry( send_queues, service_name ) );
+  assert_false( get_send_queue_occupancy( service_name, &length, &size ) );
+
+  delete_message_received_callback( service_name, callback_hello );
+
+  finalize_messenger();
+  shm_transport_enabled = true;
+}
+
+/********************************************************************************
+ * Message buffer tests.
+ ********************************************************************************/
+
+static void
+test_write_message_buffer_wraps_around_without_moving_data() {
+  message_buffer *buf = create_message_buffer( 16 );
+
+  assert_true( write_message_buffer( buf, "0123456789ab", 12 ) );
+  truncate_message_buffer( buf, 8 );
+  assert_int_equal( buf->head_offset, 8 );
+  assert_int_equal( message_buffer_remain_bytes( buf ), 12 );
+
+  assert_true( write_message_buffer( buf, "ABCDEFGHIJ", 10 ) );
+  assert_int_equal( buf->head_offset, 8 );
+  assert_int_equal( buf->data_length, 14 );
+  assert_memory_equal( ( char * ) buf->buffer + 8, "89abABCD", 8 );
+  assert_memory_equal( buf->buffer, "EFGHIJ", 6 );
+  assert_false( write_message_buffer( buf, "KLM", 3 ) );
+
+  truncate_message_buffer( buf, 10 );
+  assert_int_equal( buf->head_offset, 2 );
+  assert_int_equal( buf->data_length, 4 );
+
+  truncate_message_buffer( buf, 4 );
+  assert_int_equal( buf->head_offset, 0 );
+  assert_int_equal( buf->data_length, 0 );
+
+  free_message_buffer( buf );
+}
+
+
 /********************************************************************************
  * Run tests.
  ********************************************************************************/
@@ -425,6 +784,27 @@ main() {
     unit_test_setup_teardown( test_send_then_message_received_callback_is_called,
                               reset_messenger,
                               reset_messenger ),
+    unit_test_setup_teardown( test_send_without_shm_ring_then_message_received_callback_is_called,
+                              reset_messenger,
+                              reset_messenger ),
+    unit_test_setup_teardown( test_send_falls_back_to_socket_if_shm_ring_is_not_passed,
+                              reset_messenger,
+                              reset_messenger ),
+    unit_test_setup_teardown( test_message_received_with_shm_ring_offer_in_one_read,
+                              reset_messenger,
+                              reset_messenger ),
+    unit_test_setup_teardown( test_control_message_is_sent_before_bulk_messages,
+                              reset_messenger,
+                              reset_messenger ),
+    unit_test_setup_teardown( test_fence_keeps_order_with_both_lanes,
+                              reset_messenger,
+                              reset_messenger ),
+    unit_test( test_message_tag_priority ),
+    unit_test( test_send_queue_watermarks ),
+    unit_test( test_delete_congested_send_queue_reports_relief ),
+
+    // Message buffer tests.
+    unit_test( test_write_message_buffer_wraps_around_without_moving_data ),
   };
   return run_tests( tests );
 }
@@ -170,6 +170,7 @@ static uint8_t USER_DATA[ USER_DATA_LEN ];
 
 
 static bool packet_in_handler_called = false;
+static const void *expected_packet_in_frame = NULL;
 
 
 /********************************************************************************
@@ -215,13 +216,14 @@ mock_add_message_replied_callback( char *service_name,
 
 
 bool
-mock_send_message( char *service_name, uint16_t tag, void *data, size_t len ) {
+mock_send_message_with_priority( char *service_name, uint16_t tag, void *data, size_t len, int priority ) {
   uint32_t tag32 = tag;
 
   check_expected( service_name );
   check_expected( tag32 );
   check_expected( data );
   check_expected( len );
+  check_expected( priority );
 
   return ( bool ) mock();
 }
@@ -271,13 +273,6 @@ mock_clear_send_queue( const char *service_name ) {
 }
 
 
-bool
-mock_parse_packet( buffer *buf ) {
-  calloc_packet_info( buf );
-  return ( bool ) mock();
-}
-
-
 static void
 mock_switch_disconnected_handler( uint64_t datapath_id, void *user_data ) {
   check_expected( &datapath_id );
@@ -464,6 +459,35 @@ mock_simple_packet_in_handler( uint64_t dpid, packet_in event ) {
 }
 
 
+static void
+mock_deferred_packet_in_handler( uint64_t datapath_id, uint32_t transaction_id, uint32_t buffer_id,
+                                 uint16_t total_len, uint8_t reason, uint8_t table_id, uint64_t cookie,
+                                 const oxm_matches *match, const buffer *data, void *user_data ) {
+  UNUSED( datapath_id );
+  UNUSED( transaction_id );
+  UNUSED( buffer_id );
+  UNUSED( total_len );
+  UNUSED( reason );
+  UNUSED( table_id );
+  UNUSED( cookie );
+  UNUSED( match );
+  UNUSED( user_data );
+
+  // the frame is not copied out of the message
+  assert_true( data->data == expected_packet_in_frame );
+
+  // nor parsed until packet_info is looked at
+  const packet_info *info = data->user_data;
+  assert_true( info != NULL );
+  assert_int_equal( info->format, 0 );
+  assert_int_equal( get_packet_info( data ).format, ETH_IPV4_UDP );
+  assert_int_equal( info->format, ETH_IPV4_UDP );
+  assert_int_equal( info->udp_dst_port, 53 );
+
+  packet_in_handler_called = true;
+}
+
+
 static void
 mock_flow_removed_handler( uint64_t datapath_id, uint32_t transaction_id, uint64_t cookie, uint16_t priority,
                            uint8_t reason, uint8_t table_id, uint32_t duration_sec, uint32_t duration_nsec,
@@ -1503,11 +1527,12 @@ test_send_openflow_message() {
           SERVICE_NAME, strlen( SERVICE_NAME ) + 1 );
   memcpy( ( char * ) expected_data + header_length, buffer->data, buffer->length );
 
-  expect_string( mock_send_message, service_name, REMOTE_SERVICE_NAME );
-  expect_value( mock_send_message, tag32, MESSENGER_OPENFLOW_MESSAGE );
-  expect_value( mock_send_message, len, expected_length );
-  expect_memory( mock_send_message, data, expected_data, expected_length );
-  will_return( mock_send_message, true );
+  expect_string( mock_send_message_with_priority, service_name, REMOTE_SERVICE_NAME );
+  expect_value( mock_send_message_with_priority, tag32, MESSENGER_OPENFLOW_MESSAGE );
+  expect_value( mock_send_message_with_priority, len, expected_length );
+  expect_memory( mock_send_message_with_priority, data, expected_data, expected_length );
+  expect_value( mock_send_message_with_priority, priority, MESSENGER_PRIORITY_CONTROL );
+  will_return( mock_send_message_with_priority, true );
 
   ret = send_openflow_message( DATAPATH_ID, buffer );
   
@@ -2046,7 +2071,6 @@ test_handle_packet_in() {
 
   buffer *buffer = create_packet_in( TRANSACTION_ID, buffer_id, total_len, reason, table_id, cookie, match, data );
   
-  will_return( mock_parse_packet, true );
   expect_memory( mock_packet_in_handler, &datapath_id, &DATAPATH_ID, sizeof( uint64_t ) );
   expect_value( mock_packet_in_handler, transaction_id, TRANSACTION_ID );
   expect_value( mock_packet_in_handler, buffer_id, buffer_id );
@@ -2105,7 +2129,6 @@ test_handle_packet_in_with_simple_handler() {
 
   buffer *buffer = create_packet_in( TRANSACTION_ID, buffer_id, total_len, reason, table_id, cookie, match, data );
   
-  will_return( mock_parse_packet, true );
   expect_memory( mock_simple_packet_in_handler, &datapath_id, &DATAPATH_ID, sizeof( uint64_t ) );
   expect_value( mock_simple_packet_in_handler, transaction_id, TRANSACTION_ID );
   expect_value( mock_simple_packet_in_handler, buffer_id, buffer_id );
@@ -2128,50 +2151,37 @@ test_handle_packet_in_with_simple_handler() {
 
 
 static void
-test_handle_packet_in_with_malformed_packet() {
+test_handle_packet_in_defers_parsing_frame() {
   uint32_t buffer_id = 0x01020304;
   uint8_t reason = OFPR_NO_MATCH;
   uint8_t table_id = 0x01;
   uint64_t cookie = 0xAAAABBBBCCCCDDDD;
-  oxm_matches *match;
-  size_t match1_len, match2_len;
-  oxm_match_header *queue[ 2 ];
-  uint32_t* value;
-  
-  match1_len = ( sizeof( oxm_match_header ) + OXM_LENGTH( OXM_OF_IN_PORT ) );
-  queue[ 0 ] = xcalloc( 1, match1_len );
-  value = ( uint32_t* ) (queue[ 0 ] + 1);
-  *queue[ 0 ] = OXM_OF_IN_PORT;
-  *value = 0x2468ACEF;
-    
-  match2_len = ( sizeof( oxm_match_header ) + OXM_LENGTH( OXM_OF_IN_PHY_PORT ) );
-  queue[ 1 ] = xcalloc( 1, match2_len );
-  value = ( uint32_t* ) (queue[ 1 ] + 1);
-  *queue[ 1 ] = OXM_OF_IN_PHY_PORT;
-  *value = 0xFECA8642;
-
-  match = create_oxm_matches();
-  match->n_matches = 2;
-  append_to_tail( &match->list, queue[ 0 ] );
-  append_to_tail( &match->list, queue[ 1 ] );
+  oxm_matches *match = create_oxm_matches();
+  append_oxm_match_in_port( match, 0x2468ACEF );
+  append_oxm_match_in_phy_port( match, 0xFECA8642 );
 
   buffer *data = alloc_buffer_with_length( 64 );
-  calloc_packet_info( data );
-  append_back_buffer( data, 64 );
-  memset( data->data, 0x01, 64 );
-  uint16_t total_len = ( uint16_t ) data->length ;
-
-  buffer *buffer = create_packet_in( TRANSACTION_ID, buffer_id, total_len, reason, table_id, cookie, match, data );
-
-  will_return( mock_parse_packet, false );
-
-  set_packet_in_handler( mock_packet_in_handler, USER_DATA );
-
+  uint8_t *frame = append_back_buffer( data, 64 );
+  memset( frame, 0, 64 );
+  memcpy( frame, MAC_ADDR_X, OFP_ETH_ALEN );
+  memcpy( frame + OFP_ETH_ALEN, MAC_ADDR_Y, OFP_ETH_ALEN );
+  frame[ 12 ] = 0x08; // IPv4
+  frame[ 14 ] = 0x45;
+  frame[ 17 ] = 50;
+  frame[ 22 ] = 64;
+  frame[ 23 ] = IPPROTO_UDP;
+  frame[ 37 ] = 53;
+  frame[ 39 ] = 30;
+
+  buffer *buffer = create_packet_in( TRANSACTION_ID, buffer_id, ( uint16_t ) data->length, reason, table_id, cookie, match, data );
+  expected_packet_in_frame = ( char * ) buffer->data + buffer->length - data->length;
+
+  set_packet_in_handler( mock_deferred_packet_in_handler, USER_DATA );
   handle_packet_in( DATAPATH_ID, buffer );
 
-  assert_false( packet_in_handler_called );
+  assert_true( packet_in_handler_called );
 
-  delete_oxm_matches(match);
+  delete_oxm_matches( match );
   free_buffer( buffer );
   free_buffer( data );
 }
@@ -4345,7 +4355,6 @@ test_handle_openflow_message() {
     buffer *buffer = create_packet_in( TRANSACTION_ID, buffer_id, total_len, reason, table_id, cookie, match, data );
     append_front_buffer( buffer, sizeof( openflow_service_header_t ) );
     memcpy( buffer->data, &messenger_header, sizeof( openflow_service_header_t ) );
-    will_return( mock_parse_packet, true );
     expect_memory( mock_packet_in_handler, &datapath_id, &DATAPATH_ID, sizeof( uint64_t ) );
     expect_value( mock_packet_in_handler, transaction_id, TRANSACTION_ID );
     expect_value( mock_packet_in_handler, buffer_id, buffer_id );
@@ -5931,7 +5940,7 @@ main() {
     unit_test_setup_teardown( test_set_packet_in_handler_should_die_if_handler_is_NULL, init, cleanup ),
     unit_test_setup_teardown( test_handle_packet_in, init, cleanup ),
     unit_test_setup_teardown( test_handle_packet_in_with_simple_handler, init, cleanup ),
-    unit_test_setup_teardown( test_handle_packet_in_with_malformed_packet, init, cleanup ),
+    unit_test_setup_teardown( test_handle_packet_in_defers_parsing_frame, init, cleanup ),
     unit_test_setup_teardown( test_handle_packet_in_without_data, init, cleanup ),
     unit_test_setup_teardown( test_handle_packet_in_without_handler, init, cleanup ),
     unit_test_setup_teardown( test_handle_packet_in_should_die_if_message_is_NULL, init, cleanup ),
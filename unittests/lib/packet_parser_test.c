@@ -1262,6 +1262,46 @@ test_parse_packet_mpls_succeeds_multicast() {
   free_buffer( buffer );
 }
 
+
+static void
+test_defer_parse_packet_parses_on_first_access() {
+  const char filename[] = "./unittests/lib/test_packets/udp.cap";
+  buffer *buffer = store_packet_to_buffer( filename );
+
+  defer_parse_packet( buffer );
+
+  packet_info *packet_info = buffer->user_data;
+
+  assert_int_equal( packet_info->format, 0 );
+
+  assert_true( packet_type_ipv4_udp( buffer ) );
+  assert_int_equal( packet_info->format, ETH_IPV4_UDP );
+  assert_int_equal( packet_info->ipv4_saddr, 0x0a3835af );
+  assert_int_equal( packet_info->udp_dst_port, 23499 );
+  assert_int_equal( packet_info->l4_payload_length, 48 );
+
+  free_buffer( buffer );
+}
+
+
+static void
+test_parse_deferred_packet_ignores_parsed_buffer() {
+  const char filename[] = "./unittests/lib/test_packets/udp.cap";
+  buffer *buffer = store_packet_to_buffer( filename );
+
+  assert_true( parse_packet( buffer ) );
+
+  packet_info *packet_info = buffer->user_data;
+  packet_info->udp_dst_port = 0;
+
+  parse_deferred_packet( buffer );
+
+  assert_true( buffer->user_data == packet_info );
+  assert_int_equal( packet_info->udp_dst_port, 0 );
+
+  free_buffer( buffer );
+}
+
 /******************************************************************************
  * Run tests.
  ******************************************************************************/
@@ -1308,6 +1348,9 @@ main() {
     unit_test( test_parse_packet_icmpv6_succeeds ),
     unit_test( test_parse_packet_mpls_succeeds_unicast ),
     unit_test( test_parse_packet_mpls_succeeds_multicast ),
+
+    unit_test( test_defer_parse_packet_parses_on_first_access ),
+    unit_test( test_parse_deferred_packet_ignores_parsed_buffer ),
   };
   stub_logger();
   return run_tests( tests );
@@ -0,0 +1,223 @@
+/*
+ * Unit tests for shared memory ring.
+ *
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "checks.h"
+#include "cmockery_trema.h"
+#include "shm_ring.h"
+#include "wrapper.h"
+
+
+static bool
+readable( int fd ) {
+  uint64_t count = 0;
+  return read( fd, &count, sizeof( count ) ) == sizeof( count ) && count > 0;
+}
+
+
+static shm_ring *
+attach_copy( shm_ring *producer ) {
+  int memory_fd = dup( producer->memory_fd );
+  int notify_fd = dup( producer->notify_fd );
+  int space_fd = dup( producer->space_fd );
+  shm_ring *consumer = attach_shm_ring( memory_fd, notify_fd, space_fd );
+  assert_true( consumer != NULL );
+
+  return consumer;
+}
+
+
+/*************************************************************************
+ * create and attach tests.
+ *************************************************************************/
+
+static void
+test_create_and_attach_shm_ring() {
+  shm_ring *producer = create_shm_ring( 5000 );
+  assert_true( producer != NULL );
+  assert_int_equal( producer->header->size, 8192 );
+
+  shm_ring *consumer = attach_copy( producer );
+  assert_int_equal( consumer->header->size, 8192 );
+  assert_true( shm_ring_is_empty( consumer ) );
+
+  delete_shm_ring( consumer );
+  delete_shm_ring( producer );
+}
+
+
+static void
+test_attach_shm_ring_fails_with_invalid_memory() {
+  int fds[ 2 ];
+  assert_int_equal( pipe( fds ), 0 );
+
+  assert_true( attach_shm_ring( fds[ 0 ], -1, -1 ) == NULL );
+
+  close( fds[ 0 ] );
+  close( fds[ 1 ] );
+}
+
+
+/*************************************************************************
+ * reserve and peek tests.
+ *************************************************************************/
+
+static void
+test_reserve_and_peek_shm_ring() {
+  shm_ring *producer = create_shm_ring( 4096 );
+  shm_ring *consumer = attach_copy( producer );
+
+  size_t length = 0;
+  assert_true( peek_shm_ring( consumer, &length ) == NULL );
+
+  char *record = reserve_shm_ring( producer, 6 );
+  assert_true( record != NULL );
+  memcpy( record, "HELLO", 6 );
+  assert_true( shm_ring_is_empty( consumer ) );
+  commit_shm_ring( producer );
+
+  char *peeked = peek_shm_ring( consumer, &length );
+  assert_true( peeked != NULL );
+  assert_int_equal( length, 6 );
+  assert_string_equal( peeked, "HELLO" );
+  consume_shm_ring( consumer );
+  assert_true( shm_ring_is_empty( consumer ) );
+  assert_true( peek_shm_ring( consumer, &length ) == NULL );
+
+  delete_shm_ring( consumer );
+  delete_shm_ring( producer );
+}
+
+
+static void
+test_records_wrap_around_shm_ring() {
+  shm_ring *producer = create_shm_ring( 4096 );
+  shm_ring *consumer = attach_copy( producer );
+
+  for ( uint32_t i = 0; i < 1000; i++ ) {
+    uint32_t *record = reserve_shm_ring( producer, 100 );
+    assert_true( record != NULL );
+    *record = i;
+    commit_shm_ring( producer );
+
+    size_t length = 0;
+    uint32_t *peeked = peek_shm_ring( consumer, &length );
+    assert_true( peeked != NULL );
+    assert_int_equal( length, 100 );
+    assert_int_equal( *peeked, i );
+    consume_shm_ring( consumer );
+  }
+
+  delete_shm_ring( consumer );
+  delete_shm_ring( producer );
+}
+
+
+static void
+test_reserve_shm_ring_fails_if_record_is_too_large() {
+  shm_ring *producer = create_shm_ring( 4096 );
+
+  assert_true( reserve_shm_ring( producer, 4096 ) == NULL );
+
+  delete_shm_ring( producer );
+}
+
+
+/*************************************************************************
+ * wakeup tests.
+ *************************************************************************/
+
+static void
+test_producer_is_woken_up_when_space_is_released() {
+  shm_ring *producer = create_shm_ring( 4096 );
+  shm_ring *consumer = attach_copy( producer );
+
+  unsigned int n = 0;
+  while ( reserve_shm_ring( producer, 1000 ) != NULL ) {
+    commit_shm_ring( producer );
+    n++;
+  }
+  assert_true( n > 0 );
+  assert_false( readable( producer->space_fd ) );
+
+  size_t length;
+  assert_true( peek_shm_ring( consumer, &length ) != NULL );
+  consume_shm_ring( consumer );
+  assert_true( readable( producer->space_fd ) );
+  assert_true( reserve_shm_ring( producer, 1000 ) != NULL );
+
+  delete_shm_ring( consumer );
+  delete_shm_ring( producer );
+}
+
+
+static void
+test_consumer_is_woken_up_only_if_waiting() {
+  shm_ring *producer = create_shm_ring( 4096 );
+  shm_ring *consumer = attach_copy( producer );
+
+  assert_true( reserve_shm_ring( producer, 8 ) != NULL );
+  commit_shm_ring( producer );
+  assert_false( readable( consumer->notify_fd ) );
+  assert_false( wait_shm_ring( consumer ) );
+
+  size_t length;
+  assert_true( peek_shm_ring( consumer, &length ) != NULL );
+  consume_shm_ring( consumer );
+  assert_true( wait_shm_ring( consumer ) );
+
+  assert_true( reserve_shm_ring( producer, 8 ) != NULL );
+  commit_shm_ring( producer );
+  assert_true( readable( consumer->notify_fd ) );
+
+  delete_shm_ring( consumer );
+  delete_shm_ring( producer );
+}
+
+
+/*************************************************************************
+ * Run tests.
+ *************************************************************************/
+
+int
+main() {
+  const UnitTest tests[] = {
+    unit_test( test_create_and_attach_shm_ring ),
+    unit_test( test_attach_shm_ring_fails_with_invalid_memory ),
+    unit_test( test_reserve_and_peek_shm_ring ),
+    unit_test( test_records_wrap_around_shm_ring ),
+    unit_test( test_reserve_shm_ring_fails_if_record_is_too_large ),
+    unit_test( test_producer_is_woken_up_when_space_is_released ),
+    unit_test( test_consumer_is_woken_up_only_if_waiting ),
+  };
+
+  return run_tests( tests );
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
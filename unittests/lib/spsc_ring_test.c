@@ -0,0 +1,149 @@
+/*
+ * Unit tests for spsc ring.
+ *
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "checks.h"
+#include "cmockery_trema.h"
+#include "spsc_ring.h"
+#include "wrapper.h"
+
+
+/*************************************************************************
+ * create and delete tests.
+ *************************************************************************/
+
+static void
+test_create_and_delete_spsc_ring() {
+  spsc_ring *ring = create_spsc_ring( 5 );
+  assert_true( ring != NULL );
+  assert_int_equal( ring->size, 8 );
+  assert_int_equal( get_spsc_ring_length( ring ), 0 );
+
+  delete_spsc_ring( ring );
+}
+
+
+static void
+test_delete_spsc_ring_with_buffers() {
+  spsc_ring *ring = create_spsc_ring( 4 );
+  assert_true( push_spsc_ring( ring, alloc_buffer() ) );
+  assert_true( push_spsc_ring( ring, alloc_buffer() ) );
+
+  delete_spsc_ring( ring );
+}
+
+
+/*************************************************************************
+ * push and pop tests.
+ *************************************************************************/
+
+static void
+test_push_and_pop_spsc_ring() {
+  spsc_ring *ring = create_spsc_ring( 4 );
+  buffer *first = alloc_buffer();
+  buffer *second = alloc_buffer();
+
+  assert_true( push_spsc_ring( ring, first ) );
+  assert_true( push_spsc_ring( ring, second ) );
+  assert_int_equal( get_spsc_ring_length( ring ), 2 );
+
+  assert_true( pop_spsc_ring( ring ) == first );
+  assert_true( pop_spsc_ring( ring ) == second );
+  assert_true( pop_spsc_ring( ring ) == NULL );
+  assert_int_equal( get_spsc_ring_length( ring ), 0 );
+
+  free_buffer( first );
+  free_buffer( second );
+  delete_spsc_ring( ring );
+}
+
+
+static void
+test_push_spsc_ring_if_ring_is_full() {
+  spsc_ring *ring = create_spsc_ring( 2 );
+  buffer *data[ 3 ] = { alloc_buffer(), alloc_buffer(), alloc_buffer() };
+
+  assert_true( push_spsc_ring( ring, data[ 0 ] ) );
+  assert_true( push_spsc_ring( ring, data[ 1 ] ) );
+  assert_false( push_spsc_ring( ring, data[ 2 ] ) );
+
+  assert_true( pop_spsc_ring( ring ) == data[ 0 ] );
+  assert_true( push_spsc_ring( ring, data[ 2 ] ) );
+  assert_true( pop_spsc_ring( ring ) == data[ 1 ] );
+  assert_true( pop_spsc_ring( ring ) == data[ 2 ] );
+
+  for ( int i = 0; i < 3; i++ ) {
+    free_buffer( data[ i ] );
+  }
+  delete_spsc_ring( ring );
+}
+
+
+static void
+test_pop_spsc_ring_bulk() {
+  spsc_ring *ring = create_spsc_ring( 4 );
+  buffer *data[ 4 ];
+  for ( int i = 0; i < 4; i++ ) {
+    data[ i ] = alloc_buffer();
+    assert_true( push_spsc_ring( ring, data[ i ] ) );
+  }
+
+  buffer *popped[ 4 ];
+  assert_int_equal( pop_spsc_ring_bulk( ring, popped, 3 ), 3 );
+  for ( int i = 0; i < 3; i++ ) {
+    assert_true( popped[ i ] == data[ i ] );
+  }
+  assert_int_equal( pop_spsc_ring_bulk( ring, popped, 3 ), 1 );
+  assert_true( popped[ 0 ] == data[ 3 ] );
+  assert_int_equal( pop_spsc_ring_bulk( ring, popped, 3 ), 0 );
+
+  for ( int i = 0; i < 4; i++ ) {
+    free_buffer( data[ i ] );
+  }
+  delete_spsc_ring( ring );
+}
+
+
+/*************************************************************************
+ * Run tests.
+ *************************************************************************/
+
+int
+main() {
+  const UnitTest tests[] = {
+    unit_test( test_create_and_delete_spsc_ring ),
+    unit_test( test_delete_spsc_ring_with_buffers ),
+    unit_test( test_push_and_pop_spsc_ring ),
+    unit_test( test_push_spsc_ring_if_ring_is_full ),
+    unit_test( test_pop_spsc_ring_bulk ),
+  };
+
+  return run_tests( tests );
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -212,6 +212,74 @@ test_increment_stat_fails_if_not_initialized() {
 }
 
 
+/********************************************************************************
+ * register_stat_entry() and increment_stat_by_id() tests.
+ ********************************************************************************/
+
+static void
+test_register_stat_entry_returns_same_id_for_same_key() {
+  assert_true( init_stat() );
+
+  int id = register_stat_entry( "key" );
+  assert_true( id >= 0 );
+  assert_int_equal( register_stat_entry( "key" ), id );
+  assert_true( register_stat_entry( "another key" ) != id );
+
+  assert_true( finalize_stat() );
+}
+
+
+static void
+test_increment_stat_by_id_succeeds() {
+  assert_true( init_stat() );
+
+  const char *key = "key";
+  int id = register_stat_entry( key );
+  increment_stat_by_id( id );
+  increment_stat( key );
+  increment_stat_by_id( id );
+
+  stat_entry *entry = lookup_hash_entry( stats, key );
+  assert_string_equal( entry->key, key );
+  uint64_t expected_value = 3;
+  assert_memory_equal( &entry->value, &expected_value, sizeof( uint64_t ) );
+
+  assert_true( finalize_stat() );
+}
+
+
+static void
+test_register_stat_entry_grows_id_table() {
+  assert_true( init_stat() );
+
+  char key[ STAT_KEY_LENGTH ];
+  for ( int i = 0; i < 10000; i++ ) {
+    snprintf( key, sizeof( key ), "key %d", i );
+    assert_int_equal( register_stat_entry( key ), i );
+  }
+  const int ids[] = { 0, 63, 64, 191, 192, 4095, 4096, 9999 };
+  for ( size_t i = 0; i < sizeof( ids ) / sizeof( ids[ 0 ] ); i++ ) {
+    increment_stat_by_id( ids[ i ] );
+    snprintf( key, sizeof( key ), "key %d", ids[ i ] );
+    stat_entry *entry = lookup_hash_entry( stats, key );
+    uint64_t expected_value = 1;
+    assert_memory_equal( &entry->value, &expected_value, sizeof( uint64_t ) );
+  }
+
+  assert_true( finalize_stat() );
+}
+
+
+static void
+test_increment_stat_by_id_fails_with_unregistered_id() {
+  assert_true( init_stat() );
+
+  expect_assert_failure( increment_stat_by_id( 0 ) );
+
+  assert_true( finalize_stat() );
+}
+
+
 /********************************************************************************
  * dump_stats() tests.
  ********************************************************************************/
@@ -274,6 +342,12 @@ main() {
     unit_test_setup_teardown( test_increment_stat_fails_if_key_is_NULL, reset, reset ),
     unit_test_setup_teardown( test_increment_stat_fails_if_not_initialized, reset, reset ),
 
+    // register_stat_entry() and increment_stat_by_id() tests.
+    unit_test_setup_teardown( test_register_stat_entry_returns_same_id_for_same_key, reset, reset ),
+    unit_test_setup_teardown( test_increment_stat_by_id_succeeds, reset, reset ),
+    unit_test_setup_teardown( test_register_stat_entry_grows_id_table, reset, reset ),
+    unit_test_setup_teardown( test_increment_stat_by_id_fails_with_unregistered_id, reset, reset ),
+
     // dump_sats() tests.
     unit_test_setup_teardown( test_dump_stats_succeeds, reset, reset ),
     unit_test_setup_teardown( test_dump_stats_succeeds_without_entries, reset, reset ),
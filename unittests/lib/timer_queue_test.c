@@ -0,0 +1,211 @@
+/*
+ * Unit tests for timer queue.
+ *
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "checks.h"
+#include "cmockery_trema.h"
+#include "timer_queue.h"
+#include "wrapper.h"
+
+
+/*************************************************************************
+ * Helpers.
+ *************************************************************************/
+
+static int fired[ 16 ];
+static int fired_nr = 0;
+static timer_queue *current_queue = NULL;
+static timer_handle self_handle = INVALID_TIMER_HANDLE;
+
+
+static void
+record_callback( void *user_data ) {
+  fired[ fired_nr++ ] = ( int ) ( intptr_t ) user_data;
+}
+
+
+static void
+cancel_self_callback( void *user_data ) {
+  record_callback( user_data );
+  assert_true( remove_timer_entry( current_queue, self_handle ) );
+}
+
+
+static struct timespec
+seconds( time_t sec ) {
+  struct timespec ts = { sec, 0 };
+  return ts;
+}
+
+
+/*************************************************************************
+ * Tests.
+ *************************************************************************/
+
+static void
+test_run_timer_entries_in_expiration_order() {
+  timer_queue *queue = create_timer_queue();
+  struct timespec zero = seconds( 0 );
+  fired_nr = 0;
+
+  const time_t order[] = { 5, 3, 9, 1, 7, 2, 8, 4, 6, 10, 12, 11, 14, 13, 16, 15, 17, 18 };
+  for ( int i = 0; i < 18; i++ ) {
+    struct timespec expires_at = seconds( order[ i ] );
+    assert_true( add_timer_entry( queue, record_callback, ( void * ) ( intptr_t ) order[ i ], &expires_at, &zero ) != INVALID_TIMER_HANDLE );
+  }
+  assert_int_equal( get_timer_entry_count( queue ), 18 );
+  assert_int_equal( get_next_timer_expiry( queue )->tv_sec, 1 );
+
+  struct timespec now = seconds( 10 );
+  run_timer_entries( queue, &now );
+  assert_int_equal( fired_nr, 10 );
+  for ( int i = 0; i < 10; i++ ) {
+    assert_int_equal( fired[ i ], i + 1 );
+  }
+  assert_int_equal( get_timer_entry_count( queue ), 8 );
+  assert_int_equal( get_next_timer_expiry( queue )->tv_sec, 11 );
+
+  delete_timer_queue( queue );
+}
+
+
+static void
+test_remove_timer_entry_by_handle() {
+  timer_queue *queue = create_timer_queue();
+  struct timespec zero = seconds( 0 );
+  struct timespec one = seconds( 1 );
+  struct timespec two = seconds( 2 );
+  fired_nr = 0;
+
+  timer_handle first = add_timer_entry( queue, record_callback, ( void * ) 1, &one, &zero );
+  timer_handle second = add_timer_entry( queue, record_callback, ( void * ) 2, &two, &zero );
+  assert_true( remove_timer_entry( queue, first ) );
+  assert_false( remove_timer_entry( queue, first ) );
+  assert_true( lookup_timer_entry( queue, first ) == NULL );
+  assert_true( lookup_timer_entry( queue, second ) != NULL );
+
+  // a reused entry must not be reachable through the stale handle
+  timer_handle third = add_timer_entry( queue, record_callback, ( void * ) 3, &one, &zero );
+  assert_true( third != first );
+  assert_false( remove_timer_entry( queue, first ) );
+  assert_true( find_timer_entry( queue, record_callback, ( void * ) 3 ) == third );
+
+  struct timespec now = seconds( 2 );
+  run_timer_entries( queue, &now );
+  assert_int_equal( fired_nr, 2 );
+  assert_int_equal( fired[ 0 ], 3 );
+  assert_int_equal( fired[ 1 ], 2 );
+  assert_false( remove_timer_entry( queue, second ) );
+
+  delete_timer_queue( queue );
+}
+
+
+static void
+test_update_timer_entry() {
+  timer_queue *queue = create_timer_queue();
+  struct timespec zero = seconds( 0 );
+  struct timespec one = seconds( 1 );
+  struct timespec five = seconds( 5 );
+  fired_nr = 0;
+
+  timer_handle handle = add_timer_entry( queue, record_callback, ( void * ) 1, &one, &zero );
+  add_timer_entry( queue, record_callback, ( void * ) 2, &five, &zero );
+  struct timespec later = seconds( 10 );
+  assert_true( update_timer_entry( queue, handle, &later, &zero ) );
+  assert_int_equal( get_next_timer_expiry( queue )->tv_sec, 5 );
+
+  struct timespec now = seconds( 10 );
+  run_timer_entries( queue, &now );
+  assert_int_equal( fired_nr, 2 );
+  assert_int_equal( fired[ 0 ], 2 );
+  assert_int_equal( fired[ 1 ], 1 );
+
+  delete_timer_queue( queue );
+}
+
+
+static void
+test_periodic_timer_entry_cancelled_by_itself() {
+  timer_queue *queue = create_timer_queue();
+  struct timespec one = seconds( 1 );
+  fired_nr = 0;
+  current_queue = queue;
+
+  self_handle = add_timer_entry( queue, cancel_self_callback, ( void * ) 1, &one, &one );
+  struct timespec now = seconds( 1 );
+  run_timer_entries( queue, &now );
+  assert_int_equal( fired_nr, 1 );
+  assert_int_equal( get_timer_entry_count( queue ), 0 );
+  assert_true( lookup_timer_entry( queue, self_handle ) == NULL );
+
+  delete_timer_queue( queue );
+}
+
+
+static void
+test_periodic_timer_entry_is_rearmed() {
+  timer_queue *queue = create_timer_queue();
+  struct timespec one = seconds( 1 );
+  fired_nr = 0;
+
+  timer_handle handle = add_timer_entry( queue, record_callback, ( void * ) 1, &one, &one );
+  struct timespec now = seconds( 1 );
+  run_timer_entries( queue, &now );
+  assert_int_equal( fired_nr, 1 );
+  assert_int_equal( get_next_timer_expiry( queue )->tv_sec, 2 );
+
+  // fallen behind: fires once and is rearmed at now
+  now = seconds( 10 );
+  run_timer_entries( queue, &now );
+  assert_int_equal( fired_nr, 2 );
+  assert_int_equal( get_next_timer_expiry( queue )->tv_sec, 10 );
+  assert_true( lookup_timer_entry( queue, handle ) != NULL );
+
+  delete_timer_queue( queue );
+}
+
+
+/*************************************************************************
+ * Run tests.
+ *************************************************************************/
+
+int
+main() {
+  const UnitTest tests[] = {
+    unit_test( test_run_timer_entries_in_expiration_order ),
+    unit_test( test_remove_timer_entry_by_handle ),
+    unit_test( test_update_timer_entry ),
+    unit_test( test_periodic_timer_entry_cancelled_by_itself ),
+    unit_test( test_periodic_timer_entry_is_rearmed ),
+  };
+
+  return run_tests( tests );
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
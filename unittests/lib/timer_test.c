@@ -27,24 +27,15 @@
 #include <sys/stat.h>
 #include "checks.h"
 #include "cmockery_trema.h"
-#include "doubly_linked_list.h"
 #include "timer.h"
+#include "timer_queue.h"
 
 
 /********************************************************************************
  * Static data and types
  ********************************************************************************/
 
-// FIXME
-typedef struct timer_callback_info {
-  void ( *function )( void *user_data );
-  struct timespec expires_at;
-  struct timespec interval;
-  void *user_data;
-} timer_callback_info;
-
-
-extern dlist_element *timer_callbacks;
+extern timer_queue *timer_callbacks;
 
 
 /********************************************************************************
@@ -80,12 +71,8 @@ mock_debug( const char *format, ... ) {
 
 static timer_callback_info *
 find_timer_callback( void ( *callback )( void *user_data ) ) {
-  dlist_element *e;
-  timer_callback_info *cb;
-
-  cb = NULL;
-  for ( e = timer_callbacks->next; e; e = e->next ) {
-    cb = e->data;
+  for ( unsigned int i = 0; i < timer_callbacks->heap_nr; i++ ) {
+    timer_callback_info *cb = &timer_callbacks->entries[ timer_callbacks->heap[ i ] ];
     if ( cb->function == callback ) {
       return cb;
     }
@@ -204,6 +191,36 @@ test_delete_timer_event() {
 }
 
 
+static void
+test_cancel_timer_event() {
+  init_timer();
+
+  will_return_count( mock_clock_gettime, 0, -1 );
+
+  char user_data[] = "It's time!!!";
+  struct itimerspec interval;
+  interval.it_value.tv_sec = 1;
+  interval.it_value.tv_nsec = 0;
+  interval.it_interval.tv_sec = 1;
+  interval.it_interval.tv_nsec = 0;
+  timer_handle handle = add_timer_event( &interval, mock_timer_event_callback, user_data );
+  assert_true( handle != INVALID_TIMER_HANDLE );
+
+  interval.it_interval.tv_sec = 3;
+  assert_true( reschedule_timer_event( handle, &interval ) );
+  timer_callback_info *callback = find_timer_callback( mock_timer_event_callback );
+  assert_true( callback != NULL );
+  assert_int_equal( callback->interval.tv_sec, 3 );
+
+  assert_true( cancel_timer_event( handle ) );
+  assert_true( find_timer_callback( mock_timer_event_callback ) == NULL );
+  assert_false( cancel_timer_event( handle ) );
+  assert_false( reschedule_timer_event( handle, &interval ) );
+
+  finalize_timer();
+}
+
+
 static void
 test_nonexistent_timer_event_callback() {
   assert_false( delete_timer_event( mock_timer_event_callback, NULL ) );
@@ -233,6 +250,7 @@ main() {
     unit_test( test_periodic_event_callback ),
     unit_test( test_add_timer_event_callback_fail_with_invalid_timespec ),
     unit_test( test_delete_timer_event ),
+    unit_test( test_cancel_timer_event ),
     unit_test( test_nonexistent_timer_event_callback ),
     unit_test( test_clock_gettime_fail_einval ),
   };
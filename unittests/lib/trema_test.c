@@ -81,6 +81,48 @@ mock_init_log() {
 }
 
 
+bool
+mock_start_log_writer() {
+  return true;
+}
+
+
+bool
+mock_stop_log_writer() {
+  return true;
+}
+
+
+void
+mock_enable_buffer_cache() {
+}
+
+
+void
+mock_disable_buffer_cache() {
+}
+
+
+void
+mock_enable_list_element_cache() {
+}
+
+
+void
+mock_disable_list_element_cache() {
+}
+
+
+void
+mock_enable_dlist_element_cache() {
+}
+
+
+void
+mock_disable_dlist_element_cache() {
+}
+
+
 void
 mock_error( const char *format, ... ) {
   UNUSED( format );
@@ -0,0 +1,379 @@
+/*
+ * Unit tests for egress_queue.
+ *
+ * Copyright (C) 2012-2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cmockery_trema.h"
+#include "egress_queue.h"
+
+
+/*************************************************************************
+ * Setup and teardown.
+ *************************************************************************/
+
+#define MAX_QUEUE_LENGTH 64
+#define MTU 1500
+#define FRAME_LENGTH 1000
+#define LINK_RATE 1000000 // bytes per second
+#define MAX_RATE 100 // 10% of the link rate
+#define MAX_RATE_BPS ( LINK_RATE * MAX_RATE / 1000 )
+
+
+static egress_scheduler *scheduler = NULL;
+
+
+static void
+setup() {
+  scheduler = create_egress_scheduler( MAX_QUEUE_LENGTH, MTU );
+}
+
+
+static void
+teardown() {
+  delete_egress_scheduler( scheduler );
+  scheduler = NULL;
+}
+
+
+/*************************************************************************
+ * Helpers.
+ *************************************************************************/
+
+static egress_queue *
+add_queue( uint32_t queue_id, uint8_t priority, uint32_t weight, uint16_t min_rate, uint16_t max_rate ) {
+  egress_queue_config config = { queue_id, priority, weight, min_rate, max_rate };
+  assert_true( add_egress_queue( scheduler, &config ) );
+
+  egress_queue *queue = lookup_egress_queue( scheduler, queue_id );
+  assert_true( queue != NULL );
+
+  return queue;
+}
+
+
+static void
+enqueue_frames( egress_queue *queue, unsigned int n_frames, size_t length ) {
+  for ( unsigned int i = 0; i < n_frames; i++ ) {
+    buffer *frame = get_free_packet_buffer( queue->buffers );
+    assert_true( frame != NULL );
+    memset( append_back_buffer( frame, length ), 0, length );
+    enqueue_packet_buffer( queue->buffers, frame );
+  }
+}
+
+
+/*
+ * Sends the frame at the head of the queue chosen by the scheduler in
+ * the same way as ether_device does. Returns NULL if no queue is chosen.
+ */
+static egress_queue *
+transmit() {
+  egress_queue *queue = schedule_egress_queue( scheduler );
+  if ( queue == NULL ) {
+    return NULL;
+  }
+
+  buffer *frame = dequeue_packet_buffer( queue->buffers );
+  assert_true( frame != NULL );
+  size_t length = frame->length;
+  mark_packet_buffer_as_used( queue->buffers, frame );
+  complete_egress_transmission( queue, length );
+
+  return queue;
+}
+
+
+/*
+ * Pretends that the bucket was last refilled the given time ago.
+ */
+static void
+rewind_token_bucket( token_bucket *bucket, long msec ) {
+  struct timespec delta = { msec / 1000, ( msec % 1000 ) * 1000000 };
+  SUB_TIMESPEC( &bucket->updated_at, &delta, &bucket->updated_at );
+}
+
+
+/*************************************************************************
+ * Configuration tests.
+ *************************************************************************/
+
+static void
+test_create_egress_scheduler_adds_default_queue() {
+  assert_int_equal( scheduler->n_queues, 1 );
+
+  egress_queue *queue = lookup_egress_queue( scheduler, EGRESS_QUEUE_DEFAULT_ID );
+  assert_true( queue != NULL );
+  assert_int_equal( queue->config.weight, MTU );
+}
+
+
+static void
+test_add_egress_queue_sorts_queues_by_priority() {
+  add_queue( 1, 1, 0, EGRESS_QUEUE_RATE_UNCFG, EGRESS_QUEUE_RATE_UNCFG );
+  add_queue( 2, 3, 0, EGRESS_QUEUE_RATE_UNCFG, EGRESS_QUEUE_RATE_UNCFG );
+  add_queue( 3, 2, 0, EGRESS_QUEUE_RATE_UNCFG, EGRESS_QUEUE_RATE_UNCFG );
+
+  assert_int_equal( scheduler->n_queues, 4 );
+  assert_int_equal( scheduler->queues[ 0 ]->config.queue_id, 2 );
+  assert_int_equal( scheduler->queues[ 1 ]->config.queue_id, 3 );
+  assert_int_equal( scheduler->queues[ 2 ]->config.queue_id, 1 );
+  assert_int_equal( scheduler->queues[ 3 ]->config.queue_id, EGRESS_QUEUE_DEFAULT_ID );
+  assert_true( lookup_egress_queue( scheduler, 4 ) == NULL );
+}
+
+
+static void
+test_add_egress_queue_fails_to_reconfigure_backlogged_queue() {
+  egress_queue *queue = add_queue( 1, 1, 0, EGRESS_QUEUE_RATE_UNCFG, EGRESS_QUEUE_RATE_UNCFG );
+  enqueue_frames( queue, 1, FRAME_LENGTH );
+
+  egress_queue_config config = { 1, 1, 3000, EGRESS_QUEUE_RATE_UNCFG, EGRESS_QUEUE_RATE_UNCFG };
+  assert_false( add_egress_queue( scheduler, &config ) );
+  assert_int_equal( queue->config.weight, MTU );
+}
+
+
+/*************************************************************************
+ * Scheduling tests.
+ *************************************************************************/
+
+static void
+test_schedule_egress_queue_returns_null_if_no_backlog() {
+  assert_true( schedule_egress_queue( scheduler ) == NULL );
+  assert_int_equal( get_egress_backlog( scheduler ), 0 );
+}
+
+
+static void
+test_schedule_egress_queue_serves_higher_priority_first() {
+  egress_queue *low = lookup_egress_queue( scheduler, EGRESS_QUEUE_DEFAULT_ID );
+  egress_queue *high = add_queue( 1, 1, 0, EGRESS_QUEUE_RATE_UNCFG, EGRESS_QUEUE_RATE_UNCFG );
+  enqueue_frames( low, 3, FRAME_LENGTH );
+  enqueue_frames( high, 3, FRAME_LENGTH );
+  assert_int_equal( get_egress_backlog( scheduler ), 6 );
+
+  for ( int i = 0; i < 3; i++ ) {
+    assert_true( transmit() == high );
+  }
+  for ( int i = 0; i < 3; i++ ) {
+    assert_true( transmit() == low );
+  }
+  assert_true( transmit() == NULL );
+  assert_int_equal( high->stats.tx_packets, 3 );
+  assert_int_equal( high->stats.tx_bytes, 3 * FRAME_LENGTH );
+}
+
+
+static void
+test_schedule_egress_queue_shares_by_drr_quanta() {
+  egress_queue *light = add_queue( 1, 1, 1500, EGRESS_QUEUE_RATE_UNCFG, EGRESS_QUEUE_RATE_UNCFG );
+  egress_queue *heavy = add_queue( 2, 1, 3000, EGRESS_QUEUE_RATE_UNCFG, EGRESS_QUEUE_RATE_UNCFG );
+  enqueue_frames( light, MAX_QUEUE_LENGTH, FRAME_LENGTH );
+  enqueue_frames( heavy, MAX_QUEUE_LENGTH, FRAME_LENGTH );
+
+  // each round gives 1500 and 3000 bytes of credit
+  for ( int i = 0; i < 60; i++ ) {
+    assert_true( transmit() != NULL );
+  }
+  assert_true( light->stats.tx_packets >= 19 && light->stats.tx_packets <= 21 );
+  assert_int_equal( light->stats.tx_packets + heavy->stats.tx_packets, 60 );
+  assert_true( light->deficit <= light->config.weight );
+  assert_true( heavy->deficit <= heavy->config.weight );
+}
+
+
+static void
+test_schedule_egress_queue_shares_bytes_fairly_among_frame_sizes() {
+  egress_queue *small = add_queue( 1, 1, 0, EGRESS_QUEUE_RATE_UNCFG, EGRESS_QUEUE_RATE_UNCFG );
+  egress_queue *large = add_queue( 2, 1, 0, EGRESS_QUEUE_RATE_UNCFG, EGRESS_QUEUE_RATE_UNCFG );
+  enqueue_frames( small, MAX_QUEUE_LENGTH, 100 );
+  enqueue_frames( large, MAX_QUEUE_LENGTH, MTU );
+
+  while ( small->stats.tx_packets < MAX_QUEUE_LENGTH && large->stats.tx_packets < MAX_QUEUE_LENGTH ) {
+    assert_true( transmit() != NULL );
+  }
+
+  // both queues get the same bytes, not the same number of frames
+  uint64_t diff = small->stats.tx_bytes > large->stats.tx_bytes ?
+                  small->stats.tx_bytes - large->stats.tx_bytes : large->stats.tx_bytes - small->stats.tx_bytes;
+  assert_true( diff <= MTU );
+}
+
+
+static void
+test_schedule_egress_queue_resets_deficit_of_idle_queue() {
+  egress_queue *idle = add_queue( 1, 1, 0, EGRESS_QUEUE_RATE_UNCFG, EGRESS_QUEUE_RATE_UNCFG );
+  egress_queue *busy = add_queue( 2, 1, 0, EGRESS_QUEUE_RATE_UNCFG, EGRESS_QUEUE_RATE_UNCFG );
+  enqueue_frames( idle, 1, FRAME_LENGTH );
+  enqueue_frames( busy, 4, FRAME_LENGTH );
+
+  for ( int i = 0; i < 5; i++ ) {
+    assert_true( transmit() != NULL );
+  }
+  assert_int_equal( idle->stats.tx_packets, 1 );
+  assert_int_equal( busy->stats.tx_packets, 4 );
+
+  // credit is not carried over an idle period
+  assert_true( transmit() == NULL );
+  assert_int_equal( idle->deficit, 0 );
+  assert_int_equal( busy->deficit, 0 );
+}
+
+
+/*************************************************************************
+ * Rate limiting tests.
+ *************************************************************************/
+
+static void
+test_token_bucket_starts_empty() {
+  egress_queue *queue = add_queue( 1, 1, 0, EGRESS_QUEUE_RATE_UNCFG, MAX_RATE );
+  assert_true( queue->max_bucket.rate == 0 );
+
+  set_egress_link_rate( scheduler, LINK_RATE );
+  assert_true( queue->max_bucket.rate == MAX_RATE_BPS );
+  assert_true( queue->max_bucket.tokens == 0 );
+  assert_true( queue->min_bucket.rate == 0 );
+}
+
+
+static void
+test_token_bucket_is_refilled_by_elapsed_time() {
+  egress_queue *queue = add_queue( 1, 1, 0, EGRESS_QUEUE_RATE_UNCFG, MAX_RATE );
+  set_egress_link_rate( scheduler, LINK_RATE );
+  enqueue_frames( queue, 1, FRAME_LENGTH );
+
+  // 5ms worth of tokens is not enough for a frame
+  rewind_token_bucket( &queue->max_bucket, 5 );
+  assert_true( schedule_egress_queue( scheduler ) == NULL );
+  assert_true( queue->max_bucket.tokens >= MAX_RATE_BPS / 200 );
+  assert_true( queue->max_bucket.tokens < FRAME_LENGTH );
+
+  rewind_token_bucket( &queue->max_bucket, 5 );
+  assert_true( schedule_egress_queue( scheduler ) == queue );
+  assert_true( queue->max_bucket.tokens >= FRAME_LENGTH );
+}
+
+
+static void
+test_token_bucket_is_capped_by_burst_size() {
+  egress_queue *queue = add_queue( 1, 1, 0, EGRESS_QUEUE_RATE_UNCFG, MAX_RATE );
+  set_egress_link_rate( scheduler, LINK_RATE );
+
+  // a bucket holds 10ms worth of tokens, but at least one MTU
+  rewind_token_bucket( &queue->max_bucket, 3000 );
+  assert_true( schedule_egress_queue( scheduler ) == NULL );
+  assert_true( queue->max_bucket.tokens == MTU );
+
+  complete_egress_transmission( queue, FRAME_LENGTH );
+  assert_true( queue->max_bucket.tokens == MTU - FRAME_LENGTH );
+  complete_egress_transmission( queue, FRAME_LENGTH );
+  assert_true( queue->max_bucket.tokens == 0 );
+}
+
+
+static void
+test_schedule_egress_queue_throttles_queue_over_max_rate() {
+  egress_queue *shaped = add_queue( 1, 1, 0, EGRESS_QUEUE_RATE_UNCFG, MAX_RATE );
+  set_egress_link_rate( scheduler, LINK_RATE );
+  enqueue_frames( shaped, 3, FRAME_LENGTH );
+
+  rewind_token_bucket( &shaped->max_bucket, 10 );
+  assert_true( transmit() == shaped );
+  assert_true( transmit() == NULL );
+  assert_int_equal( get_egress_backlog( scheduler ), 2 );
+
+  // lower priority queues are served while a queue is throttled
+  egress_queue *unshaped = lookup_egress_queue( scheduler, EGRESS_QUEUE_DEFAULT_ID );
+  enqueue_frames( unshaped, 1, FRAME_LENGTH );
+  assert_true( transmit() == unshaped );
+  assert_true( transmit() == NULL );
+}
+
+
+static void
+test_schedule_egress_queue_limits_throughput_to_max_rate() {
+  egress_queue *queue = add_queue( 1, 1, 0, EGRESS_QUEUE_RATE_UNCFG, MAX_RATE );
+  set_egress_link_rate( scheduler, LINK_RATE );
+
+  // a second in 10ms steps
+  for ( int i = 0; i < 100; i++ ) {
+    enqueue_frames( queue, MAX_QUEUE_LENGTH - get_packet_buffers_length( queue->buffers ), FRAME_LENGTH );
+    rewind_token_bucket( &queue->max_bucket, 10 );
+    while ( transmit() != NULL );
+  }
+
+  assert_true( queue->stats.tx_bytes >= MAX_RATE_BPS * 95 / 100 );
+  assert_true( queue->stats.tx_bytes <= MAX_RATE_BPS + MTU );
+}
+
+
+static void
+test_schedule_egress_queue_serves_queue_below_min_rate_first() {
+  egress_queue *guaranteed = add_queue( 1, 0, 0, MAX_RATE, EGRESS_QUEUE_RATE_UNCFG );
+  egress_queue *high = add_queue( 2, 1, 0, EGRESS_QUEUE_RATE_UNCFG, EGRESS_QUEUE_RATE_UNCFG );
+  set_egress_link_rate( scheduler, LINK_RATE );
+  enqueue_frames( guaranteed, 2, FRAME_LENGTH );
+  enqueue_frames( high, 2, FRAME_LENGTH );
+
+  rewind_token_bucket( &guaranteed->min_bucket, 10 );
+  assert_true( transmit() == guaranteed );
+
+  // then strict priority applies again
+  assert_true( transmit() == high );
+  assert_true( transmit() == high );
+  assert_true( transmit() == guaranteed );
+}
+
+
+/*************************************************************************
+ * Run tests.
+ *************************************************************************/
+
+int
+main() {
+  const UnitTest tests[] = {
+    unit_test_setup_teardown( test_create_egress_scheduler_adds_default_queue, setup, teardown ),
+    unit_test_setup_teardown( test_add_egress_queue_sorts_queues_by_priority, setup, teardown ),
+    unit_test_setup_teardown( test_add_egress_queue_fails_to_reconfigure_backlogged_queue, setup, teardown ),
+
+    unit_test_setup_teardown( test_schedule_egress_queue_returns_null_if_no_backlog, setup, teardown ),
+    unit_test_setup_teardown( test_schedule_egress_queue_serves_higher_priority_first, setup, teardown ),
+    unit_test_setup_teardown( test_schedule_egress_queue_shares_by_drr_quanta, setup, teardown ),
+    unit_test_setup_teardown( test_schedule_egress_queue_shares_bytes_fairly_among_frame_sizes, setup, teardown ),
+    unit_test_setup_teardown( test_schedule_egress_queue_resets_deficit_of_idle_queue, setup, teardown ),
+
+    unit_test_setup_teardown( test_token_bucket_starts_empty, setup, teardown ),
+    unit_test_setup_teardown( test_token_bucket_is_refilled_by_elapsed_time, setup, teardown ),
+    unit_test_setup_teardown( test_token_bucket_is_capped_by_burst_size, setup, teardown ),
+    unit_test_setup_teardown( test_schedule_egress_queue_throttles_queue_over_max_rate, setup, teardown ),
+    unit_test_setup_teardown( test_schedule_egress_queue_limits_throughput_to_max_rate, setup, teardown ),
+    unit_test_setup_teardown( test_schedule_egress_queue_serves_queue_below_min_rate_first, setup, teardown ),
+  };
+  return run_tests( tests );
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
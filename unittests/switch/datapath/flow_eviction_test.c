@@ -0,0 +1,269 @@
+/*
+ * Unit tests for flow_eviction.
+ *
+ * Copyright (C) 2012-2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cmockery_trema.h"
+#include "flow_eviction.h"
+
+
+/*************************************************************************
+ * Setup and teardown.
+ *************************************************************************/
+
+#define N_ENTRIES 256
+#define TABLE_SIZE 8
+
+
+static flow_eviction_index eviction;
+static flow_entry entries[ N_ENTRIES ];
+
+
+static void
+setup() {
+  memset( entries, 0, sizeof( entries ) );
+  for ( int i = 0; i < N_ENTRIES; i++ ) {
+    entries[ i ].eviction_index = FLOW_EVICTION_NOT_INDEXED;
+  }
+  init_flow_eviction_index( &eviction, FLOW_EVICTION_LRU );
+}
+
+
+static void
+teardown() {
+  finalize_flow_eviction_index( &eviction );
+}
+
+
+/*************************************************************************
+ * Helpers.
+ *************************************************************************/
+
+static void
+set_entry( flow_entry *entry, uint16_t priority, time_t last_seen_sec, uint16_t idle_timeout, uint16_t hard_timeout ) {
+  entry->priority = priority;
+  entry->created_at.tv_sec = 1;
+  entry->created_at.tv_nsec = 0;
+  entry->last_seen.tv_sec = last_seen_sec;
+  entry->last_seen.tv_nsec = 0;
+  entry->idle_timeout = idle_timeout;
+  entry->hard_timeout = hard_timeout;
+}
+
+
+static void
+assert_heap_order() {
+  for ( uint32_t i = 0; i < eviction.n_slots; i++ ) {
+    assert_true( eviction.slots[ i ].entry->eviction_index == i );
+    if ( i > 0 ) {
+      assert_true( eviction.slots[ ( i - 1 ) / 2 ].key <= eviction.slots[ i ].key );
+    }
+  }
+}
+
+
+/*
+ * Evicts an entry to add another one in the same way as a full flow
+ * table does.
+ */
+static flow_entry *
+replace_victim( flow_entry *entry ) {
+  flow_entry *victim = select_flow_entry_to_evict( &eviction );
+  assert_true( victim != NULL );
+  delete_flow_eviction_entry( &eviction, victim );
+  add_flow_eviction_entry( &eviction, entry );
+  assert_int_equal( eviction.n_slots, TABLE_SIZE );
+
+  return victim;
+}
+
+
+/*************************************************************************
+ * Heap tests.
+ *************************************************************************/
+
+static void
+test_index_keeps_heap_order_on_add_and_delete() {
+  uint32_t seed = 1;
+  for ( int i = 0; i < N_ENTRIES; i++ ) {
+    seed = seed * 1103515245 + 12345;
+    set_entry( &entries[ i ], 0, ( time_t ) ( seed >> 16 ) % 1000 + 1, 0, 0 );
+    add_flow_eviction_entry( &eviction, &entries[ i ] );
+  }
+  assert_int_equal( eviction.n_slots, N_ENTRIES );
+  assert_heap_order();
+
+  for ( int i = 0; i < N_ENTRIES; i += 3 ) {
+    delete_flow_eviction_entry( &eviction, &entries[ i ] );
+    assert_int_equal( entries[ i ].eviction_index, FLOW_EVICTION_NOT_INDEXED );
+    assert_heap_order();
+  }
+  assert_int_equal( eviction.n_slots, N_ENTRIES - ( N_ENTRIES + 2 ) / 3 );
+
+  // victims come out in the order of last_seen
+  time_t last = 0;
+  while ( eviction.n_slots > 0 ) {
+    flow_entry *victim = select_flow_entry_to_evict( &eviction );
+    assert_true( victim->last_seen.tv_sec >= last );
+    last = victim->last_seen.tv_sec;
+    delete_flow_eviction_entry( &eviction, victim );
+  }
+  assert_true( select_flow_entry_to_evict( &eviction ) == NULL );
+}
+
+
+static void
+test_delete_flow_eviction_entry_ignores_entry_not_indexed() {
+  set_entry( &entries[ 0 ], 0, 10, 0, 0 );
+  set_entry( &entries[ 1 ], 0, 20, 0, 0 );
+  add_flow_eviction_entry( &eviction, &entries[ 0 ] );
+
+  delete_flow_eviction_entry( &eviction, &entries[ 1 ] );
+  assert_int_equal( eviction.n_slots, 1 );
+  assert_true( select_flow_entry_to_evict( &eviction ) == &entries[ 0 ] );
+}
+
+
+static void
+test_table_miss_entry_is_never_evicted() {
+  set_entry( &entries[ 0 ], 0, 1, 0, 0 );
+  entries[ 0 ].table_miss = true;
+  add_flow_eviction_entry( &eviction, &entries[ 0 ] );
+
+  assert_int_equal( entries[ 0 ].eviction_index, FLOW_EVICTION_NOT_INDEXED );
+  assert_true( select_flow_entry_to_evict( &eviction ) == NULL );
+}
+
+
+/*************************************************************************
+ * Victim selection tests.
+ *************************************************************************/
+
+static void
+test_select_least_recently_seen_entry() {
+  for ( int i = 0; i < TABLE_SIZE; i++ ) {
+    set_entry( &entries[ i ], ( uint16_t ) i, 100 - i, 0, 0 );
+    add_flow_eviction_entry( &eviction, &entries[ i ] );
+  }
+  assert_true( select_flow_entry_to_evict( &eviction ) == &entries[ TABLE_SIZE - 1 ] );
+
+  // the key of an entry seen since it was indexed is refreshed
+  entries[ TABLE_SIZE - 1 ].last_seen.tv_sec = 200;
+  assert_true( select_flow_entry_to_evict( &eviction ) == &entries[ TABLE_SIZE - 2 ] );
+  assert_heap_order();
+}
+
+
+static void
+test_select_least_important_then_oldest_entry_when_table_is_full() {
+  set_flow_eviction_policy( &eviction, FLOW_EVICTION_IMPORTANCE );
+  const uint16_t priorities[ TABLE_SIZE ] = { 300, 100, 200, 100, 300, 200, 100, 200 };
+  const time_t last_seen[ TABLE_SIZE ] = { 10, 50, 20, 30, 5, 60, 40, 15 };
+  for ( int i = 0; i < TABLE_SIZE; i++ ) {
+    set_entry( &entries[ i ], priorities[ i ], last_seen[ i ], 0, 0 );
+    add_flow_eviction_entry( &eviction, &entries[ i ] );
+  }
+
+  // lower priority first, and older ones among the same priority
+  const int victims[] = { 3, 6, 1, 7, 2, 5, 4, 0 };
+  for ( int i = 0; i < TABLE_SIZE; i++ ) {
+    flow_entry *entry = &entries[ TABLE_SIZE + i ];
+    set_entry( entry, 400, 100 + i, 0, 0 );
+    assert_true( replace_victim( entry ) == &entries[ victims[ i ] ] );
+  }
+
+  // a high priority entry outlives low priority ones however recently seen
+  set_entry( &entries[ 2 * TABLE_SIZE ], 50, 1000, 0, 0 );
+  assert_true( replace_victim( &entries[ 2 * TABLE_SIZE ] ) == &entries[ TABLE_SIZE ] );
+  set_entry( &entries[ 2 * TABLE_SIZE + 1 ], 400, 1000, 0, 0 );
+  assert_true( replace_victim( &entries[ 2 * TABLE_SIZE + 1 ] ) == &entries[ 2 * TABLE_SIZE ] );
+  assert_heap_order();
+}
+
+
+static void
+test_select_entry_to_expire_first() {
+  set_flow_eviction_policy( &eviction, FLOW_EVICTION_EXPIRY );
+  set_entry( &entries[ 0 ], 0, 10, 0, 0 );    // never expires
+  set_entry( &entries[ 1 ], 0, 10, 0, 30 );   // expires at 31
+  set_entry( &entries[ 2 ], 0, 10, 5, 0 );    // expires at 15
+  set_entry( &entries[ 3 ], 0, 10, 30, 20 );  // expires at 21
+  for ( int i = 0; i < 4; i++ ) {
+    add_flow_eviction_entry( &eviction, &entries[ i ] );
+  }
+
+  assert_true( select_flow_entry_to_evict( &eviction ) == &entries[ 2 ] );
+
+  // idle timeout is extended by traffic
+  entries[ 2 ].last_seen.tv_sec = 40;
+  const int victims[] = { 3, 1, 2, 0 };
+  for ( int i = 0; i < 4; i++ ) {
+    flow_entry *victim = select_flow_entry_to_evict( &eviction );
+    assert_true( victim == &entries[ victims[ i ] ] );
+    delete_flow_eviction_entry( &eviction, victim );
+  }
+}
+
+
+static void
+test_set_flow_eviction_policy_reorders_entries() {
+  for ( int i = 0; i < TABLE_SIZE; i++ ) {
+    set_entry( &entries[ i ], ( uint16_t ) ( TABLE_SIZE - i ), 10 + i, 0, 0 );
+    add_flow_eviction_entry( &eviction, &entries[ i ] );
+  }
+  assert_true( select_flow_entry_to_evict( &eviction ) == &entries[ 0 ] );
+
+  set_flow_eviction_policy( &eviction, FLOW_EVICTION_IMPORTANCE );
+  assert_heap_order();
+  assert_true( select_flow_entry_to_evict( &eviction ) == &entries[ TABLE_SIZE - 1 ] );
+
+  set_flow_eviction_policy( &eviction, FLOW_EVICTION_LRU );
+  assert_heap_order();
+  assert_true( select_flow_entry_to_evict( &eviction ) == &entries[ 0 ] );
+}
+
+
+/*************************************************************************
+ * Run tests.
+ *************************************************************************/
+
+int
+main() {
+  const UnitTest tests[] = {
+    unit_test_setup_teardown( test_index_keeps_heap_order_on_add_and_delete, setup, teardown ),
+    unit_test_setup_teardown( test_delete_flow_eviction_entry_ignores_entry_not_indexed, setup, teardown ),
+    unit_test_setup_teardown( test_table_miss_entry_is_never_evicted, setup, teardown ),
+
+    unit_test_setup_teardown( test_select_least_recently_seen_entry, setup, teardown ),
+    unit_test_setup_teardown( test_select_least_important_then_oldest_entry_when_table_is_full, setup, teardown ),
+    unit_test_setup_teardown( test_select_entry_to_expire_first, setup, teardown ),
+    unit_test_setup_teardown( test_set_flow_eviction_policy_reorders_entries, setup, teardown ),
+  };
+  return run_tests( tests );
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
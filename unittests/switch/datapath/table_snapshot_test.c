@@ -0,0 +1,345 @@
+/*
+ * Unit tests for table_snapshot.
+ *
+ * Copyright (C) 2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "cmockery_trema.h"
+#include "flow_table.h"
+#include "group_table.h"
+#include "meter_table.h"
+#include "switch_port.h"
+#include "table_manager.h"
+#include "table_snapshot.h"
+
+
+/*************************************************************************
+ * Setup and teardown.
+ *************************************************************************/
+
+#define SNAPSHOT_FILE "/tmp/table_snapshot_test.snapshot"
+#define DATAPATH_ID 0xabc
+#define MAX_FLOW_ENTRIES 16
+
+#define METER_ID 1
+#define GROUP_ID 2
+#define IN_PORT 3
+#define OUT_PORT OFPP_CONTROLLER
+#define PRIORITY 100
+#define IDLE_TIMEOUT 30
+#define HARD_TIMEOUT 60
+#define COOKIE 0x1234
+#define FLOW_AGE_SEC 10
+#define FLOW_IDLE_AGE_SEC 3
+
+// offset of the version in the snapshot header ( after the magic )
+#define VERSION_OFFSET 8
+
+
+static void
+setup() {
+  unlink( SNAPSHOT_FILE );
+  init_switch_port();
+  init_table_manager( MAX_FLOW_ENTRIES );
+}
+
+
+static void
+teardown() {
+  finalize_table_manager();
+  finalize_switch_port();
+  unlink( SNAPSHOT_FILE );
+}
+
+
+/*************************************************************************
+ * Helpers.
+ *************************************************************************/
+
+static void
+reset_tables() {
+  finalize_table_manager();
+  init_table_manager( MAX_FLOW_ENTRIES );
+}
+
+
+static void
+add_meter() {
+  struct ofp_meter_band_drop band;
+  memset( &band, 0, sizeof( band ) );
+  band.type = OFPMBT_DROP;
+  band.len = sizeof( band );
+  band.rate = 1000;
+  band.burst_size = 100;
+  list_element *bands = NULL;
+  create_list( &bands );
+  append_to_tail( &bands, &band );
+  assert_int_equal( add_meter_entry( OFPMF_KBPS, METER_ID, bands ), OFDPE_SUCCESS );
+  delete_list( bands );
+
+  meter_entry *entry = lookup_meter_entry( METER_ID );
+  entry->packet_count = 10;
+  entry->byte_count = 1000;
+  entry->bands[ 0 ].packet_count = 2;
+  entry->bands[ 0 ].byte_count = 200;
+}
+
+
+static void
+add_group() {
+  action_list *actions = create_action_list();
+  assert_int_equal( append_action( actions, create_action_output( OUT_PORT, 0 ) ), OFDPE_SUCCESS );
+  bucket_list *buckets = create_action_bucket_list();
+  bucket *bucket = create_action_bucket( 0, OFPP_ANY, OFPG_ANY, actions );
+  bucket->packet_count = 20;
+  bucket->byte_count = 2000;
+  append_action_bucket( buckets, bucket );
+
+  group_entry *entry = alloc_group_entry( OFPGT_ALL, GROUP_ID, buckets );
+  assert_true( entry != NULL );
+  entry->packet_count = 30;
+  entry->byte_count = 3000;
+  assert_int_equal( add_group_entry( entry ), OFDPE_SUCCESS );
+}
+
+
+static match *
+create_flow_match() {
+  match *match = create_match();
+  match->in_port.value = IN_PORT;
+  match->in_port.mask = UINT32_MAX;
+  match->in_port.valid = true;
+
+  return match;
+}
+
+
+static void
+add_flow() {
+  instruction_set *instructions = create_instruction_set();
+  add_instruction( instructions, alloc_instruction_meter( METER_ID ) );
+  action_list *actions = create_action_list();
+  assert_int_equal( append_action( actions, create_action_group( GROUP_ID ) ), OFDPE_SUCCESS );
+  add_instruction( instructions, alloc_instruction_apply_actions( actions ) );
+
+  flow_entry *entry = alloc_flow_entry( create_flow_match(), instructions, PRIORITY, IDLE_TIMEOUT, HARD_TIMEOUT,
+                                        OFPFF_SEND_FLOW_REM, COOKIE );
+  assert_true( entry != NULL );
+  entry->packet_count = 40;
+  entry->byte_count = 4000;
+  entry->created_at.tv_sec -= FLOW_AGE_SEC;
+  entry->last_seen.tv_sec -= FLOW_IDLE_AGE_SEC;
+  assert_int_equal( add_flow_entry( 0, entry, 0 ), OFDPE_SUCCESS );
+}
+
+
+static flow_entry *
+lookup_flow() {
+  match *match = create_flow_match();
+  flow_entry *entry = lookup_flow_entry_strict( 0, match, PRIORITY );
+  delete_match( match );
+
+  return entry;
+}
+
+
+static void
+save_tables() {
+  add_meter();
+  add_group();
+  add_flow();
+  assert_int_equal( save_table_snapshot( SNAPSHOT_FILE, DATAPATH_ID ), OFDPE_SUCCESS );
+  reset_tables();
+}
+
+
+static void
+assert_tables_are_empty() {
+  assert_true( lookup_meter_entry( METER_ID ) == NULL );
+  assert_true( lookup_group_entry( GROUP_ID ) == NULL );
+  assert_true( lookup_flow() == NULL );
+}
+
+
+static void
+assert_age_sec( const struct timespec *since, time_t expected ) {
+  struct timespec now;
+  time_now( &now );
+  struct timespec age = { 0, 0 };
+  timespec_diff( *since, now, &age );
+  assert_true( age.tv_sec >= expected && age.tv_sec <= expected + 1 );
+}
+
+
+/*************************************************************************
+ * save_table_snapshot() and load_table_snapshot() tests.
+ *************************************************************************/
+
+static void
+test_load_table_snapshot_restores_entries_and_counters() {
+  save_tables();
+  assert_tables_are_empty();
+
+  assert_int_equal( load_table_snapshot( SNAPSHOT_FILE, DATAPATH_ID ), OFDPE_SUCCESS );
+
+  meter_entry *meter = lookup_meter_entry( METER_ID );
+  assert_true( meter != NULL );
+  assert_int_equal( meter->flags, OFPMF_KBPS );
+  assert_int_equal( meter->bands_count, 1 );
+  assert_int_equal( meter->bands[ 0 ].type, OFPMBT_DROP );
+  assert_int_equal( meter->bands[ 0 ].rate, 1000 );
+  assert_int_equal( meter->bands[ 0 ].burst_size, 100 );
+  assert_int_equal( meter->bands[ 0 ].packet_count, 2 );
+  assert_int_equal( meter->bands[ 0 ].byte_count, 200 );
+  assert_int_equal( meter->packet_count, 10 );
+  assert_int_equal( meter->byte_count, 1000 );
+
+  group_entry *group = lookup_group_entry( GROUP_ID );
+  assert_true( group != NULL );
+  assert_int_equal( group->type, OFPGT_ALL );
+  assert_int_equal( group->packet_count, 30 );
+  assert_int_equal( group->byte_count, 3000 );
+  assert_int_equal( get_bucket_count( group->buckets ), 1 );
+  bucket *bucket = get_first_element( group->buckets )->data;
+  assert_int_equal( bucket->packet_count, 20 );
+  assert_int_equal( bucket->byte_count, 2000 );
+  action *output = get_first_element( bucket->actions )->data;
+  assert_int_equal( output->type, OFPAT_OUTPUT );
+  assert_int_equal( output->port, OUT_PORT );
+
+  flow_entry *flow = lookup_flow();
+  assert_true( flow != NULL );
+  assert_int_equal( flow->idle_timeout, IDLE_TIMEOUT );
+  assert_int_equal( flow->hard_timeout, HARD_TIMEOUT );
+  assert_int_equal( flow->flags, OFPFF_SEND_FLOW_REM );
+  assert_int_equal( flow->cookie, COOKIE );
+  assert_int_equal( flow->packet_count, 40 );
+  assert_int_equal( flow->byte_count, 4000 );
+  assert_true( flow->instructions->meter != NULL );
+  assert_int_equal( flow->instructions->meter->meter_id, METER_ID );
+  assert_true( flow->instructions->apply_actions != NULL );
+  action *group_action = get_first_element( flow->instructions->apply_actions->actions )->data;
+  assert_int_equal( group_action->type, OFPAT_GROUP );
+  assert_int_equal( group_action->group_id, GROUP_ID );
+}
+
+
+static void
+test_load_table_snapshot_continues_timeouts_from_snapshot_time() {
+  save_tables();
+
+  assert_int_equal( load_table_snapshot( SNAPSHOT_FILE, DATAPATH_ID ), OFDPE_SUCCESS );
+
+  flow_entry *flow = lookup_flow();
+  assert_true( flow != NULL );
+  assert_age_sec( &flow->created_at, FLOW_AGE_SEC );
+  assert_age_sec( &flow->last_seen, FLOW_IDLE_AGE_SEC );
+  assert_age_sec( &lookup_meter_entry( METER_ID )->created_at, 0 );
+  assert_age_sec( &lookup_group_entry( GROUP_ID )->created_at, 0 );
+}
+
+
+static void
+test_load_table_snapshot_fails_if_not_found() {
+  assert_int_equal( load_table_snapshot( SNAPSHOT_FILE, DATAPATH_ID ), ERROR_NOT_FOUND );
+}
+
+
+static void
+test_load_table_snapshot_rejects_truncated_image() {
+  save_tables();
+  struct stat st;
+  assert_int_equal( stat( SNAPSHOT_FILE, &st ), 0 );
+  assert_int_equal( truncate( SNAPSHOT_FILE, st.st_size - 1 ), 0 );
+
+  assert_int_equal( load_table_snapshot( SNAPSHOT_FILE, DATAPATH_ID ), OFDPE_FAILED );
+  // nothing is installed even though meters and groups are intact
+  assert_tables_are_empty();
+}
+
+
+static void
+test_load_table_snapshot_rejects_trailing_data() {
+  save_tables();
+  int fd = open( SNAPSHOT_FILE, O_WRONLY | O_APPEND );
+  assert_true( fd >= 0 );
+  assert_int_equal( write( fd, "x", 1 ), 1 );
+  close( fd );
+
+  assert_int_equal( load_table_snapshot( SNAPSHOT_FILE, DATAPATH_ID ), OFDPE_FAILED );
+  assert_tables_are_empty();
+}
+
+
+static void
+test_load_table_snapshot_rejects_version_mismatch() {
+  save_tables();
+  uint32_t version = 0xffffffff;
+  int fd = open( SNAPSHOT_FILE, O_WRONLY );
+  assert_true( fd >= 0 );
+  assert_int_equal( pwrite( fd, &version, sizeof( version ), VERSION_OFFSET ), sizeof( version ) );
+  close( fd );
+
+  assert_int_equal( load_table_snapshot( SNAPSHOT_FILE, DATAPATH_ID ), OFDPE_FAILED );
+  assert_tables_are_empty();
+}
+
+
+static void
+test_load_table_snapshot_rejects_another_datapath() {
+  save_tables();
+
+  assert_int_equal( load_table_snapshot( SNAPSHOT_FILE, DATAPATH_ID + 1 ), OFDPE_FAILED );
+  assert_tables_are_empty();
+}
+
+
+/*************************************************************************
+ * Run tests.
+ *************************************************************************/
+
+int
+main() {
+  add_thread();
+  init_timer_safe();
+
+  const UnitTest tests[] = {
+    unit_test_setup_teardown( test_load_table_snapshot_restores_entries_and_counters, setup, teardown ),
+    unit_test_setup_teardown( test_load_table_snapshot_continues_timeouts_from_snapshot_time, setup, teardown ),
+    unit_test_setup_teardown( test_load_table_snapshot_fails_if_not_found, setup, teardown ),
+
+    unit_test_setup_teardown( test_load_table_snapshot_rejects_truncated_image, setup, teardown ),
+    unit_test_setup_teardown( test_load_table_snapshot_rejects_trailing_data, setup, teardown ),
+    unit_test_setup_teardown( test_load_table_snapshot_rejects_version_mismatch, setup, teardown ),
+    unit_test_setup_teardown( test_load_table_snapshot_rejects_another_datapath, setup, teardown ),
+  };
+  return run_tests( tests );
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,306 @@
+/*
+ * Unit tests for packet_in_table.
+ *
+ * Copyright (C) 2008-2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cmockery_trema.h"
+#include "trema.h"
+#include "packet_in_table.h"
+
+
+/*************************************************************************
+ * Functions to be tested.
+ *************************************************************************/
+
+bool make_flow_key( packet_in_key_t *key, const uint8_t *frame, size_t length );
+unsigned int hash_flow_key( const void *key );
+
+
+/*************************************************************************
+ * Setup and teardown.
+ *************************************************************************/
+
+#define INTERVAL_MSEC 100
+#define MAX_ENTRIES 4096
+#define FRAME_LENGTH 60
+#define IN_PORT 1
+#define SRC_ADDR 0xc0a80001
+#define DST_PORT 53
+
+
+static packet_in_table_t *table = NULL;
+static struct timespec now;
+
+
+int
+mock_clock_gettime( clockid_t clk_id, struct timespec *tp ) {
+  assert_int_equal( clk_id, CLOCK_MONOTONIC );
+  *tp = now;
+
+  return 0;
+}
+
+
+static void
+setup() {
+  now.tv_sec = 1000;
+  now.tv_nsec = 0;
+  table = create_packet_in_table( INTERVAL_MSEC );
+}
+
+
+static void
+teardown() {
+  delete_packet_in_table( table );
+  table = NULL;
+}
+
+
+/*************************************************************************
+ * Helpers.
+ *************************************************************************/
+
+static buffer *
+create_udp_frame( uint32_t saddr, uint16_t src_port, uint16_t dst_port ) {
+  buffer *frame = alloc_buffer_with_length( FRAME_LENGTH );
+  uint8_t *p = append_back_buffer( frame, FRAME_LENGTH );
+  memset( p, 0, FRAME_LENGTH );
+
+  const uint8_t macda[] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x02 };
+  const uint8_t macsa[] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x01 };
+  memcpy( p, macda, sizeof( macda ) );
+  memcpy( p + 6, macsa, sizeof( macsa ) );
+  p[ 12 ] = 0x08; // IPv4
+  p[ 13 ] = 0x00;
+
+  uint8_t *ip = p + 14;
+  ip[ 0 ] = 0x45;
+  ip[ 2 ] = 0;
+  ip[ 3 ] = 46;
+  ip[ 8 ] = 64;
+  ip[ 9 ] = IPPROTO_UDP;
+  uint32_t nsaddr = htonl( saddr );
+  const uint8_t daddr[] = { 192, 168, 0, 2 };
+  memcpy( ip + 12, &nsaddr, sizeof( nsaddr ) );
+  memcpy( ip + 16, daddr, sizeof( daddr ) );
+
+  uint8_t *udp = ip + 20;
+  udp[ 0 ] = ( uint8_t ) ( src_port >> 8 );
+  udp[ 1 ] = ( uint8_t ) src_port;
+  udp[ 2 ] = ( uint8_t ) ( dst_port >> 8 );
+  udp[ 3 ] = ( uint8_t ) dst_port;
+
+  return frame;
+}
+
+
+static buffer *
+create_udp_packet_in( uint32_t in_port, uint32_t saddr, uint16_t src_port, uint16_t dst_port ) {
+  buffer *frame = create_udp_frame( saddr, src_port, dst_port );
+  oxm_matches *match = create_oxm_matches();
+  append_oxm_match_in_port( match, in_port );
+
+  buffer *packet_in = create_packet_in( 0, OFP_NO_BUFFER, FRAME_LENGTH, OFPR_NO_MATCH, 0, 0, match, frame );
+
+  delete_oxm_matches( match );
+  free_buffer( frame );
+
+  return packet_in;
+}
+
+
+static bool
+suppress_udp_packet_in( uint32_t in_port, uint32_t saddr, uint16_t src_port, uint16_t dst_port ) {
+  buffer *packet_in = create_udp_packet_in( in_port, saddr, src_port, dst_port );
+  bool suppressed = suppress_packet_in( table, packet_in );
+  free_buffer( packet_in );
+
+  return suppressed;
+}
+
+
+static void
+advance_clock( long msec ) {
+  struct timespec delta = { msec / 1000, ( msec % 1000 ) * 1000000 };
+  ADD_TIMESPEC( &now, &delta, &now );
+}
+
+
+static int
+compare_uint64( const void *x, const void *y ) {
+  uint64_t a = *( const uint64_t * ) x;
+  uint64_t b = *( const uint64_t * ) y;
+
+  return a < b ? -1 : a > b ? 1 : 0;
+}
+
+
+/*
+ * Looks for two UDP flows, told by the source address and port, whose
+ * flow keys have the same hash.
+ */
+static bool
+find_colliding_flows( uint32_t *saddrs, uint16_t *ports ) {
+  static uint64_t candidates[ 1 << 18 ];
+  const uint32_t n_candidates = sizeof( candidates ) / sizeof( candidates[ 0 ] );
+
+  for ( uint32_t i = 0; i < n_candidates; i++ ) {
+    buffer *frame = create_udp_frame( i * 2654435761U, ( uint16_t ) ( i * 40503U ), DST_PORT );
+    packet_in_key_t key;
+    assert_true( make_flow_key( &key, frame->data, frame->length ) );
+    candidates[ i ] = ( ( uint64_t ) hash_flow_key( &key ) << 32 ) | i;
+    free_buffer( frame );
+  }
+  qsort( candidates, n_candidates, sizeof( candidates[ 0 ] ), compare_uint64 );
+
+  for ( uint32_t i = 1; i < n_candidates; i++ ) {
+    if ( ( candidates[ i - 1 ] >> 32 ) == ( candidates[ i ] >> 32 ) ) {
+      for ( uint32_t j = 0; j < 2; j++ ) {
+        uint32_t found = ( uint32_t ) candidates[ i - 1 + j ];
+        saddrs[ j ] = found * 2654435761U;
+        ports[ j ] = ( uint16_t ) ( found * 40503U );
+      }
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+/*************************************************************************
+ * suppress_packet_in() tests.
+ *************************************************************************/
+
+static void
+test_suppress_packet_in_suppresses_repeated_packet_in() {
+  assert_false( suppress_udp_packet_in( IN_PORT, SRC_ADDR, 1024, DST_PORT ) );
+  assert_true( suppress_udp_packet_in( IN_PORT, SRC_ADDR, 1024, DST_PORT ) );
+  assert_true( suppress_udp_packet_in( IN_PORT, SRC_ADDR, 1024, DST_PORT ) );
+
+  packet_in_table_stats_t stats;
+  get_packet_in_table_stats( table, &stats );
+  assert_true( stats.forwarded == 1 );
+  assert_true( stats.suppressed == 2 );
+}
+
+
+static void
+test_suppress_packet_in_forwards_other_flows() {
+  assert_false( suppress_udp_packet_in( IN_PORT, SRC_ADDR, 1024, DST_PORT ) );
+  assert_false( suppress_udp_packet_in( IN_PORT, SRC_ADDR, 1025, DST_PORT ) );
+  assert_false( suppress_udp_packet_in( IN_PORT + 1, SRC_ADDR, 1024, DST_PORT ) );
+  assert_int_equal( table->n_entries, 2 );
+}
+
+
+static void
+test_suppress_packet_in_forwards_after_window_expires() {
+  assert_false( suppress_udp_packet_in( IN_PORT, SRC_ADDR, 1024, DST_PORT ) );
+
+  advance_clock( INTERVAL_MSEC - 1 );
+  assert_true( suppress_udp_packet_in( IN_PORT, SRC_ADDR, 1024, DST_PORT ) );
+
+  advance_clock( 1 );
+  assert_false( suppress_udp_packet_in( IN_PORT, SRC_ADDR, 1024, DST_PORT ) );
+  assert_int_equal( table->n_entries, 1 );
+}
+
+
+static void
+test_suppress_packet_in_caps_number_of_windows() {
+  for ( uint32_t i = 0; i < MAX_ENTRIES; i++ ) {
+    assert_false( suppress_udp_packet_in( IN_PORT, SRC_ADDR, ( uint16_t ) i, DST_PORT ) );
+  }
+  assert_int_equal( table->n_entries, MAX_ENTRIES );
+
+  // a new flow closes the oldest window
+  assert_false( suppress_udp_packet_in( IN_PORT, SRC_ADDR, MAX_ENTRIES, DST_PORT ) );
+  assert_int_equal( table->n_entries, MAX_ENTRIES );
+  assert_true( suppress_udp_packet_in( IN_PORT, SRC_ADDR, MAX_ENTRIES - 1, DST_PORT ) );
+  assert_true( suppress_udp_packet_in( IN_PORT, SRC_ADDR, 1, DST_PORT ) );
+  assert_false( suppress_udp_packet_in( IN_PORT, SRC_ADDR, 0, DST_PORT ) );
+  assert_int_equal( table->n_entries, MAX_ENTRIES );
+}
+
+
+static void
+test_suppress_packet_in_tells_flows_with_same_hash_apart() {
+  uint32_t saddrs[ 2 ];
+  uint16_t ports[ 2 ];
+  assert_true( find_colliding_flows( saddrs, ports ) );
+
+  assert_false( suppress_udp_packet_in( IN_PORT, saddrs[ 0 ], ports[ 0 ], DST_PORT ) );
+  assert_false( suppress_udp_packet_in( IN_PORT, saddrs[ 1 ], ports[ 1 ], DST_PORT ) );
+  assert_true( suppress_udp_packet_in( IN_PORT, saddrs[ 0 ], ports[ 0 ], DST_PORT ) );
+  assert_true( suppress_udp_packet_in( IN_PORT, saddrs[ 1 ], ports[ 1 ], DST_PORT ) );
+  assert_int_equal( table->n_entries, 2 );
+}
+
+
+/*************************************************************************
+ * clear_packet_in_window() tests.
+ *************************************************************************/
+
+static void
+test_clear_packet_in_window_by_unbuffered_packet_out() {
+  assert_false( suppress_udp_packet_in( IN_PORT, SRC_ADDR, 1024, DST_PORT ) );
+
+  buffer *frame = create_udp_frame( SRC_ADDR, 1024, DST_PORT );
+  buffer *packet_out = create_packet_out( 0, OFP_NO_BUFFER, IN_PORT, NULL, frame );
+  clear_packet_in_window( table, packet_out );
+  free_buffer( packet_out );
+  free_buffer( frame );
+
+  assert_int_equal( table->n_entries, 0 );
+  assert_false( suppress_udp_packet_in( IN_PORT, SRC_ADDR, 1024, DST_PORT ) );
+
+  packet_in_table_stats_t stats;
+  get_packet_in_table_stats( table, &stats );
+  assert_true( stats.cleared == 1 );
+}
+
+
+/*************************************************************************
+ * Run tests.
+ *************************************************************************/
+
+int
+main() {
+  const UnitTest tests[] = {
+    unit_test_setup_teardown( test_suppress_packet_in_suppresses_repeated_packet_in, setup, teardown ),
+    unit_test_setup_teardown( test_suppress_packet_in_forwards_other_flows, setup, teardown ),
+    unit_test_setup_teardown( test_suppress_packet_in_forwards_after_window_expires, setup, teardown ),
+    unit_test_setup_teardown( test_suppress_packet_in_caps_number_of_windows, setup, teardown ),
+    unit_test_setup_teardown( test_suppress_packet_in_tells_flows_with_same_hash_apart, setup, teardown ),
+
+    unit_test_setup_teardown( test_clear_packet_in_window_by_unbuffered_packet_out, setup, teardown ),
+  };
+  return run_tests( tests );
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
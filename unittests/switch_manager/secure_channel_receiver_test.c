@@ -0,0 +1,191 @@
+/*
+ * Unit tests for secure_channel_receiver.
+ *
+ * Copyright (C) 2008-2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "cmockery_trema.h"
+#include "trema.h"
+#include "secure_channel_receiver.h"
+
+
+static struct switch_info sw_info;
+static int peer_fd = -1;
+static bool hold_first_message = false;
+static buffer *held_message = NULL;
+static bool release_slab_while_holding = false;
+static const void *handled_data[ 2 ];
+static int handled_count = 0;
+
+
+/*************************************************************************
+ * Mocks.
+ *************************************************************************/
+
+int
+ofpmsg_recv( struct switch_info *info, buffer *buf ) {
+  assert_true( info == &sw_info );
+  assert_true( handled_count < 2 );
+
+  handled_data[ handled_count++ ] = buf->data;
+  if ( hold_first_message && held_message == NULL ) {
+    // the first message outlives its handler
+    held_message = buf;
+    if ( release_slab_while_holding ) {
+      release_receive_slab( info );
+    }
+    return 0;
+  }
+  free_buffer( buf );
+
+  return 0;
+}
+
+
+int
+ofpmsg_send_error_msg( struct switch_info *info, uint16_t type, uint16_t code, buffer *data ) {
+  UNUSED( info );
+  UNUSED( type );
+  UNUSED( code );
+  UNUSED( data );
+
+  return 0;
+}
+
+
+/*************************************************************************
+ * Setup and teardown.
+ *************************************************************************/
+
+static void
+setup() {
+  int fds[ 2 ];
+  assert_int_equal( socketpair( AF_UNIX, SOCK_STREAM, 0, fds ), 0 );
+
+  memset( &sw_info, 0, sizeof( sw_info ) );
+  sw_info.secure_channel_fd = fds[ 0 ];
+  sw_info.recv_queue = create_message_queue();
+  peer_fd = fds[ 1 ];
+  hold_first_message = false;
+  held_message = NULL;
+  release_slab_while_holding = false;
+  handled_count = 0;
+}
+
+
+static void
+teardown() {
+  if ( held_message != NULL ) {
+    free_buffer( held_message );
+    held_message = NULL;
+  }
+  release_receive_slab( &sw_info );
+  delete_message_queue( sw_info.recv_queue );
+  close( sw_info.secure_channel_fd );
+  close( peer_fd );
+}
+
+
+/*************************************************************************
+ * Helpers.
+ *************************************************************************/
+
+static void
+send_two_echo_requests() {
+  struct ofp_header requests[ 2 ];
+  for ( int i = 0; i < 2; i++ ) {
+    requests[ i ].version = OFP_VERSION;
+    requests[ i ].type = OFPT_ECHO_REQUEST;
+    requests[ i ].length = htons( sizeof( struct ofp_header ) );
+    requests[ i ].xid = htonl( ( uint32_t ) i );
+  }
+  assert_int_equal( write( peer_fd, requests, sizeof( requests ) ), sizeof( requests ) );
+
+  assert_int_equal( recv_from_secure_channel( &sw_info ), 0 );
+  assert_int_equal( sw_info.recv_queue->length, 2 );
+}
+
+
+/*************************************************************************
+ * Tests.
+ *************************************************************************/
+
+static void
+test_message_is_handled_in_place() {
+  send_two_echo_requests();
+
+  assert_int_equal( handle_messages_from_secure_channel( &sw_info ), 0 );
+
+  assert_int_equal( handled_count, 2 );
+  assert_true( handled_data[ 1 ] == ( const char * ) handled_data[ 0 ] + sizeof( struct ofp_header ) );
+}
+
+
+static void
+test_message_after_held_message_is_copied() {
+  hold_first_message = true;
+  send_two_echo_requests();
+
+  assert_int_equal( handle_messages_from_secure_channel( &sw_info ), 0 );
+
+  assert_int_equal( handled_count, 2 );
+  assert_true( handled_data[ 1 ] != ( const char * ) handled_data[ 0 ] + sizeof( struct ofp_header ) );
+  assert_int_equal( ntohl( ( ( struct ofp_header * ) held_message->data )->xid ), 0 );
+}
+
+
+static void
+test_message_after_held_message_is_copied_across_slab_switch() {
+  hold_first_message = true;
+  release_slab_while_holding = true;
+  send_two_echo_requests();
+
+  assert_int_equal( handle_messages_from_secure_channel( &sw_info ), 0 );
+
+  assert_true( sw_info.recv_slab == NULL );
+  assert_int_equal( handled_count, 2 );
+  assert_true( handled_data[ 1 ] != ( const char * ) handled_data[ 0 ] + sizeof( struct ofp_header ) );
+  assert_int_equal( ntohl( ( ( struct ofp_header * ) held_message->data )->xid ), 0 );
+}
+
+
+/*************************************************************************
+ * Run tests.
+ *************************************************************************/
+
+int
+main() {
+  const UnitTest tests[] = {
+    unit_test_setup_teardown( test_message_is_handled_in_place, setup, teardown ),
+    unit_test_setup_teardown( test_message_after_held_message_is_copied, setup, teardown ),
+    unit_test_setup_teardown( test_message_after_held_message_is_copied_across_slab_switch, setup, teardown ),
+  };
+  return run_tests( tests );
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
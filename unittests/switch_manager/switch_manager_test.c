@@ -41,6 +41,8 @@ void secure_channel_fd_isset( fd_set *read_set, fd_set *write_set );
 char *absolute_path( const char *dir, const char *file );
 int switch_manager_main( int argc, char *argv[] );
 void wait_child( void );
+bool parse_argument( struct listener_info *listener_info, int argc, char *argv[] );
+void dispatch_to_switch_daemon( struct listener_info *listener_info, int accept_fd, struct sockaddr_in *addr );
 
 
 /*************************************************************************
@@ -284,6 +286,37 @@ mock_exit( int status ) {
 }
 
 
+int
+mock_socketpair( int domain, int type, int protocol, int sv[ 2 ] ) {
+  check_expected( domain );
+  check_expected( type );
+  check_expected( protocol );
+
+  sv[ 0 ] = ( int ) mock();
+  sv[ 1 ] = ( int ) mock();
+
+  return ( int ) mock();
+}
+
+
+ssize_t
+mock_sendmsg( int sockfd, const struct msghdr *msg, int flags ) {
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR( msg );
+  uint32_t cmsg_type32 = ( uint32_t ) cmsg->cmsg_type;
+  int passed_fd;
+  memcpy( &passed_fd, CMSG_DATA( cmsg ), sizeof( int ) );
+  const struct sockaddr_in *passed_addr = msg->msg_iov[ 0 ].iov_base;
+
+  check_expected( sockfd );
+  check_expected( cmsg_type32 );
+  check_expected( passed_fd );
+  check_expected( passed_addr->sin_port );
+  check_expected( flags );
+
+  return ( ssize_t ) mock();
+}
+
+
 /*************************************************************************
  * Test functions for switch_manager.c
  *************************************************************************/
@@ -1125,6 +1158,304 @@ test_secure_channel_accept_child_and_args_succeeded() {
 }
 
 
+/*************************************************************************
+ * Test functions for the -m option and the switch daemon shards.
+ *************************************************************************/
+
+static void
+test_parse_argument_multi_switch_option_succeeded() {
+  setup();
+
+  char *argv[] = {
+      ( char * )( uintptr_t )"switch_manager",
+      ( char * )( uintptr_t )"-m",
+      ( char * )( uintptr_t )"4",
+      NULL,
+    };
+  int argc = ARRAY_SIZE( argv ) - 1;
+
+  listener_info.n_shards = 0;
+
+  optind = 1;
+  assert_true( parse_argument( &listener_info, argc, argv ) );
+  assert_int_equal( listener_info.n_shards, 4 );
+  assert_int_equal( listener_info.switch_daemon_argc, 0 );
+
+  teardown();
+}
+
+
+static void
+test_parse_argument_long_multi_switch_option_succeeded() {
+  setup();
+
+  char *argv[] = {
+      ( char * )( uintptr_t )"switch_manager",
+      ( char * )( uintptr_t )"--multi-switch=2",
+      ( char * )( uintptr_t )"--",
+      ( char * )( uintptr_t )"--no-flow-cleanup",
+      NULL,
+    };
+  int argc = ARRAY_SIZE( argv ) - 1;
+
+  listener_info.n_shards = 0;
+
+  optind = 1;
+  assert_true( parse_argument( &listener_info, argc, argv ) );
+  assert_int_equal( listener_info.n_shards, 2 );
+  assert_int_equal( listener_info.switch_daemon_argc, 1 );
+  assert_string_equal( listener_info.switch_daemon_argv[ 0 ], "--no-flow-cleanup" );
+
+  teardown();
+}
+
+
+static void
+test_parse_argument_multi_switch_option_failed() {
+  setup();
+
+  const char *invalid_values[] = { "0", "-1", "two", "" };
+  for ( size_t i = 0; i < ARRAY_SIZE( invalid_values ); i++ ) {
+    char *argv[] = {
+        ( char * )( uintptr_t )"switch_manager",
+        ( char * )( uintptr_t )"-m",
+        ( char * )( uintptr_t )invalid_values[ i ],
+        NULL,
+      };
+    int argc = ARRAY_SIZE( argv ) - 1;
+
+    listener_info.n_shards = 0;
+
+    optind = 1;
+    assert_false( parse_argument( &listener_info, argc, argv ) );
+    assert_int_equal( listener_info.n_shards, 0 );
+  }
+
+  teardown();
+}
+
+
+static void
+expect_socketpair( int fd0, int fd1, int ret ) {
+  expect_value( mock_socketpair, domain, AF_UNIX );
+  expect_value( mock_socketpair, type, SOCK_SEQPACKET );
+  expect_value( mock_socketpair, protocol, 0 );
+  will_return( mock_socketpair, fd0 );
+  will_return( mock_socketpair, fd1 );
+  will_return( mock_socketpair, ret );
+}
+
+
+static void
+test_start_switch_daemon_shards_parent_succeeded() {
+  setup();
+
+  listener_info.listen_fd = 5;
+  listener_info.n_shards = 2;
+  listener_info.next_shard = 7;
+
+  expect_socketpair( 10, 11, 0 );
+  will_return( mock_fork, 1234 );
+  expect_value( mock_close, fd, 11 );
+  will_return( mock_close, 0 );
+
+  expect_socketpair( 12, 13, 0 );
+  will_return( mock_fork, 1235 );
+  expect_value( mock_close, fd, 13 );
+  will_return( mock_close, 0 );
+
+  assert_true( start_switch_daemon_shards( &listener_info ) );
+  assert_int_equal( listener_info.shard_fds[ 0 ], 10 );
+  assert_int_equal( listener_info.shard_fds[ 1 ], 12 );
+  assert_int_equal( listener_info.next_shard, 0 );
+
+  xfree( listener_info.shard_fds );
+  listener_info.shard_fds = NULL;
+
+  teardown();
+}
+
+
+static void
+ignore_die( const char *format, ... ) {
+  UNUSED( format );
+}
+
+
+static void
+test_start_switch_daemon_shards_child_succeeded() {
+  setup();
+
+  void ( *original_die )( const char *format, ... ) = die;
+  die = ignore_die;
+  set_trema_name( "switch_manager" );
+
+  listener_info.switch_daemon = "switch_daemon";
+  listener_info.switch_daemon_argc = 0;
+  listener_info.listen_fd = 5;
+  listener_info.n_shards = 2;
+
+  // the first daemon is started already
+  expect_socketpair( 10, 11, 0 );
+  will_return( mock_fork, 1234 );
+  expect_value( mock_close, fd, 11 );
+  will_return( mock_close, 0 );
+
+  // the second one closes the listening socket and the control
+  // socket of the first one
+  expect_socketpair( 12, 13, 0 );
+  will_return( mock_fork, 0 );
+  expect_value( mock_close, fd, 5 );
+  will_return( mock_close, 0 );
+  expect_value( mock_close, fd, 12 );
+  will_return( mock_close, 0 );
+  expect_value( mock_close, fd, 10 );
+  will_return( mock_close, 0 );
+
+  expect_string( mock_open, pathname, "/dev/null" );
+  expect_value( mock_open, flags, O_RDONLY );
+  will_return( mock_open, 0 );
+  expect_string( mock_open, pathname, "/dev/null" );
+  expect_value( mock_open, flags, O_WRONLY );
+  will_return( mock_open, 1 );
+  expect_string( mock_open, pathname, "/dev/null" );
+  expect_value( mock_open, flags, O_WRONLY );
+  will_return( mock_open, 2 );
+
+  expect_string( mock_execvp, file, listener_info.switch_daemon );
+  expect_not_value( mock_execvp, argv, NULL );
+  expect_not_value( mock_execvp, argv[ 0 ], NULL );
+  expect_not_value( mock_execvp, argv[ 1 ], NULL );
+  will_return( mock_execvp, -1 );
+
+  start_switch_daemon_shards( &listener_info );
+
+  die = original_die;
+  xfree( listener_info.shard_fds );
+  listener_info.shard_fds = NULL;
+
+  teardown();
+}
+
+
+static void
+test_start_switch_daemon_shards_socketpair_failed() {
+  setup();
+
+  listener_info.n_shards = 1;
+
+  expect_socketpair( -1, -1, -1 );
+
+  assert_false( start_switch_daemon_shards( &listener_info ) );
+
+  xfree( listener_info.shard_fds );
+  listener_info.shard_fds = NULL;
+
+  teardown();
+}
+
+
+static void
+test_start_switch_daemon_shards_fork_failed() {
+  setup();
+
+  listener_info.n_shards = 1;
+
+  expect_socketpair( 10, 11, 0 );
+  will_return( mock_fork, -1 );
+  expect_value( mock_close, fd, 10 );
+  will_return( mock_close, 0 );
+  expect_value( mock_close, fd, 11 );
+  will_return( mock_close, 0 );
+
+  assert_false( start_switch_daemon_shards( &listener_info ) );
+
+  xfree( listener_info.shard_fds );
+  listener_info.shard_fds = NULL;
+
+  teardown();
+}
+
+
+static void
+expect_sendmsg( int sockfd, int accept_fd, uint16_t port, ssize_t ret ) {
+  expect_value( mock_sendmsg, sockfd, sockfd );
+  expect_value( mock_sendmsg, cmsg_type32, SCM_RIGHTS );
+  expect_value( mock_sendmsg, passed_fd, accept_fd );
+  expect_value( mock_sendmsg, passed_addr->sin_port, htons( port ) );
+  expect_value( mock_sendmsg, flags, MSG_NOSIGNAL );
+  will_return( mock_sendmsg, ret );
+}
+
+
+static void
+test_dispatch_to_switch_daemon_succeeded() {
+  setup();
+
+  int shard_fds[] = { 10, 12 };
+  struct sockaddr_in addr;
+  memset( &addr, 0, sizeof( addr ) );
+  addr.sin_port = htons( 50000 );
+
+  listener_info.n_shards = 2;
+  listener_info.shard_fds = shard_fds;
+  listener_info.next_shard = 0;
+
+  // connections are passed round robin
+  expect_sendmsg( 10, 20, 50000, sizeof( addr ) );
+  expect_value( mock_close, fd, 20 );
+  will_return( mock_close, 0 );
+  dispatch_to_switch_daemon( &listener_info, 20, &addr );
+
+  expect_sendmsg( 12, 21, 50000, sizeof( addr ) );
+  expect_value( mock_close, fd, 21 );
+  will_return( mock_close, 0 );
+  dispatch_to_switch_daemon( &listener_info, 21, &addr );
+
+  expect_sendmsg( 10, 22, 50000, sizeof( addr ) );
+  expect_value( mock_close, fd, 22 );
+  will_return( mock_close, 0 );
+  dispatch_to_switch_daemon( &listener_info, 22, &addr );
+
+  listener_info.shard_fds = NULL;
+
+  teardown();
+}
+
+
+static void
+test_dispatch_to_switch_daemon_sendmsg_failed() {
+  setup();
+
+  int shard_fds[] = { 10, 12 };
+  struct sockaddr_in addr;
+  memset( &addr, 0, sizeof( addr ) );
+  addr.sin_port = htons( 50000 );
+
+  listener_info.n_shards = 2;
+  listener_info.shard_fds = shard_fds;
+  listener_info.next_shard = 0;
+
+  // the next switch daemon takes over
+  expect_sendmsg( 10, 20, 50000, -1 );
+  expect_sendmsg( 12, 20, 50000, sizeof( addr ) );
+  expect_value( mock_close, fd, 20 );
+  will_return( mock_close, 0 );
+  dispatch_to_switch_daemon( &listener_info, 20, &addr );
+
+  // the connection is dropped when no switch daemon takes it
+  expect_sendmsg( 10, 21, 50000, -1 );
+  expect_sendmsg( 12, 21, 50000, -1 );
+  expect_value( mock_close, fd, 21 );
+  will_return( mock_close, 0 );
+  dispatch_to_switch_daemon( &listener_info, 21, &addr );
+
+  listener_info.shard_fds = NULL;
+
+  teardown();
+}
+
+
 /*************************************************************************
  * Run tests.
  *************************************************************************/
@@ -1164,6 +1495,16 @@ main() {
     unit_test( test_secure_channel_accept_fork_failed ),
     unit_test( test_secure_channel_accept_child_succeeded ),
     unit_test( test_secure_channel_accept_child_and_args_succeeded ),
+    /* Test functions for the -m option and the switch daemon shards */
+    unit_test( test_parse_argument_multi_switch_option_succeeded ),
+    unit_test( test_parse_argument_long_multi_switch_option_succeeded ),
+    unit_test( test_parse_argument_multi_switch_option_failed ),
+    unit_test( test_start_switch_daemon_shards_parent_succeeded ),
+    unit_test( test_start_switch_daemon_shards_child_succeeded ),
+    unit_test( test_start_switch_daemon_shards_socketpair_failed ),
+    unit_test( test_start_switch_daemon_shards_fork_failed ),
+    unit_test( test_dispatch_to_switch_daemon_succeeded ),
+    unit_test( test_dispatch_to_switch_daemon_sendmsg_failed ),
   };
 
   return run_tests( tests );
@@ -0,0 +1,287 @@
+/*
+ * Unit tests for xid_table.
+ *
+ * Copyright (C) 2008-2013 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cmockery_trema.h"
+#include "trema.h"
+#include "xid_table.h"
+
+
+/*************************************************************************
+ * Variables to be tested.
+ *************************************************************************/
+
+extern uint32_t transaction_id;
+
+
+/*************************************************************************
+ * Setup and teardown.
+ *************************************************************************/
+
+#define LIFETIME_SEC 60
+#define MAX_ENTRIES 262144
+#define ORIGINAL_XID 0x1234
+
+
+static char service_name[] = "application";
+static struct timespec now;
+static int warn_count;
+static int info_count;
+static void ( *original_warn )( const char *format, ... );
+static void ( *original_info )( const char *format, ... );
+
+
+int
+mock_clock_gettime( clockid_t clk_id, struct timespec *tp ) {
+  assert_int_equal( clk_id, CLOCK_MONOTONIC );
+  *tp = now;
+
+  return 0;
+}
+
+
+static void
+count_warn( const char *format, ... ) {
+  UNUSED( format );
+  warn_count++;
+}
+
+
+static void
+count_info( const char *format, ... ) {
+  UNUSED( format );
+  info_count++;
+}
+
+
+static void
+setup() {
+  now.tv_sec = 1000;
+  now.tv_nsec = 0;
+  warn_count = 0;
+  info_count = 0;
+  original_warn = warn;
+  original_info = info;
+  warn = count_warn;
+  info = count_info;
+  init_xid_table();
+}
+
+
+static void
+teardown() {
+  finalize_xid_table();
+  warn = original_warn;
+  info = original_info;
+}
+
+
+/*************************************************************************
+ * Helpers.
+ *************************************************************************/
+
+static void
+advance_clock( long msec ) {
+  struct timespec delta = { msec / 1000, ( msec % 1000 ) * 1000000 };
+  ADD_TIMESPEC( &now, &delta, &now );
+}
+
+
+static xid_table_stats_t
+get_stats() {
+  xid_table_stats_t stats;
+  get_xid_table_stats( &stats );
+
+  return stats;
+}
+
+
+/*************************************************************************
+ * insert_xid_entry() and delete_xid_entry() tests.
+ *************************************************************************/
+
+static void
+test_insert_and_lookup_xid_entry() {
+  uint32_t xid = insert_xid_entry( ORIGINAL_XID, service_name );
+
+  xid_entry_t *entry = lookup_xid_entry( xid );
+  assert_true( entry != NULL );
+  assert_int_equal( entry->xid, xid );
+  assert_int_equal( entry->original_xid, ORIGINAL_XID );
+  assert_string_equal( entry->service_name, service_name );
+  assert_true( entry->service_name != service_name );
+  assert_int_equal( entry->expire_at.tv_sec, now.tv_sec + LIFETIME_SEC );
+  assert_int_equal( entry->expire_at.tv_nsec, now.tv_nsec );
+  assert_int_equal( get_stats().in_flight, 1 );
+}
+
+
+static void
+test_deleted_xid_entry_is_reused() {
+  uint32_t xid = insert_xid_entry( ORIGINAL_XID, service_name );
+  xid_entry_t *entry = lookup_xid_entry( xid );
+
+  delete_xid_entry( entry );
+  assert_true( lookup_xid_entry( xid ) == NULL );
+  assert_int_equal( get_stats().in_flight, 0 );
+
+  uint32_t new_xid = insert_xid_entry( ORIGINAL_XID + 1, service_name );
+  assert_true( new_xid != xid );
+  assert_true( lookup_xid_entry( new_xid ) == entry );
+  assert_int_equal( entry->original_xid, ORIGINAL_XID + 1 );
+  assert_int_equal( get_stats().in_flight, 1 );
+  assert_int_equal( get_stats().peak_in_flight, 1 );
+}
+
+
+static void
+test_generate_xid_skips_xid_in_use() {
+  uint32_t xids[ 3 ];
+  for ( int i = 0; i < 3; i++ ) {
+    xids[ i ] = insert_xid_entry( ORIGINAL_XID, service_name );
+  }
+  assert_true( xids[ 0 ] != xids[ 1 ] && xids[ 1 ] != xids[ 2 ] && xids[ 0 ] != xids[ 2 ] );
+
+  transaction_id = xids[ 0 ] - 1;
+  uint32_t xid = insert_xid_entry( ORIGINAL_XID, service_name );
+  assert_true( xid != xids[ 0 ] && xid != xids[ 1 ] && xid != xids[ 2 ] );
+  assert_int_equal( get_stats().in_flight, 4 );
+}
+
+
+/*************************************************************************
+ * Expiry and eviction tests.
+ *************************************************************************/
+
+static void
+test_xid_entry_expires_after_lifetime() {
+  uint32_t first = insert_xid_entry( ORIGINAL_XID, service_name );
+  advance_clock( 1000 );
+  uint32_t second = insert_xid_entry( ORIGINAL_XID, service_name );
+
+  advance_clock( ( LIFETIME_SEC - 1 ) * 1000 - 1 );
+  uint32_t third = insert_xid_entry( ORIGINAL_XID, service_name );
+  assert_true( lookup_xid_entry( first ) != NULL );
+  assert_int_equal( get_stats().expired, 0 );
+
+  advance_clock( 1 );
+  insert_xid_entry( ORIGINAL_XID, service_name );
+  assert_true( lookup_xid_entry( first ) == NULL );
+  assert_true( lookup_xid_entry( second ) != NULL );
+  assert_true( lookup_xid_entry( third ) != NULL );
+  assert_int_equal( get_stats().expired, 1 );
+  assert_int_equal( get_stats().in_flight, 3 );
+
+  advance_clock( LIFETIME_SEC * 1000 );
+  insert_xid_entry( ORIGINAL_XID, service_name );
+  assert_int_equal( get_stats().expired, 4 );
+  assert_int_equal( get_stats().in_flight, 1 );
+}
+
+
+static void
+test_oldest_xid_entry_is_evicted_when_table_is_full() {
+  uint32_t first = insert_xid_entry( ORIGINAL_XID, service_name );
+  uint32_t second = insert_xid_entry( ORIGINAL_XID, service_name );
+  for ( int i = 2; i < MAX_ENTRIES; i++ ) {
+    insert_xid_entry( ORIGINAL_XID, service_name );
+  }
+  assert_int_equal( get_stats().in_flight, MAX_ENTRIES );
+  assert_int_equal( get_stats().evicted, 0 );
+
+  uint32_t xid = insert_xid_entry( ORIGINAL_XID, service_name );
+  assert_true( lookup_xid_entry( first ) == NULL );
+  assert_true( lookup_xid_entry( second ) != NULL );
+  assert_true( lookup_xid_entry( xid ) != NULL );
+  assert_int_equal( get_stats().evicted, 1 );
+  assert_int_equal( get_stats().in_flight, MAX_ENTRIES );
+  assert_int_equal( get_stats().peak_in_flight, MAX_ENTRIES );
+
+  insert_xid_entry( ORIGINAL_XID, service_name );
+  assert_true( lookup_xid_entry( second ) == NULL );
+  assert_int_equal( get_stats().evicted, 2 );
+}
+
+
+static void
+test_evictions_are_logged_when_they_start_and_stop() {
+  for ( int i = 0; i < MAX_ENTRIES + 3; i++ ) {
+    insert_xid_entry( ORIGINAL_XID, service_name );
+  }
+  assert_int_equal( get_stats().evicted, 3 );
+  assert_int_equal( warn_count, 1 );
+  assert_int_equal( info_count, 0 );
+
+  advance_clock( LIFETIME_SEC * 1000 );
+  insert_xid_entry( ORIGINAL_XID, service_name );
+  insert_xid_entry( ORIGINAL_XID, service_name );
+  assert_int_equal( warn_count, 1 );
+  assert_int_equal( info_count, 1 );
+
+  for ( int i = 2; i < MAX_ENTRIES + 1; i++ ) {
+    insert_xid_entry( ORIGINAL_XID, service_name );
+  }
+  assert_int_equal( get_stats().evicted, 4 );
+  assert_int_equal( warn_count, 2 );
+}
+
+
+static void
+test_expiry_makes_room_before_eviction() {
+  for ( int i = 0; i < MAX_ENTRIES; i++ ) {
+    insert_xid_entry( ORIGINAL_XID, service_name );
+  }
+
+  advance_clock( LIFETIME_SEC * 1000 );
+  insert_xid_entry( ORIGINAL_XID, service_name );
+  assert_int_equal( get_stats().expired, MAX_ENTRIES );
+  assert_int_equal( get_stats().evicted, 0 );
+  assert_int_equal( get_stats().in_flight, 1 );
+}
+
+
+/*************************************************************************
+ * Run tests.
+ *************************************************************************/
+
+int
+main() {
+  const UnitTest tests[] = {
+    unit_test_setup_teardown( test_insert_and_lookup_xid_entry, setup, teardown ),
+    unit_test_setup_teardown( test_deleted_xid_entry_is_reused, setup, teardown ),
+    unit_test_setup_teardown( test_generate_xid_skips_xid_in_use, setup, teardown ),
+
+    unit_test_setup_teardown( test_xid_entry_expires_after_lifetime, setup, teardown ),
+    unit_test_setup_teardown( test_oldest_xid_entry_is_evicted_when_table_is_full, setup, teardown ),
+    unit_test_setup_teardown( test_evictions_are_logged_when_they_start_and_stop, setup, teardown ),
+    unit_test_setup_teardown( test_expiry_makes_room_before_eviction, setup, teardown ),
+  };
+  return run_tests( tests );
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */